@@ -0,0 +1,45 @@
+/****************************************************************************************
+ *
+ * Copyright (c) 2024, Shenyang Institute of Automation, Chinese Academy of Sciences
+ *
+ * Authors: Yanpeng Jia
+ * Contact: jiayanpeng@sia.cn
+ *
+ ****************************************************************************************/
+#ifndef MY_PCL_TUTORIAL_BEV_GRID_H
+#define MY_PCL_TUTORIAL_BEV_GRID_H
+
+#include <vector>
+
+// Uniform bird's-eye-view grid over a set of 2D points (detection or track centers),
+// rebuilt once per frame so range lookups replace all-pairs loops. Cells are stored
+// CSR style (cell_start_ / indices_), rebuilding allocates nothing once the
+// buffers have grown to the scene size.
+class BevGrid
+{
+  public:
+    BevGrid() : cell_size_(4.0), nx_(0), ny_(0), min_x_(0), min_y_(0) {};
+
+    // Buckets the centers (x[i], y[i]). cellSize is the preferred cell edge in m, it
+    // is doubled while the grid would have far more cells than points.
+    // Non-finite centers are left out, no range query can match them.
+    void build(const std::vector<double>& x, const std::vector<double>& y, double cellSize);
+
+    // Appends every point whose cell overlaps [minX,maxX]x[minY,maxY] to out,
+    // in ascending index order. Candidates may lie outside the window.
+    void query(double minX, double maxX, double minY, double maxY, std::vector<int>& out) const;
+
+    size_t cellCount() const { return cell_start_.empty() ? 0 : cell_start_.size() - 1; };
+
+  private:
+    double cell_size_;
+    int nx_;
+    int ny_;
+    double min_x_;
+    double min_y_;
+    std::vector<int> cell_of_;     // per point, -1 if not indexed
+    std::vector<int> cell_start_;  // nx_*ny_ + 1 offsets into indices_
+    std::vector<int> indices_;     // point indices grouped by cell, ascending within a cell
+};
+
+#endif /* MY_PCL_TUTORIAL_BEV_GRID_H */
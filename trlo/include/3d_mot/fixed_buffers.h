@@ -0,0 +1,66 @@
+/****************************************************************************************
+ *
+ * Copyright (c) 2024, Shenyang Institute of Automation, Chinese Academy of Sciences
+ *
+ * Authors: Yanpeng Jia
+ * Contact: jiayanpeng@sia.cn
+ *
+ ****************************************************************************************/
+#ifndef MY_PCL_TUTORIAL_FIXED_BUFFERS_H
+#define MY_PCL_TUTORIAL_FIXED_BUFFERS_H
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+
+// History of at most N values stored inline, for the per track histories. Pushing
+// onto a full ring drops the oldest value, so a track never allocates for them and
+// a recycled pool slot starts from an empty ring. [0] is the oldest value.
+template <typename T, int N>
+class RingBuffer
+{
+  public:
+    RingBuffer() : head_(0), size_(0) {};
+
+    void push_back(const T& value)
+    {
+        data_[(head_ + size_) % N] = value;
+        if (size_ < N) size_++;
+        else head_ = (head_ + 1) % N;
+    };
+
+    void pop_front()
+    {
+        assert(size_ > 0);
+        head_ = (head_ + 1) % N;
+        size_--;
+    };
+
+    void clear() { head_ = 0; size_ = 0; };
+
+    int  size() const { return size_; };
+    bool empty() const { return size_ == 0; };
+    static int capacity() { return N; };
+
+    T&       operator[](int i)       { return data_[(head_ + i) % N]; };
+    const T& operator[](int i) const { return data_[(head_ + i) % N]; };
+
+    T&       back()       { return (*this)[size_ - 1]; };
+    const T& back() const { return (*this)[size_ - 1]; };
+
+  private:
+    T data_[N];
+    int head_;
+    int size_;
+};
+
+// Makes room for n elements in a per frame scratch vector before it is assigned or
+// resized. assign() allocates exactly n, so a slowly rising peak would reallocate at
+// every new maximum; doubling keeps that to a few times during warm up.
+template <typename V>
+inline void reserveScratch(V& v, size_t n)
+{
+    if (v.capacity() < n) v.reserve(std::max(n, 2*v.capacity()));
+}
+
+#endif /* MY_PCL_TUTORIAL_FIXED_BUFFERS_H */
@@ -0,0 +1,40 @@
+/****************************************************************************************
+ *
+ * Copyright (c) 2024, Shenyang Institute of Automation, Chinese Academy of Sciences
+ *
+ * Authors: Yanpeng Jia
+ * Contact: jiayanpeng@sia.cn
+ *
+ ****************************************************************************************/
+#ifndef MY_PCL_TUTORIAL_HUNGARIAN_H
+#define MY_PCL_TUTORIAL_HUNGARIAN_H
+
+#include <vector>
+
+// Minimum cost assignment of every row to a distinct column (rows <= cols) by
+// shortest augmenting paths (Hungarian method, O(rows^2 * cols)). The cost matrix
+// is row major; infinite entries mark pairs that may not be assigned, every row
+// needs at least one finite entry it can fall back to.
+//
+// u and v are the row and column potentials. On entry they must satisfy
+// u[i] + v[j] <= cost(i,j) and v[j] <= 0 (columns may stay unassigned); all zero
+// is fine, seeding u from an earlier frame warm starts the search. They hold the
+// optimal duals on return.
+class HungarianSolver
+{
+  public:
+    HungarianSolver() {};
+
+    void solve(const std::vector<double>& cost, int rows, int cols,
+               std::vector<double>& u, std::vector<double>& v, std::vector<int>& rowCol);
+
+  private:
+    std::vector<double> uu_;
+    std::vector<double> vv_;
+    std::vector<double> minv_;
+    std::vector<int> colRow_;
+    std::vector<int> way_;
+    std::vector<char> used_;
+};
+
+#endif /* MY_PCL_TUTORIAL_HUNGARIAN_H */
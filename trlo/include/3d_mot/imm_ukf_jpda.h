@@ -14,19 +14,165 @@
 #include <pcl/point_types.h>
 #include <pcl/io/pcd_io.h>
 
+#include "3d_mot/ukf.h"
+#include "3d_mot/track_pool.h"
+#include "3d_mot/oriented_box.h"
+#include "3d_mot/bev_grid.h"
+#include "3d_mot/hungarian.h"
+#include "3d_mot/sigma_batch.h"
+
 using namespace std;
 using namespace pcl;
 
-void getOriginPoints(Eigen::Matrix3f pose);
+// How gated detections update the tracks: soft JPDA weights, or the single
+// detection each track gets in the global nearest neighbour assignment.
+enum AssociationMode
+{
+    ASSOC_JPDA = 0,
+    ASSOC_GNN
+};
+
+struct TrackerConfig
+{
+    double gammaG          = 9.22;  // gate threshold, chi-square 99% with 2 dof
+    double pG              = 0.99;  // gate probability
+    double pD              = 0.9;   // detection probability
+    double distanceThres   = 99;    // m, max distance between a track and its associated box
+    int    lifeTimeThres   = 3;     // gated detections before a track gets a box
+    double bbYawChangeThres = 0.2;  // rad, largest box yaw change accepted per frame
+    int    local2localHistory = 10; // ego motion steps kept per track, at most UKF_LOCAL2LOCAL_MAX
+    double staticDistThres = 3.0;   // m, max travel since init for a static track
+    int    staticLifetime  = 8;     // gated detections before a track can be static
+    double gateCellSize    = 4.0;   // m, cell edge of the detection grid used for gating
+    int    jpdaMaxHypotheses = 1024; // joint events per cluster before falling back to per track PDA
+    AssociationMode association = ASSOC_JPDA;
+};
+
+// One live track as reported by MultiObjectTracker::step, in the odom frame.
+struct TrackedObject
+{
+    int id;            // unique for the lifetime of the tracker
+    int trackNum;      // 1-4 tentative, 5 confirmed, 6-8 coasting
+    TrackState state;
+    float x;
+    float y;
+    double v;
+    double yaw;
+    bool isStatic;
+    bool isVisible;    // bbox holds the associated box footprint
+    BoxFootprint bbox;
+};
+
+// Detection as seen by the gating and association steps.
+struct BoxMeasurement
+{
+    double x;
+    double y;
+    BoxFootprint footprint;
+};
+
+// IMM-UKF tracker with JPDA-style gating. All state is owned by the instance, so
+// several trackers can run side by side and reset() starts a new sequence.
+class MultiObjectTracker
+{
+  public:
+    explicit MultiObjectTracker(const TrackerConfig& config = TrackerConfig());
+
+    // Advances every track to timestamp, associates the detection boxes (odom frame)
+    // and returns the live tracks. ego_pose is the sensor pose in the odom frame.
+    // The list stays valid until the next step() or reset().
+    const std::vector<TrackedObject>& step(const vector<OrientedBox>& detections, double timestamp,
+                                           const Eigen::Matrix4f& ego_pose);
+
+    void reset();
+
+    // position std (m) of the least certain confirmed track after coasting dt seconds
+    double maxPredictedPositionStd(double dt) const;
+
+    const TrackerConfig& config() const { return config_; };
+    size_t liveTracks() const { return targets_.liveCount(); };
+    size_t trackSlots() const { return targets_.slotCount(); };
+    size_t trackStoreBytes() const { return targets_.bytes(); };
 
-Eigen::VectorXd getCpFromBbox(PointCloud<PointXYZ> bBox);
+  private:
+    TrackerConfig config_;
+    TrackPool targets_;
+    std::vector<int> track_ids_;  // per pool slot
+    std::vector<double> gnn_duals_;  // per pool slot, assignment row potential of the last frame
+    int next_id_;
+    std::vector<TrackedObject> tracks_;
 
-void immUkfJpdaf(vector<PointCloud<PointXYZ>> bBoxes, double timestamp, 
-	PointCloud<PointXYZ>& targets, vector<vector<double>>& targetVandYaw, 
-	vector<int>& trackManage, vector<bool>& isStaticVec,
-	vector<bool>& isVisVec, vector<PointCloud<PointXYZ>>& visBB);
+    // per frame work buffers, reused and grown by reserveScratch so a steady scene
+    // does not allocate
+    std::vector<BoxMeasurement> measurements_;
+    std::vector<double> centerX_;
+    std::vector<double> centerY_;
+    BevGrid grid_;
+    std::vector<int> candScratch_;
+    std::vector<double> trackX_;
+    std::vector<double> trackY_;
+    BevGrid trackGrid_;
+    std::vector<int> matchScratch_;
+    LidarVecList measScratch_;
+    std::vector<int> bboxScratch_;
+    LidarVecList gateZ_;              // per live track, predicted gate center
+    LidarMatList gateS_;              // per live track, inflated gate covariance
+    SigmaPointBatch sigmaBatch_[3];   // per motion model, sigma points of the live tracks
 
+    // tracks sharing gated detections, solved together by JPDA
+    struct ClusterScratch
+    {
+        LidarVecList meas;
+        std::vector<double> e;       // 3 likelihoods per gated pair
+        std::vector<double> beta;    // 3 association weights per gated pair
+        std::vector<double> miss;    // 3 no-detection weights per track
+        std::vector<double> b;       // clutter weight per track
+        std::vector<int> off;        // gated pairs of each track
+        std::vector<int> det;        // detection of each gated pair
+        std::vector<int> assign;
+        std::vector<char> used;      // per detection, all zero between clusters
+        std::vector<double> lambda;
+        // GNN: cluster detections are the first columns, one miss column per track follows
+        HungarianSolver hungarian;
+        std::vector<int> cols;       // detection of each column
+        std::vector<int> column;     // per detection, -1 between clusters
+        std::vector<double> cost;
+        std::vector<double> u;
+        std::vector<double> v;
+        std::vector<int> rowCol;
+        std::vector<int> bbox;
+    };
+    std::vector<int> pdaTracks_;      // slots reaching the PDA update this frame
+    std::vector<int> gateStart_;      // per pdaTracks_ entry, offsets into gateDet_
+    std::vector<int> gateDet_;        // gated detections, in gating order
+    std::vector<int> gatedTrackNum_;  // per pdaTracks_ entry, track number when it gated
+    std::vector<int> ufParent_;       // union-find over pdaTracks_ entries, then detections
+    std::vector<int> clusterId_;
+    std::vector<int> trackCluster_;   // per pdaTracks_ entry
+    std::vector<int> clusterStart_;   // per cluster, offsets into clusterTracks_
+    std::vector<int> clusterTracks_;  // pdaTracks_ entries grouped by cluster
+    std::vector<ClusterScratch> clusterScratch_;  // one per worker thread
 
+    bool init_;
+    double timestamp_;
+    double egoVelo_;
+    double egoYaw_;
+    double egoPreYaw_;
+    Eigen::Vector3f egoPrePos_;
 
+    int addTrack(const LidarVec& meas, double timestamp);
+    void gateCandidates(const LidarVec& maxDetZ, const LidarMat& maxDetS, double detS, vector<int>& candidates) const;
+    void measurementValidation(const vector<BoxMeasurement>& detections, const vector<int>& candidates, UKF& target, bool secondInit,
+                               const LidarVec& maxDetZ, const LidarMat& invS, LidarVecList& measVec, vector<int>& bboxVec,
+                               vector<int>& matchingVec);
+    void filterPDA(UKF& target, const LidarVecList& measVec, const double* e, const double* beta,
+                   const double* betaZero, vector<double>& lambdaVec);
+    void clusterGates();
+    void updateCluster(int cluster, ClusterScratch& scratch);
+    void assignCluster(int cluster, ClusterScratch& scratch);
+    void associateBB(int trackNum, const vector<BoxMeasurement>& detections, const vector<int>& bboxVec, UKF& target);
+    void updateBB(UKF& target);
+    void mergeOverSegmentation();
+};
 
 #endif /* MY_PCL_TUTORIAL_IMM_UKF_JPDAF_H */
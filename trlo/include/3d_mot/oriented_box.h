@@ -0,0 +1,56 @@
+/****************************************************************************************
+ *
+ * Copyright (c) 2024, Shenyang Institute of Automation, Chinese Academy of Sciences
+ *
+ * Authors: Yanpeng Jia
+ * Contact: jiayanpeng@sia.cn
+ *
+ ****************************************************************************************/
+#ifndef MY_PCL_TUTORIAL_ORIENTED_BOX_H
+#define MY_PCL_TUTORIAL_ORIENTED_BOX_H
+
+#include <cmath>
+#include "Eigen/Dense"
+
+// x-y corners of a box footprint, in the order
+// (-l/2,-w/2), (+l/2,-w/2), (+l/2,+w/2), (-l/2,+w/2) of the box frame.
+struct BoxFootprint
+{
+    float x[4];
+    float y[4];
+};
+
+// Detection box handed to the tracker: center, size along the box axes and yaw
+// about z. Plain data, so vectors of boxes are a single allocation.
+struct OrientedBox
+{
+    float x, y, z;
+    float l, w, h;
+    float yaw;
+
+    // The same box seen from another frame, T maps this frame into the target one.
+    OrientedBox transformed(const Eigen::Matrix4f& T) const
+    {
+        OrientedBox out = *this;
+        out.x = T(0,0)*x + T(0,1)*y + T(0,2)*z + T(0,3);
+        out.y = T(1,0)*x + T(1,1)*y + T(1,2)*z + T(1,3);
+        out.z = T(2,0)*x + T(2,1)*y + T(2,2)*z + T(2,3);
+        out.yaw = yaw + std::atan2(T(1,0), T(0,0));
+        return out;
+    }
+
+    BoxFootprint footprint() const
+    {
+        const float c = std::cos(yaw), s = std::sin(yaw);
+        const float dx[4] = {-l/2,  l/2, l/2, -l/2};
+        const float dy[4] = {-w/2, -w/2, w/2,  w/2};
+        BoxFootprint fp;
+        for (int i = 0; i < 4; i++) {
+            fp.x[i] = x + c*dx[i] - s*dy[i];
+            fp.y[i] = y + s*dx[i] + c*dy[i];
+        }
+        return fp;
+    }
+};
+
+#endif /* MY_PCL_TUTORIAL_ORIENTED_BOX_H */
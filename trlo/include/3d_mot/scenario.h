@@ -0,0 +1,81 @@
+/****************************************************************************************
+ *
+ * Copyright (c) 2024, Shenyang Institute of Automation, Chinese Academy of Sciences
+ *
+ * Authors: Yanpeng Jia
+ * Contact: jiayanpeng@sia.cn
+ *
+ ****************************************************************************************/
+#ifndef MY_PCL_TUTORIAL_SCENARIO_H
+#define MY_PCL_TUTORIAL_SCENARIO_H
+
+#include <vector>
+#include <random>
+#include "Eigen/Dense"
+
+#include "3d_mot/oriented_box.h"
+
+struct ScenarioConfig
+{
+    int    objects       = 50;     // objects kept inside the sensed area
+    double rate          = 10.0;   // Hz
+    double spacing       = 12.0;   // m, mean distance between objects
+    double minHalfExtent = 40.0;   // m, sensed area is a square around the ego
+    double maxSpeed      = 12.0;   // m/s
+    double ctrvRatio     = 0.3;    // objects turning at a constant rate, the rest go straight
+    double maxYawRate    = 0.3;    // rad/s
+    double pD            = 0.9;    // probability an object is detected in a frame
+    double posNoise      = 0.1;    // m, detection center std
+    double yawNoise      = 0.05;   // rad, detection yaw std
+    double clutterRate   = 0.1;    // false boxes per frame, per object
+    double egoSpeed      = 8.0;    // m/s
+    double egoYawRate    = 0.05;   // rad/s
+    unsigned seed        = 1;
+};
+
+// Ground truth object at the current frame, odom frame.
+struct ScenarioObject
+{
+    int id;                // new id whenever an object leaves the area and is respawned
+    double x;
+    double y;
+    double v;
+    double yaw;
+    double yawRate;
+};
+
+// Deterministic multi object scene for driving MultiObjectTracker without a sensor:
+// objects moving with the CV or CTRV model around a moving ego vehicle, detected
+// with probability pD, position and yaw noise and uniform clutter boxes. The same
+// config and seed always produce the same sequence.
+class SyntheticScenario
+{
+  public:
+    explicit SyntheticScenario(const ScenarioConfig& config = ScenarioConfig());
+
+    // advances to the next frame, the first call returns frame 0
+    void next();
+
+    double timestamp() const { return timestamp_; };
+    const Eigen::Matrix4f& egoPose() const { return egoPose_; };
+    // detection boxes of the frame in the odom frame, clutter included
+    const std::vector<OrientedBox>& detections() const { return detections_; };
+    const std::vector<ScenarioObject>& objects() const { return objects_; };
+
+  private:
+    ScenarioConfig config_;
+    std::mt19937 rng_;
+    int frame_;
+    int nextId_;
+    double halfExtent_;
+    double timestamp_;
+    double egoX_, egoY_, egoYaw_;
+    Eigen::Matrix4f egoPose_;
+    std::vector<ScenarioObject> objects_;
+    std::vector<OrientedBox> detections_;
+
+    double uniform(double lo, double hi);
+    void spawn(ScenarioObject& object);
+};
+
+#endif /* MY_PCL_TUTORIAL_SCENARIO_H */
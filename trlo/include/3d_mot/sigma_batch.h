@@ -0,0 +1,45 @@
+/****************************************************************************************
+ *
+ * Copyright (c) 2024, Shenyang Institute of Automation, Chinese Academy of Sciences
+ *
+ * Authors: Yanpeng Jia
+ * Contact: jiayanpeng@sia.cn
+ *
+ ****************************************************************************************/
+#ifndef MY_PCL_TUTORIAL_SIGMA_BATCH_H
+#define MY_PCL_TUTORIAL_SIGMA_BATCH_H
+
+#include <vector>
+#include "3d_mot/ukf.h"
+
+// Sine and cosine of n values in one vectorizable pass (quadrant reduction and
+// minimax polynomials, within 2 ulp of libm for |x| < 1e5, libm beyond).
+void sinCosBatch(const double* x, double* s, double* c, int n);
+
+// Augmented sigma points of many tracks for one motion model, stored structure of
+// arrays (point j of track k at k*UKF_N_SIGMA + j), so the model is propagated for
+// every track in one SIMD pass instead of one UKF::Cv / UKF::Ctrv call per point.
+// propagate() matches the per point models up to sin/cos rounding.
+class SigmaPointBatch
+{
+  public:
+    SigmaPointBatch() : tracks_(0) {};
+
+    // room for the given number of tracks, the contents are unspecified afterwards
+    void resize(int tracks);
+
+    void load(int track, const AugSigmaMat& Xsig_aug);
+    void store(int track, SigmaMat& Xsig_pred) const;
+
+    // modelInd as in UKF::Prediction: 0 CV, 1 CTRV, 2 random motion
+    void propagate(int modelInd, double delta_t);
+
+  private:
+    int tracks_;
+    // state rows are updated in place
+    std::vector<double> px_, py_, v_, yaw_, yawd_;
+    std::vector<double> nu_a_, nu_yawdd_;
+    std::vector<double> sin0_, cos0_, sin1_, cos1_, yaw1_;
+};
+
+#endif /* MY_PCL_TUTORIAL_SIGMA_BATCH_H */
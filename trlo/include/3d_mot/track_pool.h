@@ -0,0 +1,80 @@
+/****************************************************************************************
+ *
+ * Copyright (c) 2024, Shenyang Institute of Automation, Chinese Academy of Sciences
+ *
+ * Authors: Yanpeng Jia
+ * Contact: jiayanpeng@sia.cn
+ *
+ ****************************************************************************************/
+#ifndef MY_PCL_TUTORIAL_TRACK_POOL_H
+#define MY_PCL_TUTORIAL_TRACK_POOL_H
+
+#include <vector>
+#include "3d_mot/ukf.h"
+
+// Lifecycle of a track, derived from its track number:
+//   0 dead, 1-4 tentative, 5 confirmed (associated this frame), 6-8 coasting (missed 1-3 frames)
+enum TrackState
+{
+    TRACK_DEAD = 0,
+    TRACK_TENTATIVE,
+    TRACK_CONFIRMED,
+    TRACK_COASTING
+};
+
+inline TrackState trackStateOf(int trackNum)
+{
+    if (trackNum <= 0) return TRACK_DEAD;
+    if (trackNum < 5)  return TRACK_TENTATIVE;
+    if (trackNum == 5) return TRACK_CONFIRMED;
+    return TRACK_COASTING;
+}
+
+// Fixed slots of UKF tracks. Dead tracks are swept into a free list and their slots
+// reused by new tracks, so storage is bounded by the peak number of simultaneous
+// objects. live() lists the occupied slots in creation order, which keeps the
+// association order identical to a grow-only track vector.
+class TrackPool
+{
+  public:
+    TrackPool() : bytes_(0) {};
+
+    // Takes a free slot (or grows the pool), initializes the filter at meas and
+    // returns the slot. The new track starts tentative with track number 1.
+    int allocate(const LidarVec& meas, double timestamp);
+
+    // Returns every live slot whose track number dropped to 0 to the free list.
+    // Returns the number of tracks released.
+    int sweep();
+
+    void clear();
+
+    const std::vector<int>& live() const { return live_; };
+
+    UKF&       operator[](int slot)       { return tracks_[slot]; };
+    const UKF& operator[](int slot) const { return tracks_[slot]; };
+
+    int&       trackNum(int slot)       { return track_num_[slot]; };
+    const int& trackNum(int slot) const { return track_num_[slot]; };
+
+    TrackState state(int slot) const { return trackStateOf(track_num_[slot]); };
+
+    size_t liveCount() const { return live_.size(); };
+    size_t slotCount() const { return tracks_.size(); };
+
+    // heap bytes of the slot storage, kept up to date by allocate/sweep/clear.
+    // The per track histories are stored inline in UKF, so this is all of it.
+    size_t bytes() const { return bytes_; };
+
+  private:
+    // UKF holds fixed-size Eigen members, so it needs the aligned allocator
+    std::vector<UKF, Eigen::aligned_allocator<UKF>> tracks_;
+    std::vector<int> track_num_;
+    std::vector<int> free_slots_;
+    std::vector<int> live_;
+    size_t bytes_;
+
+    void updateBytes();
+};
+
+#endif /* MY_PCL_TUTORIAL_TRACK_POOL_H */
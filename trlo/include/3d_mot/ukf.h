@@ -13,15 +13,42 @@
 #include <vector>
 #include <string>
 #include <fstream>
-#include <pcl/point_types.h>
-#include <pcl/point_cloud.h>
+#include "3d_mot/oriented_box.h"
+#include "3d_mot/fixed_buffers.h"
 
 
 using Eigen::MatrixXd;
 using Eigen::VectorXd;
 
+// Fixed filter dimensions: state [px py v yaw yawd], augmented with the two process
+// noises, 2 * n_aug + 1 sigma points, lidar measures [px py], radar [rho phi rho_dot].
+const int UKF_N_X     = 5;
+const int UKF_N_AUG   = 7;
+const int UKF_N_SIGMA = 2 * UKF_N_AUG + 1;
+
+// Inline history lengths: velocities kept per track, and the most ego motion steps
+// a track can hold whatever TrackerConfig::local2localHistory asks for.
+const int UKF_VELO_HISTORY       = 3;
+const int UKF_LOCAL2LOCAL_MAX    = 32;
+
+typedef Eigen::Matrix<double, UKF_N_X, 1>             StateVec;
+typedef Eigen::Matrix<double, UKF_N_X, UKF_N_X>       StateMat;
+typedef Eigen::Matrix<double, UKF_N_AUG, 1>           AugStateVec;
+typedef Eigen::Matrix<double, UKF_N_AUG, UKF_N_AUG>   AugStateMat;
+typedef Eigen::Matrix<double, UKF_N_X, UKF_N_SIGMA>   SigmaMat;
+typedef Eigen::Matrix<double, UKF_N_AUG, UKF_N_SIGMA> AugSigmaMat;
+typedef Eigen::Matrix<double, UKF_N_SIGMA, 1>         SigmaWeights;
+typedef Eigen::Matrix<double, 2, 1>                   LidarVec;
+typedef Eigen::Matrix<double, 2, 2>                   LidarMat;
+typedef Eigen::Matrix<double, 3, 1>                   RadarVec;
+typedef Eigen::Matrix<double, 3, 3>                   RadarMat;
+typedef Eigen::Matrix<double, UKF_N_X, 2>             LidarGainMat;
+typedef std::vector<LidarVec, Eigen::aligned_allocator<LidarVec>> LidarVecList;
+typedef std::vector<LidarMat, Eigen::aligned_allocator<LidarMat>> LidarMatList;
+
 class UKF {
 public:
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
 
     ///* initially set to false, set to true in first call of ProcessMeasurement
     bool is_initialized_;
@@ -33,37 +60,37 @@ public:
     bool use_radar_;
 
 //    ///* state vector: [pos1 pos2 vel_abs yaw_angle yaw_rate] in SI units and rad
-    MatrixXd x_merge_;
+    StateVec x_merge_;
 
     ///* state vector: [pos1 pos2 vel_abs yaw_angle yaw_rate] in SI units and rad
-    MatrixXd x_cv_;
+    StateVec x_cv_;
 
     ///* state vector: [pos1 pos2 vel_abs yaw_angle yaw_rate] in SI units and rad
-    MatrixXd x_ctrv_;
+    StateVec x_ctrv_;
 
     ///* state vector: [pos1 pos2 vel_abs yaw_angle yaw_rate] in SI units and rad
-    MatrixXd x_rm_;
+    StateVec x_rm_;
 
 //    ///* state covariance matrix
-    MatrixXd P_merge_;
+    StateMat P_merge_;
 
     ///* state covariance matrix
-    MatrixXd P_cv_;
+    StateMat P_cv_;
 
     ///* state covariance matrix
-    MatrixXd P_ctrv_;
+    StateMat P_ctrv_;
 
     ///* state covariance matrix
-    MatrixXd P_rm_;
+    StateMat P_rm_;
 
     ///* predicted sigma points matrix
-    MatrixXd Xsig_pred_cv_;
+    SigmaMat Xsig_pred_cv_;
 
     ///* predicted sigma points matrix
-    MatrixXd Xsig_pred_ctrv_;
+    SigmaMat Xsig_pred_ctrv_;
 
     ///* predicted sigma points matrix
-    MatrixXd Xsig_pred_rm_;
+    SigmaMat Xsig_pred_rm_;
 
     ///* time when the state is true, in us
     long long time_us_;
@@ -96,7 +123,7 @@ public:
     double std_radrd_ ;
 
     ///* Weights of sigma points
-    VectorXd weights_;
+    SigmaWeights weights_;
 
     ///* State dimension
     int n_x_;
@@ -141,46 +168,46 @@ public:
     double modeProbCTRV_;
     double modeProbRM_;
 
-    std::vector<double> ini_u_;
+    Eigen::Vector3d ini_u_;
 
-    std::vector<double> p1_;
+    Eigen::Vector3d p1_;
 
-    std::vector<double> p2_;
+    Eigen::Vector3d p2_;
 
-    std::vector<double> p3_;
+    Eigen::Vector3d p3_;
 
-    VectorXd zPredCVr_;
-    VectorXd zPredCTRVr_;
-    VectorXd zPredRMr_;
+    RadarVec zPredCVr_;
+    RadarVec zPredCTRVr_;
+    RadarVec zPredRMr_;
 
-    VectorXd zPredCVl_;
-    VectorXd zPredCTRVl_;
-    VectorXd zPredRMl_;
+    LidarVec zPredCVl_;
+    LidarVec zPredCTRVl_;
+    LidarVec zPredRMl_;
 
-    MatrixXd lS_cv_;
-    MatrixXd lS_ctrv_;
-    MatrixXd lS_rm_;
-    MatrixXd rS_cv_;
-    MatrixXd rS_ctrv_;
-    MatrixXd rS_rm_;
+    LidarMat lS_cv_;
+    LidarMat lS_ctrv_;
+    LidarMat lS_rm_;
+    RadarMat rS_cv_;
+    RadarMat rS_ctrv_;
+    RadarMat rS_rm_;
 
-    MatrixXd K_cv_;
-    MatrixXd K_ctrv_;
-    MatrixXd K_rm_;
+    LidarGainMat K_cv_;
+    LidarGainMat K_ctrv_;
+    LidarGainMat K_rm_;
 
     double gammaG_;
     double pD_;
     double pG_;
 
     int lifetime_;
-    std::vector<double> velo_history_;
+    RingBuffer<double, UKF_VELO_HISTORY> velo_history_;
     bool isStatic_;
 
     // bounding box params
     bool isVisBB_;
-    // todo: need initialization?
-    pcl::PointCloud<pcl::PointXYZ> BBox_;
-    pcl::PointCloud<pcl::PointXYZ> bestBBox_;
+    BoxFootprint BBox_;
+    BoxFootprint bestBBox_;
+    bool hasBestBBox_;
     double bestYaw_;
     double bb_yaw_;
     double bb_area_;
@@ -189,12 +216,12 @@ public:
     std::vector<double> bb_area_history_;
 
     // for env classification
-    VectorXd initMeas_;
+    LidarVec initMeas_;
     double distFromInit_;
 
     
-    std::vector<VectorXd> local2local_;
-    std::vector<double> local2localYawVec_;
+    RingBuffer<LidarVec, UKF_LOCAL2LOCAL_MAX> local2local_;
+    RingBuffer<double, UKF_LOCAL2LOCAL_MAX> local2localYawVec_;
 
     double x_merge_yaw_;
 
@@ -210,11 +237,11 @@ public:
 
     void UpdateYawWithHighProb();
 
-    void Initialize(VectorXd z, double timestamp);
+    void Initialize(const LidarVec& z, double timestamp);
 
-    double CalculateGauss(VectorXd z, int sensorInd, int modelInd);
+    double CalculateGauss(const VectorXd& z, int sensorInd, int modelInd);
 
-    void UpdateModeProb(std::vector<double> lambdaVec);
+    void UpdateModeProb(const std::vector<double>& lambdaVec);
 
     void MergeEstimationAndCovariance();
 
@@ -222,9 +249,9 @@ public:
 
     void Interaction();
 
-    void MeasurementValidation(VectorXd z, std::vector<VectorXd>& meas);
+    void MeasurementValidation(const LidarVec& z, LidarVecList& meas);
 
-    void PDAupdate(std::vector<VectorXd> z, int modelInd);
+    void PDAupdate(const LidarVecList& z, int modelInd);
 
     /**
      * ProcessMeasurement
@@ -232,14 +259,14 @@ public:
      */
     void ProcessIMMUKF(double dt);
 
-    void PostProcessIMMUKF(std::vector<double> lambdaVec);
+    void PostProcessIMMUKF(const std::vector<double>& lambdaVec);
 
 
-    void Ctrv(double p_x, double p_y, double v, double yaw, double yawd, double nu_a, double nu_yawdd, double delta_t, std::vector<double>&state);
+    void Ctrv(double p_x, double p_y, double v, double yaw, double yawd, double nu_a, double nu_yawdd, double delta_t, StateVec& state);
 
-    void Cv(double p_x, double p_y, double v, double yaw, double yawd, double nu_a, double nu_yawdd, double delta_t, std::vector<double>&state);
+    void Cv(double p_x, double p_y, double v, double yaw, double yawd, double nu_a, double nu_yawdd, double delta_t, StateVec& state);
 
-    void randomMotion(double p_x, double p_y, double v, double yaw, double yawd, double nu_a, double nu_yawdd, double delta_t, std::vector<double>&state);
+    void randomMotion(double p_x, double p_y, double v, double yaw, double yawd, double nu_a, double nu_yawdd, double delta_t, StateVec& state);
 
     /**
      * Prediction Predicts sigma points, the state, and the state covariance
@@ -248,6 +275,16 @@ public:
      */
     void Prediction(double delta_t, int modelInd);
 
+    /**
+     * Prediction split around the sigma point propagation, so the sigma points of
+     * many tracks can be propagated together (SigmaPointBatch)
+     * AugmentedSigmaPoints draws the model's augmented sigma points,
+     * PredictMeanAndCovariance reduces the propagated ones in Xsig_pred_* to x and P
+     */
+    void AugmentedSigmaPoints(int modelInd, AugSigmaMat& Xsig_aug);
+
+    void PredictMeanAndCovariance(int modelInd);
+
     /**
      * Updates the state and the state covariance matrix using a laser measurement
      * @param meas_package The measurement at k+1
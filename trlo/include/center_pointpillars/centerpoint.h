@@ -36,27 +36,32 @@
 #include "NvOnnxConfig.h"
 #include "NvInferRuntime.h"
 #include "center_pointpillars/preprocess.h"
+#include "center_pointpillars/preprocess_cpu.h"
 #include "center_pointpillars/postprocess.h"
+#include "center_pointpillars/postprocess_cpu.h"
+#include "center_pointpillars/detector.h"
 #include "spconv/engine.hpp"
 #include "center_pointpillars/tensorrt.hpp"
 #include "center_pointpillars/timer.hpp"
+#include "trlo/metrics.h"
 
-typedef struct float11 { float val[11]; } float11;
-
-class CenterPoint {
+class CenterPoint : public Detector {
   private:
     Params params_;
     bool verbose_;
 
-    std::shared_ptr<PreProcessCuda> pre_;
+    std::shared_ptr<PreProcess> pre_;
     std::shared_ptr<spconv::Engine> scn_engine_;
     std::shared_ptr<TensorRT::Engine> trt_;
     std::shared_ptr<PostProcessCuda> post_;
+    std::shared_ptr<PostProcessCpu> post_cpu_;
+    PostProcessBackend post_backend_;
 
-    std::vector<float> timing_pre_;
-    std::vector<float> timing_scn_engine_;
-    std::vector<float> timing_trt_;
-    std::vector<float> timing_post_;
+    // per phase latency (ms), owned by the process-wide metrics registry
+    trlo::Histogram* timing_pre_;
+    trlo::Histogram* timing_scn_engine_;
+    trlo::Histogram* timing_trt_;
+    trlo::Histogram* timing_post_;
 
     unsigned int* h_detections_num_;
     float* d_detections_;
@@ -69,6 +74,14 @@ class CenterPoint {
     half* d_vel_[NUM_TASKS];
     half* d_hm_[NUM_TASKS];
 
+    // pinned host copies of the heads for the CPU postprocess backend
+    half* h_reg_[NUM_TASKS] = {};
+    half* h_height_[NUM_TASKS] = {};
+    half* h_dim_[NUM_TASKS] = {};
+    half* h_rot_[NUM_TASKS] = {};
+    half* h_vel_[NUM_TASKS] = {};
+    half* h_hm_[NUM_TASKS] = {};
+
     int reg_n_;
     int reg_c_;
     int reg_h_;
@@ -81,19 +94,41 @@ class CenterPoint {
 
     half* d_voxel_features;
     unsigned int* d_voxel_indices;
+    // device copies of the voxels when the CPU preprocess backend is used
+    half* d_cpu_voxel_features_ = nullptr;
+    unsigned int* d_cpu_voxel_indices_ = nullptr;
     std::vector<int> sparse_shape;
 
+    // device buffers of the batched postprocess backend
+    unsigned int* d_batch_detections_num_ = nullptr;
+    float* d_batch_detections_ = nullptr;
+    float* d_batch_sorted_ = nullptr;
+    float* d_batch_permuted_ = nullptr;
+    uint64_t* d_batch_mask_ = nullptr;
+    float* d_batch_kept_ = nullptr;
+    float* h_batch_kept_ = nullptr;
+    unsigned int batch_kept_size_ = 0;
+
     std::vector<float11> detections_;
     unsigned int h_mask_size_;
     uint64_t* h_mask_ = nullptr;
     EventTimer timer_;
 
+    void postprocessCuda(cudaStream_t stream);
+    void postprocessCpu(cudaStream_t stream);
+    void postprocessCudaBatched(cudaStream_t stream);
+
   public:
-    CenterPoint(std::string modelFile_Dir, bool verbose = false);
+    CenterPoint(std::string modelFile_Dir, bool verbose = false, bool cpu_preprocess = false,
+                PostProcessBackend post_backend = POSTPROCESS_CUDA);
     ~CenterPoint(void);
 
     int prepare();
+    // points must be host accessible when the CPU preprocess backend is used
     int doinfer(void* points, unsigned int point_num, cudaStream_t stream);
+    int detect(const void* points, unsigned int points_num, double stamp,
+               cudaStream_t stream, std::vector<Bndbox>& boxes) override;
+    bool deviceInput() const override { return pre_->onDevice(); }
     std::vector<Bndbox> nms_pred_;
     void perf_report();
 };
\ No newline at end of file
@@ -0,0 +1,55 @@
+/****************************************************************************************
+ *
+ * Copyright (c) 2024, Shenyang Institute of Automation, Chinese Academy of Sciences
+ *
+ * Authors: Yanpeng Jia
+ * Contact: jiayanpeng@sia.cn
+ *
+ ****************************************************************************************/
+/*
+ * SPDX-FileCopyrightText: Copyright (c) 2023 NVIDIA CORPORATION & AFFILIATES. All rights reserved.
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+ 
+#ifndef DETECTOR_H_
+#define DETECTOR_H_
+
+#include <vector>
+#include "center_pointpillars/postprocess.h"
+
+// Common interface of the 3D detectors that can sit behind centerpp_node.
+class Detector {
+  public:
+    virtual ~Detector() {};
+
+    // Detects boxes in points_num packed points (x, y, z, 0, 0) of the scan taken at
+    // stamp. points is device memory when deviceInput() is true.
+    virtual int detect(const void* points, unsigned int points_num, double stamp,
+                       cudaStream_t stream, std::vector<Bndbox>& boxes) = 0;
+
+    virtual bool deviceInput() const = 0;
+
+    // false for backends that never look at the points (replay), so the caller can
+    // skip packing and all GPU resources
+    virtual bool needsPoints() const { return true; }
+};
+
+#endif
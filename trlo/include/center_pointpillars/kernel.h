@@ -39,6 +39,11 @@ const int THREADS_FOR_VOXEL = 256;
 
 #define DIVUP(x, y) (x + y - 1) / y
 
+// batched postprocess: per task slots of MAX_DET_NUM boxes, sorted in one block per task
+const int SORT_SIZE = 1024;
+const int NMS_MAX_COL_BLOCKS = DIVUP(MAX_DET_NUM, NMS_THREADS_PER_BLOCK);
+static_assert(MAX_DET_NUM <= SORT_SIZE, "batched sort handles at most SORT_SIZE boxes per task");
+
 cudaError_t voxelizationLaunch(const float *points, size_t points_size,
         float min_x_range, float max_x_range,
         float min_y_range, float max_y_range,
@@ -92,4 +97,51 @@ int permute_launch(unsigned int boxes_num,
                    float * permute_boxes_sorted, 
                    cudaStream_t stream);
 
+int postprocess_batched_launch(
+                    int num_tasks,
+                    int H,
+                    int W,
+                    int C_reg,
+                    int C_height,
+                    int C_dim,
+                    int C_rot,
+                    int C_vel,
+                    const int *C_hm,
+                    half *const *reg,
+                    half *const *height,
+                    half *const *dim,
+                    half *const *rot,
+                    half *const *vel,
+                    half *const *hm,
+                    unsigned int *detection_num,
+                    float *detections,
+                    const float *post_center_range,
+                    float out_size_factor,
+                    const float *voxel_size,
+                    const float *pc_range,
+                    float score_threshold,
+                    cudaStream_t stream = 0);
+
+int sort_permute_batched_launch(int num_tasks,
+                    const unsigned int *detection_num,
+                    const float *detections,
+                    float *boxes_sorted,
+                    float *permute_boxes_sorted,
+                    cudaStream_t stream = 0);
+
+int nms_batched_launch(int num_tasks,
+                    const unsigned int *detection_num,
+                    const float *permute_boxes_sorted,
+                    float nms_iou_threshold,
+                    uint64_t *mask,
+                    cudaStream_t stream = 0);
+
+int nms_reduce_batched_launch(int num_tasks,
+                    const unsigned int *detection_num,
+                    const uint64_t *mask,
+                    const float *boxes_sorted,
+                    unsigned int max_keep,
+                    float *kept,
+                    cudaStream_t stream = 0);
+
 #endif
\ No newline at end of file
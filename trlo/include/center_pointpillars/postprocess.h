@@ -57,6 +57,15 @@ struct Bndbox {
         : x(x_), y(y_), z(z_), w(w_), l(l_), h(h_), vx(vx_), vy(vy_), rt(rt_), id(id_), score(score_) {}
 };
 
+// one decoded detection: x, y, z, dx, dy, dz, vx, vy, rot, label, score
+typedef struct float11 { float val[11]; } float11;
+
+enum PostProcessBackend {
+    POSTPROCESS_CUDA = 0,
+    POSTPROCESS_CPU,
+    POSTPROCESS_CUDA_BATCHED,
+};
+
 class PostProcessCuda {
   private:
     Params params_;
@@ -96,6 +105,31 @@ class PostProcessCuda {
         unsigned int boxes_num, 
         const float *boxes_sorted, 
         float * permute_boxes, cudaStream_t stream);
+
+    // decode, sort, permute, NMS and mask reduction for all tasks without leaving the device.
+    // detections/boxes_sorted/permute_boxes hold NUM_TASKS * MAX_DET_NUM boxes, mask
+    // NUM_TASKS * MAX_DET_NUM * NMS_MAX_COL_BLOCKS words, kept NUM_TASKS * (1 + nms_post_max_size * DET_CHANNEL)
+    int doPostBatchedCuda(
+      int H,
+      int W,
+      int C_reg,
+      int C_height,
+      int C_dim,
+      int C_rot,
+      int C_vel,
+      const int *C_hm,
+      half *const *reg,
+      half *const *height,
+      half *const *dim,
+      half *const *rot,
+      half *const *vel,
+      half *const *hm,
+      unsigned int *detection_num,
+      float *detections,
+      float *boxes_sorted,
+      float *permute_boxes,
+      uint64_t *mask,
+      float *kept, cudaStream_t stream);
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,103 @@
+/****************************************************************************************
+ *
+ * Copyright (c) 2024, Shenyang Institute of Automation, Chinese Academy of Sciences
+ *
+ * Authors: Yanpeng Jia
+ * Contact: jiayanpeng@sia.cn
+ *
+ ****************************************************************************************/
+/*
+ * SPDX-FileCopyrightText: Copyright (c) 2023 NVIDIA CORPORATION & AFFILIATES. All rights reserved.
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+ 
+#ifndef POSTPROCESS_CPU_H_
+#define POSTPROCESS_CPU_H_
+
+#include <vector>
+#include "center_pointpillars/postprocess.h"
+
+// host pointers to the head outputs of one task, batch size 1
+struct TaskHead {
+    const half *reg;
+    const half *height;
+    const half *dim;
+    const half *rot;
+    const half *vel;
+    const half *hm;
+    int C_hm;
+};
+
+// Host implementation of predictKernel + permute_cuda + nms_cuda. Detections are
+// ranked by score (top nms_pre_max_size instead of the first ones found), and the
+// greedy rotated BEV NMS only compares boxes in neighbouring cells of a uniform grid.
+class PostProcessCpu {
+  private:
+    Params params_;
+
+  public:
+    PostProcessCpu();
+    ~PostProcessCpu();
+
+    // decodes one task into score sorted detections, same layout as predictKernel
+    int doPostDecodeCpu(
+      int H,
+      int W,
+      int C_reg,
+      int C_height,
+      int C_dim,
+      int C_rot,
+      int C_vel,
+      const TaskHead &head,
+      std::vector<float11> &detections);
+
+    // greedy NMS over score sorted detections, returns at most nms_post_max_size indices
+    int doPostNMSCpu(
+      const std::vector<float11> &detections,
+      std::vector<int> &keep);
+
+    // decode + NMS for all tasks, tasks run in parallel
+    int doPostCpu(
+      int H,
+      int W,
+      int C_reg,
+      int C_height,
+      int C_dim,
+      int C_rot,
+      int C_vel,
+      const std::vector<TaskHead> &heads,
+      std::vector<Bndbox> &boxes);
+};
+
+// Greedy walk over an NMS bitmask as written by nms_cuda / nms_batched_cuda: row i holds
+// mask_stride words and bit j of word b is set if box i suppresses box b * 64 + j.
+// Host twin of nms_reduce_batched_cuda, returns at most max_keep indices.
+int nms_mask_reduce_cpu(
+      const uint64_t *mask,
+      unsigned int boxes_num,
+      unsigned int mask_stride,
+      unsigned int max_keep,
+      std::vector<int> &keep);
+
+// IoU of two BEV boxes {x, y, z, dx, dy, dz, heading}, same geometry as devIoU
+float rotatedBoxIoU(const float *box_a, const float *box_b);
+
+#endif
@@ -29,9 +29,26 @@
  * DEALINGS IN THE SOFTWARE.
  */
  
+#ifndef PREPROCESS_H_
+#define PREPROCESS_H_
+
 #include "kernel.h"
 
-class PreProcessCuda {
+// Voxelization backend used by CenterPoint. Voxel features are feature_num halves per
+// voxel, indices are {batch, z, y, x} per voxel; both live in the backend's memory space.
+class PreProcess {
+  public:
+    virtual ~PreProcess() {};
+
+    virtual int alloc_resource() = 0;
+    virtual int generateVoxels(const float *points, size_t points_size, cudaStream_t stream) = 0;
+    virtual unsigned int getOutput(half** voxel_features, unsigned int** voxel_indices, std::vector<int>& sparse_shape) = 0;
+    // points averaged into each voxel, at most max_points_per_voxel
+    virtual const unsigned int* getVoxelNum() const = 0;
+    virtual bool onDevice() const = 0;
+};
+
+class PreProcessCuda : public PreProcess {
   private:
     Params params_;
     unsigned int *point2voxel_offset_;
@@ -57,4 +74,8 @@ class PreProcessCuda {
     int alloc_resource();
     int generateVoxels(const float *points, size_t points_size, cudaStream_t stream);
     unsigned int getOutput(half** d_voxel_features, unsigned int** d_voxel_indices, std::vector<int>& sparse_shape);
-};
\ No newline at end of file
+    const unsigned int* getVoxelNum() const { return d_voxel_num_; }
+    bool onDevice() const { return true; }
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,68 @@
+/****************************************************************************************
+ *
+ * Copyright (c) 2024, Shenyang Institute of Automation, Chinese Academy of Sciences
+ *
+ * Authors: Yanpeng Jia
+ * Contact: jiayanpeng@sia.cn
+ *
+ ****************************************************************************************/
+/*
+ * SPDX-FileCopyrightText: Copyright (c) 2023 NVIDIA CORPORATION & AFFILIATES. All rights reserved.
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+ 
+#ifndef PREPROCESS_CPU_H_
+#define PREPROCESS_CPU_H_
+
+#include "center_pointpillars/preprocess.h"
+
+// Host implementation of buildHashKernel / voxelizationKernel / featureExtractionKernel.
+// Uses the same hash function, table size and linear probing as the device table, but
+// inserts in point order so voxel ids and the points kept per voxel are deterministic.
+// Point offsets and feature extraction run in parallel with OpenMP.
+class PreProcessCpu : public PreProcess {
+  private:
+    Params params_;
+
+    std::vector<unsigned int> hash_table_;          // keys in the first half, voxel ids in the second
+    std::vector<unsigned int> point_voxel_offset_;
+    std::vector<unsigned int> voxel_num_;
+    std::vector<unsigned int> voxel_points_;        // max_points_per_voxel point ids per voxel
+
+    std::vector<half> voxel_features_;
+    std::vector<unsigned int> voxel_indices_;
+    unsigned int real_num_voxels_ = 0;
+
+    unsigned int insertHashTable(unsigned int key, unsigned int hash_size);
+
+  public:
+    PreProcessCpu();
+    ~PreProcessCpu();
+
+    int alloc_resource();
+    // points must be host accessible (host, pinned or managed memory); stream is unused
+    int generateVoxels(const float *points, size_t points_size, cudaStream_t stream);
+    unsigned int getOutput(half** h_voxel_features, unsigned int** h_voxel_indices, std::vector<int>& sparse_shape);
+    const unsigned int* getVoxelNum() const { return voxel_num_.data(); }
+    bool onDevice() const { return false; }
+};
+
+#endif
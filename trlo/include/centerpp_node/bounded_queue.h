@@ -0,0 +1,94 @@
+/****************************************************************************************
+ *
+ * Copyright (c) 2024, Shenyang Institute of Automation, Chinese Academy of Sciences
+ *
+ * Authors: Yanpeng Jia
+ * Contact: jiayanpeng@sia.cn
+ *
+ ****************************************************************************************/
+
+#ifndef BOUNDED_QUEUE_H_
+#define BOUNDED_QUEUE_H_
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+
+// Fixed-capacity blocking FIFO used to hand frames between the centerpp_node
+// pipeline stages. Once stop() is called every waiting push/pop returns false.
+template <typename T>
+class BoundedQueue
+{
+  public:
+    explicit BoundedQueue(size_t capacity) : capacity_(capacity > 0 ? capacity : 1) {};
+
+    // Blocks while the queue is full (back-pressure on the producing stage).
+    bool push(T item) {
+        std::unique_lock<std::mutex> lock(this->mtx_);
+        this->not_full_.wait(lock, [this] { return this->stopped_ || this->queue_.size() < this->capacity_; });
+        if (this->stopped_) return false;
+        this->queue_.push_back(std::move(item));
+        this->not_empty_.notify_one();
+        return true;
+    }
+
+    // Never blocks: when full the oldest element is evicted into *dropped so the
+    // caller can recycle it. Returns true if an element was evicted.
+    bool pushDropOldest(T item, T* dropped) {
+        std::lock_guard<std::mutex> lock(this->mtx_);
+        bool evicted = false;
+        if (this->queue_.size() >= this->capacity_) {
+            if (dropped) *dropped = std::move(this->queue_.front());
+            this->queue_.pop_front();
+            evicted = true;
+        }
+        this->queue_.push_back(std::move(item));
+        this->not_empty_.notify_one();
+        return evicted;
+    }
+
+    // Blocks until an element is available.
+    bool pop(T& item) {
+        std::unique_lock<std::mutex> lock(this->mtx_);
+        this->not_empty_.wait(lock, [this] { return this->stopped_ || !this->queue_.empty(); });
+        if (this->stopped_) return false;
+        item = std::move(this->queue_.front());
+        this->queue_.pop_front();
+        this->not_full_.notify_one();
+        return true;
+    }
+
+    bool tryPop(T& item) {
+        std::lock_guard<std::mutex> lock(this->mtx_);
+        if (this->stopped_ || this->queue_.empty()) return false;
+        item = std::move(this->queue_.front());
+        this->queue_.pop_front();
+        this->not_full_.notify_one();
+        return true;
+    }
+
+    void stop() {
+        std::lock_guard<std::mutex> lock(this->mtx_);
+        this->stopped_ = true;
+        this->not_empty_.notify_all();
+        this->not_full_.notify_all();
+    }
+
+    size_t size() const {
+        std::lock_guard<std::mutex> lock(this->mtx_);
+        return this->queue_.size();
+    }
+
+    size_t capacity() const { return this->capacity_; }
+
+  private:
+    std::deque<T> queue_;
+    mutable std::mutex mtx_;
+    std::condition_variable not_empty_;
+    std::condition_variable not_full_;
+    size_t capacity_;
+    bool stopped_ = false;
+};
+
+#endif
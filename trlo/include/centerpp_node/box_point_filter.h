@@ -0,0 +1,59 @@
+/****************************************************************************************
+ *
+ * Copyright (c) 2024, Shenyang Institute of Automation, Chinese Academy of Sciences
+ *
+ * Authors: Yanpeng Jia
+ * Contact: jiayanpeng@sia.cn
+ *
+ ****************************************************************************************/
+
+#ifndef BOX_POINT_FILTER_H_
+#define BOX_POINT_FILTER_H_
+
+#include <vector>
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+#include "center_pointpillars/postprocess.h"
+
+// Splits a scan into points outside / inside a set of oriented boxes. Boxes are
+// rasterized into a BEV grid covering their footprint, so each point is only tested
+// against the boxes registered in its cell.
+class BoxPointFilter
+{
+  public:
+    BoxPointFilter(float cell_size = 0.5f, float margin = 0.0f);
+
+    void setBoxes(const std::vector<Bndbox>& boxes);
+
+    // one pass over cloud_in, points inside any box go to dynamic_out
+    void filter(const pcl::PointCloud<pcl::PointXYZI>& cloud_in,
+                pcl::PointCloud<pcl::PointXYZI>& static_out,
+                pcl::PointCloud<pcl::PointXYZ>& dynamic_out);
+
+  private:
+    // box in BEV-friendly form, yaw = -rt as published on the box topic
+    struct OrientedBox {
+        float x, y, z;
+        float cos_yaw, sin_yaw;
+        float half_w, half_l, half_h;
+    };
+
+    bool inside(float px, float py, float pz) const;
+
+    float cell_size_;
+    float margin_;
+
+    std::vector<OrientedBox> boxes_;
+
+    // grid over the union of the box footprints, CSR list of boxes per cell
+    float min_x_ = 0.0f;
+    float min_y_ = 0.0f;
+    int size_x_ = 0;
+    int size_y_ = 0;
+    std::vector<int> cell_offsets_;
+    std::vector<int> cell_boxes_;
+
+    std::vector<unsigned char> labels_;
+};
+
+#endif
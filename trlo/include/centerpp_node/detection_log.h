@@ -0,0 +1,79 @@
+/****************************************************************************************
+ *
+ * Copyright (c) 2024, Shenyang Institute of Automation, Chinese Academy of Sciences
+ *
+ * Authors: Yanpeng Jia
+ * Contact: jiayanpeng@sia.cn
+ *
+ ****************************************************************************************/
+
+#ifndef DETECTION_LOG_H_
+#define DETECTION_LOG_H_
+
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+#include "center_pointpillars/detector.h"
+
+// Binary detection log: an 8 byte magic followed by one record per scan,
+//   double stamp | uint32 count | count x (9 float box, int32 id, float score)
+// little endian, as written by the host.
+class DetectionLogWriter
+{
+  public:
+    DetectionLogWriter() {};
+    ~DetectionLogWriter();
+
+    bool open(const std::string& path);
+    void write(double stamp, const std::vector<Bndbox>& boxes);
+    void close();
+    bool isOpen() const { return this->out_.is_open(); }
+
+  private:
+    std::ofstream out_;
+};
+
+// Serves detections from a log instead of running a network, matching each scan to
+// the record with the nearest stamp within tolerance.
+class ReplayDetector : public Detector
+{
+  public:
+    ReplayDetector(double tolerance = 0.005);
+
+    bool load(const std::string& path);
+
+    int detect(const void* points, unsigned int points_num, double stamp,
+               cudaStream_t stream, std::vector<Bndbox>& boxes) override;
+    bool deviceInput() const override { return false; }
+    bool needsPoints() const override { return false; }
+
+    size_t records() const { return this->stamps_.size(); }
+    size_t misses() const { return this->misses_; }
+
+  private:
+    double tolerance_;
+    std::vector<double> stamps_;        // sorted
+    std::vector<size_t> offsets_;       // records() + 1 entries into boxes_
+    std::vector<Bndbox> boxes_;
+    size_t misses_ = 0;
+};
+
+// Runs another detector and logs what it returns, to build replay logs from live runs.
+class RecordingDetector : public Detector
+{
+  public:
+    RecordingDetector(std::unique_ptr<Detector> inner, const std::string& path);
+
+    int detect(const void* points, unsigned int points_num, double stamp,
+               cudaStream_t stream, std::vector<Bndbox>& boxes) override;
+    bool deviceInput() const override { return this->inner_->deviceInput(); }
+    bool needsPoints() const override { return this->inner_->needsPoints(); }
+
+  private:
+    std::unique_ptr<Detector> inner_;
+    DetectionLogWriter writer_;
+};
+
+#endif
@@ -0,0 +1,70 @@
+/****************************************************************************************
+ *
+ * Copyright (c) 2024, Shenyang Institute of Automation, Chinese Academy of Sciences
+ *
+ * Authors: Yanpeng Jia
+ * Contact: jiayanpeng@sia.cn
+ *
+ ****************************************************************************************/
+
+#ifndef DETECTION_SCHEDULER_H_
+#define DETECTION_SCHEDULER_H_
+
+#include <vector>
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+#include "center_pointpillars/postprocess.h"
+
+// Decides per scan whether CenterPoint has to run. Inference is forced every
+// detect_every frames, and earlier when the tracker's predicted position std or the
+// ego motion since the last detected frame exceeds its threshold.
+class DetectionScheduler
+{
+  public:
+    DetectionScheduler(int detect_every = 1, double max_track_std = 0.5,
+                       double max_ego_translation = 2.0, double max_ego_rotation = 0.1);
+
+    bool shouldDetect(double track_std, const Eigen::Matrix4f& ego_pose) const;
+
+    void detected(const Eigen::Matrix4f& ego_pose);
+    void skipped() { this->frames_skipped_++; }
+
+    int framesSkipped() const { return this->frames_skipped_; }
+
+  private:
+    int detect_every_;
+    double max_track_std_;
+    double max_ego_translation_;
+    double max_ego_rotation_;
+
+    bool has_detection_ = false;
+    int frames_skipped_ = 0;
+    Eigen::Matrix4f last_pose_ = Eigen::Matrix4f::Identity();
+};
+
+// Boxes of the last detected frame held in the odom frame, with the velocity of the
+// track each one was associated to, so they can be carried to skipped frames.
+class BoxPropagator
+{
+  public:
+    BoxPropagator() {};
+
+    // velocity[i] is the odom-frame velocity of boxes[i], zero for static boxes
+    void reset(double stamp, const Eigen::Matrix4f& ego_pose,
+               const std::vector<Bndbox>& boxes, const std::vector<Eigen::Vector2f>& velocity);
+
+    // Boxes moved to stamp and expressed in the ego frame of ego_pose. Boxes with
+    // a velocity also go to dynamic. Returns false before the first reset().
+    bool propagate(double stamp, const Eigen::Matrix4f& ego_pose,
+                   std::vector<Bndbox>& boxes, std::vector<Bndbox>& dynamic) const;
+
+    double stamp() const { return this->stamp_; }
+
+  private:
+    bool valid_ = false;
+    double stamp_ = 0.0;
+    std::vector<Bndbox> boxes_;
+    std::vector<Eigen::Vector2f> velocity_;
+};
+
+#endif
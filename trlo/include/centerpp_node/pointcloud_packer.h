@@ -0,0 +1,43 @@
+/****************************************************************************************
+ *
+ * Copyright (c) 2024, Shenyang Institute of Automation, Chinese Academy of Sciences
+ *
+ * Authors: Yanpeng Jia
+ * Contact: jiayanpeng@sia.cn
+ *
+ ****************************************************************************************/
+
+#ifndef POINTCLOUD_PACKER_H_
+#define POINTCLOUD_PACKER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <sensor_msgs/PointCloud2.h>
+
+// Packs a PointCloud2 into the 5-float-per-point layout (x, y, z, 0, 0) expected by
+// CenterPoint::doinfer. Host-only, so it can be exercised without a GPU.
+class PointCloudPacker
+{
+  public:
+    static const unsigned int kPointFeatures = 5;
+
+    PointCloudPacker() {};
+
+    // Writes at most max_points points into dst (max_points * kPointFeatures floats)
+    // and returns the number written. Non-finite points are skipped; returns 0 if
+    // the message is big-endian or has no FLOAT32 x/y/z fields within point_step.
+    size_t pack(const sensor_msgs::PointCloud2& msg, float* dst, size_t max_points);
+
+    // Points dropped by the last pack() because max_points was reached.
+    size_t truncated() const { return truncated_; }
+
+  private:
+    bool findFields(const sensor_msgs::PointCloud2& msg);
+
+    uint32_t x_offset_ = 0;
+    uint32_t y_offset_ = 0;
+    uint32_t z_offset_ = 0;
+    size_t truncated_ = 0;
+};
+
+#endif
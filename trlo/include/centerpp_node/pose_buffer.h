@@ -0,0 +1,55 @@
+/****************************************************************************************
+ *
+ * Copyright (c) 2024, Shenyang Institute of Automation, Chinese Academy of Sciences
+ *
+ * Authors: Yanpeng Jia
+ * Contact: jiayanpeng@sia.cn
+ *
+ ****************************************************************************************/
+
+#ifndef POSE_BUFFER_H_
+#define POSE_BUFFER_H_
+
+#include <cstddef>
+#include <mutex>
+#include <vector>
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+
+// Fixed-capacity ring of timestamped ego poses. Odometry is appended in time order,
+// lookups binary-search the ring and interpolate (slerp + lerp) at the requested
+// stamp. Entries older than max_age behind the newest pose are trimmed on insert.
+class PoseBuffer
+{
+  public:
+    PoseBuffer(size_t capacity = 512, double max_age = 2.0);
+
+    // Out-of-order stamps (older than the newest entry) are ignored.
+    void insert(double stamp, const Eigen::Quaterniond& q, const Eigen::Vector3d& t);
+
+    // Pose at stamp, clamped to the oldest / newest entry outside the buffered
+    // range. Returns false only when the buffer is empty.
+    bool lookup(double stamp, Eigen::Quaterniond& q, Eigen::Vector3d& t) const;
+    bool lookup(double stamp, Eigen::Matrix4f& T) const;
+
+    size_t size() const;
+    void clear();
+
+  private:
+    struct StampedPose {
+        double stamp;
+        Eigen::Quaterniond q;
+        Eigen::Vector3d t;
+    };
+
+    // i-th oldest entry, caller holds mtx_
+    const StampedPose& at(size_t i) const { return this->ring_[(this->head_ + i) % this->ring_.size()]; }
+
+    std::vector<StampedPose, Eigen::aligned_allocator<StampedPose>> ring_;
+    size_t head_ = 0;
+    size_t size_ = 0;
+    double max_age_;
+    mutable std::mutex mtx_;
+};
+
+#endif
@@ -78,6 +78,9 @@ public:
 
   inline PointCloudConstPtr getInputCloud() const { return _adaptor.pcl; }
 
+  // bytes of the index (node pool and point indices), the cloud itself is not counted
+  inline size_t usedMemory() { return _kdtree.usedMemory(_kdtree); }
+
   int  nearestKSearch (const PointT &point, int k, std::vector<int> &k_indices,
                        std::vector<float> &k_sqr_distances) const;
 
@@ -0,0 +1,28 @@
+/****************************************************************************************
+ *
+ * Copyright (c) 2024, Shenyang Institute of Automation, Chinese Academy of Sciences
+ *
+ * Authors: Yanpeng Jia
+ * Contact: jiayanpeng@sia.cn
+ *
+ ****************************************************************************************/
+
+#ifndef TRLO_CLOUD_FILTERS_H_
+#define TRLO_CLOUD_FILTERS_H_
+
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+
+namespace trlo {
+
+/**
+ * Keeps the points whose range from the sensor origin lies in [th1, th2].
+ * cloud_in and cloud_out may be the same cloud. Free of ROS, so the odometry
+ * and detection nodes and the benchmarks share one implementation.
+ **/
+
+void removeClosedPointCloud(const pcl::PointCloud<pcl::PointXYZI> &cloud_in, pcl::PointCloud<pcl::PointXYZI> &cloud_out, float th1, float th2);
+
+}
+
+#endif
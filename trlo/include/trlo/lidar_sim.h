@@ -0,0 +1,112 @@
+/****************************************************************************************
+ *
+ * Copyright (c) 2024, Shenyang Institute of Automation, Chinese Academy of Sciences
+ *
+ * Authors: Yanpeng Jia
+ * Contact: jiayanpeng@sia.cn
+ *
+ ****************************************************************************************/
+
+#ifndef TRLO_LIDAR_SIM_H_
+#define TRLO_LIDAR_SIM_H_
+
+#include <vector>
+
+#include <Eigen/Core>
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+
+#include "trlo/trajectory_eval.h"
+
+namespace trlo {
+
+// Spinning lidar, the defaults are close to the HDL-64E of KITTI
+struct LidarSimConfig {
+  int beams           = 64;
+  double fov_up       = 2.0;     // deg
+  double fov_down     = -24.8;   // deg
+  double azimuth_res  = 0.2;     // deg between columns
+  double min_range    = 0.5;     // m
+  double max_range    = 120.0;   // m
+  double range_noise  = 0.02;    // m, std of the range
+  double dropout      = 0.0;     // probability a return is lost
+  bool organized      = false;   // beams x columns with NaN for no return, else dense
+  unsigned seed       = 1;
+};
+
+/**
+ * Scene primitives in the world frame, z up. reflectivity in [0, 1] scales the
+ * intensity of the returns.
+ **/
+
+// points p with normal.dot(p) == d
+struct SimPlane {
+  Eigen::Vector3d normal;
+  double d;
+  float reflectivity;
+};
+
+// rotated by yaw about its vertical axis
+struct SimBox {
+  Eigen::Vector3d center;
+  Eigen::Vector3d half;
+  double yaw;
+  float reflectivity;
+};
+
+// vertical cylinder from z = 0 to height
+struct SimPole {
+  double x;
+  double y;
+  double radius;
+  double height;
+  float reflectivity;
+};
+
+struct LidarScene {
+  std::vector<SimPlane> planes;
+  std::vector<SimBox> boxes;
+  std::vector<SimPole> poles;
+
+  // Ground at z = 0 and a street along +x from 0 to length: building blocks with
+  // gaps on both sides, parked cars and poles. The same seed gives the same scene.
+  static LidarScene street(double length, unsigned seed);
+};
+
+// Sensor poses of a drive down LidarScene::street at speed, gently weaving
+// across the lane, sampled at rate. Exact ground truth for the generated scans.
+PoseList streetTrajectory(int frames, double rate, double speed, double sensor_height = 1.73);
+
+/**
+ * Deterministic CPU ray caster. Every beam and column of a scan is one ray from
+ * the sensor pose, the first hit within [min_range, max_range] is a return. Rows
+ * of the organized output are rings, ring 0 the lowest beam. Noise and dropout are
+ * drawn from a hash of (seed, frame, ring, column), so a scan only depends on its
+ * inputs, not on the order or the thread count it is generated with. The scan is
+ * taken at a single pose, without motion distortion.
+ **/
+
+class LidarSim {
+public:
+  LidarSim(const LidarScene& scene, const LidarSimConfig& config = LidarSimConfig());
+
+  // pose is sensor to world, the points are in the sensor frame
+  void scan(const Eigen::Matrix4d& pose, int frame, pcl::PointCloud<pcl::PointXYZI>& cloud) const;
+
+  int columns() const {
+    return this->columns_;
+  }
+  const LidarSimConfig& config() const {
+    return this->config_;
+  }
+
+private:
+  LidarScene scene_;
+  LidarSimConfig config_;
+  int columns_;
+  std::vector<double> elevations_;
+};
+
+}
+
+#endif
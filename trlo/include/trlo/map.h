@@ -27,32 +27,66 @@ private:
 
   void abortTimerCB(const ros::TimerEvent& e);
   void publishTimerCB(const ros::TimerEvent& e);
+  void metricsTimerCB(const ros::TimerEvent& e);
 
   void keyframeCB(const sensor_msgs::PointCloud2ConstPtr& keyframe);
 
   bool savePcd(trlo::save_pcd::Request& req,
                trlo::save_pcd::Response& res);
 
+  bool startSaveJob(const std::string& path, float leaf_size);
+  void saveJob(pcl::PointCloud<PointType>::ConstPtr map, std::string path, float leaf_size);
+  void publishSaveStatus(const std::string& path, size_t points_written, float progress, bool done, bool success);
+  void publishMemory();
+
   void getParams();
 
   ros::NodeHandle nh;
   ros::Timer abort_timer;
   ros::Timer publish_timer;
+  ros::Timer metrics_timer;
 
   ros::Subscriber keyframe_sub;
   ros::Publisher map_pub;
+  ros::Publisher save_status_pub;
+  ros::Publisher memory_pub;
+  ros::Publisher metrics_pub;
 
   ros::ServiceServer save_pcd_srv;
 
   pcl::PointCloud<PointType>::Ptr trlo_map;
   pcl::VoxelGrid<PointType> voxelgrid;
 
+  std::thread save_thread;
+  std::atomic<bool> save_in_progress;
+  // guards sharing trlo_map with the save job and the save_snapshot entry, so the
+  // copy-on-write in keyframeCB and the release in saveJob see the same use_count
+  std::mutex mtx_save;
+
+  // Bytes of the map, and of the old map a running save job still holds after a copy
+  enum MemoryEntry {
+    MEM_MAP = 0,
+    MEM_SAVE_SNAPSHOT
+  };
+  trlo::MemoryLedger memory {"trlo_map", "save_snapshot"};
+
+  // owned by the process-wide metrics registry
+  trlo::Histogram* keyframe_ms;
+  trlo::Histogram* save_ms;
+  trlo::Counter* keyframes_received;
+  trlo::Gauge* map_points;
+
   ros::Time map_stamp;
   std::string odom_frame;
 
   bool publish_full_map_;
   double publish_freq_;
   double leaf_size_;
+  std::string shutdown_save_path_;
+  int save_chunk_size_;
+  double memory_warn_mb_;
+  double metrics_publish_freq_;
+  std::string metrics_file_;
 
   static std::atomic<bool> abort_;
 
@@ -0,0 +1,77 @@
+/****************************************************************************************
+ *
+ * Copyright (c) 2024, Shenyang Institute of Automation, Chinese Academy of Sciences
+ *
+ * Authors: Yanpeng Jia
+ * Contact: jiayanpeng@sia.cn
+ *
+ ****************************************************************************************/
+
+#ifndef TRLO_MEMORY_LEDGER_H_
+#define TRLO_MEMORY_LEDGER_H_
+
+#include <atomic>
+#include <cstddef>
+#include <initializer_list>
+#include <string>
+#include <vector>
+
+#include <pcl/point_cloud.h>
+
+namespace trlo {
+
+/**
+ * Byte counters of the containers of a node, one entry per container. The owner
+ * updates an entry where its container changes (grow/shrink on insert and erase,
+ * set where it is rebuilt), so reading the ledger never walks the containers.
+ * Entries are fixed at construction; counters are atomic and may be read from
+ * other threads, e.g. the debug and diagnostics publishers.
+ **/
+
+class MemoryLedger {
+public:
+  static const int kMaxEntries = 16;
+
+  explicit MemoryLedger(std::initializer_list<const char*> names);
+
+  void grow(int entry, size_t bytes);
+  void shrink(int entry, size_t bytes);
+  void set(int entry, size_t bytes);
+
+  int size() const {
+    return this->size_;
+  }
+  const std::string& name(int entry) const {
+    return this->names_[entry];
+  }
+  size_t bytes(int entry) const {
+    return this->bytes_[entry].load(std::memory_order_relaxed);
+  }
+  size_t peak(int entry) const {
+    return this->peak_[entry].load(std::memory_order_relaxed);
+  }
+  size_t total() const;
+
+private:
+  void updatePeak(int entry, size_t bytes);
+
+  int size_;
+  std::string names_[kMaxEntries];
+  std::atomic<size_t> bytes_[kMaxEntries];
+  std::atomic<size_t> peak_[kMaxEntries];
+};
+
+// Heap bytes held by a container, by capacity since that is what is allocated
+template <typename T, typename Alloc>
+inline size_t heapBytes(const std::vector<T, Alloc>& v) {
+  return v.capacity() * sizeof(T);
+}
+
+template <typename PointT>
+inline size_t heapBytes(const pcl::PointCloud<PointT>& cloud) {
+  return cloud.points.capacity() * sizeof(PointT);
+}
+
+}
+
+#endif
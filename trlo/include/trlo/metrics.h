@@ -0,0 +1,196 @@
+/****************************************************************************************
+ *
+ * Copyright (c) 2024, Shenyang Institute of Automation, Chinese Academy of Sciences
+ *
+ * Authors: Yanpeng Jia
+ * Contact: jiayanpeng@sia.cn
+ *
+ ****************************************************************************************/
+
+#ifndef TRLO_METRICS_H_
+#define TRLO_METRICS_H_
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <string>
+#include <vector>
+
+namespace trlo {
+
+/**
+ * Process-wide counters, gauges and fixed-bucket histograms.
+ *
+ * Every counter and histogram is split into kShards cache-line sized shards. A thread
+ * is given a shard the first time it records and only ever touches that one, so with
+ * up to kShards recording threads an update is an uncontended relaxed atomic add and
+ * never takes a lock. Reading sums the shards. Registration takes a lock and should be
+ * done once at startup; the returned pointers stay valid for the life of the process.
+ **/
+
+static const int kMetricShards = 16;
+static const size_t kCacheLine = 64;
+
+// Fixed array of n default constructed T on cache line aligned storage. operator new[]
+// only guarantees alignof(max_align_t) before C++17, which would let two shards share
+// a line whatever their alignas.
+template <typename T>
+class CacheAlignedArray {
+public:
+  explicit CacheAlignedArray(size_t n) : size_(n) {
+    void* p = nullptr;
+    if (posix_memalign(&p, kCacheLine, n * sizeof(T)) != 0) {
+      throw std::bad_alloc();
+    }
+    this->data_ = static_cast<T*>(p);
+    for (size_t i = 0; i < n; i++) {
+      new (this->data_ + i) T();
+    }
+  }
+  ~CacheAlignedArray() {
+    for (size_t i = 0; i < this->size_; i++) {
+      this->data_[i].~T();
+    }
+    free(this->data_);
+  }
+  CacheAlignedArray(const CacheAlignedArray&) = delete;
+  CacheAlignedArray& operator=(const CacheAlignedArray&) = delete;
+
+  T& operator[](size_t i) {
+    return this->data_[i];
+  }
+  const T& operator[](size_t i) const {
+    return this->data_[i];
+  }
+
+private:
+  T* data_;
+  size_t size_;
+};
+
+// Bucket upper bounds (ms) of the latency histograms, 1-2-5 steps from 50 us to 5 s
+std::vector<double> latencyBucketsMs();
+
+class Counter {
+public:
+  explicit Counter(const std::string& name);
+
+  void add(uint64_t n = 1);
+
+  const std::string& name() const {
+    return this->name_;
+  }
+  uint64_t value() const;
+
+private:
+  struct alignas(kCacheLine) Shard {
+    std::atomic<uint64_t> value;
+  };
+
+  std::string name_;
+  CacheAlignedArray<Shard> shards_;
+};
+
+// Last written value, gauges are set and not summed so they are not sharded
+class Gauge {
+public:
+  explicit Gauge(const std::string& name);
+
+  void set(double value) {
+    this->value_.store(value, std::memory_order_relaxed);
+  }
+
+  const std::string& name() const {
+    return this->name_;
+  }
+  double value() const {
+    return this->value_.load(std::memory_order_relaxed);
+  }
+
+private:
+  std::string name_;
+  std::atomic<double> value_;
+};
+
+struct HistogramSnapshot {
+  std::string name;
+  std::vector<double> bounds;     // upper bound of each bucket but the overflow one
+  std::vector<uint64_t> buckets;  // bounds.size() + 1 counts
+  uint64_t count = 0;
+  double sum = 0;
+  double max = 0;
+  double last = 0;
+
+  double mean() const {
+    return this->count > 0 ? this->sum / this->count : 0;
+  }
+
+  // Interpolated within the bucket holding the rank, never above max
+  double quantile(double q) const;
+};
+
+class Histogram {
+public:
+  Histogram(const std::string& name, const std::vector<double>& bounds);
+
+  void record(double value);
+
+  const std::string& name() const {
+    return this->name_;
+  }
+  // Newest recorded value over all shards
+  double last() const;
+  HistogramSnapshot snapshot() const;
+
+private:
+  // last is the newest value of the shard, stamped with a steady clock in ns so the
+  // newest over all shards can be picked without a shared atomic
+  struct alignas(kCacheLine) Shard {
+    std::atomic<uint64_t> count;
+    std::atomic<double> sum;
+    std::atomic<double> max;
+    std::atomic<double> last;
+    std::atomic<int64_t> last_stamp;
+  };
+
+  std::string name_;
+  std::vector<double> bounds_;
+  CacheAlignedArray<Shard> shards_;
+  // kShards rows of bounds_.size() + 1 buckets, rows padded to a whole cache line
+  size_t row_;
+  std::unique_ptr<CacheAlignedArray<std::atomic<uint64_t>>> buckets_;
+};
+
+struct MetricsSnapshot {
+  std::vector<std::pair<std::string, uint64_t>> counters;
+  std::vector<std::pair<std::string, double>> gauges;
+  std::vector<HistogramSnapshot> histograms;
+};
+
+class MetricsRegistry {
+public:
+  static MetricsRegistry& global();
+
+  // Returns the metric registered under name, creating it on first use
+  Counter* counter(const std::string& name);
+  Gauge* gauge(const std::string& name);
+  Histogram* histogram(const std::string& name, const std::vector<double>& bounds = latencyBucketsMs());
+
+  MetricsSnapshot snapshot() const;
+
+private:
+  mutable std::mutex mtx_;
+  std::vector<std::unique_ptr<Counter>> counters_;
+  std::vector<std::unique_ptr<Gauge>> gauges_;
+  std::vector<std::unique_ptr<Histogram>> histograms_;
+};
+
+// Appends the snapshot to path as one JSON object per line
+bool appendMetricsSnapshot(const std::string& path, const MetricsSnapshot& snapshot, double stamp);
+
+}
+
+#endif
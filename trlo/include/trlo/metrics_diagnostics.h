@@ -0,0 +1,63 @@
+/****************************************************************************************
+ *
+ * Copyright (c) 2024, Shenyang Institute of Automation, Chinese Academy of Sciences
+ *
+ * Authors: Yanpeng Jia
+ * Contact: jiayanpeng@sia.cn
+ *
+ ****************************************************************************************/
+
+#ifndef TRLO_METRICS_DIAGNOSTICS_H_
+#define TRLO_METRICS_DIAGNOSTICS_H_
+
+#include <diagnostic_msgs/DiagnosticArray.h>
+
+#include "trlo/metrics.h"
+
+namespace trlo {
+
+inline diagnostic_msgs::KeyValue metricsKeyValue(const std::string& key, const std::string& value) {
+  diagnostic_msgs::KeyValue kv;
+  kv.key = key;
+  kv.value = value;
+  return kv;
+}
+
+// One status per metric, named <prefix>/<metric>. Histograms carry count, mean,
+// p50/p90/p99, max and last; counters and gauges a single value.
+inline void metricsToDiagnostics(const MetricsSnapshot& snapshot, const std::string& prefix,
+                                 diagnostic_msgs::DiagnosticArray& stats) {
+  for (const auto& c : snapshot.counters) {
+    diagnostic_msgs::DiagnosticStatus status;
+    status.level = diagnostic_msgs::DiagnosticStatus::OK;
+    status.name = prefix + "/" + c.first;
+    status.values.push_back(metricsKeyValue("value", std::to_string(c.second)));
+    stats.status.push_back(status);
+  }
+
+  for (const auto& g : snapshot.gauges) {
+    diagnostic_msgs::DiagnosticStatus status;
+    status.level = diagnostic_msgs::DiagnosticStatus::OK;
+    status.name = prefix + "/" + g.first;
+    status.values.push_back(metricsKeyValue("value", std::to_string(g.second)));
+    stats.status.push_back(status);
+  }
+
+  for (const auto& h : snapshot.histograms) {
+    diagnostic_msgs::DiagnosticStatus status;
+    status.level = diagnostic_msgs::DiagnosticStatus::OK;
+    status.name = prefix + "/" + h.name;
+    status.values.push_back(metricsKeyValue("count", std::to_string(h.count)));
+    status.values.push_back(metricsKeyValue("mean", std::to_string(h.mean())));
+    status.values.push_back(metricsKeyValue("p50", std::to_string(h.quantile(0.5))));
+    status.values.push_back(metricsKeyValue("p90", std::to_string(h.quantile(0.9))));
+    status.values.push_back(metricsKeyValue("p99", std::to_string(h.quantile(0.99))));
+    status.values.push_back(metricsKeyValue("max", std::to_string(h.max)));
+    status.values.push_back(metricsKeyValue("last", std::to_string(h.last)));
+    stats.status.push_back(status);
+  }
+}
+
+}
+
+#endif
@@ -23,9 +23,30 @@ public:
   void start();
   void stop();
 
+  // Latency of the registration stages of one scan, seconds
+  struct StageTimes {
+    double preprocess;
+    double sources;
+    double s2s;
+    double submap;
+    double s2m;
+    double keyframes;
+    double total;
+  };
+
+  // Runs one scan through the same path as the point cloud subscriber, for offline
+  // replay. Returns true when the scan produced a pose, false while initializing.
+  bool processScan(const sensor_msgs::PointCloud2ConstPtr& pc);
+
+  Eigen::Matrix4f getPose() const;
+  const StageTimes& getStageTimes() const {
+    return this->stage_times;
+  }
+
 private:
 
   void abortTimerCB(const ros::TimerEvent& e);
+  void metricsTimerCB(const ros::TimerEvent& e);
   void icpCB(const sensor_msgs::PointCloud2ConstPtr& pc);
   void imuCB(const sensor_msgs::Imu::ConstPtr& imu);
   void boxCB(const jsk_recognition_msgs::BoundingBoxArrayPtr& box);
@@ -70,11 +91,16 @@ private:
   void getSubmapKeyframes();
 
   void debug();
+  void publishMemory(double rss_bytes);
+  void updateKdtreeMemory();
+
+  double lapStage();
 
   double first_imu_time;
 
   ros::NodeHandle nh;
   ros::Timer abort_timer;
+  ros::Timer metrics_timer;
   
   ros::ServiceServer save_traj_srv;
 
@@ -88,6 +114,8 @@ private:
   ros::Publisher keyframe_pub;
   ros::Publisher kf_pub;
   ros::Publisher robot_pub;
+  ros::Publisher memory_pub;
+  ros::Publisher metrics_pub;
 
   Eigen::Vector3f origin;
   std::vector<std::pair<Eigen::Vector3f, Eigen::Quaternionf>> trajectory;
@@ -127,9 +155,27 @@ private:
 
   double curr_frame_stamp;
   double prev_frame_stamp;
-  std::vector<double> comp_times;
-  std::vector<double> submap_build_times;
-  std::vector<double> ground_optimize_times;
+
+  // Latency histograms (ms), owned by the process-wide metrics registry
+  trlo::Histogram* comp_ms;
+  trlo::Histogram* submap_build_ms;
+  trlo::Histogram* ground_optimize_ms;
+  trlo::Histogram* stage_ms[7];
+
+  StageTimes stage_times;
+  std::chrono::steady_clock::time_point stage_clock;
+
+  // Bytes held by the containers that grow with the run
+  enum MemoryEntry {
+    MEM_KEYFRAMES = 0,
+    MEM_KEYFRAME_NORMALS,
+    MEM_KEYFRAMES_CLOUD,
+    MEM_SUBMAP,
+    MEM_KDTREES,
+    MEM_IMU_BUFFER,
+    MEM_TRAJECTORY
+  };
+  trlo::MemoryLedger memory {"keyframes", "keyframe_normals", "keyframes_cloud", "submap", "kdtrees", "imu_buffer", "trajectory"};
 
   nano_gicp::NanoGICP<PointType, PointType> gicp_s2s;
   nano_gicp::NanoGICP<PointType, PointType> gicp;
@@ -243,6 +289,11 @@ private:
 
   int box_buffer_size_;
 
+  double memory_warn_mb_;
+
+  double metrics_publish_freq_;
+  std::string metrics_file_;
+
   int gicp_min_num_points_;
 
   int gicps2s_k_correspondences_;
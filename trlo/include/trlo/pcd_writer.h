@@ -0,0 +1,76 @@
+/****************************************************************************************
+ *
+ * Copyright (c) 2024, Shenyang Institute of Automation, Chinese Academy of Sciences
+ *
+ * Authors: Yanpeng Jia
+ * Contact: jiayanpeng@sia.cn
+ *
+ ****************************************************************************************/
+
+#include "trlo/trlo.h"
+
+/**
+ * Streaming binary PCD writer. Points are appended chunk by chunk and the
+ * WIDTH/POINTS fields are patched in place on close, so a map can be written
+ * without building a second (voxelized) copy of it in memory. A positive leaf
+ * size keeps the first point that falls into each voxel.
+ *
+ * Deduplication is exact over the whole file, so the writer remembers every
+ * voxel it has written: about 40 bytes per voxel in the hash set, or a bit more
+ * than the 32 bytes each point of the map itself takes when the save leaf size
+ * is at or below the map's. That set is freed on close. Writing without a leaf
+ * size keeps no state besides the chunk buffer.
+ *
+ * The points go to path + ".tmp", which close() renames over path only once the
+ * file is complete. A writer that is discarded or destroyed while still open
+ * removes the temporary file and leaves any previous file at path untouched.
+ **/
+
+class trlo::PcdWriter {
+
+public:
+
+  PcdWriter(float leaf_size = 0.);
+  ~PcdWriter();
+
+  bool open(const std::string& path);
+  bool write(const PointType* points, size_t num_points);
+  // Completes the file and moves it to the path given to open()
+  bool close();
+  // Drops the partial file, path keeps what it held before open()
+  void discard();
+
+  size_t size() const {
+    return this->num_points;
+  }
+
+private:
+
+  // voxel indices are kept as int32 so distinct voxels never share a key
+  struct VoxelKey {
+    int32_t x, y, z;
+    bool operator==(const VoxelKey& other) const {
+      return this->x == other.x && this->y == other.y && this->z == other.z;
+    }
+  };
+  struct VoxelKeyHash {
+    size_t operator()(const VoxelKey& k) const {
+      return (size_t(uint32_t(k.x)) * 73856093) ^ (size_t(uint32_t(k.y)) * 19349663) ^ (size_t(uint32_t(k.z)) * 83492791);
+    }
+  };
+
+  bool writeCount(std::streampos pos);
+
+  std::ofstream out;
+  std::string path;
+  std::string tmp_path;
+  std::streampos width_pos;
+  std::streampos points_pos;
+
+  float leaf_size;
+  size_t num_points;
+
+  std::unordered_set<VoxelKey, VoxelKeyHash> voxels;
+  std::vector<float> buffer;
+
+};
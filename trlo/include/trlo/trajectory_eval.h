@@ -0,0 +1,69 @@
+/****************************************************************************************
+ *
+ * Copyright (c) 2024, Shenyang Institute of Automation, Chinese Academy of Sciences
+ *
+ * Authors: Yanpeng Jia
+ * Contact: jiayanpeng@sia.cn
+ *
+ ****************************************************************************************/
+
+#ifndef TRLO_TRAJECTORY_EVAL_H_
+#define TRLO_TRAJECTORY_EVAL_H_
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <Eigen/Core>
+#include <Eigen/StdVector>
+
+namespace trlo {
+
+typedef std::vector<Eigen::Matrix4d, Eigen::aligned_allocator<Eigen::Matrix4d>> PoseList;
+
+/**
+ * KITTI odometry files: one pose per line as the 12 values of the row-major 3x4
+ * matrix, and the velodyne to camera extrinsic in the "Tr:" line of calib.txt.
+ **/
+
+bool loadKittiPoses(const std::string& path, PoseList& poses);
+bool saveKittiPoses(const std::string& path, const PoseList& poses);
+bool loadKittiCalib(const std::string& path, Eigen::Matrix4d& Tr);
+
+/**
+ * Accuracy of an estimated trajectory against ground truth, both indexed by frame.
+ * ATE is the translation RMSE after the rigid (Umeyama) alignment of est onto gt.
+ * RPE is the RMSE of the motion error between frames delta apart.
+ **/
+
+double absoluteTrajectoryError(const PoseList& gt, const PoseList& est);
+void relativePoseError(const PoseList& gt, const PoseList& est, int delta, double& trans_rmse, double& rot_rmse_deg);
+
+// p in [0, 1], nearest rank
+double percentile(std::vector<double> values, double p);
+
+/**
+ * Regression metrics, "name value" per line. Every metric is lower-is-better:
+ * ate_* and rpe_* are checked against tol_accuracy, latency_* against
+ * tol_latency and peak_rss_* against tol_memory, all relative to the baseline.
+ * frames must match exactly, results of different data are not comparable.
+ **/
+
+typedef std::vector<std::pair<std::string, double>> MetricList;
+
+struct MetricCheck {
+  std::string name;
+  double baseline;
+  double current;
+  double limit;
+  bool pass;
+};
+
+bool writeMetrics(const std::string& path, const MetricList& metrics);
+bool readMetrics(const std::string& path, MetricList& metrics);
+std::vector<MetricCheck> compareMetrics(const MetricList& baseline, const MetricList& current,
+                                        double tol_accuracy, double tol_latency, double tol_memory);
+
+}
+
+#endif
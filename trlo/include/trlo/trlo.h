@@ -8,6 +8,7 @@
  ****************************************************************************************/
 
 #include <atomic>
+#include <chrono>
 #include <fstream>
 #include <iomanip>
 #include <ios>
@@ -44,6 +45,7 @@
 #include <pcl_ros/transforms.h>
 #include <tf2_ros/transform_broadcaster.h>
 
+#include <diagnostic_msgs/DiagnosticArray.h>
 #include <geometry_msgs/PoseStamped.h>
 #include <nav_msgs/Odometry.h>
 #include <nav_msgs/Path.h>
@@ -58,12 +60,15 @@
 
 #include <trlo/save_pcd.h>
 #include <trlo/save_traj.h>
+#include <trlo/save_status.h>
 #include <nano_gicp/nano_gicp.hpp>
 
 #include <jsk_recognition_msgs/BoundingBox.h>
 #include <jsk_recognition_msgs/BoundingBoxArray.h>
 
 #include "center_pointpillars/postprocess.h"
+#include "trlo/memory_ledger.h"
+#include "trlo/metrics_diagnostics.h"
 
 typedef pcl::PointXYZI PointType;
 
@@ -71,5 +76,6 @@ namespace trlo {
 
   class OdomNode;
   class MapNode;
+  class PcdWriter;
 
 }
@@ -45,6 +45,8 @@ tf::TransformListener* tran;
 
 std::deque<nav_msgs::Odometry> odom_queue;
 
+MultiObjectTracker tracker;
+
 pcl::PointCloud<pcl::PointXYZ>::Ptr color_point(new pcl::PointCloud<pcl::PointXYZ>());
 
 int counta = 0;
@@ -63,46 +65,17 @@ void  track_box (const jsk_recognition_msgs::BoundingBoxArrayPtr &input){
 
   int box_num = input->boxes.size();
 
-  vector<PointCloud<PointXYZ>> bBoxes;
-  PointCloud<PointXYZ> oneBbox;
-//  bBoxes.header = input.header;
+  // jsk boxes are axis aligned, dimensions.y spans x and dimensions.x spans y
+  vector<OrientedBox> bBoxes(box_num);
   for(int i = 0; i < box_num; i++)
   {
-      PointXYZ o;
-      o.x = input->boxes[i].pose.position.x - input->boxes[i].dimensions.y / 2;
-      o.y = input->boxes[i].pose.position.y - input->boxes[i].dimensions.x / 2;
-      o.z = input->boxes[i].pose.position.z - input->boxes[i].dimensions.z / 2;
-      oneBbox.push_back(o);
-      o.x = input->boxes[i].pose.position.x + input->boxes[i].dimensions.y / 2;
-      o.y = input->boxes[i].pose.position.y - input->boxes[i].dimensions.x / 2;
-      o.z = input->boxes[i].pose.position.z - input->boxes[i].dimensions.z / 2; 
-      oneBbox.push_back(o);
-      o.x = input->boxes[i].pose.position.x - input->boxes[i].dimensions.y / 2;
-      o.y = input->boxes[i].pose.position.y + input->boxes[i].dimensions.x / 2;
-      o.z = input->boxes[i].pose.position.z - input->boxes[i].dimensions.z / 2;   
-      oneBbox.push_back(o);
-      o.x = input->boxes[i].pose.position.x + input->boxes[i].dimensions.y / 2;
-      o.y = input->boxes[i].pose.position.y + input->boxes[i].dimensions.x / 2;
-      o.z = input->boxes[i].pose.position.z - input->boxes[i].dimensions.z / 2;  
-      oneBbox.push_back(o);
-      o.x = input->boxes[i].pose.position.x - input->boxes[i].dimensions.y / 2;
-      o.y = input->boxes[i].pose.position.y - input->boxes[i].dimensions.x / 2;
-      o.z = input->boxes[i].pose.position.z + input->boxes[i].dimensions.z / 2;  
-      oneBbox.push_back(o);
-      o.x = input->boxes[i].pose.position.x + input->boxes[i].dimensions.y / 2;
-      o.y = input->boxes[i].pose.position.y - input->boxes[i].dimensions.x / 2;
-      o.z = input->boxes[i].pose.position.z + input->boxes[i].dimensions.z / 2;  
-      oneBbox.push_back(o);
-      o.x = input->boxes[i].pose.position.x - input->boxes[i].dimensions.y / 2;
-      o.y = input->boxes[i].pose.position.y + input->boxes[i].dimensions.x / 2;
-      o.z = input->boxes[i].pose.position.z + input->boxes[i].dimensions.z / 2;  
-      oneBbox.push_back(o);
-      o.x = input->boxes[i].pose.position.x + input->boxes[i].dimensions.y / 2;
-      o.y = input->boxes[i].pose.position.y + input->boxes[i].dimensions.x / 2;
-      o.z = input->boxes[i].pose.position.z + input->boxes[i].dimensions.z / 2;  
-      oneBbox.push_back(o);
-      bBoxes.push_back(oneBbox);
-      oneBbox.clear();
+      bBoxes[i].x = input->boxes[i].pose.position.x;
+      bBoxes[i].y = input->boxes[i].pose.position.y;
+      bBoxes[i].z = input->boxes[i].pose.position.z;
+      bBoxes[i].l = input->boxes[i].dimensions.y;
+      bBoxes[i].w = input->boxes[i].dimensions.x;
+      bBoxes[i].h = input->boxes[i].dimensions.z;
+      bBoxes[i].yaw = 0;
   }
   
   // std::cout << "!!!!!input->boxes[i].pose.position.x: " << input->boxes[0].pose.position.x << std::endl;
@@ -129,24 +102,20 @@ void  track_box (const jsk_recognition_msgs::BoundingBoxArrayPtr &input){
   // tran->setTransform(transform);
 
   
-  PointCloud<PointXYZ> newBox;
+  Eigen::Matrix4f ego_pose = Eigen::Matrix4f::Identity();
+  Eigen::Quaternionf ego_q(odom_queue.front().pose.pose.orientation.w, odom_queue.front().pose.pose.orientation.x, odom_queue.front().pose.pose.orientation.y, odom_queue.front().pose.pose.orientation.z);
+  ego_pose.block<3,3>(0,0) = ego_q.toRotationMatrix();
+  ego_pose.block<3,1>(0,3) = Eigen::Vector3f(odom_queue.front().pose.pose.position.x, odom_queue.front().pose.pose.position.y, 0.0);
   for(int i = 0; i < box_num; i++ ){
-    bBoxes[i].header.frame_id = "robot/odom";
-
-    // tran->waitForTransform("robot/odom", "robot/base_link", last_time, ros::Duration(10.0));
-    // pcl_ros::transformPointCloud("robot/odom", bBoxes[i], newBox, *tran);
-    Eigen::Matrix4f last_T;
-    Eigen::Quaternionf last_q(odom_queue.front().pose.pose.orientation.w, odom_queue.front().pose.pose.orientation.x, odom_queue.front().pose.pose.orientation.y, odom_queue.front().pose.pose.orientation.z);
-    last_T.block<3,3>(0,0) = last_q.toRotationMatrix();
-    last_T.block<3,1>(0,3) = Eigen::Vector3f(odom_queue.front().pose.pose.position.x, odom_queue.front().pose.pose.position.y, 0.0);
-    pcl::transformPointCloud(bBoxes[i], newBox, last_T);
-    bBoxes[i] = newBox;
-    bBoxes[i].header.frame_id = "robot/odom";
-    // std::cout << "!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!" << std::endl;
+    bBoxes[i] = bBoxes[i].transformed(ego_pose);
   }
 
-  for (int i = 0; i < bBoxes.size(); i++) {
-    *color_point += bBoxes[i];
+  for (int i = 0; i < box_num; i++) {
+    BoxFootprint fp = bBoxes[i].footprint();
+    for (int j = 0; j < 8; j++) {
+      float z = j < 4 ? bBoxes[i].z - bBoxes[i].h / 2 : bBoxes[i].z + bBoxes[i].h / 2;
+      color_point->push_back(PointXYZ(fp.x[j % 4], fp.y[j % 4], z));
+    }
   }
 
   sensor_msgs::PointCloud2 cloud_msg;
@@ -156,24 +125,16 @@ void  track_box (const jsk_recognition_msgs::BoundingBoxArrayPtr &input){
   pub_track_box.publish(cloud_msg);
 
   //end converting----------------------------------------
-  PointCloud<PointXYZ> targetPoints;
-  vector<vector<double>> targetVandYaw;
-  vector<int> trackManage;  // trackManage???  大量具有相关不确定性的跟踪对象需要有效地实施跟踪管理。跟踪管理的主要目的是动态限制虚假跟踪列表的数量（从而防止错误的数据关联），并在丢失检测的情况下保持对象跟踪
-  vector<bool> isStaticVec;
-  vector<bool> isVisVec;
-  vector<PointCloud<PointXYZ>> visBBs;
-  // std::cout << "!!!!!input->boxes[i].pose.position.x: " << bBoxes[0][0] << std::endl;
-  immUkfJpdaf(bBoxes, timestamp, targetPoints, targetVandYaw, trackManage, isStaticVec, isVisVec, visBBs);
+  const vector<TrackedObject>& tracks = tracker.step(bBoxes, timestamp, ego_pose);
 
-// //   cout << "size is "<<visBBs.size()<<endl;
-//   // cout << "x1:"<<visBBs[0][0].x<<"y1:"<<visBBs[0][0].y<<endl;
-//   // cout << "x2:"<<visBBs[0][1].x<<"y2:"<<visBBs[0][1].y<<endl;
-//   // cout << "x3:"<<visBBs[0][2].x<<"y3:"<<visBBs[0][2].y<<endl;
-//   // cout << "x4:"<<visBBs[0][3].x<<"y4:"<<visBBs[0][3].y<<endl;
-
-
-  assert(targetPoints.size() == trackManage.size());
-  assert(targetPoints.size()== targetVandYaw.size());
+  PointCloud<PointXYZ> targetPoints;
+  for(int i = 0; i < tracks.size(); i++){
+    PointXYZ o;
+    o.x = tracks[i].x;
+    o.y = tracks[i].y;
+    o.z = -1.73/2;
+    targetPoints.push_back(o);
+  }
 
   Eigen::Matrix4f last_T;
   Eigen::Quaternionf last_q(odom_queue.front().pose.pose.orientation.w, odom_queue.front().pose.pose.orientation.x, odom_queue.front().pose.pose.orientation.y, odom_queue.front().pose.pose.orientation.z);
@@ -189,15 +150,6 @@ void  track_box (const jsk_recognition_msgs::BoundingBoxArrayPtr &input){
   // pcl_ros::transformPointCloud("/velodyne", targetPoints, egoTFPoints, *tran);
   pcl::transformPointCloud(targetPoints, egoTFPoints, last_T);
 
-  //processing visBBs
-  PointCloud<PointXYZ> visEgoBB;
-  for(int i = 0; i < visBBs.size(); i++){
-    visBBs[i].header.frame_id = "robot/base_link";
-    // pcl_ros::transformPointCloud("/velodyne", visBBs[i], visEgoBB, *tran);
-    pcl::transformPointCloud(visBBs[i], visEgoBB, last_T);
-
-    visBBs[i] = visEgoBB;
-  }
   //end converting to ego tf-------------------------
 
 
@@ -208,13 +160,10 @@ void  track_box (const jsk_recognition_msgs::BoundingBoxArrayPtr &input){
   for(int i = 0; i < targetPoints.size(); i++){
     visualization_msgs::Marker arrowsG;
     arrowsG.lifetime = ros::Duration(0.1);
-    if(trackManage[i] == 0 ) {
-      continue;
-    }
-    if(isVisVec[i] == false ) {
+    if(tracks[i].isVisible == false ) {
       continue;
     }
-    if(isStaticVec[i] == true){
+    if(tracks[i].isStatic == true){
       continue;
     }
 //    arrowsG.header.frame_id = "/velo_link";
@@ -228,14 +177,14 @@ void  track_box (const jsk_recognition_msgs::BoundingBoxArrayPtr &input){
     arrowsG.color.g = 1.0f; // 绿色
     // arrowsG.color.r = 1.0f; // 红色
     arrowsG.color.a = 1.0;  
-    arrowsG.id = i;
+    arrowsG.id = tracks[i].id;
     geometry_msgs::Point p;
     // assert(targetPoints[i].size()==4);
     p.x = egoTFPoints[i].x;
     p.y = egoTFPoints[i].y;
     p.z = -1.73/2;
-    double tv   = targetVandYaw[i][0];
-    double tyaw = targetVandYaw[i][1];
+    double tv   = tracks[i].v;
+    double tyaw = tracks[i].yaw;
 
     // Set the pose of the marker.  This is a full 6DOF pose relative to the frame/time specified in the header
     arrowsG.pose.position.x = p.x;
@@ -315,7 +264,6 @@ void  track_box (const jsk_recognition_msgs::BoundingBoxArrayPtr &input){
 //  cout << "targetPoints.size() is --=------" << targetPoints.size() <<endl;
 
   for(int i = 0; i < targetPoints.size(); i++){
-    if(trackManage[i] == 0) continue;
     geometry_msgs::Point p;
     // p.x = targetPoints[i].x;
     // p.y = targetPoints[i].y;
@@ -324,17 +272,17 @@ void  track_box (const jsk_recognition_msgs::BoundingBoxArrayPtr &input){
     p.z = -1.73/2;
 
 //   cout << "is ------------------" << i <<endl;
-    // cout << "trackManage[i]  " <<trackManage[i] << endl; // 输出
-    if(isStaticVec[i] == true){   // isStaticVec???
+    // cout << "trackNum  " <<tracks[i].trackNum << endl; // 输出
+    if(tracks[i].isStatic == true){
       pointsB.points.push_back(p);    // 蓝点
     }
-    else if(trackManage[i] < 5 ){  // 小于5为黄点
+    else if(tracks[i].state == TRACK_TENTATIVE){  // 小于5为黄点
       pointsY.points.push_back(p);
     }
-    else if(trackManage[i] == 5){  // 等于5为绿点
+    else if(tracks[i].state == TRACK_CONFIRMED){  // 等于5为绿点
       pointsG.points.push_back(p);
     }
-    else if(trackManage[i] > 5){
+    else if(tracks[i].state == TRACK_COASTING){
       pointsR.points.push_back(p);    // 大于5为红点
     }
   }
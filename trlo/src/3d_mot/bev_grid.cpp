@@ -0,0 +1,103 @@
+/****************************************************************************************
+ *
+ * Copyright (c) 2024, Shenyang Institute of Automation, Chinese Academy of Sciences
+ *
+ * Authors: Yanpeng Jia
+ * Contact: jiayanpeng@sia.cn
+ *
+ ****************************************************************************************/
+
+#include <cmath>
+#include <algorithm>
+
+#include "3d_mot/bev_grid.h"
+#include "3d_mot/fixed_buffers.h"
+
+void BevGrid::build(const std::vector<double>& x, const std::vector<double>& y, double cellSize){
+    int n = x.size();
+    reserveScratch(cell_of_, n);
+    cell_of_.assign(n, -1);
+    indices_.clear();
+
+    double minX = 0, maxX = 0, minY = 0, maxY = 0;
+    bool any = false;
+    for(int i = 0; i < n; i++){
+        if(!std::isfinite(x[i]) || !std::isfinite(y[i])) continue;
+        if(!any){
+            minX = maxX = x[i];
+            minY = maxY = y[i];
+            any = true;
+        }
+        minX = std::min(minX, x[i]); maxX = std::max(maxX, x[i]);
+        minY = std::min(minY, y[i]); maxY = std::max(maxY, y[i]);
+    }
+    if(!any){
+        nx_ = ny_ = 0;
+        cell_start_.assign(1, 0);
+        return;
+    }
+
+    // keep the cell count within a small multiple of the point count, so
+    // sparse scenes spread over a large area do not pay for empty cells
+    cell_size_ = cellSize > 0 ? cellSize : 4.0;
+    const double maxCells = std::max(64, 4*n);
+    while(true){
+        double cx = std::floor((maxX - minX)/cell_size_) + 1;
+        double cy = std::floor((maxY - minY)/cell_size_) + 1;
+        if(cx*cy <= maxCells) break;
+        cell_size_ *= 2;
+    }
+    min_x_ = minX;
+    min_y_ = minY;
+    nx_ = (int)std::floor((maxX - minX)/cell_size_) + 1;
+    ny_ = (int)std::floor((maxY - minY)/cell_size_) + 1;
+
+    // counting sort by cell, stable so indices stay ascending inside each cell
+    reserveScratch(cell_start_, nx_*ny_ + 1);
+    cell_start_.assign(nx_*ny_ + 1, 0);
+    for(int i = 0; i < n; i++){
+        if(!std::isfinite(x[i]) || !std::isfinite(y[i])) continue;
+        int ix = std::min(nx_ - 1, (int)((x[i] - min_x_)/cell_size_));
+        int iy = std::min(ny_ - 1, (int)((y[i] - min_y_)/cell_size_));
+        cell_of_[i] = iy*nx_ + ix;
+        cell_start_[cell_of_[i] + 1]++;
+    }
+    for(int c = 0; c < nx_*ny_; c++){
+        cell_start_[c + 1] += cell_start_[c];
+    }
+    reserveScratch(indices_, cell_start_[nx_*ny_]);
+    indices_.resize(cell_start_[nx_*ny_]);
+    for(int i = 0; i < n; i++){
+        if(cell_of_[i] < 0) continue;
+        // cell_start_ is used as a write cursor and restored below
+        indices_[cell_start_[cell_of_[i]]++] = i;
+    }
+    for(int c = nx_*ny_; c > 0; c--){
+        cell_start_[c] = cell_start_[c - 1];
+    }
+    cell_start_[0] = 0;
+}
+
+void BevGrid::query(double minX, double maxX, double minY, double maxY, std::vector<int>& out) const{
+    if(nx_ == 0 || !(minX <= maxX) || !(minY <= maxY)) return;
+
+    double fx0 = std::floor((minX - min_x_)/cell_size_);
+    double fx1 = std::floor((maxX - min_x_)/cell_size_);
+    double fy0 = std::floor((minY - min_y_)/cell_size_);
+    double fy1 = std::floor((maxY - min_y_)/cell_size_);
+    if(fx1 < 0 || fy1 < 0 || fx0 >= nx_ || fy0 >= ny_) return;
+    int ix0 = (int)std::max(0.0, fx0), ix1 = (int)std::min((double)(nx_ - 1), fx1);
+    int iy0 = (int)std::max(0.0, fy0), iy1 = (int)std::min((double)(ny_ - 1), fy1);
+
+    size_t first = out.size();
+    for(int iy = iy0; iy <= iy1; iy++){
+        for(int ix = ix0; ix <= ix1; ix++){
+            int c = iy*nx_ + ix;
+            out.insert(out.end(), indices_.begin() + cell_start_[c], indices_.begin() + cell_start_[c + 1]);
+        }
+    }
+    // callers are order sensitive (detection claims, nearest pick ties), keep the full scan order
+    if(iy1 > iy0 || ix1 > ix0){
+        std::sort(out.begin() + first, out.end());
+    }
+}
@@ -0,0 +1,80 @@
+/****************************************************************************************
+ *
+ * Copyright (c) 2024, Shenyang Institute of Automation, Chinese Academy of Sciences
+ *
+ * Authors: Yanpeng Jia
+ * Contact: jiayanpeng@sia.cn
+ *
+ ****************************************************************************************/
+
+#include <limits>
+
+#include "3d_mot/hungarian.h"
+
+void HungarianSolver::solve(const std::vector<double>& cost, int rows, int cols,
+                            std::vector<double>& u, std::vector<double>& v, std::vector<int>& rowCol){
+    const double INF = std::numeric_limits<double>::infinity();
+
+    // 1-based potentials, index 0 is the virtual column the augmenting path starts from
+    uu_.assign(rows + 1, 0);
+    vv_.assign(cols + 1, 0);
+    for(int i = 0; i < rows; i++) uu_[i + 1] = u[i];
+    for(int j = 0; j < cols; j++) vv_[j + 1] = v[j];
+    colRow_.assign(cols + 1, 0);
+    way_.assign(cols + 1, 0);
+
+    for(int i = 1; i <= rows; i++){
+        colRow_[0] = i;
+        int j0 = 0;
+        minv_.assign(cols + 1, INF);
+        used_.assign(cols + 1, 0);
+        do{
+            used_[j0] = 1;
+            int i0 = colRow_[j0];
+            const double* row = &cost[(i0 - 1)*cols];
+            double delta = INF;
+            int j1 = 0;
+            for(int j = 1; j <= cols; j++){
+                if(used_[j]) continue;
+                double cur = row[j - 1] - uu_[i0] - vv_[j];
+                if(cur < minv_[j]){
+                    minv_[j] = cur;
+                    way_[j] = j0;
+                }
+                if(minv_[j] < delta){
+                    delta = minv_[j];
+                    j1 = j;
+                }
+            }
+            // no reachable free column, the row has no finite entry left
+            if(j1 == 0) break;
+            for(int j = 0; j <= cols; j++){
+                if(used_[j]){
+                    uu_[colRow_[j]] += delta;
+                    vv_[j] -= delta;
+                }
+                else{
+                    minv_[j] -= delta;
+                }
+            }
+            j0 = j1;
+        } while(colRow_[j0] != 0);
+        if(colRow_[j0] != 0) continue;
+
+        // flip the augmenting path
+        do{
+            int j1 = way_[j0];
+            colRow_[j0] = colRow_[j1];
+            j0 = j1;
+        } while(j0);
+    }
+
+    rowCol.assign(rows, -1);
+    for(int j = 1; j <= cols; j++){
+        if(colRow_[j] != 0) rowCol[colRow_[j] - 1] = j - 1;
+    }
+    u.resize(rows);
+    v.resize(cols);
+    for(int i = 0; i < rows; i++) u[i] = uu_[i + 1];
+    for(int j = 0; j < cols; j++) v[j] = vv_[j + 1];
+}
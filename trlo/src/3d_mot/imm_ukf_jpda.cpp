@@ -12,6 +12,10 @@
 #include <vector>
 #include <cmath>
 #include <math.h>
+#include <limits>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 #include "3d_mot/ukf.h"
 #include "3d_mot/imm_ukf_jpda.h"
@@ -21,41 +25,7 @@ using namespace Eigen;
 using namespace pcl;
 
 
-bool init_= false;
-double timestamp_ ;
-double egoVelo_;
-double egoYaw_;
-double egoPreYaw_;
-VectorXd preMeas_;
-
-const double gammaG_ = 9.22; // 99%
-const double pG_ = 0.99;
-const double pD_ = 0.9;
-const double distanceThres_ = 99;
-
-const int lifeTimeThres_ = 3;
-
-//bbox update params
-const double bbYawChangeThres_  = 0.2;
-const double bbAreaChangeThres_ = 0.5;
-const double bbVelThres_        = 0.05;
-const double bbDeltaVel_        = 0.01;
-const int    nStepBack_         = 3;
-
-int countIt = 0;
-vector<UKF> targets_;
-vector<int> trackNumVec_;
-
-//testing recover origin tf
-vector<vector<double>> egoPoints_;
-vector<vector<double>> egoDeltaHis_;
-vector<double> egoDiffYaw_;
-
-void getOriginPoints(Eigen::Matrix3f pose){
-    egoYaw_ = pose.eulerAngles(2, 1, 0)(0);
-}
-
-void findMaxZandS(UKF target, VectorXd& maxDetZ, MatrixXd& maxDetS){
+void findMaxZandS(const UKF& target, LidarVec& maxDetZ, LidarMat& maxDetS){
     double cv_det   = target.lS_cv_.determinant();
     double ctrv_det = target.lS_ctrv_.determinant();
     double rm_det   = target.lS_rm_.determinant();
@@ -84,31 +54,41 @@ void findMaxZandS(UKF target, VectorXd& maxDetZ, MatrixXd& maxDetS){
 
 }
 
-void measurementValidation(vector<vector<double>> trackPoints, UKF& target, bool secondInit, VectorXd maxDetZ, MatrixXd maxDetS,
-     vector<VectorXd>& measVec, vector<VectorXd>& bboxVec, vector<int>& matchingVec){
+// Detections that can fall inside the gate diff^T S^-1 diff < gammaG, in ascending
+// index order. The gate ellipse is bounded by |dx| <= sqrt(gammaG*S(0,0)) and
+// |dy| <= sqrt(gammaG*S(1,1)) when S is positive definite; otherwise every
+// detection is a candidate, as in a full scan.
+void MultiObjectTracker::gateCandidates(const LidarVec& maxDetZ, const LidarMat& maxDetS, double detS, vector<int>& candidates) const{
+    candidates.clear();
+    if(detS > 0 && maxDetS(0,0) > 0 && maxDetS(1,1) > 0){
+        // small margin so rounding never drops a detection on the gate border
+        double hx = sqrt(config_.gammaG*maxDetS(0,0))*(1 + 1e-9) + 1e-9;
+        double hy = sqrt(config_.gammaG*maxDetS(1,1))*(1 + 1e-9) + 1e-9;
+        grid_.query(maxDetZ(0) - hx, maxDetZ(0) + hx, maxDetZ(1) - hy, maxDetZ(1) + hy, candidates);
+        return;
+    }
+    int targetSize = measurements_.size();
+    reserveScratch(candidates, targetSize);
+    candidates.resize(targetSize);
+    for(int i = 0; i < targetSize; i++) candidates[i] = i;
+}
+
+void MultiObjectTracker::measurementValidation(const vector<BoxMeasurement>& detections, const vector<int>& candidates, UKF& target,
+     bool secondInit, const LidarVec& maxDetZ, const LidarMat& invS, LidarVecList& measVec, vector<int>& bboxVec, vector<int>& matchingVec){
 
     int count = 0;
     bool secondInitDone = false;
     double smallestNIS = 999;
-    VectorXd smallestMeas = VectorXd(2);
-    int targetSize = trackPoints.size();
-    for(int i = 0; i < targetSize; i++){
-        double x = trackPoints[i][0];
-        double y = trackPoints[i][1];
-        VectorXd meas = VectorXd(2);
-        meas << x, y;
-
-        VectorXd bbox = VectorXd(10);
-        bbox << x, y,
-                trackPoints[i][2], trackPoints[i][3],
-                trackPoints[i][4], trackPoints[i][5],
-                trackPoints[i][6], trackPoints[i][7],
-                trackPoints[i][8], trackPoints[i][9];
-
-        VectorXd diff = meas - maxDetZ;
-        double nis = diff.transpose()*maxDetS.inverse()*diff;
-
-        if(nis < gammaG_){ // x^2 99% range
+    LidarVec smallestMeas = LidarVec::Zero();
+    int candidateSize = candidates.size();
+    for(int c = 0; c < candidateSize; c++){
+        int i = candidates[c];
+        LidarVec meas(detections[i].x, detections[i].y);
+
+        LidarVec diff = meas - maxDetZ;
+        double nis = diff.transpose()*invS*diff;
+
+        if(nis < config_.gammaG){ // x^2 99% range
             count ++;
             if(matchingVec[i] == 0) target.lifetime_ ++;
 
@@ -124,7 +104,7 @@ void measurementValidation(vector<vector<double>> trackPoints, UKF& target, bool
             }
             else{
                 measVec.push_back(meas);
-                bboxVec.push_back(bbox);
+                bboxVec.push_back(i);
                 matchingVec[i] = 1;
             }
         }
@@ -134,88 +114,129 @@ void measurementValidation(vector<vector<double>> trackPoints, UKF& target, bool
 //    cout << "size of bboxVec is " << bboxVec.size() <<endl;
 }
 
-void filterPDA(UKF& target, vector<VectorXd> measVec, vector<double>& lambdaVec){
-    // calculating association probability
-    // UKF one = targets[0];
-    double numMeas = measVec.size();
-    double b = 2*numMeas*(1-pD_*pG_)/(gammaG_*pD_);
-    double eCVSum   = 0;
-    double eCTRVSum = 0;
-    double eRMSum   = 0;
-
-    vector<double> eCvVec;
-    vector<double> eCtrvVec;
-    vector<double> eRmVec;
-
-    vector<VectorXd> diffCVVec;
-    vector<VectorXd> diffCTRVVec;
-    vector<VectorXd> diffRMVec;
+// Gaussian likelihood of every gated measurement under the three motion models,
+// stored as e[3*i] (CV), e[3*i+1] (CTRV), e[3*i+2] (RM).
+void pdaLikelihoods(const UKF& target, const LidarVecList& measVec, double* e){
+    LidarMat invSCV   = target.lS_cv_.inverse();
+    LidarMat invSCTRV = target.lS_ctrv_.inverse();
+    LidarMat invSRM   = target.lS_rm_.inverse();
 
+    int numMeas = measVec.size();
     for(int i = 0; i < numMeas; i++){
-        VectorXd diffCV   = measVec[i] - target.zPredCVl_;
-        VectorXd diffCTRV = measVec[i] - target.zPredCTRVl_;
-        VectorXd diffRM   = measVec[i] - target.zPredRMl_;
+        LidarVec diffCV   = measVec[i] - target.zPredCVl_;
+        LidarVec diffCTRV = measVec[i] - target.zPredCTRVl_;
+        LidarVec diffRM   = measVec[i] - target.zPredRMl_;
 
-        diffCVVec.push_back(diffCV);
-        diffCTRVVec.push_back(diffCTRV);
-        diffRMVec.push_back(diffRM);
-
-        double eCV   = exp(  -0.5*diffCV.transpose()*  target.lS_cv_.inverse()  *diffCV);
-        double eCTRV = exp(-0.5*diffCTRV.transpose()*  target.lS_ctrv_.inverse()*diffCTRV);
-        double eRM   = exp(  -0.5*diffRM.transpose()*  target.lS_rm_.inverse()  *diffRM);
+        e[3*i]   = exp(  -0.5*diffCV.transpose()  *invSCV  *diffCV);
+        e[3*i+1] = exp(-0.5*diffCTRV.transpose()*invSCTRV*diffCTRV);
+        e[3*i+2] = exp(  -0.5*diffRM.transpose()  *invSRM  *diffRM);
+    }
+}
 
-        eCvVec.push_back(eCV);
-        eCtrvVec.push_back(eCTRV);
-        eRmVec.push_back(eRM);
+// Single track PDA weights: beta[3*i+m] for measurement i under model m and the
+// no-detection weights betaZero[m], from the likelihoods e of pdaLikelihoods.
+void pdaWeights(const TrackerConfig& config, int numMeas, const double* e, double* beta, double* betaZero){
+    double b = 2*numMeas*(1-config.pD*config.pG)/(config.gammaG*config.pD);
+    double eCVSum   = 0;
+    double eCTRVSum = 0;
+    double eRMSum   = 0;
+    for(int i = 0; i < numMeas; i++){
+        eCVSum   += e[3*i];
+        eCTRVSum += e[3*i+1];
+        eRMSum   += e[3*i+2];
+    }
+    betaZero[0] = b/(b+eCVSum);
+    betaZero[1] = b/(b+eCTRVSum);
+    betaZero[2] = b/(b+eRMSum);
 
-        eCVSum   += eCV;
-        eCTRVSum += eCTRV;
-        eRMSum   += eRM;
+    // turn the likelihoods into association probabilities
+    for(int i = 0; i < numMeas; i++){
+        beta[3*i]   = e[3*i]/(b+eCVSum);
+        beta[3*i+1] = e[3*i+1]/(b+eCTRVSum);
+        beta[3*i+2] = e[3*i+2]/(b+eRMSum);
     }
-    double betaCVZero   = b/(b+eCVSum);
-    double betaCTRVZero = b/(b+eCTRVSum);
-    double betaRMZero   = b/(b+eRMSum);
+}
 
-    vector<double> betaCV;
-    vector<double> betaCTRV;
-    vector<double> betaRM;
+// Walks every joint event of a cluster: each track takes one of its gated
+// detections or none, and no detection goes to two tracks. An event weighs the
+// product of its likelihoods e, times the track's clutter weight b for each missed
+// track. The weights are summed into beta (per gated pair), miss (per track) and total.
+struct JointEventContext
+{
+    int m;                 // tracks in the cluster
+    const int* off;        // gated pairs of track t are off[t] .. off[t+1]-1
+    const int* det;        // detection of each gated pair
+    const double* e;       // 3 likelihoods per gated pair
+    const double* b;       // clutter weight per track
+    char* used;            // per detection, taken by a track earlier in the event
+    int* assign;           // gated pair chosen by each track, -1 for none
+    double* beta;          // 3 per gated pair
+    double* miss;          // 3 per track
+    double total[3];
+};
+
+void enumerateJointEvents(JointEventContext& c, int t, double wCV, double wCTRV, double wRM){
+    if(t == c.m){
+        c.total[0] += wCV;
+        c.total[1] += wCTRV;
+        c.total[2] += wRM;
+        for(int k = 0; k < c.m; k++){
+            double* acc = c.assign[k] < 0 ? &c.miss[3*k] : &c.beta[3*c.assign[k]];
+            acc[0] += wCV;
+            acc[1] += wCTRV;
+            acc[2] += wRM;
+        }
+        return;
+    }
+    c.assign[t] = -1;
+    enumerateJointEvents(c, t + 1, wCV*c.b[t], wCTRV*c.b[t], wRM*c.b[t]);
+    for(int idx = c.off[t]; idx < c.off[t+1]; idx++){
+        int d = c.det[idx];
+        if(c.used[d]) continue;
+        c.used[d] = 1;
+        c.assign[t] = idx;
+        enumerateJointEvents(c, t + 1, wCV*c.e[3*idx], wCTRV*c.e[3*idx+1], wRM*c.e[3*idx+2]);
+        c.used[d] = 0;
+    }
+}
 
-    // cout << "beta cv" << endl;
+void MultiObjectTracker::filterPDA(UKF& target, const LidarVecList& measVec, const double* e, const double* beta,
+                                   const double* betaZero, vector<double>& lambdaVec){
+    double numMeas = measVec.size();
+    double eCVSum   = 0;
+    double eCTRVSum = 0;
+    double eRMSum   = 0;
     for(int i = 0; i < numMeas; i++){
-        double tempCV   = eCvVec[i]/(b+eCVSum);
-        double tempCTRV = eCtrvVec[i]/(b+eCTRVSum);
-        double tempRM   = eRmVec[i]/(b+eRMSum);
-        // cout << tempCV << endl;
-        betaCV.push_back(tempCV);
-        betaCTRV.push_back(tempCTRV);
-        betaRM.push_back(tempRM);
-
-    }
-    VectorXd sigmaXcv;
-    VectorXd sigmaXctrv;
-    VectorXd sigmaXrm;
-    sigmaXcv.setZero(2);
-    sigmaXctrv.setZero(2);
-    sigmaXrm.setZero(2);
+        eCVSum   += e[3*i];
+        eCTRVSum += e[3*i+1];
+        eRMSum   += e[3*i+2];
+    }
+    double betaCVZero   = betaZero[0];
+    double betaCTRVZero = betaZero[1];
+    double betaRMZero   = betaZero[2];
+    const double* eVec = beta;
+
+    LidarVec sigmaXcv   = LidarVec::Zero();
+    LidarVec sigmaXctrv = LidarVec::Zero();
+    LidarVec sigmaXrm   = LidarVec::Zero();
 
     for(int i = 0; i < numMeas; i++){
-        sigmaXcv   += betaCV[i]*diffCVVec[i];
-        sigmaXctrv += betaCTRV[i]*diffCTRVVec[i];
-        sigmaXrm   += betaRM[i]*diffRMVec[i];
+        sigmaXcv   += eVec[3*i]  *(measVec[i] - target.zPredCVl_);
+        sigmaXctrv += eVec[3*i+1]*(measVec[i] - target.zPredCTRVl_);
+        sigmaXrm   += eVec[3*i+2]*(measVec[i] - target.zPredRMl_);
     }
 
-    MatrixXd sigmaPcv;
-    MatrixXd sigmaPctrv;
-    MatrixXd sigmaPrm;
-    sigmaPcv.setZero(2,2);
-    sigmaPctrv.setZero(2,2);
-    sigmaPrm.setZero(2,2);
+    LidarMat sigmaPcv   = LidarMat::Zero();
+    LidarMat sigmaPctrv = LidarMat::Zero();
+    LidarMat sigmaPrm   = LidarMat::Zero();
     for(int i = 0; i < numMeas; i++){
-        sigmaPcv   += (betaCV[i]  *diffCVVec[i]  *diffCVVec[i].transpose()     - sigmaXcv*sigmaXcv.transpose());
-        sigmaPctrv += (betaCTRV[i]*diffCTRVVec[i]*diffCTRVVec[i].transpose()   - sigmaXctrv*sigmaXctrv.transpose());
-        sigmaPrm   += (betaRM[i]  *diffRMVec[i]  *diffRMVec[i].transpose()     - sigmaXrm*sigmaXrm.transpose());
+        LidarVec diffCV   = measVec[i] - target.zPredCVl_;
+        LidarVec diffCTRV = measVec[i] - target.zPredCTRVl_;
+        LidarVec diffRM   = measVec[i] - target.zPredRMl_;
+        sigmaPcv   += (eVec[3*i]  *diffCV  *diffCV.transpose()     - sigmaXcv*sigmaXcv.transpose());
+        sigmaPctrv += (eVec[3*i+1]*diffCTRV*diffCTRV.transpose()   - sigmaXctrv*sigmaXctrv.transpose());
+        sigmaPrm   += (eVec[3*i+2]*diffRM  *diffRM.transpose()     - sigmaXrm*sigmaXrm.transpose());
     }
-
     // update x and P
     target.x_cv_   = target.x_cv_   + target.K_cv_*sigmaXcv;
     target.x_ctrv_ = target.x_ctrv_ + target.K_ctrv_*sigmaXctrv;
@@ -245,25 +266,25 @@ void filterPDA(UKF& target, vector<VectorXd> measVec, vector<double>& lambdaVec)
     }
     // cout << "after update p cv: "<<endl << target.P_cv_ << endl;
 
-    VectorXd maxDetZ;
-    MatrixXd maxDetS;
+    LidarVec maxDetZ;
+    LidarMat maxDetS;
     // cout << endl<<"filterPDA" << endl;
     findMaxZandS(target, maxDetZ, maxDetS);
-    double Vk =  M_PI *sqrt(gammaG_ * maxDetS.determinant());
+    double Vk =  M_PI *sqrt(config_.gammaG * maxDetS.determinant());
 
     double lambdaCV, lambdaCTRV, lambdaRM;
     if(numMeas != 0){
-    	lambdaCV   = (1 - pG_*pD_)/pow(Vk, numMeas) +
-	                        pD_*pow(Vk, 1-numMeas)*eCVSum/(numMeas*sqrt(2*M_PI*target.lS_cv_.determinant()));
-	    lambdaCTRV = (1 - pG_*pD_)/pow(Vk, numMeas) +
-	                        pD_*pow(Vk, 1-numMeas)*eCTRVSum/(numMeas*sqrt(2*M_PI*target.lS_ctrv_.determinant()));
-	    lambdaRM   = (1 - pG_*pD_)/pow(Vk, numMeas) +
-	                        pD_*pow(Vk, 1-numMeas)*eRMSum/(numMeas*sqrt(2*M_PI*target.lS_rm_.determinant()));
+    	lambdaCV   = (1 - config_.pG*config_.pD)/pow(Vk, numMeas) +
+	                        config_.pD*pow(Vk, 1-numMeas)*eCVSum/(numMeas*sqrt(2*M_PI*target.lS_cv_.determinant()));
+	    lambdaCTRV = (1 - config_.pG*config_.pD)/pow(Vk, numMeas) +
+	                        config_.pD*pow(Vk, 1-numMeas)*eCTRVSum/(numMeas*sqrt(2*M_PI*target.lS_ctrv_.determinant()));
+	    lambdaRM   = (1 - config_.pG*config_.pD)/pow(Vk, numMeas) +
+	                        config_.pD*pow(Vk, 1-numMeas)*eRMSum/(numMeas*sqrt(2*M_PI*target.lS_rm_.determinant()));
     }
     else{
-    	lambdaCV   = (1 - pG_*pD_)/pow(Vk, numMeas);
-	    lambdaCTRV = (1 - pG_*pD_)/pow(Vk, numMeas);
-	    lambdaRM   = (1 - pG_*pD_)/pow(Vk, numMeas);
+    	lambdaCV   = (1 - config_.pG*config_.pD)/pow(Vk, numMeas);
+	    lambdaCTRV = (1 - config_.pG*config_.pD)/pow(Vk, numMeas);
+	    lambdaRM   = (1 - config_.pG*config_.pD)/pow(Vk, numMeas);
     }
     // cout <<endl<< "lambda: "<<endl<<lambdaCV << " "<< lambdaCTRV<<" "<< lambdaRM << endl;
     lambdaVec.push_back(lambdaCV);
@@ -271,26 +292,254 @@ void filterPDA(UKF& target, vector<VectorXd> measVec, vector<double>& lambdaVec)
     lambdaVec.push_back(lambdaRM);
 }
 
-void getNearestEuclidBBox(UKF target, vector<VectorXd> bboxVec, vector<double>& Bbox, int& minDist){
-    int minInd = 0;
+int findClusterRoot(vector<int>& parent, int x){
+    while(parent[x] != x){
+        parent[x] = parent[parent[x]];
+        x = parent[x];
+    }
+    return x;
+}
+
+void MultiObjectTracker::clusterGates(){
+    // union-find on shared gated detections, tracks come first, detections after
+    int P = pdaTracks_.size();
+    int D = measurements_.size();
+    reserveScratch(ufParent_, P + D);
+    ufParent_.resize(P + D);
+    for(int i = 0; i < P + D; i++) ufParent_[i] = i;
+    for(int p = 0; p < P; p++){
+        for(int idx = gateStart_[p]; idx < gateStart_[p+1]; idx++){
+            int a = findClusterRoot(ufParent_, p);
+            int b = findClusterRoot(ufParent_, P + gateDet_[idx]);
+            if(a != b) ufParent_[max(a, b)] = min(a, b);
+        }
+    }
+
+    // clusters numbered by their first track, tracks keep the live order inside
+    reserveScratch(clusterId_, P + D);
+    clusterId_.assign(P + D, -1);
+    reserveScratch(trackCluster_, P);
+    trackCluster_.resize(P);
+    int clusters = 0;
+    for(int p = 0; p < P; p++){
+        int r = findClusterRoot(ufParent_, p);
+        if(clusterId_[r] < 0) clusterId_[r] = clusters++;
+        trackCluster_[p] = clusterId_[r];
+    }
+    reserveScratch(clusterStart_, clusters + 1);
+    clusterStart_.assign(clusters + 1, 0);
+    for(int p = 0; p < P; p++) clusterStart_[trackCluster_[p] + 1]++;
+    for(int c = 0; c < clusters; c++) clusterStart_[c + 1] += clusterStart_[c];
+    reserveScratch(clusterTracks_, P);
+    clusterTracks_.resize(P);
+    // clusterId_ is no longer needed and serves as the write cursor of each cluster
+    for(int c = 0; c < clusters; c++) clusterId_[c] = clusterStart_[c];
+    for(int p = 0; p < P; p++) clusterTracks_[clusterId_[trackCluster_[p]]++] = p;
+}
+
+void MultiObjectTracker::updateCluster(int cluster, ClusterScratch& s){
+    int first = clusterStart_[cluster];
+    int m = clusterStart_[cluster + 1] - first;
+
+    // gated pairs of the cluster, track after track
+    reserveScratch(s.off, m + 1);
+    s.off.resize(m + 1);
+    s.off[0] = 0;
+    for(int t = 0; t < m; t++){
+        int p = clusterTracks_[first + t];
+        s.off[t + 1] = s.off[t] + gateStart_[p + 1] - gateStart_[p];
+    }
+    int pairs = s.off[m];
+    reserveScratch(s.det, pairs);
+    s.det.resize(pairs);
+    reserveScratch(s.e, 3*pairs);
+    s.e.resize(3*pairs);
+    reserveScratch(s.beta, 3*pairs);
+    s.beta.assign(3*pairs, 0);
+    reserveScratch(s.miss, 3*m);
+    s.miss.assign(3*m, 0);
+    reserveScratch(s.b, m);
+    s.b.resize(m);
+    reserveScratch(s.assign, m);
+    s.assign.resize(m);
+
+    double events = 1;
+    for(int t = 0; t < m; t++){
+        int p = clusterTracks_[first + t];
+        int numMeas = s.off[t + 1] - s.off[t];
+        s.meas.clear();
+        for(int k = 0; k < numMeas; k++){
+            int d = gateDet_[gateStart_[p] + k];
+            s.det[s.off[t] + k] = d;
+            s.meas.push_back(LidarVec(measurements_[d].x, measurements_[d].y));
+        }
+        pdaLikelihoods(targets_[pdaTracks_[p]], s.meas, s.e.data() + 3*s.off[t]);
+        s.b[t] = 2*numMeas*(1-config_.pD*config_.pG)/(config_.gammaG*config_.pD);
+        events *= numMeas + 1;
+    }
+
+    if(config_.association == ASSOC_GNN){
+        this->assignCluster(cluster, s);
+        return;
+    }
+
+    // joint association when the tracks compete for detections and the event
+    // count stays under the cap, independent PDA per track otherwise
+    bool joint = m > 1 && events <= config_.jpdaMaxHypotheses;
+    if(joint){
+        if(s.used.size() < measurements_.size()) s.used.resize(measurements_.size(), 0);
+        JointEventContext c;
+        c.m      = m;
+        c.off    = s.off.data();
+        c.det    = s.det.data();
+        c.e      = s.e.data();
+        c.b      = s.b.data();
+        c.used   = s.used.data();
+        c.assign = s.assign.data();
+        c.beta   = s.beta.data();
+        c.miss   = s.miss.data();
+        c.total[0] = c.total[1] = c.total[2] = 0;
+        enumerateJointEvents(c, 0, 1, 1, 1);
+        if(c.total[0] > 0 && c.total[1] > 0 && c.total[2] > 0){
+            for(int idx = 0; idx < 3*pairs; idx++) s.beta[idx] /= c.total[idx % 3];
+            for(int idx = 0; idx < 3*m; idx++)     s.miss[idx] /= c.total[idx % 3];
+        }
+        else{
+            // every event underflowed, the per track weights are still usable
+            joint = false;
+        }
+    }
+
+    for(int t = 0; t < m; t++){
+        UKF& target = targets_[pdaTracks_[clusterTracks_[first + t]]];
+        int numMeas = s.off[t + 1] - s.off[t];
+        const double* e = s.e.data() + 3*s.off[t];
+        double* beta = s.beta.data() + 3*s.off[t];
+        double betaZero[3];
+        if(joint){
+            betaZero[0] = s.miss[3*t];
+            betaZero[1] = s.miss[3*t+1];
+            betaZero[2] = s.miss[3*t+2];
+        }
+        else{
+            pdaWeights(config_, numMeas, e, beta, betaZero);
+        }
+
+        s.meas.clear();
+        for(int idx = s.off[t]; idx < s.off[t + 1]; idx++){
+            s.meas.push_back(LidarVec(measurements_[s.det[idx]].x, measurements_[s.det[idx]].y));
+        }
+        s.lambda.clear();
+        filterPDA(target, s.meas, e, beta, betaZero, s.lambda);
+        // cout << "PostIMMUKF" << endl;
+        target.PostProcessIMMUKF(s.lambda);
+        // TODO: might be wrong
+        double targetVelo = target.x_merge_(2);
+        target.velo_history_.push_back(targetVelo);
+    }
+}
+
+// Global nearest neighbour: the cluster's tracks and gated detections form a cost
+// matrix of gate NIS values, each track also has a private miss column at gammaG,
+// so a gated detection is always taken unless another track needs it more. The
+// Hungarian solve starts from the row potentials the tracks ended the last frame
+// with. Each track then updates with its single detection, or none.
+void MultiObjectTracker::assignCluster(int cluster, ClusterScratch& s){
+    const double INF = numeric_limits<double>::infinity();
+    int first = clusterStart_[cluster];
+    int m = clusterStart_[cluster + 1] - first;
+
+    if(s.column.size() < measurements_.size()) s.column.resize(measurements_.size(), -1);
+    s.cols.clear();
+    for(int idx = 0; idx < s.off[m]; idx++){
+        int d = s.det[idx];
+        if(s.column[d] < 0){
+            s.column[d] = s.cols.size();
+            s.cols.push_back(d);
+        }
+    }
+    int n = s.cols.size();
+    int C = n + m;
+    reserveScratch(s.cost, m*C);
+    s.cost.assign(m*C, INF);
+    for(int t = 0; t < m; t++){
+        const UKF& target = targets_[pdaTracks_[clusterTracks_[first + t]]];
+        // same metric as the gate
+        LidarVec maxDetZ;
+        LidarMat maxDetS;
+        findMaxZandS(target, maxDetZ, maxDetS);
+        LidarMat invS = (maxDetS*4).inverse();
+        for(int idx = s.off[t]; idx < s.off[t + 1]; idx++){
+            int d = s.det[idx];
+            LidarVec diff = LidarVec(measurements_[d].x, measurements_[d].y) - maxDetZ;
+            s.cost[t*C + s.column[d]] = diff.transpose()*invS*diff;
+        }
+        s.cost[t*C + n + t] = config_.gammaG;
+    }
+
+    // warm start from last frame's row potentials. Columns may stay unassigned, so
+    // their potentials start at 0 and each row potential is capped by its row minimum.
+    reserveScratch(s.u, m);
+    s.u.resize(m);
+    reserveScratch(s.v, C);
+    s.v.assign(C, 0);
+    for(int t = 0; t < m; t++){
+        s.u[t] = gnn_duals_[pdaTracks_[clusterTracks_[first + t]]];
+        for(int j = 0; j < C; j++) s.u[t] = min(s.u[t], s.cost[t*C + j]);
+    }
+    s.hungarian.solve(s.cost, m, C, s.u, s.v, s.rowCol);
+
+    for(int t = 0; t < m; t++){
+        int p = clusterTracks_[first + t];
+        UKF& target = targets_[pdaTracks_[p]];
+        gnn_duals_[pdaTracks_[p]] = s.u[t];
+
+        int pair = -1;
+        if(s.rowCol[t] >= 0 && s.rowCol[t] < n){
+            for(int idx = s.off[t]; idx < s.off[t + 1]; idx++){
+                if(s.det[idx] == s.cols[s.rowCol[t]]) pair = idx;
+            }
+        }
+
+        // bounding box association and validation with the assigned detection only
+        s.bbox.clear();
+        if(pair >= 0) s.bbox.push_back(s.det[pair]);
+        associateBB(gatedTrackNum_[p], measurements_, s.bbox, target);
+        updateBB(target);
+
+        s.meas.clear();
+        if(pair >= 0) s.meas.push_back(LidarVec(measurements_[s.det[pair]].x, measurements_[s.det[pair]].y));
+        const double one[3]  = {1, 1, 1};
+        const double zero[3] = {0, 0, 0};
+        const double* e = pair >= 0 ? s.e.data() + 3*pair : s.e.data();
+        s.lambda.clear();
+        filterPDA(target, s.meas, e, one, zero, s.lambda);
+        target.PostProcessIMMUKF(s.lambda);
+        // TODO: might be wrong
+        double targetVelo = target.x_merge_(2);
+        target.velo_history_.push_back(targetVelo);
+    }
+
+    for(int j = 0; j < n; j++) s.column[s.cols[j]] = -1;
+}
+
+int getNearestEuclidBBox(const UKF& target, const vector<BoxMeasurement>& detections, const vector<int>& bboxVec, int& minDist){
+    int minInd = bboxVec[0];
     double px = target.x_merge_(0);
     double py = target.x_merge_(1);
-    for (int i = 0; i < bboxVec.size(); i++){
-        double measX = bboxVec[i](0);
-        double measY = bboxVec[i](1);
+    for (size_t i = 0; i < bboxVec.size(); i++){
+        double measX = detections[bboxVec[i]].x;
+        double measY = detections[bboxVec[i]].y;
         double dist = sqrt((px-measX)*(px-measX)+(py-measY)*(py-measY));
         if(dist < minDist){
             minDist = dist;
-            minInd = i;
+            minInd = bboxVec[i];
         }
     }
-    assert(bboxVec[minInd].rows() == 10);
-    for(int i = 0; i < 10; i++){
-        Bbox.push_back(bboxVec[minInd](i));
-    }
+    return minInd;
 }
 
-void associateBB(int trackNum, vector<VectorXd> bboxVec, UKF& target){
+void MultiObjectTracker::associateBB(int trackNum, const vector<BoxMeasurement>& detections, const vector<int>& bboxVec, UKF& target){
     //skip if no validated measurement
 
     // cout <<"bboxVec.size() is " << bboxVec.size() <<endl;
@@ -301,77 +550,40 @@ void associateBB(int trackNum, vector<VectorXd> bboxVec, UKF& target){
     }
 
 
-    if(trackNum == 5 && target.lifetime_ > lifeTimeThres_){
-        vector<double> nearestBbox;
+    if(trackNum == 5 && target.lifetime_ > config_.lifeTimeThres){
         int minDist = 999;
-        getNearestEuclidBBox(target, bboxVec, nearestBbox, minDist);
-        if(minDist < distanceThres_){
-            PointCloud<PointXYZ> bbox;
-            PointXYZ o;
+        int nearest = getNearestEuclidBBox(target, detections, bboxVec, minDist);
+        if(minDist < config_.distanceThres){
             // transformTargetAnchorTF2Local(target.local2local_, target.local2localYawVec_, nearestBbox);
-            assert(nearestBbox.size() == 10);
-            for(int i = 0; i < 2; i++){
-                double height;
-                if(i == 0) {height = -1.73;}
-                else       {height = 0;}
-                o.x = nearestBbox[2];
-                o.y = nearestBbox[3];
-                o.z = height;
-                bbox.push_back(o);
-                o.x = nearestBbox[4];
-                o.y = nearestBbox[5];
-                o.z = height;
-                bbox.push_back(o);
-                o.x = nearestBbox[6];
-                o.y = nearestBbox[7];
-                o.z = height;
-                bbox.push_back(o);
-                o.x = nearestBbox[8];
-                o.y = nearestBbox[9];
-                o.z = height;
-                bbox.push_back(o);
-            }
             target.isVisBB_ = true;
-            target.BBox_    = bbox;
+            target.BBox_    = detections[nearest].footprint;
         }
     }
 }
 
-VectorXd getCpFromBbox(PointCloud<PointXYZ> bBox){
-    PointXYZ p1 = bBox[0];
-    PointXYZ p2 = bBox[1];
-    PointXYZ p3 = bBox[2];
-    PointXYZ p4 = bBox[3];
-
-    double cx = (p1.x + p2.x) / 2;
-    double cy = (p1.y + p4.y) / 2;
-
-    VectorXd cp(2);
-    cp << cx, cy;
-    return cp;
+LidarVec getCpFromBbox(const BoxFootprint& bBox){
+    double cx = (bBox.x[0] + bBox.x[1]) / 2;
+    double cy = (bBox.y[0] + bBox.y[3]) / 2;
+    return LidarVec(cx, cy);
 }
 
-double getBboxArea(PointCloud<PointXYZ> bBox){
-    PointXYZ p1 = bBox[0];
-    PointXYZ p2 = bBox[1];
-    PointXYZ p3 = bBox[2];
-    PointXYZ p4 = bBox[3];
-
+double getBboxArea(const BoxFootprint& bBox){
     //S=tri(p1,p2,p3) + tri(p1, p3, p4)
     //s(triangle) = 1/2*|(x1−x3)(y2−y3)−(x2−x3)(y1−y3)|
-    double tri1 = 0.5*abs((p1.x - p3.x)*(p2.y - p3.y) - (p2.x - p3.x)*(p1.y - p3.y));
-    double tri2 = 0.5*abs((p1.x - p4.x)*(p3.y - p4.y) - (p3.x - p4.x)*(p1.y - p4.y));
+    const float* x = bBox.x;
+    const float* y = bBox.y;
+    double tri1 = 0.5*abs((x[0] - x[2])*(y[1] - y[2]) - (x[1] - x[2])*(y[0] - y[2]));
+    double tri2 = 0.5*abs((x[0] - x[3])*(y[2] - y[3]) - (x[2] - x[3])*(y[0] - y[3]));
     double S = tri1 + tri2;
     return S;
 }
 
-void updateVisBoxArea(UKF& target, VectorXd dtCP){
-    int lastInd = target.bb_yaw_history_.size()-1;
+void updateVisBoxArea(UKF& target, const LidarVec& dtCP){
     // double diffYaw = target.bb_yaw_history_[lastInd] - target.bb_yaw_history_[lastInd-1];
     double area = getBboxArea(target.bestBBox_);
-    for(int i = 0; i < target.BBox_.size(); i++){
-        target.BBox_[i].x = target.bestBBox_[i].x + dtCP(0);
-        target.BBox_[i].y = target.bestBBox_[i].y + dtCP(1);
+    for(int i = 0; i < 4; i++){
+        target.BBox_.x[i] = target.bestBBox_.x[i] + dtCP(0);
+        target.BBox_.y[i] = target.bestBBox_.y[i] + dtCP(1);
     }
 
     double postArea = getBboxArea(target.BBox_);
@@ -379,44 +591,35 @@ void updateVisBoxArea(UKF& target, VectorXd dtCP){
 
 }
 
-void updateBoxYaw(UKF& target, VectorXd cp, double bestDiffYaw, bool isVis){
+void updateBoxYaw(UKF& target, const LidarVec& cp, double bestDiffYaw, bool isVis){
 
     // cout << "before convert "<< target.BBox_[0].x << " "<<target.BBox_[0].y<<endl;
-    for(int i = 0; i < target.BBox_.size(); i++){
-        if(isVis){
-            // rotate around cp
-            double preX = target.BBox_[i].x;
-            double preY = target.BBox_[i].y;
-            target.BBox_[i].x = cos(bestDiffYaw)*(preX - cp(0)) - sin(bestDiffYaw)*(preY - cp(1)) + cp(0);
-            target.BBox_[i].y = sin(bestDiffYaw)*(preX - cp(0)) + cos(bestDiffYaw)*(preY - cp(1)) + cp(1);
-        }
-        else{
-            // rotate around cp
-            double preX = target.bestBBox_[i].x;
-            double preY = target.bestBBox_[i].y;
-            target.bestBBox_[i].x = cos(bestDiffYaw)*(preX - cp(0)) - sin(bestDiffYaw)*(preY - cp(1)) + cp(0);
-            target.bestBBox_[i].y = sin(bestDiffYaw)*(preX - cp(0)) + cos(bestDiffYaw)*(preY - cp(1)) + cp(1);
-        }
+    BoxFootprint& box = isVis ? target.BBox_ : target.bestBBox_;
+    for(int i = 0; i < 4; i++){
+        // rotate around cp
+        double preX = box.x[i];
+        double preY = box.y[i];
+        box.x[i] = cos(bestDiffYaw)*(preX - cp(0)) - sin(bestDiffYaw)*(preY - cp(1)) + cp(0);
+        box.y[i] = sin(bestDiffYaw)*(preX - cp(0)) + cos(bestDiffYaw)*(preY - cp(1)) + cp(1);
     }
     // cout << "after convert "<< target.BBox_[0].x << " "<<target.BBox_[0].y<<endl;
 }
 
 
-double getBBoxYaw(UKF target){
-    PointCloud<PointXYZ> bBox = target.BBox_;
-    PointXYZ p1 = bBox[0];
-    PointXYZ p2 = bBox[1];
-    PointXYZ p3 = bBox[2];
-    double dist1 = sqrt((p1.x- p2.x)*(p1.x - p2.x) + (p1.y - p2.y)*(p1.y - p2.y));
-    double dist2 = sqrt((p3.x- p2.x)*(p3.x - p2.x) + (p3.y - p2.y)*(p3.y - p2.y));
+double getBBoxYaw(const UKF& target){
+    const BoxFootprint& bBox = target.BBox_;
+    const float* x = bBox.x;
+    const float* y = bBox.y;
+    double dist1 = sqrt((x[0]- x[1])*(x[0] - x[1]) + (y[0] - y[1])*(y[0] - y[1]));
+    double dist2 = sqrt((x[2]- x[1])*(x[2] - x[1]) + (y[2] - y[1])*(y[2] - y[1]));
 
     double yaw;
     // dist1 is length
     if(dist1>dist2){
-        yaw = atan2(p1.y - p2.y, p1.x - p2.x);
+        yaw = atan2(y[0] - y[1], x[0] - x[1]);
     }
     else{
-        yaw = atan2(p3.y - p2.y, p3.x - p2.x);
+        yaw = atan2(y[2] - y[1], x[2] - x[1]);
     }
 
     double ukfYaw  = target.x_merge_(3);
@@ -432,22 +635,23 @@ double getBBoxYaw(UKF target){
     }
 }
 
-void updateBB(UKF& target){
+void MultiObjectTracker::updateBB(UKF& target){
     // skip to prevent memory leak by accessing empty target.bbox_
     if(!target.isVisBB_){
         return;
     }
     // skip the rest of process if the first bbox associaiton
-    if(target.bestBBox_.empty()){
+    if(!target.hasBestBBox_){
         target.bestBBox_ = target.BBox_;
+        target.hasBestBBox_ = true;
         target.bestYaw_  = getBBoxYaw(target);
         return;
     }
 
     // calculate yaw
-    VectorXd cp         = getCpFromBbox(target.BBox_);
-    VectorXd bestCP     = getCpFromBbox(target.bestBBox_);
-    VectorXd dtCP       = cp - bestCP;
+    LidarVec cp         = getCpFromBbox(target.BBox_);
+    LidarVec bestCP     = getCpFromBbox(target.bestBBox_);
+    LidarVec dtCP       = cp - bestCP;
     double yaw = getBBoxYaw(target);
 
     // bbox area
@@ -473,18 +677,16 @@ void updateBB(UKF& target){
     double DiffYaw = yaw - currentYaw;
 
     //when the diff yaw is out of range, keep the previous yaw
-    if(abs(DiffYaw) > bbYawChangeThres_){
+    if(abs(DiffYaw) > config_.bbYawChangeThres){
         // updateVisBoxYaw(target, cp, bestDiffYaw);
     }
     //when the diff is acceptable, update best yaw
-    else if(abs(DiffYaw) < bbYawChangeThres_){
+    else if(abs(DiffYaw) < config_.bbYawChangeThres){
         bool isVis = true;
         updateBoxYaw(target, cp, DiffYaw, isVis);
         isVis = false;
         updateBoxYaw(target, cp, DiffYaw, isVis);
 
-        double afterYaw  = getBBoxYaw(target);
-        // cout << "box yaw after "<< afterYaw<<endl;
         // assert(abs(yaw -getBBoxYaw(target)) < 0.01 );
         target.bestYaw_  = yaw;
     }
@@ -499,24 +701,47 @@ double getIntersectCoef(double vec1x, double vec1y, double vec2x,double vec2y,
 
 }
 
-void mergeOverSegmentation(vector<UKF> targets){
+void MultiObjectTracker::mergeOverSegmentation(){
     // cout << "mergeOverSegmentation"<<endl;
-    int targetSize = targets.size();
-    for(int i = 0; i < targetSize; i++){
+    TrackPool& targets = targets_;
+    const vector<int>& live = targets.live();
+    int targetSize = live.size();
+
+    // a merged center lies inside the box footprint, so only tracks in the
+    // footprint's bounding rectangle need the triangle tests
+    reserveScratch(trackX_, targetSize);
+    trackX_.resize(targetSize);
+    reserveScratch(trackY_, targetSize);
+    trackY_.resize(targetSize);
+    for(int lj = 0; lj < targetSize; lj++){
+        trackX_[lj] = targets[live[lj]].x_merge_(0);
+        trackY_[lj] = targets[live[lj]].x_merge_(1);
+    }
+    trackGrid_.build(trackX_, trackY_, config_.gateCellSize);
+    vector<int>& candidates = candScratch_;
+
+    for(int li = 0; li < targetSize; li++){
+        int i = live[li];
         if(targets[i].isVisBB_ == true){
-            double vec1x = targets[i].BBox_[0].x;
-            double vec1y = targets[i].BBox_[0].y;
-            double vec2x = targets[i].BBox_[1].x;
-            double vec2y = targets[i].BBox_[1].y;
-            double vec3x = targets[i].BBox_[2].x;
-            double vec3y = targets[i].BBox_[2].y;
-            double vec4x = targets[i].BBox_[3].x;
-            double vec4y = targets[i].BBox_[3].y;
+            const BoxFootprint& box = targets[i].BBox_;
+            double vec1x = box.x[0];
+            double vec1y = box.y[0];
+            double vec2x = box.x[1];
+            double vec2y = box.y[1];
+            double vec3x = box.x[2];
+            double vec3y = box.y[2];
+            double vec4x = box.x[3];
+            double vec4y = box.y[3];
             double cp1x  = (vec1x+vec2x+vec3x)/3;
             double cp1y  = (vec1y+vec2y+vec3y)/3;
             double cp2x  = (vec1x+vec4x+vec3x)/3;
             double cp2y  = (vec1y+vec4y+vec3y)/3;
-            for (int j = 0; j < targetSize; j++){
+            candidates.clear();
+            trackGrid_.query(min(min(vec1x, vec2x), min(vec3x, vec4x)), max(max(vec1x, vec2x), max(vec3x, vec4x)),
+                             min(min(vec1y, vec2y), min(vec3y, vec4y)), max(max(vec1y, vec2y), max(vec3y, vec4y)), candidates);
+            int candidateSize = candidates.size();
+            for (int c = 0; c < candidateSize; c++){
+                int j = live[candidates[c]];
                 if(i == j) continue;
                 double px = targets[j].x_merge_(0);
                 double py = targets[j].x_merge_(1);
@@ -528,8 +753,8 @@ void mergeOverSegmentation(vector<UKF> targets){
                 double cross6 = getIntersectCoef(vec3x, vec3y, vec4x, vec4y, px, py, cp2x, cp2y);
                 if((cross1 > 0 && cross2>0&&cross3>0)||(cross4>0 && cross5 > 0 && cross6>0)){
                     // cout << "merrrrrrrrrrrrrrrrrrrrrrrrrrrrrrrrrrrrrrrge"<<endl;
-                    trackNumVec_[i] = 5;
-                    trackNumVec_[j] = 0;
+                    targets.trackNum(i) = 5;
+                    targets.trackNum(j) = 0;
                 }
             }
         }
@@ -537,94 +762,114 @@ void mergeOverSegmentation(vector<UKF> targets){
 }
 
 
-void immUkfJpdaf(vector<PointCloud<PointXYZ>> bBoxes, double timestamp,
-                     PointCloud<PointXYZ>& targetPoints, vector<vector<double>>& targetVandYaw,
-                     vector<int>& trackManage, vector<bool>& isStaticVec,
-                     vector<bool>& isVisVec, vector<PointCloud<PointXYZ>>& visBBs){
+MultiObjectTracker::MultiObjectTracker(const TrackerConfig& config) : config_(config){
+    this->reset();
+}
 
-    countIt ++;
+void MultiObjectTracker::reset(){
+    targets_.clear();
+    track_ids_.clear();
+    gnn_duals_.clear();
+    tracks_.clear();
+    next_id_    = 0;
+    init_       = false;
+    timestamp_  = 0;
+    egoVelo_    = 0;
+    egoYaw_     = 0;
+    egoPreYaw_  = 0;
+    egoPrePos_.setZero();
+}
 
-	// convert from bboxes to cx,cy
-    vector<vector<double>> trackPoints;
-    for(int i = 0; i < bBoxes.size(); i ++){
-        PointXYZ p1 = bBoxes[i][0];
-        PointXYZ p2 = bBoxes[i][1];
-        PointXYZ p3 = bBoxes[i][2];
-        PointXYZ p4 = bBoxes[i][3];
+int MultiObjectTracker::addTrack(const LidarVec& meas, double timestamp){
+    int slot = targets_.allocate(meas, timestamp);
+    if(slot >= int(track_ids_.size())) {
+        track_ids_.resize(slot + 1);
+        gnn_duals_.resize(slot + 1);
+    }
+    track_ids_[slot] = next_id_++;
+    gnn_duals_[slot] = 0;
+    return slot;
+}
 
-        VectorXd cp = getCpFromBbox(bBoxes[i]);
+const std::vector<TrackedObject>& MultiObjectTracker::step(const vector<OrientedBox>& bBoxes, double timestamp,
+                                                           const Eigen::Matrix4f& ego_pose){
 
-        // cout << "trackpoitns "<< cp(0) <<" "<<cp(1)<< endl;
-        vector<double> point;
-        point.push_back(cp(0));
-        point.push_back(cp(1));
-        point.push_back(p1.x);
-        point.push_back(p1.y);
-        point.push_back(p2.x);
-        point.push_back(p2.y);
-        point.push_back(p3.x);
-        point.push_back(p3.y);
-        point.push_back(p4.x);
-        point.push_back(p4.y);
+    tracks_.clear();
 
-        trackPoints.push_back(point);
+    // ego yaw and speed, only used for the per track local2local history
+    Eigen::Vector3f egoPos = ego_pose.block<3,1>(0,3);
+    egoYaw_ = atan2(ego_pose(1,0), ego_pose(0,0));
+    if(init_ && timestamp > timestamp_){
+        egoVelo_ = (egoPos - egoPrePos_).head<2>().norm()/(timestamp - timestamp_);
+    }
+    egoPrePos_ = egoPos;
+
+	// convert from bboxes to cx,cy and footprint, once per frame
+    vector<BoxMeasurement>& trackPoints = measurements_;
+    trackPoints.resize(bBoxes.size());
+    centerX_.resize(bBoxes.size());
+    centerY_.resize(bBoxes.size());
+    for(size_t i = 0; i < bBoxes.size(); i ++){
+        trackPoints[i].x         = centerX_[i] = bBoxes[i].x;
+        trackPoints[i].y         = centerY_[i] = bBoxes[i].y;
+        trackPoints[i].footprint = bBoxes[i].footprint();
     }
-
-    // cout << trackPoints[0][0] << endl;
 
     if(!init_) {
         // cout << trackPoints.size()<< endl;
         int targetSize = trackPoints.size();
     	for(int i = 0; i < targetSize; i++){
-                double px = trackPoints[i][0];
-                double py = trackPoints[i][1];
-
-                PointXYZ o;
-                o.x = px;
-                o.y = py;
-                o.z = -1.73/2;
-                targetPoints.push_back(o);
-
-                vector<double> VandYaw;
-                VandYaw.push_back(0);
-                VandYaw.push_back(0);
-                targetVandYaw.push_back(VandYaw);
-                isStaticVec.push_back(false);
-                isVisVec.push_back(false);
-
-	    		VectorXd initMeas = VectorXd(2);
-	    		initMeas << px, py;
-
-                UKF ukf;
-                ukf.Initialize(initMeas, timestamp);
-                targets_.push_back(ukf);
-                //initialize trackNumVec
-                trackNumVec_.push_back(1);
+	    		LidarVec initMeas(trackPoints[i].x, trackPoints[i].y);
+
+                int slot = this->addTrack(initMeas, timestamp);
+
+                TrackedObject track;
+                track.id        = track_ids_[slot];
+                track.trackNum  = targets_.trackNum(slot);
+                track.state     = targets_.state(slot);
+                track.x         = trackPoints[i].x;
+                track.y         = trackPoints[i].y;
+                track.v         = 0;
+                track.yaw       = 0;
+                track.isStatic  = false;
+                track.isVisible = false;
+                tracks_.push_back(track);
     	}
         timestamp_ = timestamp;
         egoPreYaw_ = egoYaw_;
-        trackManage = trackNumVec_;
         init_ = true;
-        // cout << targets_.size() << " " << trackNumVec_.size() << targetPoints.size()<<endl;
-        assert(targets_.size() == trackNumVec_.size());
-        assert(targets_.size() == targetPoints.size());
-        assert(targetPoints.size()== targetVandYaw.size());
-        // cout << "target state: "<<endl<< targets_[0].x_merge_ << endl;
-        return;
+        assert(targets_.liveCount() == tracks_.size());
+        return tracks_;
     }
 
-    assert (targets_.size() == trackNumVec_.size());
-
     // params initialization for ukf process
-    vector<int> matchingVec(trackPoints.size());
+    vector<int>& matchingVec = matchScratch_;
+    reserveScratch(matchingVec, trackPoints.size());
+    matchingVec.assign(trackPoints.size(), 0);
     // double dt = (timestamp - timestamp_)/1000000.0;
     double dt = timestamp - timestamp_;
     timestamp_ = timestamp;
 
-
-    // start UKF process
-    int targetSize = targets_.size();
-    for(int i = 0; i < targetSize; i++){
+    // spatial index over this frame's detections, so gating is not tracks x detections
+    grid_.build(centerX_, centerY_, config_.gateCellSize);
+
+    // start UKF process, live tracks only
+    const vector<int>& live = targets_.live();
+    int targetSize = live.size();
+    pdaTracks_.clear();
+    gatedTrackNum_.clear();
+    gateDet_.clear();
+    gateStart_.assign(1, 0);
+    gateZ_.resize(targetSize);
+    gateS_.resize(targetSize);
+    for(int m = 0; m < 3; m++) sigmaBatch_[m].resize(targetSize);
+
+    // prediction phase, every track on its own so it runs in parallel, except for the
+    // sigma point propagation which runs once per motion model over all tracks
+    #pragma omp parallel for schedule(dynamic, 8) if(targetSize > 32)
+    for(int k = 0; k < targetSize; k++){
+        int i = live[k];
+        int& trackNum = targets_.trackNum(i);
         //reset isVisBB_ to false
         targets_[i].isVisBB_ = false;
 
@@ -632,71 +877,107 @@ void immUkfJpdaf(vector<PointCloud<PointXYZ>> bBoxes, double timestamp,
         double diffYaw = (egoYaw_ - egoPreYaw_);
         double dX = dt*egoVelo_*cos(diffYaw);
         double dY = dt*egoVelo_*sin(diffYaw);
-        VectorXd diff(2);
-        diff << dX, dY;
-        targets_[i].local2local_.push_back(diff);
+        targets_[i].local2local_.push_back(LidarVec(dX, dY));
         targets_[i].local2localYawVec_.push_back(diffYaw);
+        while(targets_[i].local2local_.size() > std::max(config_.local2localHistory, 0)){
+            targets_[i].local2local_.pop_front();
+            targets_[i].local2localYawVec_.pop_front();
+        }
 
     	//todo: modify here. This skips irregular measurement and nan
-    	if(trackNumVec_[i] == 0) continue;
+    	if(trackNum == 0) continue;
         // prevent ukf not to explode
         if(targets_[i].P_merge_.determinant() > 10 || targets_[i].P_merge_(4,4) > 1000){
-            trackNumVec_[i] = 0;
+            trackNum = 0;
             continue;
         }
         // cout << "target state start -----------------------------------"<<endl;
         // cout << "covariance"<<endl<<targets_[i].P_merge_<<endl;
-        VectorXd maxDetZ;
-        MatrixXd maxDetS;
-    	vector<VectorXd> measVec;
-        vector<VectorXd> bboxVec;
-    	vector<double> lambdaVec;
-    	// cout << "ProcessIMMUKF" << endl;
-    	targets_[i].ProcessIMMUKF(dt);
-    	// cout << "measurementValidation" << endl;
+        // same steps as UKF::ProcessIMMUKF
+        targets_[i].MixingProbability();
+        targets_[i].Interaction();
+        AugSigmaMat Xsig_aug;
+        for(int m = 0; m < 3; m++){
+            targets_[i].AugmentedSigmaPoints(m, Xsig_aug);
+            sigmaBatch_[m].load(k, Xsig_aug);
+        }
+    }
+
+    for(int m = 0; m < 3; m++) sigmaBatch_[m].propagate(m, dt);
+
+    #pragma omp parallel for schedule(dynamic, 8) if(targetSize > 32)
+    for(int k = 0; k < targetSize; k++){
+        int i = live[k];
+        int& trackNum = targets_.trackNum(i);
+        if(trackNum == 0) continue;
+
+        sigmaBatch_[0].store(k, targets_[i].Xsig_pred_cv_);
+        sigmaBatch_[1].store(k, targets_[i].Xsig_pred_ctrv_);
+        sigmaBatch_[2].store(k, targets_[i].Xsig_pred_rm_);
+        for(int m = 0; m < 3; m++){
+            targets_[i].PredictMeanAndCovariance(m);
+            targets_[i].UpdateLidar(m);
+        }
         // pre gating
-        findMaxZandS(targets_[i], maxDetZ, maxDetS);
-        maxDetS = maxDetS*4;
-        double detS = maxDetS.determinant();
+        findMaxZandS(targets_[i], gateZ_[k], gateS_[k]);
+        gateS_[k] = gateS_[k]*4;
+        double detS = gateS_[k].determinant();
 
         // prevent ukf not to explode
         if(isnan(detS)|| detS > 10) {
-            trackNumVec_[i] = 0;
-            continue;
+            trackNum = 0;
         }
+    }
+
+    // association phase, serial in live order: earlier tracks claim detections first
+    for(int k = 0; k < targetSize; k++){
+        int i = live[k];
+        int& trackNum = targets_.trackNum(i);
+        if(trackNum == 0) continue;
+
+        const LidarVec& maxDetZ = gateZ_[k];
+        const LidarMat& maxDetS = gateS_[k];
+        double detS = maxDetS.determinant();
+        LidarVecList& measVec = measScratch_;
+        vector<int>& bboxVec = bboxScratch_;
+        measVec.clear();
+        bboxVec.clear();
+    	// cout << "measurementValidation" << endl;
 
         bool secondInit;
-        if(trackNumVec_[i] == 1){
+        if(trackNum == 1){
             secondInit = true;
         }
         else{
             secondInit = false;
         }
 
-        // transform local to The target anchor TF
-        // redundant calculation, modify here later
-        vector<vector<double>> dcTrackPoints;
-        dcTrackPoints = trackPoints;
         assert(targets_[i].local2local_.size()== targets_[i].local2localYawVec_.size());
-        // transformLocal2TargetAnchorTF(targets_[i].local2local_, targets_[i].local2localYawVec_, dcTrackPoints);
+        // transformLocal2TargetAnchorTF(targets_[i].local2local_, targets_[i].local2localYawVec_, trackPoints);
 
-        // measurement gating
-        measurementValidation(dcTrackPoints, targets_[i], secondInit, maxDetZ, maxDetS,
+        // measurement gating, gate inverse computed once per track
+        LidarMat invS = maxDetS.inverse();
+        vector<int>& candidates = candScratch_;
+        gateCandidates(maxDetZ, maxDetS, detS, candidates);
+        measurementValidation(trackPoints, candidates, targets_[i], secondInit, maxDetZ, invS,
          measVec, bboxVec, matchingVec);
 
-        // bounding box association
+        // bounding box association, in GNN mode it waits for the assigned detection
         // input: track number, bbox measurements, &target
-        associateBB(trackNumVec_[i], bboxVec, targets_[i]);
+        int gatedTrackNum = trackNum;
+        if(config_.association != ASSOC_GNN || secondInit){
+            associateBB(trackNum, trackPoints, bboxVec, targets_[i]);
 
-        // bounding box validation
-        updateBB(targets_[i]);
+            // bounding box validation
+            updateBB(targets_[i]);
+        }
 
         // cout << "validated meas "<<measVec[0][0]<<" "<<measVec[0][1]<<endl;
 
         // doing combined initialization
         if(secondInit){
             if(measVec.size() == 0){
-                trackNumVec_[i] = 0;
+                trackNum = 0;
                 continue;
             }
 
@@ -720,159 +1001,167 @@ void immUkfJpdaf(vector<PointCloud<PointXYZ>> bBoxes, double timestamp,
             targets_[i].x_merge_(2) = targets_[i].x_cv_(2) = targets_[i].x_ctrv_(2) = targets_[i].x_rm_(2) = targetV;
             targets_[i].x_merge_(3) = targets_[i].x_cv_(3) = targets_[i].x_ctrv_(3) = targets_[i].x_rm_(3) = targetYaw;
 
-            trackNumVec_[i]++;
+            trackNum++;
             continue;
         }
 
     	// update tracking number
     	if(measVec.size() > 0) {
-    		if(trackNumVec_[i] < 3){
-    			trackNumVec_[i]++;
+    		if(trackNum < 3){
+    			trackNum++;
     		}
-    		else if(trackNumVec_[i] == 3){
-    			trackNumVec_[i] = 5;
+    		else if(trackNum == 3){
+    			trackNum = 5;
     		}
-    		else if(trackNumVec_[i] >= 5){
-    			trackNumVec_[i] = 5;
+    		else if(trackNum >= 5){
+    			trackNum = 5;
     		}
     	}else{
-            if(trackNumVec_[i] < 5){
-                trackNumVec_[i] = 0;
+            if(trackNum < 5){
+                trackNum = 0;
             }
-    		else if(trackNumVec_[i] >= 5 && trackNumVec_[i] < 8){
-    			trackNumVec_[i]++;
+    		else if(trackNum >= 5 && trackNum < 8){
+    			trackNum++;
     		}
-    		else if(trackNumVec_[i] = 8){
-    			trackNumVec_[i] = 0;
+    		else{
+    			trackNum = 0;
     		}
     	}
 
-        if(trackNumVec_[i] == 0) continue;
-
+        if(trackNum == 0) continue;
 
-	    filterPDA(targets_[i], measVec, lambdaVec);
-	    // cout << "PostIMMUKF" << endl;
-	    targets_[i].PostProcessIMMUKF(lambdaVec);
-        // TODO: might be wrong
-        double targetVelo = targets_[i].x_merge_(2);
-        targets_[i].velo_history_.push_back(targetVelo);
-        if(targets_[i].velo_history_.size() == 4) {
-            targets_[i].velo_history_.erase (targets_[i].velo_history_.begin());
-        }
+        // the PDA update waits until every track has gated, so tracks competing
+        // for the same detections can be associated jointly
+        pdaTracks_.push_back(i);
+        gatedTrackNum_.push_back(gatedTrackNum);
+        gateDet_.insert(gateDet_.end(), bboxVec.begin(), bboxVec.end());
+        gateStart_.push_back(gateDet_.size());
 
         // targets_[i].x_cv_(0) = targets_[i].x_ctrv_(0) = targets_[i].x_rm_(0) = targets_[i].x_merge_(0) = measVec[0](0);
         // targets_[i].x_cv_(1) = targets_[i].x_ctrv_(1) = targets_[i].x_rm_(1) = targets_[i].x_merge_(1) = measVec[0](1);
     }
+
+    // update phase, clusters only touch their own tracks, so they update in
+    // parallel and the result does not depend on the thread count
+    this->clusterGates();
+    int clusterCount = clusterStart_.size() - 1;
+    int threads = 1;
+#ifdef _OPENMP
+    threads = omp_get_max_threads();
+#endif
+    if(int(clusterScratch_.size()) < threads) clusterScratch_.resize(threads);
+    #pragma omp parallel for schedule(dynamic, 1) if(clusterCount > 16)
+    for(int c = 0; c < clusterCount; c++){
+        int tid = 0;
+#ifdef _OPENMP
+        tid = omp_get_thread_num();
+#endif
+        this->updateCluster(c, clusterScratch_[tid]);
+    }
     // end UKF process
 
     // cout << trackPoints[0][0] << endl;
     // cout << targets_[0].x_merge_(0) << endl;
 
-    // deling with over segmentation, update trackNumVec_
-    mergeOverSegmentation(targets_);
+    // deling with over segmentation, update track numbers
+    this->mergeOverSegmentation();
 
+    // static dynamic classification of the surviving tracks
+    for (int k = 0; k < targetSize; k++){
+        int i = live[k];
+        // once target is static, it is dtatic until lost
+        if(targets_[i].isStatic_ || targets_.trackNum(i) == 0){
+            continue;
+        }
 
-    // making new ukf target
-    int addedNum = 0;
-    int targetNum = targets_.size();
-    int matchSize = matchingVec.size();
-    for(int i = 0; i < matchSize; i ++){
-        if(matchingVec[i] == 0){
-            double px = trackPoints[i][0];
-            double py = trackPoints[i][1];
-
-            VectorXd initMeas = VectorXd(2);
-            initMeas << px, py;
-
-            UKF ukf;
-            ukf.Initialize(initMeas, timestamp);
-            targets_.push_back(ukf);
-            //initialize trackNumVec
-            trackNumVec_.push_back(1);
-            addedNum ++;
-        }
-    }
-    assert(targets_.size() == (addedNum + targetNum));
-
-    // making poitns for visualization
-    // cout << "making points for vis" <<endl;
-    int targetNumCount = 0;
-    
-    int trackNum = trackNumVec_.size();
-    for(int i = 0; i < trackNum; i++){
-        double tx   = targets_[i].x_merge_(0);
-        double ty   = targets_[i].x_merge_(1);
+        double tx = targets_[i].x_merge_(0);
+        double ty = targets_[i].x_merge_(1);
         double mx = targets_[i].initMeas_(0);
         double my = targets_[i].initMeas_(1);
-        // cout <<"fisrt meas "<<mx << " "<<my<<endl;
-        // cout <<"estimate "<<tx << " "<<ty<<endl;
         targets_[i].distFromInit_ = sqrt((tx - mx)*(tx - mx) + (ty - my)*(ty - my));
-        vector<double> cp;
-        cp.push_back(tx);
-        cp.push_back(ty);
 
-        // update tx and ty to the position in local tf
-        // transformTargetAnchorTF2Local(targets_[i].local2local_, targets_[i].local2localYawVec_ ,cp);
-        // cout << "after back to ego tf" << endl;
-        // cout << cp[0] << " " << cp[1] << endl;
-
-        double tv = targets_[i].x_merge_(2);
-        double tyaw = targets_[i].x_merge_(3);
+        if(targets_.trackNum(i) >= 2 && targets_[i].lifetime_ > config_.staticLifetime ){
+            // assuming below 0.3 m/s for static onject
+            if((targets_[i].distFromInit_ < config_.staticDistThres)&&
+                    (targets_[i].modeProbRM_ > targets_[i].modeProbCV_ ||
+                     targets_[i].modeProbRM_ > targets_[i].modeProbCTRV_ )){
+                targets_[i].isStatic_ = true;
+            }
+        }
+    }
 
-        // tyaw += egoPoints_[0][2];
-        while (tyaw> M_PI) tyaw -= 2.*M_PI;
-        while (tyaw<-M_PI) tyaw += 2.*M_PI;
-        // cout << "testing yaw off "<< tyaw << endl;
+    // a filter that diverged to nan or inf never gates a detection again and would be
+    // reported at a nan position, so it dies with the others
+    for (int k = 0; k < targetSize; k++){
+        int i = live[k];
+        if(targets_.trackNum(i) != 0 &&
+           (!targets_[i].x_merge_.allFinite() || !targets_[i].P_merge_.allFinite())){
+            targets_.trackNum(i) = 0;
+        }
+    }
 
-        PointXYZ o;
-        o.x = cp[0];
-        o.y = cp[1];
-        o.z = -1.73/2;
-        targetPoints.push_back(o);
+    // recycle the slots of tracks that died this frame
+    targets_.sweep();
 
-        vector<double> VandYaw;
-        VandYaw.push_back(tv);
-        VandYaw.push_back(tyaw);
-        targetVandYaw.push_back(VandYaw);
+    // making new ukf target
+    int matchSize = matchingVec.size();
+    for(int i = 0; i < matchSize; i ++){
+        if(matchingVec[i] == 0){
+            double px = trackPoints[i].x;
+            double py = trackPoints[i].y;
 
-        isStaticVec.push_back(false);
-        // isVisVec.push_back(false);
-        isVisVec.push_back(targets_[i].isVisBB_);
-        if(targets_[i].isVisBB_){
-            visBBs.push_back(targets_[i].BBox_);
-        }
+            LidarVec initMeas(px, py);
 
-        if(trackNumVec_[i] != 0){
-            targetNumCount ++;
+            this->addTrack(initMeas, timestamp);
         }
     }
 
-    // static dynamic classification
-    targetSize = isStaticVec.size();
-    for (int i = 0; i < targetNum; i++){
-        // once target is static, it is dtatic until lost
-        if(targets_[i].isStatic_ ){
-            isStaticVec[i] = true;
-            continue;
-        }
-
-
-        if(trackNumVec_[i] >= 2 && targets_[i].lifetime_ > 8 ){
-            // assuming below 0.3 m/s for static onject
-            double distThres = 0.11 * targets_[i].lifetime_;
-            distThres = 3.0;
-            if((targets_[i].distFromInit_ < distThres)&&
-                    (targets_[i].modeProbRM_ > targets_[i].modeProbCV_ ||
-                     targets_[i].modeProbRM_ > targets_[i].modeProbCTRV_ )){
-                isStaticVec[i] = true;
-                targets_[i].isStatic_ = true;
-            }
-            else{
+    // report every live track
+    const vector<int>& tracks = targets_.live();
+    int trackNum = tracks.size();
+    for(int k = 0; k < trackNum; k++){
+        int i = tracks[k];
+        double tyaw = targets_[i].x_merge_(3);
+        while (tyaw> M_PI) tyaw -= 2.*M_PI;
+        while (tyaw<-M_PI) tyaw += 2.*M_PI;
 
-            }
+        TrackedObject track;
+        track.id        = track_ids_[i];
+        track.trackNum  = targets_.trackNum(i);
+        track.state     = targets_.state(i);
+        track.x         = targets_[i].x_merge_(0);
+        track.y         = targets_[i].x_merge_(1);
+        track.v         = targets_[i].x_merge_(2);
+        track.yaw       = tyaw;
+        track.isStatic  = targets_[i].isStatic_;
+        track.isVisible = targets_[i].isVisBB_;
+        if(track.isVisible){
+            track.bbox = targets_[i].BBox_;
         }
+        tracks_.push_back(track);
     }
 
-    trackManage = trackNumVec_;
     egoPreYaw_ = egoYaw_;
-}
\ No newline at end of file
+    return tracks_;
+}
+
+double MultiObjectTracker::maxPredictedPositionStd(double dt) const{
+    double maxStd = 0;
+    const vector<int>& live = targets_.live();
+    int trackNum = live.size();
+    for(int k = 0; k < trackNum; k++){
+        int i = live[k];
+        TrackState state = targets_.state(i);
+        if(state != TRACK_CONFIRMED && state != TRACK_COASTING) continue;
+        const UKF& target = targets_[i];
+        double v = target.x_merge_(2);
+        // position + velocity and heading error carried over dt + unmodelled acceleration
+        double posVar = target.P_merge_(0,0) + target.P_merge_(1,1)
+                      + dt*dt*target.P_merge_(2,2)
+                      + v*v*dt*dt*target.P_merge_(3,3);
+        double accStd = 0.5*target.std_a_ctrv_*dt*dt;
+        posVar += 2*accStd*accStd;
+        maxStd = max(maxStd, sqrt(posVar));
+    }
+    return maxStd;
+}
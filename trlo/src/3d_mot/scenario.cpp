@@ -0,0 +1,103 @@
+/****************************************************************************************
+ *
+ * Copyright (c) 2024, Shenyang Institute of Automation, Chinese Academy of Sciences
+ *
+ * Authors: Yanpeng Jia
+ * Contact: jiayanpeng@sia.cn
+ *
+ ****************************************************************************************/
+
+#include <cmath>
+#include <algorithm>
+
+#include "3d_mot/scenario.h"
+
+SyntheticScenario::SyntheticScenario(const ScenarioConfig& config)
+    : config_(config), rng_(config.seed), frame_(-1), nextId_(0), timestamp_(0),
+      egoX_(0), egoY_(0), egoYaw_(0)
+{
+    halfExtent_ = std::max(config_.minHalfExtent, 0.5*config_.spacing*std::sqrt((double)config_.objects));
+    egoPose_.setIdentity();
+    objects_.resize(config_.objects);
+    for(size_t i = 0; i < objects_.size(); i++) spawn(objects_[i]);
+}
+
+// mt19937 output is fixed by the standard, the <random> distributions are not, so the
+// draws are made here to keep the sequence identical across standard libraries
+double SyntheticScenario::uniform(double lo, double hi){
+    return lo + (hi - lo)*((rng_() + 0.5)/4294967296.0);
+}
+
+void SyntheticScenario::spawn(ScenarioObject& object){
+    object.id  = nextId_++;
+    object.x   = egoX_ + uniform(-halfExtent_, halfExtent_);
+    object.y   = egoY_ + uniform(-halfExtent_, halfExtent_);
+    object.v   = uniform(0, config_.maxSpeed);
+    object.yaw = uniform(-M_PI, M_PI);
+    object.yawRate = uniform(0, 1) < config_.ctrvRatio ? uniform(-config_.maxYawRate, config_.maxYawRate) : 0;
+}
+
+void SyntheticScenario::next(){
+    const double dt = 1.0/config_.rate;
+    if(frame_ >= 0){
+        egoX_ += config_.egoSpeed*dt*std::cos(egoYaw_);
+        egoY_ += config_.egoSpeed*dt*std::sin(egoYaw_);
+        egoYaw_ += config_.egoYawRate*dt;
+        for(size_t i = 0; i < objects_.size(); i++){
+            ScenarioObject& o = objects_[i];
+            if(std::fabs(o.yawRate) > 0.001){
+                o.x += o.v/o.yawRate*(std::sin(o.yaw + o.yawRate*dt) - std::sin(o.yaw));
+                o.y += o.v/o.yawRate*(std::cos(o.yaw) - std::cos(o.yaw + o.yawRate*dt));
+            }
+            else{
+                o.x += o.v*dt*std::cos(o.yaw);
+                o.y += o.v*dt*std::sin(o.yaw);
+            }
+            o.yaw += o.yawRate*dt;
+            // left the sensed area, a new object takes its place
+            if(std::fabs(o.x - egoX_) > halfExtent_ || std::fabs(o.y - egoY_) > halfExtent_) spawn(o);
+        }
+    }
+    frame_++;
+    timestamp_ = frame_*dt;
+
+    egoPose_.setIdentity();
+    egoPose_(0,0) = std::cos(egoYaw_);
+    egoPose_(0,1) = -std::sin(egoYaw_);
+    egoPose_(1,0) = std::sin(egoYaw_);
+    egoPose_(1,1) = std::cos(egoYaw_);
+    egoPose_(0,3) = egoX_;
+    egoPose_(1,3) = egoY_;
+
+    detections_.clear();
+    for(size_t i = 0; i < objects_.size(); i++){
+        const ScenarioObject& o = objects_[i];
+        if(uniform(0, 1) >= config_.pD) continue;
+        // Box-Muller, two normal draws for the center
+        double r = std::sqrt(-2.0*std::log(uniform(0, 1)));
+        double a = uniform(0, 2*M_PI);
+        OrientedBox box;
+        box.x = o.x + config_.posNoise*r*std::cos(a);
+        box.y = o.y + config_.posNoise*r*std::sin(a);
+        box.z = 0.8;
+        box.l = 4.5;
+        box.w = 1.9;
+        box.h = 1.6;
+        box.yaw = o.yaw + uniform(-1.7320508, 1.7320508)*config_.yawNoise;
+        detections_.push_back(box);
+    }
+
+    double clutter = config_.clutterRate*config_.objects;
+    int clutterNum = (int)clutter + (uniform(0, 1) < clutter - (int)clutter ? 1 : 0);
+    for(int i = 0; i < clutterNum; i++){
+        OrientedBox box;
+        box.x = egoX_ + uniform(-halfExtent_, halfExtent_);
+        box.y = egoY_ + uniform(-halfExtent_, halfExtent_);
+        box.z = 0.5;
+        box.l = uniform(0.5, 2.0);
+        box.w = uniform(0.5, 2.0);
+        box.h = 1.0;
+        box.yaw = uniform(-M_PI, M_PI);
+        detections_.push_back(box);
+    }
+}
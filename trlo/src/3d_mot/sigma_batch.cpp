@@ -0,0 +1,139 @@
+/****************************************************************************************
+ *
+ * Copyright (c) 2024, Shenyang Institute of Automation, Chinese Academy of Sciences
+ *
+ * Authors: Yanpeng Jia
+ * Contact: jiayanpeng@sia.cn
+ *
+ ****************************************************************************************/
+
+#include <cmath>
+
+#include "3d_mot/sigma_batch.h"
+
+void sinCosBatch(const double* x, double* s, double* c, int n){
+    // pi/2 split in three parts, n*PIO2_1 and n*PIO2_2 are exact for the quadrant counts used here
+    const double TWO_OVER_PI = 6.36619772367581382433e-01;
+    const double PIO2_1 = 1.57079632673412561417e+00;
+    const double PIO2_2 = 6.07710050630396597660e-11;
+    const double PIO2_3 = 2.02226624879595063154e-21;
+    // adding and subtracting 1.5*2^52 rounds to the nearest integer
+    const double ROUND  = 6755399441055744.0;
+
+    #pragma omp simd
+    for(int i = 0; i < n; i++){
+        double q = (x[i]*TWO_OVER_PI + ROUND) - ROUND;
+        double r = ((x[i] - q*PIO2_1) - q*PIO2_2) - q*PIO2_3;
+        double z = r*r;
+        // fdlibm kernels on |r| <= pi/4
+        double sr = r + r*z*(-1.66666666666666324348e-01 + z*(8.33333333332248946124e-03 + z*(-1.98412698298579493134e-04 +
+                    z*(2.75573137070700676789e-06 + z*(-2.50507602534068634195e-08 + z*1.58969099521155010221e-10)))));
+        double cr = 1.0 - 0.5*z + z*z*(4.16666666666666019037e-02 + z*(-1.38888888888741095749e-03 + z*(2.48015872894767294178e-05 +
+                    z*(-2.75573143513906633035e-07 + z*(2.08757232129817482790e-09 + z*-1.13596475577881948265e-11)))));
+        // quadrant 0..3 from q mod 4
+        double quad = q - 4.0*((q*0.25 + ROUND) - ROUND);
+        if(quad < 0) quad += 4.0;
+        double sinv = (quad == 0.0) ? sr : (quad == 1.0) ? cr : (quad == 2.0) ? -sr : -cr;
+        double cosv = (quad == 0.0) ? cr : (quad == 1.0) ? -sr : (quad == 2.0) ? -cr : sr;
+        s[i] = sinv;
+        c[i] = cosv;
+    }
+
+    // the reduction loses accuracy for large arguments, rare enough for libm
+    for(int i = 0; i < n; i++){
+        if(!(std::fabs(x[i]) < 1e5)){
+            s[i] = std::sin(x[i]);
+            c[i] = std::cos(x[i]);
+        }
+    }
+}
+
+void SigmaPointBatch::resize(int tracks){
+    tracks_ = tracks;
+    size_t n = (size_t)tracks*UKF_N_SIGMA;
+    px_.resize(n); py_.resize(n); v_.resize(n); yaw_.resize(n); yawd_.resize(n);
+    nu_a_.resize(n); nu_yawdd_.resize(n);
+    sin0_.resize(n); cos0_.resize(n); sin1_.resize(n); cos1_.resize(n); yaw1_.resize(n);
+}
+
+void SigmaPointBatch::load(int track, const AugSigmaMat& Xsig_aug){
+    int base = track*UKF_N_SIGMA;
+    for(int j = 0; j < UKF_N_SIGMA; j++){
+        px_[base + j]       = Xsig_aug(0, j);
+        py_[base + j]       = Xsig_aug(1, j);
+        v_[base + j]        = Xsig_aug(2, j);
+        yaw_[base + j]      = Xsig_aug(3, j);
+        yawd_[base + j]     = Xsig_aug(4, j);
+        nu_a_[base + j]     = Xsig_aug(5, j);
+        nu_yawdd_[base + j] = Xsig_aug(6, j);
+    }
+}
+
+void SigmaPointBatch::store(int track, SigmaMat& Xsig_pred) const{
+    int base = track*UKF_N_SIGMA;
+    for(int j = 0; j < UKF_N_SIGMA; j++){
+        Xsig_pred(0, j) = px_[base + j];
+        Xsig_pred(1, j) = py_[base + j];
+        Xsig_pred(2, j) = v_[base + j];
+        Xsig_pred(3, j) = yaw_[base + j];
+        Xsig_pred(4, j) = yawd_[base + j];
+    }
+}
+
+void SigmaPointBatch::propagate(int modelInd, double delta_t){
+    int n = tracks_*UKF_N_SIGMA;
+    // random motion keeps the state as it is
+    if(modelInd != 0 && modelInd != 1) return;
+
+    double* px   = px_.data();
+    double* py   = py_.data();
+    double* v    = v_.data();
+    double* yaw  = yaw_.data();
+    double* yawd = yawd_.data();
+    const double* nu_a     = nu_a_.data();
+    const double* nu_yawdd = nu_yawdd_.data();
+    double* s0 = sin0_.data();
+    double* c0 = cos0_.data();
+    sinCosBatch(yaw, s0, c0, n);
+
+    if(modelInd == 0){
+        // same operation order as UKF::Cv
+        #pragma omp simd
+        for(int i = 0; i < n; i++){
+            double px_p = px[i] + v[i]*c0[i]*delta_t;
+            double py_p = py[i] + v[i]*s0[i]*delta_t;
+            px[i]   = px_p + 0.5 * nu_a[i] * delta_t * delta_t * c0[i];
+            py[i]   = py_p + 0.5 * nu_a[i] * delta_t * delta_t * s0[i];
+            v[i]    = v[i] + nu_a[i]*delta_t;
+            yaw[i]  = yaw[i] + 0.5*nu_yawdd[i]*delta_t*delta_t;
+            yawd[i] = yawd[i] + nu_yawdd[i]*delta_t;
+        }
+        return;
+    }
+
+    // CTRV, same operation order as UKF::Ctrv
+    double* yaw1 = yaw1_.data();
+    double* s1 = sin1_.data();
+    double* c1 = cos1_.data();
+    #pragma omp simd
+    for(int i = 0; i < n; i++) yaw1[i] = yaw[i] + yawd[i] * delta_t;
+    sinCosBatch(yaw1, s1, c1, n);
+    #pragma omp simd
+    for(int i = 0; i < n; i++){
+        //avoid division by zero, both branches are evaluated and one is kept
+        bool turning = std::fabs(yawd[i]) > 0.001;
+        double w = turning ? yawd[i] : 1.0;
+        double px_turn = px[i] + v[i] / w * (s1[i] - s0[i]);
+        double py_turn = py[i] + v[i] / w * (c0[i] - c1[i]);
+        double px_line = px[i] + v[i] * delta_t * c0[i];
+        double py_line = py[i] + v[i] * delta_t * s0[i];
+        double px_p = turning ? px_turn : px_line;
+        double py_p = turning ? py_turn : py_line;
+
+        px[i]   = px_p + 0.5 * nu_a[i] * delta_t * delta_t * c0[i];
+        py[i]   = py_p + 0.5 * nu_a[i] * delta_t * delta_t * s0[i];
+        v[i]    = v[i] + nu_a[i]*delta_t;
+        yaw[i]  = yaw1[i] + 0.5*nu_yawdd[i]*delta_t*delta_t;
+        yawd[i] = yawd[i] + nu_yawdd[i]*delta_t;
+    }
+}
@@ -0,0 +1,60 @@
+/****************************************************************************************
+ *
+ * Copyright (c) 2024, Shenyang Institute of Automation, Chinese Academy of Sciences
+ *
+ * Authors: Yanpeng Jia
+ * Contact: jiayanpeng@sia.cn
+ *
+ ****************************************************************************************/
+
+#include "3d_mot/track_pool.h"
+
+int TrackPool::allocate(const LidarVec& meas, double timestamp){
+    int slot;
+    if(!free_slots_.empty()){
+        slot = free_slots_.back();
+        free_slots_.pop_back();
+        tracks_[slot] = UKF();
+    }
+    else{
+        slot = tracks_.size();
+        tracks_.push_back(UKF());
+        track_num_.push_back(0);
+    }
+    tracks_[slot].Initialize(meas, timestamp);
+    track_num_[slot] = 1;
+    live_.push_back(slot);
+    updateBytes();
+    return slot;
+}
+
+int TrackPool::sweep(){
+    int released = 0;
+    int kept = 0;
+    for(size_t k = 0; k < live_.size(); k++){
+        int slot = live_[k];
+        if(track_num_[slot] == 0){
+            free_slots_.push_back(slot);
+            released++;
+        }
+        else{
+            live_[kept++] = slot;
+        }
+    }
+    live_.resize(kept);
+    updateBytes();
+    return released;
+}
+
+void TrackPool::clear(){
+    tracks_.clear();
+    track_num_.clear();
+    free_slots_.clear();
+    live_.clear();
+    updateBytes();
+}
+
+void TrackPool::updateBytes(){
+    bytes_ = tracks_.capacity() * sizeof(UKF)
+           + (track_num_.capacity() + free_slots_.capacity() + live_.capacity()) * sizeof(int);
+}
@@ -0,0 +1,252 @@
+/****************************************************************************************
+ *
+ * Copyright (c) 2024, Shenyang Institute of Automation, Chinese Academy of Sciences
+ *
+ * Authors: Yanpeng Jia
+ * Contact: jiayanpeng@sia.cn
+ *
+ ****************************************************************************************/
+
+// Tracker scaling benchmark on synthetic scenes, no ROS needed.
+//
+//   tracker_bench [frames] [rate] [jpda|gnn] [objects ...]
+//   tracker_bench predict_update [iterations]
+//
+// For every object count it runs one SyntheticScenario through a fresh
+// MultiObjectTracker and prints the step() time per frame, the heap allocations per
+// frame and CLEAR MOT style counts of the confirmed tracks against the ground truth.
+// Allocations are given over all frames and over the frames after the first third,
+// once the track pool and the scratch buffers have grown to the scene; the latter
+// only counts a buffer reaching a new peak.
+// Confirmed tracks whose state went nan are listed separately, they never match, and
+// any of them makes the bench exit with 2.
+// predict_update times one predict/update cycle of a lone IMM-UKF and its heap
+// allocations, the cost every track pays each frame before association.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <new>
+#include <atomic>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include <unordered_map>
+
+#include "3d_mot/imm_ukf_jpda.h"
+#include "3d_mot/scenario.h"
+
+static std::atomic<long> allocations(0);
+
+void* operator new(size_t size){
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    void* p = malloc(size ? size : 1);
+    if(!p) throw std::bad_alloc();
+    return p;
+}
+void* operator new[](size_t size){ return operator new(size); }
+void operator delete(void* p) noexcept { free(p); }
+void operator delete[](void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+void operator delete[](void* p, size_t) noexcept { free(p); }
+
+struct BenchResult
+{
+    double meanMs;
+    double p99Ms;
+    double maxMs;
+    double allocsPerFrame;
+    double steadyAllocsPerFrame;  // after the warm up third of the frames
+    double liveTracks;
+    long gt;
+    long misses;
+    long falsePositives;
+    long idSwitches;
+    long nonFinite;    // confirmed tracks with a nan or infinite position, also counted as fp
+    double motp;
+};
+
+// confirmed tracks closer than this to a ground truth object count as a match
+static const double MATCH_DIST = 2.0;
+
+static BenchResult runScenario(const ScenarioConfig& scenarioConfig, const TrackerConfig& trackerConfig, int frames){
+    SyntheticScenario scenario(scenarioConfig);
+    MultiObjectTracker tracker(trackerConfig);
+    BenchResult r;
+    memset(&r, 0, sizeof(r));
+
+    std::vector<double> stepMs;
+    stepMs.reserve(frames);
+    std::vector<int> lastTrack;            // per ground truth id, track it was matched to
+    std::unordered_map<int, int> trackIndex;
+    std::vector<char> trackUsed;
+    std::vector<int> gtTrack;
+    struct Pair { double d; int gt; int track; };
+    std::vector<Pair> pairs;
+    double distSum = 0;
+    long matches = 0;
+    long allocs = 0;
+    long steadyAllocs = 0;
+    const int warmup = frames/3;
+    double liveSum = 0;
+
+    for(int f = 0; f < frames; f++){
+        scenario.next();
+        long a0 = allocations.load(std::memory_order_relaxed);
+        auto t0 = std::chrono::steady_clock::now();
+        const std::vector<TrackedObject>& tracks = tracker.step(scenario.detections(), scenario.timestamp(), scenario.egoPose());
+        auto t1 = std::chrono::steady_clock::now();
+        allocs += allocations.load(std::memory_order_relaxed) - a0;
+        if(f >= warmup) steadyAllocs += allocations.load(std::memory_order_relaxed) - a0;
+        stepMs.push_back(std::chrono::duration<double, std::milli>(t1 - t0).count());
+        liveSum += tracker.liveTracks();
+
+        // matching, previous correspondences first, then the closest free pairs
+        const std::vector<ScenarioObject>& objects = scenario.objects();
+        trackIndex.clear();
+        for(size_t j = 0; j < tracks.size(); j++){
+            if(tracks[j].state == TRACK_CONFIRMED) trackIndex[tracks[j].id] = j;
+        }
+        trackUsed.assign(tracks.size(), 0);
+        gtTrack.assign(objects.size(), -1);
+        for(size_t i = 0; i < objects.size(); i++){
+            const ScenarioObject& o = objects[i];
+            if(o.id >= (int)lastTrack.size()) lastTrack.resize(o.id + 1, -1);
+            if(lastTrack[o.id] < 0) continue;
+            std::unordered_map<int, int>::const_iterator it = trackIndex.find(lastTrack[o.id]);
+            if(it == trackIndex.end() || trackUsed[it->second]) continue;
+            const TrackedObject& t = tracks[it->second];
+            if(!(std::hypot(t.x - o.x, t.y - o.y) <= MATCH_DIST)) continue;
+            gtTrack[i] = it->second;
+            trackUsed[it->second] = 1;
+        }
+        pairs.clear();
+        for(size_t i = 0; i < objects.size(); i++){
+            if(gtTrack[i] >= 0) continue;
+            for(size_t j = 0; j < tracks.size(); j++){
+                if(trackUsed[j] || tracks[j].state != TRACK_CONFIRMED) continue;
+                double d = std::hypot(tracks[j].x - objects[i].x, tracks[j].y - objects[i].y);
+                if(d <= MATCH_DIST) pairs.push_back(Pair{d, (int)i, (int)j});
+            }
+        }
+        std::sort(pairs.begin(), pairs.end(), [](const Pair& a, const Pair& b){ return a.d < b.d; });
+        for(size_t p = 0; p < pairs.size(); p++){
+            if(gtTrack[pairs[p].gt] >= 0 || trackUsed[pairs[p].track]) continue;
+            gtTrack[pairs[p].gt] = pairs[p].track;
+            trackUsed[pairs[p].track] = 1;
+        }
+
+        r.gt += objects.size();
+        for(size_t i = 0; i < objects.size(); i++){
+            const ScenarioObject& o = objects[i];
+            if(gtTrack[i] < 0){
+                r.misses++;
+                continue;
+            }
+            const TrackedObject& t = tracks[gtTrack[i]];
+            if(lastTrack[o.id] >= 0 && lastTrack[o.id] != t.id) r.idSwitches++;
+            lastTrack[o.id] = t.id;
+            distSum += std::hypot(t.x - o.x, t.y - o.y);
+            matches++;
+        }
+        for(size_t j = 0; j < tracks.size(); j++){
+            if(tracks[j].state != TRACK_CONFIRMED) continue;
+            if(!trackUsed[j]) r.falsePositives++;
+            if(!std::isfinite(tracks[j].x) || !std::isfinite(tracks[j].y)) r.nonFinite++;
+        }
+    }
+
+    double sum = 0;
+    for(size_t f = 0; f < stepMs.size(); f++) sum += stepMs[f];
+    r.meanMs = sum/frames;
+    std::sort(stepMs.begin(), stepMs.end());
+    r.p99Ms = stepMs[std::min((size_t)(0.99*frames), stepMs.size() - 1)];
+    r.maxMs = stepMs.back();
+    r.allocsPerFrame = allocs/(double)frames;
+    r.steadyAllocsPerFrame = steadyAllocs/(double)(frames - warmup);
+    r.liveTracks = liveSum/frames;
+    r.motp = matches ? distSum/matches : 0;
+    return r;
+}
+
+// One IMM-UKF cycle of a lone filter on a target going round a circle: mixing, prediction
+// and lidar update of the three models, PDA update, mode probabilities and merge.
+static int runPredictUpdate(int iterations){
+    const double dt = 0.1;
+    UKF ukf;
+    ukf.Initialize(LidarVec(0, 0), 0);
+    LidarVecList z(1);
+    VectorXd meas(2);
+    std::vector<double> lambda(3);
+
+    long a0 = allocations.load(std::memory_order_relaxed);
+    auto t0 = std::chrono::steady_clock::now();
+    for(int i = 1; i <= iterations; i++){
+        // 8 m/s on a 40 m circle, keeps the coordinates bounded however long it runs
+        z[0] = LidarVec(40*std::sin(0.02*i), 40 - 40*std::cos(0.02*i));
+        ukf.ProcessIMMUKF(dt);
+        for(int m = 0; m < 3; m++) ukf.PDAupdate(z, m);
+        meas << z[0](0), z[0](1);
+        for(int m = 0; m < 3; m++) lambda[m] = ukf.CalculateGauss(meas, 0, m);
+        ukf.PostProcessIMMUKF(lambda);
+    }
+    auto t1 = std::chrono::steady_clock::now();
+    long allocs = allocations.load(std::memory_order_relaxed) - a0;
+
+    printf("# predict_update, %d iterations of one filter\n", iterations);
+    printf("%12s %14s %10s\n", "ns/update", "allocs/update", "x error m");
+    printf("%12.1f %14.2f %10.4f\n", std::chrono::duration<double, std::nano>(t1 - t0).count()/iterations,
+           allocs/(double)iterations, std::hypot(ukf.x_merge_(0) - z[0](0), ukf.x_merge_(1) - z[0](1)));
+    if(!ukf.x_merge_.allFinite()){
+        fprintf(stderr, "the filter state went non-finite\n");
+        return 2;
+    }
+    return 0;
+}
+
+int main(int argc, char** argv){
+    if(argc > 1 && strcmp(argv[1], "predict_update") == 0){
+        int iterations = argc > 2 ? atoi(argv[2]) : 100000;
+        if(iterations <= 0){
+            fprintf(stderr, "usage: %s predict_update [iterations]\n", argv[0]);
+            return 1;
+        }
+        return runPredictUpdate(iterations);
+    }
+
+    int frames = argc > 1 ? atoi(argv[1]) : 300;
+    double rate = argc > 2 ? atof(argv[2]) : 10.0;
+    TrackerConfig trackerConfig;
+    if(argc > 3 && strcmp(argv[3], "gnn") == 0) trackerConfig.association = ASSOC_GNN;
+    std::vector<int> counts;
+    for(int i = 4; i < argc; i++) counts.push_back(atoi(argv[i]));
+    if(counts.empty()) counts = {10, 20, 50, 100, 200, 500};
+    if(frames <= 0 || rate <= 0){
+        fprintf(stderr, "usage: %s [frames] [rate] [jpda|gnn] [objects ...]\n"
+                        "       %s predict_update [iterations]\n", argv[0], argv[0]);
+        return 1;
+    }
+
+    printf("# %d frames at %.1f Hz, %s association\n", frames, rate,
+           trackerConfig.association == ASSOC_GNN ? "gnn" : "jpda");
+    printf("%8s %10s %10s %10s %12s %12s %10s %8s %8s %8s %8s %8s %8s\n",
+           "objects", "ms/frame", "p99 ms", "max ms", "allocs/frame", "steady", "live", "MOTA", "MOTP m", "miss", "fp", "idsw", "nan");
+    long nonFinite = 0;
+    for(size_t c = 0; c < counts.size(); c++){
+        ScenarioConfig scenarioConfig;
+        scenarioConfig.objects = counts[c];
+        scenarioConfig.rate = rate;
+        BenchResult r = runScenario(scenarioConfig, trackerConfig, frames);
+        double mota = r.gt ? 1.0 - (r.misses + r.falsePositives + r.idSwitches)/(double)r.gt : 0;
+        printf("%8d %10.3f %10.3f %10.3f %12.2f %12.2f %10.1f %8.3f %8.3f %8ld %8ld %8ld %8ld\n",
+               counts[c], r.meanMs, r.p99Ms, r.maxMs, r.allocsPerFrame, r.steadyAllocsPerFrame, r.liveTracks, mota, r.motp,
+               r.misses, r.falsePositives, r.idSwitches, r.nonFinite);
+        nonFinite += r.nonFinite;
+    }
+    if(nonFinite > 0){
+        fprintf(stderr, "%ld confirmed tracks with a non-finite state\n", nonFinite);
+        return 2;
+    }
+    return 0;
+}
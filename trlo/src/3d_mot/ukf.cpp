@@ -30,28 +30,28 @@ UKF::UKF() {
     use_radar_ = true;
 
     // initial state vector
-    x_merge_ = MatrixXd(5, 1);
+    x_merge_.setZero();
 
     // initial state vector
-    x_cv_ = MatrixXd(5, 1);
+    x_cv_.setZero();
 
     // initial state vector
-    x_ctrv_ = MatrixXd(5, 1);
+    x_ctrv_.setZero();
 
     // initial state vector
-    x_rm_ = MatrixXd(5, 1);
+    x_rm_.setZero();
 
     // initial covariance matrix
-    P_merge_ = MatrixXd(5, 5);
+    P_merge_.setZero();
 
     // initial covariance matrix
-    P_cv_ = MatrixXd(5, 5);
+    P_cv_.setZero();
 
     // initial covariance matrix
-    P_ctrv_ = MatrixXd(5, 5);
+    P_ctrv_.setZero();
 
     // initial covariance matrix
-    P_rm_ = MatrixXd(5, 5);
+    P_rm_.setZero();
 
     // Process noise standard deviation longitudinal acceleration in m/s^2
 
@@ -121,16 +121,16 @@ UKF::UKF() {
 //    Xsig_pred_ = MatrixXd(n_x_, 2 * n_aug_ + 1);
 
     // predicted sigma points matrix
-    Xsig_pred_cv_ = MatrixXd(n_x_, 2 * n_aug_ + 1);
+    Xsig_pred_cv_.setZero();
 
     // predicted sigma points matrix
-    Xsig_pred_ctrv_ = MatrixXd(n_x_, 2 * n_aug_ + 1);
+    Xsig_pred_ctrv_.setZero();
 
     // predicted sigma points matrix
-    Xsig_pred_rm_ = MatrixXd(n_x_, 2 * n_aug_ + 1);
+    Xsig_pred_rm_.setZero();
 
     //create vector for weights
-    weights_ = VectorXd(2 * n_aug_ + 1);
+    weights_.setZero();
 
     // the current NIS for radar
     NIS_radar_ = 0.0;
@@ -141,22 +141,14 @@ UKF::UKF() {
     count_ = 0;
     count_empty_ = 0;
 
-    ini_u_.push_back(0.33);
-    ini_u_.push_back(0.33);
-    ini_u_.push_back(0.33);
+    ini_u_ << 0.33, 0.33, 0.33;
 
     // different from paper, might be wrong
-    p1_.push_back(0.9);
-    p1_.push_back(0.05);
-    p1_.push_back(0.05);
+    p1_ << 0.9, 0.05, 0.05;
 
-    p2_.push_back(0.05);
-    p2_.push_back(0.9);
-    p2_.push_back(0.05);
+    p2_ << 0.05, 0.9, 0.05;
 
-    p3_.push_back(0.05);
-    p3_.push_back(0.05);
-    p3_.push_back(0.9);
+    p3_ << 0.05, 0.05, 0.9;
 
     // p1_.push_back(0.8);
     // p1_.push_back(0.1);
@@ -186,27 +178,27 @@ UKF::UKF() {
     modeProbCTRV_ = 0.33;
     modeProbRM_ = 0.33;
 
-    zPredCVl_ = VectorXd(2);
-    zPredCTRVl_ =  VectorXd(2);
-    zPredRMl_ =  VectorXd(2);
+    zPredCVl_.setZero();
+    zPredCTRVl_.setZero();
+    zPredRMl_.setZero();
 
-    zPredCVr_ = VectorXd(3);
-    zPredCTRVr_ =  VectorXd(3);
-    zPredRMr_ =  VectorXd(3);
+    zPredCVr_.setZero();
+    zPredCTRVr_.setZero();
+    zPredRMr_.setZero();
 
 //    lS_ = MatrixXd(2,2);
 //    rS_ = MatrixXd(3,3);
-    lS_cv_   = MatrixXd(2,2);
-    lS_ctrv_ = MatrixXd(2,2);
-    lS_rm_   = MatrixXd(2,2);
+    lS_cv_.setZero();
+    lS_ctrv_.setZero();
+    lS_rm_.setZero();
 
-    rS_cv_   = MatrixXd(3,3);
-    rS_ctrv_   = MatrixXd(3,3);
-    rS_rm_   = MatrixXd(3,3);
+    rS_cv_.setZero();
+    rS_ctrv_.setZero();
+    rS_rm_.setZero();
 
-    K_cv_   = MatrixXd(2,2);
-    K_ctrv_ = MatrixXd(2,2);
-    K_rm_   = MatrixXd(2,2);
+    K_cv_.setZero();
+    K_ctrv_.setZero();
+    K_rm_.setZero();
 
 //    NISvals_laser_cv_.open( "../NISvals_laser_cv.txt", ios::out );
 //    NISvals_laser_ctrv_.open( "../NISvals_laser_ctrv.txt", ios::out );
@@ -229,12 +221,13 @@ UKF::UKF() {
 
     //bounding box params
     isVisBB_ = false;
+    hasBestBBox_ = false;
     bestYaw_ = 0;
     bb_yaw_  = 0;
     bb_area_ = 0;
 
     //for env classification
-    initMeas_ = VectorXd(2);
+    initMeas_.setZero();
     distFromInit_ = 0;
 
     // local2local yaw (t-1 to t)
@@ -259,7 +252,7 @@ UKF::~UKF() {
 //    NISvals_laser_rm_.close();
 }
 
-void UKF::Initialize(VectorXd z, double timestamp) {
+void UKF::Initialize(const LidarVec& z, double timestamp) {
     // first measurement
     // x_merge_ << 1, 1, 1, 1, 0.1;
     x_merge_ << 1, 1, 0, 0, 0.1;
@@ -326,11 +319,13 @@ void UKF::Initialize(VectorXd z, double timestamp) {
     // anchorTF_ << 0, 0;
 }
 
-double UKF::CalculateGauss(VectorXd z, int sensorInd, int modelInd){
+double UKF::CalculateGauss(const VectorXd& meas, int sensorInd, int modelInd){
+    // fixed-size copies, so the residual products do not go through the heap
     if(sensorInd == 0){
+        LidarVec z = meas.head<2>();
         if      (modelInd == 0) {
             double  detS = fabs(lS_cv_.determinant());
-            MatrixXd inS = lS_cv_.inverse();
+            LidarMat inS = lS_cv_.inverse();
 //            cout << z << endl << zPredCVl_ << endl;
 //            VectorXd s = (z-zPredCVl_).transpose();
 //            double a = ((z-zPredCVl_).transpose()*inS*(z-zPredCVl_));
@@ -338,19 +333,20 @@ double UKF::CalculateGauss(VectorXd z, int sensorInd, int modelInd){
         }
         else if (modelInd == 1) {
             double  detS = fabs(lS_ctrv_.determinant());
-            MatrixXd inS = lS_ctrv_.inverse();
+            LidarMat inS = lS_ctrv_.inverse();
             return exp(-1*(((z-zPredCTRVl_).transpose()*inS*(z-zPredCTRVl_))(0))/2)/sqrt(((2*M_PI)*(2*M_PI)*detS));
         }
         else                    {
             double  detS = fabs(lS_rm_.determinant());
-            MatrixXd inS = lS_rm_.inverse();
+            LidarMat inS = lS_rm_.inverse();
             return exp(-1*(((z-zPredRMl_).transpose()  *inS*(z-zPredRMl_))(0))/2)  /sqrt(((2*M_PI)*(2*M_PI)*detS));
         }
     }
     else if(sensorInd == 1){
+        RadarVec z = meas.head<3>();
         if (modelInd == 0){
             double  detS = fabs(rS_cv_.determinant());
-            MatrixXd inS = rS_cv_.inverse();
+            RadarMat inS = rS_cv_.inverse();
             double cvProb = exp(-1*(((z-zPredCVr_).transpose()  *inS*(z-zPredCVr_))(0))/2)  /sqrt((2*M_PI)*(2*M_PI)*(2*M_PI)*detS);
             if(cvProb != 0) return cvProb;
             else {
@@ -361,7 +357,7 @@ double UKF::CalculateGauss(VectorXd z, int sensorInd, int modelInd){
         }
         else if (modelInd == 1) {
             double detS = fabs(rS_ctrv_.determinant());
-            MatrixXd inS = rS_ctrv_.inverse();
+            RadarMat inS = rS_ctrv_.inverse();
             double ctrvProb = exp(-1 * (((z - zPredCTRVr_).transpose() * inS * (z - zPredCTRVr_))(0)) / 2) /
                               sqrt((2 * M_PI) * (2 * M_PI) * (2 * M_PI) * detS);
             if (ctrvProb != 0) return ctrvProb;
@@ -374,7 +370,7 @@ double UKF::CalculateGauss(VectorXd z, int sensorInd, int modelInd){
         }
         else    {
             double  detS = fabs(rS_rm_.determinant());
-            MatrixXd inS = rS_rm_.inverse();
+            RadarMat inS = rS_rm_.inverse();
             double rmProb = exp(-1*(((z-zPredRMr_).transpose()  *inS*(z-zPredRMr_))(0))/2)  /sqrt((2*M_PI)*(2*M_PI)*(2*M_PI)*detS);
             if(rmProb != 0)return rmProb;
             else{
@@ -384,9 +380,10 @@ double UKF::CalculateGauss(VectorXd z, int sensorInd, int modelInd){
             }
         }
     }
+    return 0;
 }
 
-void UKF::UpdateModeProb(vector<double> lambdaVec){
+void UKF::UpdateModeProb(const vector<double>& lambdaVec){
     double cvGauss   = lambdaVec[0];
     double ctrvGauss = lambdaVec[1];
     double rmGauss   = lambdaVec[2];
@@ -462,12 +459,12 @@ void UKF::MixingProbability() {
 
 void UKF::Interaction() {
 
-    MatrixXd x_pre_cv   = x_cv_;
-    MatrixXd x_pre_ctrv = x_ctrv_;
-    MatrixXd x_pre_rm   = x_rm_;
-    MatrixXd P_pre_cv   = P_cv_;
-    MatrixXd P_pre_ctrv = P_ctrv_;
-    MatrixXd P_pre_rm   = P_rm_;
+    StateVec x_pre_cv   = x_cv_;
+    StateVec x_pre_ctrv = x_ctrv_;
+    StateVec x_pre_rm   = x_rm_;
+    StateMat P_pre_cv   = P_cv_;
+    StateMat P_pre_ctrv = P_ctrv_;
+    StateMat P_pre_rm   = P_rm_;
     x_cv_   = modeMatchProbCV2CV_  *x_pre_cv + modeMatchProbCTRV2CV_  *x_pre_ctrv + modeMatchProbRM2CV_  *x_pre_rm;
     x_ctrv_ = modeMatchProbCV2CTRV_*x_pre_cv + modeMatchProbCTRV2CTRV_*x_pre_ctrv + modeMatchProbRM2CTRV_*x_pre_rm;
     x_rm_   = modeMatchProbCV2RM_  *x_pre_cv + modeMatchProbCTRV2RM_  *x_pre_ctrv + modeMatchProbRM2RM_*x_pre_rm;
@@ -531,7 +528,7 @@ void UKF::ProcessIMMUKF(double dt) {
 
 }
 
-void UKF::PostProcessIMMUKF(vector<double> lambdaVec) {
+void UKF::PostProcessIMMUKF(const vector<double>& lambdaVec) {
     /*********************************************************************************************************
     *  IMM Merge Step
     *********************************************************************************************************************/
@@ -542,7 +539,7 @@ void UKF::PostProcessIMMUKF(vector<double> lambdaVec) {
 
 
 void UKF::Ctrv(double p_x, double p_y, double v, double yaw, double yawd, double nu_a, double nu_yawdd,
-               double delta_t, vector<double>&state) {
+               double delta_t, StateVec& state) {
     //predicted state values
     double px_p, py_p;
 
@@ -576,7 +573,7 @@ void UKF::Ctrv(double p_x, double p_y, double v, double yaw, double yawd, double
 }
 
 void UKF::Cv(double p_x, double p_y, double v, double yaw, double yawd, double nu_a, double nu_yawdd,
-             double delta_t, vector<double>&state) {
+             double delta_t, StateVec& state) {
     //predicted state values
     double px_p = p_x + v*cos(yaw)*delta_t;
     double py_p = p_y + v*sin(yaw)*delta_t;
@@ -605,7 +602,7 @@ void UKF::Cv(double p_x, double p_y, double v, double yaw, double yawd, double n
 
 
 void UKF::randomMotion(double p_x, double p_y, double v, double yaw, double yawd, double nu_a, double nu_yawdd,
-                       double delta_t, vector<double>&state) {
+                       double delta_t, StateVec& state) {
     // double px_p   = p_x + 0.5 * nu_a * delta_t * delta_t * cos(yaw);
     // double py_p   = p_y + 0.5 * nu_a * delta_t * delta_t * sin(yaw);
     // double v_p    = v   + nu_a*delta_t;
@@ -633,146 +630,138 @@ void UKF::randomMotion(double p_x, double p_y, double v, double yaw, double yawd
 * measurement and this one.
 */
 void UKF::Prediction(double delta_t, int modelInd) {
+    AugSigmaMat Xsig_aug;
+    AugmentedSigmaPoints(modelInd, Xsig_aug);
+
+    /*********************************************************************************************************
+    *  Predict Sigma Points
+    *********************************************************************************************************************/
+    SigmaMat& Xsig_pred_ = modelInd == 0 ? Xsig_pred_cv_ : modelInd == 1 ? Xsig_pred_ctrv_ : Xsig_pred_rm_;
+    //predict sigma points
+    StateVec state;
+    for (int i = 0; i < UKF_N_SIGMA; i++)
+    {
+        //extract values for better readability
+        double p_x      = Xsig_aug(0, i);
+        double p_y      = Xsig_aug(1, i);
+        double v        = Xsig_aug(2, i);
+        double yaw      = Xsig_aug(3, i);
+        double yawd     = Xsig_aug(4, i);
+        double nu_a     = Xsig_aug(5, i);
+        double nu_yawdd = Xsig_aug(6, i);
+
+        if(modelInd == 0)        Cv(p_x, p_y, v, yaw, yawd, nu_a, nu_yawdd, delta_t, state);
+        else if(modelInd == 1) Ctrv(p_x, p_y, v, yaw, yawd, nu_a, nu_yawdd, delta_t, state);
+        else           randomMotion(p_x, p_y, v, yaw, yawd, nu_a, nu_yawdd, delta_t, state);
+
+        //write predicted sigma point into right column
+        Xsig_pred_.col(i) = state;
+    }
+
+    PredictMeanAndCovariance(modelInd);
+}
+
+void UKF::AugmentedSigmaPoints(int modelInd, AugSigmaMat& Xsig_aug) {
     /*********************************************************************************************************
    *  Initialize model parameters
    *********************************************************************************************************************/
     double std_yawdd, std_a;
-    MatrixXd x_(x_cv_.rows(), 1);
-    MatrixXd P_(P_cv_.rows(),P_cv_.cols());
-    MatrixXd Xsig_pred_(Xsig_pred_cv_.rows(), Xsig_pred_cv_.cols());
+    const StateVec* x_model;
+    const StateMat* P_model;
     if(modelInd == 0){
-        x_ = x_cv_.col(0);
-        P_ = P_cv_;
-        Xsig_pred_ = Xsig_pred_cv_;
+        x_model   = &x_cv_;
+        P_model   = &P_cv_;
         std_yawdd = std_cv_yawdd_;
         std_a     = std_a_cv_;
     }
     else if(modelInd == 1){
-        x_ = x_ctrv_.col(0);
-        P_ = P_ctrv_;
-        Xsig_pred_ = Xsig_pred_ctrv_;
+        x_model   = &x_ctrv_;
+        P_model   = &P_ctrv_;
         std_yawdd = std_ctrv_yawdd_;
         std_a     = std_a_ctrv_;
     }
     else{
-        x_ = x_rm_.col(0);
-        P_ = P_rm_;
-        Xsig_pred_ = Xsig_pred_rm_;
+        x_model   = &x_rm_;
+        P_model   = &P_rm_;
         std_yawdd = std_rm_yawdd_;
         std_a     = std_a_rm_;
     }
-
-    /*********************************************************************************************************
-    *  Generate Sigma Points
-    *********************************************************************************************************************/
-    //calculate square root of P
-    MatrixXd A = P_.llt().matrixL();
+    const StateVec& x_ = *x_model;
+    const StateMat& P_ = *P_model;
 
     /*********************************************************************************************************
     *  Augment Sigma Points
     *********************************************************************************************************************/
-    //create augmented mean vector
-    VectorXd x_aug = VectorXd(n_aug_);
-
-    //create augmented state covariance
-    MatrixXd P_aug = MatrixXd(n_aug_, n_aug_);
-
-    //create sigma point matrix
-    MatrixXd Xsig_aug = MatrixXd(n_aug_, 2 * n_aug_ + 1);
-
     //create augmented mean state
-    x_aug.head(5) = x_;
+    AugStateVec x_aug;
+    x_aug.head<UKF_N_X>() = x_;
     x_aug(5) = 0;
     x_aug(6) = 0;
 
     //create augmented covariance matrix
-    P_aug.fill(0.0);
-    P_aug.topLeftCorner(5, 5) = P_;
+    AugStateMat P_aug;
+    P_aug.setZero();
+    P_aug.topLeftCorner<UKF_N_X, UKF_N_X>() = P_;
     P_aug(5, 5) = std_a*std_a;
     P_aug(6, 6) = std_yawdd*std_yawdd;
 
-    //create square root matrix
-    MatrixXd L = P_aug.llt().matrixL();
+    //create square root matrix, fixed 7x7 so the factorization is fully unrolled
+    Eigen::LLT<AugStateMat> llt(P_aug);
+    AugStateMat L = llt.matrixL();
 
     //create augmented sigma points
     Xsig_aug.col(0) = x_aug;
-//    if(modelInd == 2) cout<< "x state: "<<endl<<x_rm_<<endl;
-//    if(modelInd == 2) cout<< "aug x state: "<<endl<<x_aug<<endl;
-    for (int i = 0; i< n_aug_; i++)
+    const double scale = sqrt(lambda_aug_ + n_aug_);
+    for (int i = 0; i < UKF_N_AUG; i++)
     {
-        Xsig_aug.col(i + 1) = x_aug + sqrt(lambda_aug_ + n_aug_) * L.col(i);
-        Xsig_aug.col(i + 1 + n_aug_) = x_aug - sqrt(lambda_aug_ + n_aug_) * L.col(i);
+        Xsig_aug.col(i + 1)             = x_aug + scale * L.col(i);
+        Xsig_aug.col(i + 1 + UKF_N_AUG) = x_aug - scale * L.col(i);
     }
-//    if(modelInd == 2) cout<< "aug sigma x points: "<<endl<<Xsig_aug<<endl;
-
-    /*********************************************************************************************************
-    *  Predict Sigma Points
-    *********************************************************************************************************************/
-    //predict sigma points
-    for (int i = 0; i < 2 * n_aug_ + 1; i++)
-    {
-        //extract values for better readability
-        double p_x      = Xsig_aug(0, i);
-        double p_y      = Xsig_aug(1, i);
-        double v        = Xsig_aug(2, i);
-        double yaw      = Xsig_aug(3, i);
-        double yawd     = Xsig_aug(4, i);
-        double nu_a     = Xsig_aug(5, i);
-        double nu_yawdd = Xsig_aug(6, i);
-
-        vector<double> state(5);
-        if(modelInd == 0)        Cv(p_x, p_y, v, yaw, yawd, nu_a, nu_yawdd, delta_t, state);
-        else if(modelInd == 1) Ctrv(p_x, p_y, v, yaw, yawd, nu_a, nu_yawdd, delta_t, state);
-        else           randomMotion(p_x, p_y, v, yaw, yawd, nu_a, nu_yawdd, delta_t, state);
+}
 
-        //write predicted sigma point into right column
-        Xsig_pred_(0, i) = state[0];
-        Xsig_pred_(1, i) = state[1];
-        Xsig_pred_(2, i) = state[2];
-        Xsig_pred_(3, i) = state[3];
-        Xsig_pred_(4, i) = state[4];
+void UKF::PredictMeanAndCovariance(int modelInd) {
+    StateVec* x_model;
+    StateMat* P_model;
+    const SigmaMat* Xsig_model;
+    if(modelInd == 0){
+        x_model    = &x_cv_;
+        P_model    = &P_cv_;
+        Xsig_model = &Xsig_pred_cv_;
+    }
+    else if(modelInd == 1){
+        x_model    = &x_ctrv_;
+        P_model    = &P_ctrv_;
+        Xsig_model = &Xsig_pred_ctrv_;
+    }
+    else{
+        x_model    = &x_rm_;
+        P_model    = &P_rm_;
+        Xsig_model = &Xsig_pred_rm_;
     }
-//    if(modelInd == 2) cout<< "predicted sigma x points: "<<endl<<Xsig_pred_<<endl;
+    StateVec& x_ = *x_model;
+    StateMat& P_ = *P_model;
+    const SigmaMat& Xsig_pred_ = *Xsig_model;
 
     /*********************************************************************************************************
     *  Convert Predicted Sigma Points to Mean/Covariance
     *********************************************************************************************************************/
     //predicted state mean
-    x_.fill(0.0);
-    for (int i = 0; i < 2 * n_aug_ + 1; i++) {  //iterate over sigma points
-        x_ = x_ + weights_(i) * Xsig_pred_.col(i);
+    x_.setZero();
+    for (int i = 0; i < UKF_N_SIGMA; i++) {  //iterate over sigma points
+        x_ += weights_(i) * Xsig_pred_.col(i);
     }
 
     while (x_(3)> M_PI) x_(3) -= 2.*M_PI;
     while (x_(3)<-M_PI) x_(3) += 2.*M_PI;
     //predicted state covariance matrix
-    P_.fill(0.0);
-    for (int i = 0; i < 2 * n_aug_ + 1; i++) {  //iterate over sigma points
+    P_.setZero();
+    for (int i = 0; i < UKF_N_SIGMA; i++) {  //iterate over sigma points
         // state difference
-        VectorXd x_diff = Xsig_pred_.col(i) - x_;
+        StateVec x_diff = Xsig_pred_.col(i) - x_;
         //angle normalization
         while (x_diff(3)> M_PI) x_diff(3) -= 2.*M_PI;
         while (x_diff(3)<-M_PI) x_diff(3) += 2.*M_PI;
-        P_ = P_ + weights_(i) * x_diff * x_diff.transpose();
-    }
-
-    /*********************************************************************************************************
-    *  Update model parameters
-    *********************************************************************************************************************/
-    if(modelInd == 0){
-        x_cv_.col(0) = x_;
-        P_cv_ = P_;
-        Xsig_pred_cv_ = Xsig_pred_;
-    }
-    else if(modelInd == 1){
-        x_ctrv_.col(0) = x_;
-        P_ctrv_ = P_;
-        Xsig_pred_ctrv_ = Xsig_pred_;
-    }
-    else{
-        x_rm_.col(0) = x_;
-        P_rm_ = P_;
-        Xsig_pred_rm_ = Xsig_pred_;
+        P_.noalias() += weights_(i) * x_diff * x_diff.transpose();
     }
 }
 
@@ -781,134 +770,92 @@ void UKF::Prediction(double delta_t, int modelInd) {
 * @param {MeasurementPackage} meas_package
 */
 void UKF::UpdateLidar(int modelInd) {
-    // TODO refactoring
     /*********************************************************************************************************
    *  Initialize model parameters
    *********************************************************************************************************************/
-    VectorXd x(x_cv_.rows());
-    MatrixXd P(P_cv_.rows(),P_cv_.cols());
-    MatrixXd Xsig_pred(Xsig_pred_cv_.rows(), Xsig_pred_cv_.cols());
+    const StateVec* x_model;
+    const SigmaMat* Xsig_model;
+    LidarVec* zPred_model;
+    LidarMat* S_model;
+    LidarGainMat* K_model;
     if(modelInd == 0){
-        x = x_cv_.col(0);
-        P = P_cv_;
-        Xsig_pred = Xsig_pred_cv_;
+        x_model     = &x_cv_;
+        Xsig_model  = &Xsig_pred_cv_;
+        zPred_model = &zPredCVl_;
+        S_model     = &lS_cv_;
+        K_model     = &K_cv_;
     }
     else if(modelInd == 1){
-        x = x_ctrv_.col(0);
-        P = P_ctrv_;
-        Xsig_pred = Xsig_pred_ctrv_;
+        x_model     = &x_ctrv_;
+        Xsig_model  = &Xsig_pred_ctrv_;
+        zPred_model = &zPredCTRVl_;
+        S_model     = &lS_ctrv_;
+        K_model     = &K_ctrv_;
     }
     else{
-        x = x_rm_.col(0);
-        P = P_rm_;
-        Xsig_pred = Xsig_pred_rm_;
+        x_model     = &x_rm_;
+        Xsig_model  = &Xsig_pred_rm_;
+        zPred_model = &zPredRMl_;
+        S_model     = &lS_rm_;
+        K_model     = &K_rm_;
     }
+    const StateVec& x = *x_model;
+    const SigmaMat& Xsig_pred = *Xsig_model;
 
-//    count_++;
-    //extract measurement as VectorXd
-    // VectorXd z = meas_package.raw_measurements_;
-    //set measurement dimension, lidar can measure p_x and p_y
-    int n_z = 2;
-
-    //create matrix for sigma points in measurement space
-    MatrixXd Zsig = MatrixXd(n_z, 2 * n_aug_ + 1);
-
-    //transform sigma points into measurement space
-    for (int i = 0; i < 2 * n_aug_ + 1; i++) {  //2n+1 simga points
-
-        // extract values for better readibility
-        double p_x = Xsig_pred(0, i);
-        double p_y = Xsig_pred(1, i);
-
-        // measurement model
-        Zsig(0, i) = p_x;
-        Zsig(1, i) = p_y;
-    }
+    //lidar measures p_x and p_y, so the measurement sigma points are the first two state rows
+    Eigen::Matrix<double, 2, UKF_N_SIGMA> Zsig = Xsig_pred.topRows<2>();
 
     //mean predicted measurement
-    VectorXd z_pred = VectorXd(n_z);
-    z_pred.fill(0.0);
-    for (int i = 0; i < 2 * n_aug_ + 1; i++) {
-        z_pred = z_pred + weights_(i) * Zsig.col(i);
+    LidarVec z_pred;
+    z_pred.setZero();
+    for (int i = 0; i < UKF_N_SIGMA; i++) {
+        z_pred += weights_(i) * Zsig.col(i);
     }
 
     //measurement covariance matrix S
-    MatrixXd S = MatrixXd(n_z, n_z);
-    S.fill(0.0);
-    for (int i = 0; i < 2 * n_aug_ + 1; i++) {  //2n+1 simga points
+    LidarMat S;
+    S.setZero();
+    for (int i = 0; i < UKF_N_SIGMA; i++) {  //2n+1 simga points
         //residual
-        VectorXd z_diff = Zsig.col(i) - z_pred;
-        S = S + weights_(i) * z_diff * z_diff.transpose();
+        LidarVec z_diff = Zsig.col(i) - z_pred;
+        S.noalias() += weights_(i) * z_diff * z_diff.transpose();
     }
 
     //add measurement noise covariance matrix
-    MatrixXd R = MatrixXd(n_z, n_z);
-    R << std_laspx_*std_laspx_, 0,
-            0, std_laspy_*std_laspy_;
-    S = S + R;
-
-    //create matrix for cross correlation Tc
-    MatrixXd Tc = MatrixXd(n_x_, n_z);
+    S(0, 0) += std_laspx_*std_laspx_;
+    S(1, 1) += std_laspy_*std_laspy_;
 
     /*********************************************************************************************************
     *  UKF Update for Lidar
     *********************************************************************************************************************/
     //calculate cross correlation matrix
-    Tc.fill(0.0);
-    for (int i = 0; i < 2 * n_aug_ + 1; i++) {  //2n+1 simga points
+    LidarGainMat Tc;
+    Tc.setZero();
+    for (int i = 0; i < UKF_N_SIGMA; i++) {  //2n+1 simga points
 
         //residual
-        VectorXd z_diff = Zsig.col(i) - z_pred;
+        LidarVec z_diff = Zsig.col(i) - z_pred;
         // state difference
-        VectorXd x_diff = Xsig_pred.col(i) - x;
+        StateVec x_diff = Xsig_pred.col(i) - x;
 
-        Tc = Tc + weights_(i) * x_diff * z_diff.transpose();
+        Tc.noalias() += weights_(i) * x_diff * z_diff.transpose();
     }
 
-    //Kalman gain K;
-    MatrixXd K = Tc * S.inverse();
-
-    // //residual
-    // VectorXd z_diff = z - z_pred;
-
-    // //update state mean and covariance matrix
-    // x = x + K * z_diff;
-    // P = P - K*S*K.transpose();
-
-    // while (x(3)> M_PI) x(3) -= 2.*M_PI;
-    // while (x(3)<-M_PI) x(3) += 2.*M_PI;
     /*********************************************************************************************************
     *  Update model parameters
     *********************************************************************************************************************/
-    if(modelInd == 0){
-        x_cv_.col(0)  = x;
-        P_cv_         = P;
-        Xsig_pred_cv_ = Xsig_pred;
-        zPredCVl_     = z_pred;
-        lS_cv_        = S;
-        K_cv_         = K;
-    }
-    else if(modelInd == 1){
-        x_ctrv_.col(0)  = x;
-        P_ctrv_         = P;
-        Xsig_pred_ctrv_ = Xsig_pred;
-        zPredCTRVl_     = z_pred;
-        lS_ctrv_        = S;
-        K_ctrv_         = K;
-    }
-    else{
-        x_rm_.col(0)    = x;
-        P_rm_           = P;
-        Xsig_pred_rm_   = Xsig_pred;
-        zPredRMl_       = z_pred;
-        lS_rm_          = S;
-        K_rm_           = K;
-    }
+    //Kalman gain K, the state itself is updated later by the PDA step
+    *K_model     = Tc * S.inverse();
+    *zPred_model = z_pred;
+    *S_model     = S;
 }
 
-void UKF::PDAupdate(vector<VectorXd> z, int modelInd){
-    VectorXd z_pred;
-    MatrixXd S, x_, P_, K;
+void UKF::PDAupdate(const LidarVecList& z, int modelInd){
+    LidarVec z_pred;
+    LidarMat S;
+    StateVec x_;
+    StateMat P_;
+    LidarGainMat K;
     if(modelInd == 0){
         z_pred = zPredCVl_;
         S      = lS_cv_;
@@ -937,7 +884,7 @@ void UKF::PDAupdate(vector<VectorXd> z, int modelInd){
     double b = (2*M_PI*numMeas*(1-pD_*pG_))/(gammaG_*unitV*pD_);
 
     //residual
-    VectorXd z_diff = z[0] - z_pred;
+    LidarVec z_diff = z[0] - z_pred;
 
     //calculate NIS
     NIS_laser_ = z_diff.transpose() * S.inverse() * z_diff;
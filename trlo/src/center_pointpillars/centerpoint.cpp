@@ -44,21 +44,27 @@
 #include <sys/time.h>
 #include <unistd.h>
 
-template<typename T>
-double getAverage(std::vector<T> const& v) {
-    if (v.empty()) {
-        return 0;
-    }
-    return std::accumulate(v.begin(), v.end(), 0.0) / v.size();
-}
-
-CenterPoint::CenterPoint(std::string modelFile_Dir, bool verbose): verbose_(verbose)
+CenterPoint::CenterPoint(std::string modelFile_Dir, bool verbose, bool cpu_preprocess, PostProcessBackend post_backend)
+    : verbose_(verbose), post_backend_(post_backend)
 {
+    trlo::MetricsRegistry& registry = trlo::MetricsRegistry::global();
+    timing_pre_ = registry.histogram("centerpoint/voxelization_ms");
+    timing_scn_engine_ = registry.histogram("centerpoint/backbone_ms");
+    timing_trt_ = registry.histogram("centerpoint/rpn_head_ms");
+    timing_post_ = registry.histogram("centerpoint/decode_nms_ms");
+
     trt_ = TensorRT::load(modelFile_Dir + "rpn_centerhead_sim.plan");
     if(trt_ == nullptr) abort();
 
-    pre_.reset(new PreProcessCuda());
+    if (cpu_preprocess) {
+        pre_.reset(new PreProcessCpu());
+        checkCudaErrors(cudaMalloc((void **)&d_cpu_voxel_features_, params_.max_voxels * params_.feature_num * sizeof(half)));
+        checkCudaErrors(cudaMalloc((void **)&d_cpu_voxel_indices_, params_.max_voxels * 4 * sizeof(unsigned int)));
+    } else {
+        pre_.reset(new PreProcessCuda());
+    }
     post_.reset(new PostProcessCuda());
+    post_cpu_.reset(new PostProcessCpu());
 
     scn_engine_ = spconv::load_engine_from_onnx(modelFile_Dir + "centerpoint.scn.onnx");
 
@@ -100,10 +106,31 @@ CenterPoint::CenterPoint(std::string modelFile_Dir, bool verbose): verbose_(verb
         }
         auto d = trt_->getBindingDims("hm_" + std::to_string(i));
         hm_c_[i] = d[1];
+
+        if (post_backend_ == POSTPROCESS_CPU) {
+            checkCudaErrors(cudaMallocHost((void **)&h_reg_[i], trt_->getBindingNumel("reg_" + std::to_string(i)) * sizeof(half)));
+            checkCudaErrors(cudaMallocHost((void **)&h_height_[i], trt_->getBindingNumel("height_" + std::to_string(i)) * sizeof(half)));
+            checkCudaErrors(cudaMallocHost((void **)&h_dim_[i], trt_->getBindingNumel("dim_" + std::to_string(i)) * sizeof(half)));
+            checkCudaErrors(cudaMallocHost((void **)&h_rot_[i], trt_->getBindingNumel("rot_" + std::to_string(i)) * sizeof(half)));
+            checkCudaErrors(cudaMallocHost((void **)&h_vel_[i], trt_->getBindingNumel("vel_" + std::to_string(i)) * sizeof(half)));
+            checkCudaErrors(cudaMallocHost((void **)&h_hm_[i], trt_->getBindingNumel("hm_" + std::to_string(i)) * sizeof(half)));
+        }
     }
     h_mask_size_ = params_.nms_pre_max_size * DIVUP(params_.nms_pre_max_size, NMS_THREADS_PER_BLOCK) * sizeof(uint64_t);
     checkCudaErrors(cudaMallocHost((void **)&h_mask_, h_mask_size_));
     checkCudaErrors(cudaMemset(h_mask_, 0, h_mask_size_));
+
+    if (post_backend_ == POSTPROCESS_CUDA_BATCHED) {
+        const size_t boxes_size = NUM_TASKS * MAX_DET_NUM * DET_CHANNEL * sizeof(float);
+        batch_kept_size_ = NUM_TASKS * (1 + params_.nms_post_max_size * DET_CHANNEL) * sizeof(float);
+        checkCudaErrors(cudaMalloc((void **)&d_batch_detections_num_, NUM_TASKS * sizeof(unsigned int)));
+        checkCudaErrors(cudaMalloc((void **)&d_batch_detections_, boxes_size));
+        checkCudaErrors(cudaMalloc((void **)&d_batch_sorted_, boxes_size));
+        checkCudaErrors(cudaMalloc((void **)&d_batch_permuted_, boxes_size));
+        checkCudaErrors(cudaMalloc((void **)&d_batch_mask_, NUM_TASKS * MAX_DET_NUM * NMS_MAX_COL_BLOCKS * sizeof(uint64_t)));
+        checkCudaErrors(cudaMalloc((void **)&d_batch_kept_, batch_kept_size_));
+        checkCudaErrors(cudaMallocHost((void **)&h_batch_kept_, batch_kept_size_));
+    }
     return;
 }
 
@@ -125,9 +152,29 @@ CenterPoint::~CenterPoint(void)
         checkCudaErrors(cudaFree(d_rot_[i]));
         checkCudaErrors(cudaFree(d_vel_[i]));
         checkCudaErrors(cudaFree(d_hm_[i]));
+
+        if (post_backend_ == POSTPROCESS_CPU) {
+            checkCudaErrors(cudaFreeHost(h_reg_[i]));
+            checkCudaErrors(cudaFreeHost(h_height_[i]));
+            checkCudaErrors(cudaFreeHost(h_dim_[i]));
+            checkCudaErrors(cudaFreeHost(h_rot_[i]));
+            checkCudaErrors(cudaFreeHost(h_vel_[i]));
+            checkCudaErrors(cudaFreeHost(h_hm_[i]));
+        }
     }
 
     checkCudaErrors(cudaFreeHost(h_mask_));
+    if (post_backend_ == POSTPROCESS_CUDA_BATCHED) {
+        checkCudaErrors(cudaFree(d_batch_detections_num_));
+        checkCudaErrors(cudaFree(d_batch_detections_));
+        checkCudaErrors(cudaFree(d_batch_sorted_));
+        checkCudaErrors(cudaFree(d_batch_permuted_));
+        checkCudaErrors(cudaFree(d_batch_mask_));
+        checkCudaErrors(cudaFree(d_batch_kept_));
+        checkCudaErrors(cudaFreeHost(h_batch_kept_));
+    }
+    if (d_cpu_voxel_features_) checkCudaErrors(cudaFree(d_cpu_voxel_features_));
+    if (d_cpu_voxel_indices_) checkCudaErrors(cudaFree(d_cpu_voxel_indices_));
     return;
 }
 
@@ -136,15 +183,29 @@ int CenterPoint::prepare(){
     return 0;
 }
 
+int CenterPoint::detect(const void* points, unsigned int points_num, double stamp,
+                        cudaStream_t stream, std::vector<Bndbox>& boxes)
+{
+    int ret = doinfer(const_cast<void*>(points), points_num, stream);
+    boxes = nms_pred_;
+    return ret;
+}
+
 int CenterPoint::doinfer(void* points, unsigned int point_num, cudaStream_t stream)
 {
     float elapsedTime = 0.0f;
 
     timer_.start(stream);
     pre_->generateVoxels((float *)points, point_num, stream);
-    timing_pre_.push_back(timer_.stop("Voxelization", verbose_));
+    timing_pre_->record(timer_.stop("Voxelization", verbose_));
 
     unsigned int valid_num = pre_->getOutput(&d_voxel_features, &d_voxel_indices, sparse_shape);
+    if (!pre_->onDevice()) {
+        checkCudaErrors(cudaMemcpyAsync(d_cpu_voxel_features_, d_voxel_features, valid_num * params_.feature_num * sizeof(half), cudaMemcpyHostToDevice, stream));
+        checkCudaErrors(cudaMemcpyAsync(d_cpu_voxel_indices_, d_voxel_indices, valid_num * 4 * sizeof(unsigned int), cudaMemcpyHostToDevice, stream));
+        d_voxel_features = d_cpu_voxel_features_;
+        d_voxel_indices = d_cpu_voxel_indices_;
+    }
     if (verbose_) {
         std::cout << "valid_num: " << valid_num <<std::endl;
     }
@@ -155,7 +216,7 @@ int CenterPoint::doinfer(void* points, unsigned int point_num, cudaStream_t stre
         {valid_num, 4}, spconv::DType::Int32,   d_voxel_indices,
         1, sparse_shape, stream
     );
-    timing_scn_engine_.push_back(timer_.stop("3D Backbone", verbose_));
+    timing_scn_engine_->record(timer_.stop("3D Backbone", verbose_));
 
     timer_.start(stream);
     trt_->forward({result->features_data(), d_reg_[0], d_height_[0], d_dim_[0], d_rot_[0], d_vel_[0], d_hm_[0],
@@ -164,10 +225,33 @@ int CenterPoint::doinfer(void* points, unsigned int point_num, cudaStream_t stre
                                                 d_reg_[3], d_height_[3], d_dim_[3], d_rot_[3], d_vel_[3], d_hm_[3],
                                                 d_reg_[4], d_height_[4], d_dim_[4], d_rot_[4], d_vel_[4], d_hm_[4],
                                                 d_reg_[5], d_height_[5], d_dim_[5], d_rot_[5], d_vel_[5], d_hm_[5]}, stream);
-    timing_trt_.push_back(timer_.stop("RPN + Head", verbose_));
+    timing_trt_->record(timer_.stop("RPN + Head", verbose_));
     nms_pred_.clear();
 
     timer_.start(stream);
+    switch (post_backend_) {
+        case POSTPROCESS_CPU:
+            postprocessCpu(stream);
+            break;
+        case POSTPROCESS_CUDA_BATCHED:
+            postprocessCudaBatched(stream);
+            break;
+        default:
+            postprocessCuda(stream);
+            break;
+    }
+    timing_post_->record(timer_.stop("Decode + NMS", verbose_));
+    if (verbose_) {
+        std::cout << "Detection NUM: " << nms_pred_.size() << std::endl;
+        // for(int loop = 0; loop<nms_pred_.size();loop++){
+        //     printf("%d, %f, %f, %f, %f, %f, %f, %f, %f, %f, %f\n", loop, nms_pred_[loop].x, nms_pred_[loop].y,nms_pred_[loop].z,nms_pred_[loop].w,nms_pred_[loop].l,nms_pred_[loop].h,nms_pred_[loop].vx,nms_pred_[loop].vy,nms_pred_[loop].rt,nms_pred_[loop].score);
+        // }
+    }
+    return 0;
+}
+
+void CenterPoint::postprocessCuda(cudaStream_t stream)
+{
     for(unsigned int i_task =0; i_task < NUM_TASKS; i_task++) {
         checkCudaErrors(cudaMemset(h_detections_num_, 0, sizeof(unsigned int)));
         checkCudaErrors(cudaMemset(d_detections_, 0, MAX_DET_NUM * DET_CHANNEL * sizeof(float)));
@@ -200,43 +284,63 @@ int CenterPoint::doinfer(void* points, unsigned int point_num, cudaStream_t stre
         checkCudaErrors(cudaStreamSynchronize(stream));
 
         int col_blocks = DIVUP(*h_detections_num_, NMS_THREADS_PER_BLOCK);
-        std::vector<uint64_t> remv(col_blocks, 0);
-        std::vector<bool> keep(*h_detections_num_, false);
-        int max_keep_size = 0;
-        for (unsigned int i_nms = 0; i_nms < *h_detections_num_; i_nms++) {
-            unsigned int nblock = i_nms / NMS_THREADS_PER_BLOCK;
-            unsigned int inblock = i_nms % NMS_THREADS_PER_BLOCK;
-
-            if (!(remv[nblock] & (1ULL << inblock))) {
-                keep[i_nms] = true;
-                if (max_keep_size++ < params_.nms_post_max_size) {
-                    nms_pred_.push_back(Bndbox(detections_[i_nms].val[0], detections_[i_nms].val[1], detections_[i_nms].val[2],
-                                        detections_[i_nms].val[3], detections_[i_nms].val[4], detections_[i_nms].val[5],
-                                        detections_[i_nms].val[6], detections_[i_nms].val[7], detections_[i_nms].val[8],
-                                        params_.task_num_stride[i_task] + static_cast<int>(detections_[i_nms].val[9]), detections_[i_nms].val[10]));
-                }
-                uint64_t* p = h_mask_ + i_nms * col_blocks;
-                for (int j_nms = nblock; j_nms < col_blocks; j_nms++) {
-                    remv[j_nms] |= p[j_nms];
-                }
-            }
+        std::vector<int> keep;
+        nms_mask_reduce_cpu(h_mask_, *h_detections_num_, col_blocks, params_.nms_post_max_size, keep);
+        for (int i_nms : keep) {
+            nms_pred_.push_back(Bndbox(detections_[i_nms].val[0], detections_[i_nms].val[1], detections_[i_nms].val[2],
+                                detections_[i_nms].val[3], detections_[i_nms].val[4], detections_[i_nms].val[5],
+                                detections_[i_nms].val[6], detections_[i_nms].val[7], detections_[i_nms].val[8],
+                                params_.task_num_stride[i_task] + static_cast<int>(detections_[i_nms].val[9]), detections_[i_nms].val[10]));
         }
     }
-    timing_post_.push_back(timer_.stop("Decode + NMS", verbose_));
-    if (verbose_) {
-        std::cout << "Detection NUM: " << nms_pred_.size() << std::endl;
-        // for(int loop = 0; loop<nms_pred_.size();loop++){
-        //     printf("%d, %f, %f, %f, %f, %f, %f, %f, %f, %f, %f\n", loop, nms_pred_[loop].x, nms_pred_[loop].y,nms_pred_[loop].z,nms_pred_[loop].w,nms_pred_[loop].l,nms_pred_[loop].h,nms_pred_[loop].vx,nms_pred_[loop].vy,nms_pred_[loop].rt,nms_pred_[loop].score);
-        // }
+}
+
+void CenterPoint::postprocessCpu(cudaStream_t stream)
+{
+    const int HW = reg_h_ * reg_w_;
+    std::vector<TaskHead> heads(NUM_TASKS);
+    for(unsigned int i_task =0; i_task < NUM_TASKS; i_task++) {
+        checkCudaErrors(cudaMemcpyAsync(h_reg_[i_task], d_reg_[i_task], reg_c_ * HW * sizeof(half), cudaMemcpyDeviceToHost, stream));
+        checkCudaErrors(cudaMemcpyAsync(h_height_[i_task], d_height_[i_task], height_c_ * HW * sizeof(half), cudaMemcpyDeviceToHost, stream));
+        checkCudaErrors(cudaMemcpyAsync(h_dim_[i_task], d_dim_[i_task], dim_c_ * HW * sizeof(half), cudaMemcpyDeviceToHost, stream));
+        checkCudaErrors(cudaMemcpyAsync(h_rot_[i_task], d_rot_[i_task], rot_c_ * HW * sizeof(half), cudaMemcpyDeviceToHost, stream));
+        checkCudaErrors(cudaMemcpyAsync(h_vel_[i_task], d_vel_[i_task], vel_c_ * HW * sizeof(half), cudaMemcpyDeviceToHost, stream));
+        checkCudaErrors(cudaMemcpyAsync(h_hm_[i_task], d_hm_[i_task], hm_c_[i_task] * HW * sizeof(half), cudaMemcpyDeviceToHost, stream));
+        heads[i_task] = {h_reg_[i_task], h_height_[i_task], h_dim_[i_task], h_rot_[i_task], h_vel_[i_task], h_hm_[i_task], hm_c_[i_task]};
+    }
+    checkCudaErrors(cudaStreamSynchronize(stream));
+
+    post_cpu_->doPostCpu(reg_h_, reg_w_, reg_c_, height_c_, dim_c_, rot_c_, vel_c_, heads, nms_pred_);
+}
+
+void CenterPoint::postprocessCudaBatched(cudaStream_t stream)
+{
+    post_->doPostBatchedCuda(reg_h_, reg_w_, reg_c_, height_c_, dim_c_, rot_c_, vel_c_, hm_c_,
+                             d_reg_, d_height_, d_dim_, d_rot_, d_vel_, d_hm_,
+                             d_batch_detections_num_, d_batch_detections_, d_batch_sorted_, d_batch_permuted_,
+                             d_batch_mask_, d_batch_kept_, stream);
+
+    // the only host/device transfer of the postprocess
+    checkCudaErrors(cudaMemcpyAsync(h_batch_kept_, d_batch_kept_, batch_kept_size_, cudaMemcpyDeviceToHost, stream));
+    checkCudaErrors(cudaStreamSynchronize(stream));
+
+    const unsigned int task_stride = 1 + params_.nms_post_max_size * DET_CHANNEL;
+    for(unsigned int i_task =0; i_task < NUM_TASKS; i_task++) {
+        const float* task_kept = h_batch_kept_ + i_task * task_stride;
+        unsigned int num_keep = static_cast<unsigned int>(task_kept[0]);
+        for (unsigned int k = 0; k < num_keep; k++) {
+            const float* box = task_kept + 1 + k * DET_CHANNEL;
+            nms_pred_.push_back(Bndbox(box[0], box[1], box[2], box[3], box[4], box[5], box[6], box[7], box[8],
+                                       params_.task_num_stride[i_task] + static_cast<int>(box[9]), box[10]));
+        }
     }
-    return 0;
 }
 
 void CenterPoint::perf_report(){
-    float a = getAverage(timing_pre_);
-    float b = getAverage(timing_scn_engine_);
-    float c = getAverage(timing_trt_);
-    float d = getAverage(timing_post_);
+    float a = timing_pre_->snapshot().mean();
+    float b = timing_scn_engine_->snapshot().mean();
+    float c = timing_trt_->snapshot().mean();
+    float d = timing_post_->snapshot().mean();
     float total = a + b + c + d;
     std::cout << "\nPerf Report: "        << std::endl;
     std::cout << "    Voxelization: "   << a << " ms." <<std::endl;
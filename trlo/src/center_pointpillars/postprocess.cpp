@@ -128,3 +128,37 @@ int PostProcessCuda::doPermuteCuda(
   permute_launch(boxes_num, boxes_sorted, permute_boxes, stream);
   return 0;
 }
+
+int PostProcessCuda::doPostBatchedCuda(
+    int H,
+    int W,
+    int C_reg,
+    int C_height,
+    int C_dim,
+    int C_rot,
+    int C_vel,
+    const int *C_hm,
+    half *const *reg,
+    half *const *height,
+    half *const *dim,
+    half *const *rot,
+    half *const *vel,
+    half *const *hm,
+    unsigned int *detection_num,
+    float *detections,
+    float *boxes_sorted,
+    float *permute_boxes,
+    uint64_t *mask,
+    float *kept, cudaStream_t stream)
+{
+  checkCudaErrors(cudaMemsetAsync(detection_num, 0, NUM_TASKS * sizeof(unsigned int), stream));
+
+  if (postprocess_batched_launch(NUM_TASKS, H, W, C_reg, C_height, C_dim, C_rot, C_vel, C_hm,
+                                 reg, height, dim, rot, vel, hm, detection_num, detections,
+                                 d_post_center_range_, params_.out_size_factor, d_voxel_size_, d_pc_range_,
+                                 params_.score_threshold, stream) != 0) return -1;
+  if (sort_permute_batched_launch(NUM_TASKS, detection_num, detections, boxes_sorted, permute_boxes, stream) != 0) return -1;
+  if (nms_batched_launch(NUM_TASKS, detection_num, permute_boxes, params_.nms_iou_threshold, mask, stream) != 0) return -1;
+  if (nms_reduce_batched_launch(NUM_TASKS, detection_num, mask, boxes_sorted, params_.nms_post_max_size, kept, stream) != 0) return -1;
+  return 0;
+}
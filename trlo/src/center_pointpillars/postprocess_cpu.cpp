@@ -0,0 +1,407 @@
+/****************************************************************************************
+ *
+ * Copyright (c) 2024, Shenyang Institute of Automation, Chinese Academy of Sciences
+ *
+ * Authors: Yanpeng Jia
+ * Contact: jiayanpeng@sia.cn
+ *
+ ****************************************************************************************/
+/*
+ * SPDX-FileCopyrightText: Copyright (c) 2023 NVIDIA CORPORATION & AFFILIATES. All rights reserved.
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+ 
+#include "center_pointpillars/postprocess_cpu.h"
+#include <math.h>
+#include <unordered_map>
+
+#define HALF_PI  (3.141592653 * 0.5)
+
+namespace {
+
+struct Point2 {
+    float x;
+    float y;
+};
+
+inline float cross(const Point2 p1, const Point2 p2, const Point2 p0) {
+    return (p1.x - p0.x) * (p2.y - p0.y) - (p2.x - p0.x) * (p1.y - p0.y);
+}
+
+inline int check_box2d(float const *const box, const Point2 p) {
+    const float MARGIN = 1e-2;
+    float center_x = box[0];
+    float center_y = box[1];
+    float angle_cos = cosf(-box[6]);
+    float angle_sin = sinf(-box[6]);
+    float rot_x = (p.x - center_x) * angle_cos + (p.y - center_y) * (-angle_sin);
+    float rot_y = (p.x - center_x) * angle_sin + (p.y - center_y) * angle_cos;
+
+    return (fabsf(rot_x) < box[3] / 2 + MARGIN && fabsf(rot_y) < box[4] / 2 + MARGIN);
+}
+
+inline bool intersection(const Point2 p1, const Point2 p0, const Point2 q1, const Point2 q0, Point2 &ans) {
+
+    if (( fminf(p0.x, p1.x) <= fmaxf(q0.x, q1.x) &&
+          fminf(q0.x, q1.x) <= fmaxf(p0.x, p1.x) &&
+          fminf(p0.y, p1.y) <= fmaxf(q0.y, q1.y) &&
+          fminf(q0.y, q1.y) <= fmaxf(p0.y, p1.y) ) == 0)
+        return false;
+
+    float s1 = cross(q0, p1, p0);
+    float s2 = cross(p1, q1, p0);
+    float s3 = cross(p0, q1, q0);
+    float s4 = cross(q1, p1, q0);
+
+    if (!(s1 * s2 > 0 && s3 * s4 > 0))
+        return false;
+
+    float s5 = cross(q1, p1, p0);
+    if (fabsf(s5 - s1) > 1e-8) {
+        ans.x = (s5 * q0.x - s1 * q1.x) / (s5 - s1);
+        ans.y = (s5 * q0.y - s1 * q1.y) / (s5 - s1);
+
+    } else {
+        float a0 = p0.y - p1.y, b0 = p1.x - p0.x, c0 = p0.x * p1.y - p1.x * p0.y;
+        float a1 = q0.y - q1.y, b1 = q1.x - q0.x, c1 = q0.x * q1.y - q1.x * q0.y;
+        float D = a0 * b1 - a1 * b0;
+
+        ans.x = (b0 * c1 - b1 * c0) / D;
+        ans.y = (a1 * c0 - a0 * c1) / D;
+    }
+
+    return true;
+}
+
+inline void rotate_around_center(const Point2 &center, const float angle_cos, const float angle_sin, Point2 &p) {
+    float new_x = (p.x - center.x) * angle_cos + (p.y - center.y) * (-angle_sin) + center.x;
+    float new_y = (p.x - center.x) * angle_sin + (p.y - center.y) * angle_cos + center.y;
+    p = Point2 {new_x, new_y};
+}
+
+// layout consumed by NMS, see permute_cuda
+inline void permute_box(const float11 &det, float *box) {
+    box[0] = det.val[0];
+    box[1] = det.val[1];
+    box[2] = det.val[2];
+    box[3] = det.val[4];
+    box[4] = det.val[3];
+    box[5] = det.val[5];
+    box[6] = -det.val[8] - HALF_PI;
+}
+
+inline int64_t cell_key(int cx, int cy) {
+    return ((int64_t)cx << 32) | (uint32_t)cy;
+}
+
+}  // namespace
+
+float rotatedBoxIoU(const float *box_a, const float *box_b) {
+    // boxes whose circumscribed circles are disjoint cannot overlap
+    float ra = 0.5f * sqrtf(box_a[3] * box_a[3] + box_a[4] * box_a[4]);
+    float rb = 0.5f * sqrtf(box_b[3] * box_b[3] + box_b[4] * box_b[4]);
+    float dx = box_a[0] - box_b[0], dy = box_a[1] - box_b[1];
+    if (dx * dx + dy * dy > (ra + rb) * (ra + rb)) return 0.0f;
+
+    float a_angle = box_a[6], b_angle = box_b[6];
+    float a_dx_half = box_a[3] / 2, b_dx_half = box_b[3] / 2, a_dy_half = box_a[4] / 2, b_dy_half = box_b[4] / 2;
+    float a_x1 = box_a[0] - a_dx_half, a_y1 = box_a[1] - a_dy_half;
+    float a_x2 = box_a[0] + a_dx_half, a_y2 = box_a[1] + a_dy_half;
+    float b_x1 = box_b[0] - b_dx_half, b_y1 = box_b[1] - b_dy_half;
+    float b_x2 = box_b[0] + b_dx_half, b_y2 = box_b[1] + b_dy_half;
+    Point2 box_a_corners[5];
+    Point2 box_b_corners[5];
+
+    Point2 center_a = Point2 {box_a[0], box_a[1]};
+    Point2 center_b = Point2 {box_b[0], box_b[1]};
+
+    Point2 cross_points[16];
+    Point2 poly_center = {0, 0};
+    int cnt = 0;
+
+    box_a_corners[0] = Point2 {a_x1, a_y1};
+    box_a_corners[1] = Point2 {a_x2, a_y1};
+    box_a_corners[2] = Point2 {a_x2, a_y2};
+    box_a_corners[3] = Point2 {a_x1, a_y2};
+
+    box_b_corners[0] = Point2 {b_x1, b_y1};
+    box_b_corners[1] = Point2 {b_x2, b_y1};
+    box_b_corners[2] = Point2 {b_x2, b_y2};
+    box_b_corners[3] = Point2 {b_x1, b_y2};
+
+    float a_angle_cos = cosf(a_angle), a_angle_sin = sinf(a_angle);
+    float b_angle_cos = cosf(b_angle), b_angle_sin = sinf(b_angle);
+
+    for (int k = 0; k < 4; k++) {
+        rotate_around_center(center_a, a_angle_cos, a_angle_sin, box_a_corners[k]);
+        rotate_around_center(center_b, b_angle_cos, b_angle_sin, box_b_corners[k]);
+    }
+
+    box_a_corners[4] = box_a_corners[0];
+    box_b_corners[4] = box_b_corners[0];
+
+    for (int i = 0; i < 4; i++) {
+        for (int j = 0; j < 4; j++) {
+            if (intersection(box_a_corners[i + 1], box_a_corners[i],
+                             box_b_corners[j + 1], box_b_corners[j],
+                             cross_points[cnt])) {
+                poly_center = {poly_center.x + cross_points[cnt].x, poly_center.y + cross_points[cnt].y};
+                cnt++;
+            }
+        }
+    }
+
+    for (int k = 0; k < 4; k++) {
+        if (check_box2d(box_a, box_b_corners[k])) {
+            poly_center = {poly_center.x + box_b_corners[k].x, poly_center.y + box_b_corners[k].y};
+            cross_points[cnt] = box_b_corners[k];
+            cnt++;
+        }
+        if (check_box2d(box_b, box_a_corners[k])) {
+            poly_center = {poly_center.x + box_a_corners[k].x, poly_center.y + box_a_corners[k].y};
+            cross_points[cnt] = box_a_corners[k];
+            cnt++;
+        }
+    }
+
+    if (cnt < 3) return 0.0f;
+
+    poly_center.x /= cnt;
+    poly_center.y /= cnt;
+
+    float angles[16];
+    for (int k = 0; k < cnt; k++) {
+        angles[k] = atan2f(cross_points[k].y - poly_center.y, cross_points[k].x - poly_center.x);
+    }
+    for (int j = 0; j < cnt - 1; j++) {
+        for (int i = 0; i < cnt - j - 1; i++) {
+            if (angles[i] > angles[i + 1]) {
+                std::swap(angles[i], angles[i + 1]);
+                std::swap(cross_points[i], cross_points[i + 1]);
+            }
+        }
+    }
+
+    float area = 0;
+    for (int k = 0; k < cnt - 1; k++) {
+        Point2 a = {cross_points[k].x - cross_points[0].x,
+                    cross_points[k].y - cross_points[0].y};
+        Point2 b = {cross_points[k + 1].x - cross_points[0].x,
+                    cross_points[k + 1].y - cross_points[0].y};
+        area += (a.x * b.y - a.y * b.x);
+    }
+
+    float s_overlap = fabsf(area) / 2.0f;
+    float sa = box_a[3] * box_a[4];
+    float sb = box_b[3] * box_b[4];
+    return s_overlap / fmaxf(sa + sb - s_overlap, 1e-8);
+}
+
+int nms_mask_reduce_cpu(
+    const uint64_t *mask,
+    unsigned int boxes_num,
+    unsigned int mask_stride,
+    unsigned int max_keep,
+    std::vector<int> &keep)
+{
+    keep.clear();
+    const unsigned int col_blocks = DIVUP(boxes_num, NMS_THREADS_PER_BLOCK);
+    std::vector<uint64_t> remv(col_blocks, 0);
+
+    for (unsigned int i_nms = 0; i_nms < boxes_num && keep.size() < max_keep; i_nms++) {
+        unsigned int nblock = i_nms / NMS_THREADS_PER_BLOCK;
+        unsigned int inblock = i_nms % NMS_THREADS_PER_BLOCK;
+
+        if (!(remv[nblock] & (1ULL << inblock))) {
+            keep.push_back(i_nms);
+            const uint64_t *p = mask + i_nms * mask_stride;
+            for (unsigned int j_nms = nblock; j_nms < col_blocks; j_nms++) {
+                remv[j_nms] |= p[j_nms];
+            }
+        }
+    }
+
+    return keep.size();
+}
+
+PostProcessCpu::PostProcessCpu()
+{}
+
+PostProcessCpu::~PostProcessCpu()
+{}
+
+int PostProcessCpu::doPostDecodeCpu(
+    int H,
+    int W,
+    int C_reg,
+    int C_height,
+    int C_dim,
+    int C_rot,
+    int C_vel,
+    const TaskHead &head,
+    std::vector<float11> &detections)
+{
+    const int HW = H * W;
+    std::vector<float> max_logit(HW);
+    std::vector<int> label(HW, 0);
+
+    // class argmax on the logits, the sigmoid is monotonic
+    for (int i = 0; i < HW; i++) {
+        max_logit[i] = __half2float(head.hm[i]);
+    }
+    for (int c = 1; c < head.C_hm; c++) {
+        const half *hm_c = head.hm + c * HW;
+        for (int i = 0; i < HW; i++) {
+            float logit = __half2float(hm_c[i]);
+            bool greater = logit > max_logit[i];
+            max_logit[i] = greater ? logit : max_logit[i];
+            label[i] = greater ? c : label[i];
+        }
+    }
+
+    // prefilter on the logit, the score itself is checked below
+    const float logit_threshold = logf(params_.score_threshold / (1.0f - params_.score_threshold)) - 1e-4f;
+
+    detections.clear();
+    for (int i = 0; i < HW; i++) {
+        if (max_logit[i] < logit_threshold) continue;
+
+        float score = 1 / (1 + expf(-max_logit[i]));
+        if (score < params_.score_threshold) continue;
+
+        int h = i / W;
+        int w = i % W;
+
+        float xs = (__half2float(head.reg[i]) + w) * params_.out_size_factor * params_.voxel_size[0] + params_.pc_range[0];
+        float ys = (__half2float(head.reg[HW + i]) + h) * params_.out_size_factor * params_.voxel_size[1] + params_.pc_range[1];
+        float zs = __half2float(head.height[i]);
+
+        if (xs < params_.post_center_range[0] || xs > params_.post_center_range[3]) continue;
+        if (ys < params_.post_center_range[1] || ys > params_.post_center_range[4]) continue;
+        if (zs < params_.post_center_range[2] || zs > params_.post_center_range[5]) continue;
+
+        float11 det;
+        det.val[0] = xs;
+        det.val[1] = ys;
+        det.val[2] = zs;
+        det.val[3] = expf(__half2float(head.dim[0 * HW + i]));
+        det.val[4] = expf(__half2float(head.dim[1 * HW + i]));
+        det.val[5] = expf(__half2float(head.dim[2 * HW + i]));
+        det.val[6] = __half2float(head.vel[0 * HW + i]);
+        det.val[7] = __half2float(head.vel[1 * HW + i]);
+        det.val[8] = atan2f(__half2float(head.rot[i]), __half2float(head.rot[HW + i]));
+        det.val[9] = label[i];
+        det.val[10] = score;
+        detections.push_back(det);
+    }
+
+    auto by_score = [](const float11 &a, const float11 &b) { return a.val[10] > b.val[10]; };
+    if (detections.size() > params_.nms_pre_max_size) {
+        std::nth_element(detections.begin(), detections.begin() + params_.nms_pre_max_size, detections.end(), by_score);
+        detections.resize(params_.nms_pre_max_size);
+    }
+    std::sort(detections.begin(), detections.end(), by_score);
+
+    return detections.size();
+}
+
+int PostProcessCpu::doPostNMSCpu(
+    const std::vector<float11> &detections,
+    std::vector<int> &keep)
+{
+    keep.clear();
+    const int boxes_num = detections.size();
+    if (boxes_num == 0) return 0;
+
+    std::vector<float> boxes(boxes_num * 7);
+    float max_radius = 0.0f;
+    for (int i = 0; i < boxes_num; i++) {
+        float *box = &boxes[i * 7];
+        permute_box(detections[i], box);
+        max_radius = std::max(max_radius, 0.5f * sqrtf(box[3] * box[3] + box[4] * box[4]));
+    }
+
+    // overlapping boxes have centers closer than 2 * max_radius, so the 3x3 neighbourhood suffices
+    const float cell_size = std::max(2.0f * max_radius, 1e-3f);
+    std::unordered_map<int64_t, std::vector<int>> grid;
+
+    for (int i = 0; i < boxes_num && keep.size() < params_.nms_post_max_size; i++) {
+        const float *cur_box = &boxes[i * 7];
+        int cx = floorf(cur_box[0] / cell_size);
+        int cy = floorf(cur_box[1] / cell_size);
+
+        bool suppressed = false;
+        for (int dx = -1; dx <= 1 && !suppressed; dx++) {
+            for (int dy = -1; dy <= 1 && !suppressed; dy++) {
+                auto cell = grid.find(cell_key(cx + dx, cy + dy));
+                if (cell == grid.end()) continue;
+                for (int j : cell->second) {
+                    if (rotatedBoxIoU(&boxes[j * 7], cur_box) >= params_.nms_iou_threshold) {
+                        suppressed = true;
+                        break;
+                    }
+                }
+            }
+        }
+        if (suppressed) continue;
+
+        keep.push_back(i);
+        grid[cell_key(cx, cy)].push_back(i);
+    }
+
+    return keep.size();
+}
+
+int PostProcessCpu::doPostCpu(
+    int H,
+    int W,
+    int C_reg,
+    int C_height,
+    int C_dim,
+    int C_rot,
+    int C_vel,
+    const std::vector<TaskHead> &heads,
+    std::vector<Bndbox> &boxes)
+{
+    std::vector<std::vector<Bndbox>> task_boxes(heads.size());
+
+    #pragma omp parallel for schedule(dynamic, 1)
+    for (int i_task = 0; i_task < (int)heads.size(); i_task++) {
+        std::vector<float11> detections;
+        std::vector<int> keep;
+        doPostDecodeCpu(H, W, C_reg, C_height, C_dim, C_rot, C_vel, heads[i_task], detections);
+        doPostNMSCpu(detections, keep);
+
+        for (int k : keep) {
+            const float11 &det = detections[k];
+            task_boxes[i_task].push_back(Bndbox(det.val[0], det.val[1], det.val[2],
+                                                det.val[3], det.val[4], det.val[5],
+                                                det.val[6], det.val[7], det.val[8],
+                                                params_.task_num_stride[i_task] + static_cast<int>(det.val[9]), det.val[10]));
+        }
+    }
+
+    boxes.clear();
+    for (const auto &task : task_boxes) {
+        boxes.insert(boxes.end(), task.begin(), task.end());
+    }
+    return boxes.size();
+}
@@ -409,4 +409,251 @@ int permute_launch(unsigned int boxes_num,
     }
 
     return 0;
-}
\ No newline at end of file
+}
+
+int postprocess_batched_launch(
+                    int num_tasks,
+                    int H,
+                    int W,
+                    int C_reg,
+                    int C_height,
+                    int C_dim,
+                    int C_rot,
+                    int C_vel,
+                    const int *C_hm,
+                    half *const *reg,
+                    half *const *height,
+                    half *const *dim,
+                    half *const *rot,
+                    half *const *vel,
+                    half *const *hm,
+                    unsigned int *detection_num,
+                    float *detections,
+                    const float *post_center_range,
+                    float out_size_factor,
+                    const float *voxel_size,
+                    const float *pc_range,
+                    float score_threshold,
+                    cudaStream_t stream)
+{
+    dim3 threads(256);
+    dim3 blocks(DIVUP(H * W, threads.x));
+
+    // one decode per task into its own slot, no synchronization in between
+    for (int i_task = 0; i_task < num_tasks; i_task++) {
+        predictKernel<<<blocks, threads, 0, stream>>>(1, H, W, C_reg, C_height, C_dim, C_rot, C_vel, C_hm[i_task],
+                                                      reg[i_task], height[i_task], dim[i_task], rot[i_task], vel[i_task], hm[i_task],
+                                                      detection_num + i_task, detections + i_task * MAX_DET_NUM * DET_CHANNEL,
+                                                      post_center_range, out_size_factor, voxel_size, pc_range,
+                                                      score_threshold);
+    }
+
+    auto err = cudaGetLastError();
+    if (cudaSuccess != err) {
+        fprintf(stderr, "CUDA kernel failed : %s\n", cudaGetErrorString(err));
+        return -1;
+    }
+
+    return 0;
+}
+
+// one block per task: bitonic sort of the scores, then gather into sorted and permuted boxes
+__global__ void sort_permute_batched_cuda(const unsigned int *detection_num, const float *detections,
+                                          float *boxes_sorted, float *permute_boxes_sorted) {
+    const int task = blockIdx.x;
+    const int tid = threadIdx.x;
+    const int boxes_num = min(detection_num[task], MAX_DET_NUM);
+
+    const float *task_detections = detections + task * MAX_DET_NUM * DET_CHANNEL;
+    float *task_sorted = boxes_sorted + task * MAX_DET_NUM * DET_CHANNEL;
+    float *task_permuted = permute_boxes_sorted + task * MAX_DET_NUM * DET_CHANNEL;
+
+    __shared__ float keys[SORT_SIZE];
+    __shared__ int values[SORT_SIZE];
+
+    for (int i = tid; i < SORT_SIZE; i += blockDim.x) {
+        keys[i] = i < boxes_num ? task_detections[i * DET_CHANNEL + 10] : -1.0f;
+        values[i] = i;
+    }
+    __syncthreads();
+
+    // descending order
+    for (int k = 2; k <= SORT_SIZE; k <<= 1) {
+        for (int j = k >> 1; j > 0; j >>= 1) {
+            for (int i = tid; i < SORT_SIZE; i += blockDim.x) {
+                int ixj = i ^ j;
+                if (ixj > i) {
+                    bool descending = (i & k) == 0;
+                    if ((keys[i] < keys[ixj]) == descending) {
+                        float key = keys[i]; keys[i] = keys[ixj]; keys[ixj] = key;
+                        int value = values[i]; values[i] = values[ixj]; values[ixj] = value;
+                    }
+                }
+            }
+            __syncthreads();
+        }
+    }
+
+    for (int i = tid; i < boxes_num; i += blockDim.x) {
+        const float *src = task_detections + values[i] * DET_CHANNEL;
+        float *dst = task_sorted + i * DET_CHANNEL;
+        for (int c = 0; c < DET_CHANNEL; c++) {
+            dst[c] = src[c];
+        }
+
+        float *permuted = task_permuted + i * DET_CHANNEL;
+        permuted[0] = src[0];
+        permuted[1] = src[1];
+        permuted[2] = src[2];
+        permuted[3] = src[4];
+        permuted[4] = src[3];
+        permuted[5] = src[5];
+        permuted[6] = -src[8] - HALF_PI;
+    }
+}
+
+int sort_permute_batched_launch(int num_tasks,
+                    const unsigned int *detection_num,
+                    const float *detections,
+                    float *boxes_sorted,
+                    float *permute_boxes_sorted,
+                    cudaStream_t stream)
+{
+    sort_permute_batched_cuda<<<num_tasks, SORT_SIZE / 2, 0, stream>>>(detection_num, detections, boxes_sorted, permute_boxes_sorted);
+
+    auto err = cudaGetLastError();
+    if (cudaSuccess != err) {
+        fprintf(stderr, "CUDA kernel failed : %s\n", cudaGetErrorString(err));
+        return -1;
+    }
+
+    return 0;
+}
+
+// nms_cuda with blockIdx.z selecting the task; mask rows are NMS_MAX_COL_BLOCKS words wide
+__global__ void nms_batched_cuda(const unsigned int *detection_num, const float iou_threshold,
+                                 const float *permute_boxes_sorted, uint64_t *mask) {
+  const int task = blockIdx.z;
+  const int row_start = blockIdx.y;
+  const int col_start = blockIdx.x;
+  const int tid = threadIdx.x;
+  const int n_boxes = min(detection_num[task], MAX_DET_NUM);
+
+  if (row_start > col_start) return;
+  if (row_start * NMS_THREADS_PER_BLOCK >= n_boxes || col_start * NMS_THREADS_PER_BLOCK >= n_boxes) return;
+
+  const float *dev_boxes = permute_boxes_sorted + task * MAX_DET_NUM * DET_CHANNEL;
+  uint64_t *dev_mask = mask + task * MAX_DET_NUM * NMS_MAX_COL_BLOCKS;
+
+  const int row_size = min(n_boxes - row_start * NMS_THREADS_PER_BLOCK, NMS_THREADS_PER_BLOCK);
+  const int col_size = min(n_boxes - col_start * NMS_THREADS_PER_BLOCK, NMS_THREADS_PER_BLOCK);
+
+  __shared__ float block_boxes[NMS_THREADS_PER_BLOCK * 7];
+
+  if (tid < col_size) {
+    for (int c = 0; c < 7; c++) {
+      block_boxes[tid * 7 + c] = dev_boxes[(NMS_THREADS_PER_BLOCK * col_start + tid) * DET_CHANNEL + c];
+    }
+  }
+  __syncthreads();
+
+  if (tid < row_size) {
+    const int cur_box_idx = NMS_THREADS_PER_BLOCK * row_start + tid;
+    const float *cur_box = dev_boxes + cur_box_idx * DET_CHANNEL;
+    uint64_t t = 0;
+    int start = 0;
+    if (row_start == col_start) {
+      start = tid + 1;
+    }
+    for (int i = start; i < col_size; i++) {
+      if (devIoU(cur_box, block_boxes + i * 7, iou_threshold)) {
+        t |= 1ULL << i;
+      }
+    }
+    dev_mask[cur_box_idx * NMS_MAX_COL_BLOCKS + col_start] = t;
+  }
+}
+
+int nms_batched_launch(int num_tasks,
+                    const unsigned int *detection_num,
+                    const float *permute_boxes_sorted,
+                    float nms_iou_threshold,
+                    uint64_t *mask,
+                    cudaStream_t stream)
+{
+    dim3 blocks(NMS_MAX_COL_BLOCKS, NMS_MAX_COL_BLOCKS, num_tasks);
+    dim3 threads(NMS_THREADS_PER_BLOCK);
+
+    nms_batched_cuda<<<blocks, threads, 0, stream>>>(detection_num, nms_iou_threshold, permute_boxes_sorted, mask);
+
+    auto err = cudaGetLastError();
+    if (cudaSuccess != err) {
+        fprintf(stderr, "CUDA kernel failed : %s\n", cudaGetErrorString(err));
+        return -1;
+    }
+
+    return 0;
+}
+
+// one warp per task, same greedy walk as nms_mask_reduce_cpu.
+// kept holds per task: [count, max_keep * DET_CHANNEL box values]
+__global__ void nms_reduce_batched_cuda(const unsigned int *detection_num, const uint64_t *mask,
+                                        const float *boxes_sorted, unsigned int max_keep, float *kept) {
+    const int task = blockIdx.x;
+    const int lane = threadIdx.x;
+    const int boxes_num = min(detection_num[task], MAX_DET_NUM);
+    const int col_blocks = DIVUP(boxes_num, NMS_THREADS_PER_BLOCK);
+
+    const uint64_t *task_mask = mask + task * MAX_DET_NUM * NMS_MAX_COL_BLOCKS;
+    const float *task_boxes = boxes_sorted + task * MAX_DET_NUM * DET_CHANNEL;
+    float *task_kept = kept + task * (1 + max_keep * DET_CHANNEL);
+
+    __shared__ uint64_t remv[NMS_MAX_COL_BLOCKS];
+    if (lane < NMS_MAX_COL_BLOCKS) {
+        remv[lane] = 0;
+    }
+    __syncthreads();
+
+    unsigned int num_keep = 0;
+    for (int i = 0; i < boxes_num && num_keep < max_keep; i++) {
+        const int nblock = i / NMS_THREADS_PER_BLOCK;
+        const int inblock = i % NMS_THREADS_PER_BLOCK;
+        const bool keep = !(remv[nblock] & (1ULL << inblock));
+        __syncthreads();
+
+        if (keep) {
+            if (lane < DET_CHANNEL) {
+                task_kept[1 + num_keep * DET_CHANNEL + lane] = task_boxes[i * DET_CHANNEL + lane];
+            }
+            if (lane >= nblock && lane < col_blocks) {
+                remv[lane] |= task_mask[i * NMS_MAX_COL_BLOCKS + lane];
+            }
+            num_keep++;
+        }
+        __syncthreads();
+    }
+
+    if (lane == 0) {
+        task_kept[0] = num_keep;
+    }
+}
+
+int nms_reduce_batched_launch(int num_tasks,
+                    const unsigned int *detection_num,
+                    const uint64_t *mask,
+                    const float *boxes_sorted,
+                    unsigned int max_keep,
+                    float *kept,
+                    cudaStream_t stream)
+{
+    static_assert(NMS_MAX_COL_BLOCKS <= 32 && DET_CHANNEL <= 32, "reduction runs on a single warp");
+    nms_reduce_batched_cuda<<<num_tasks, 32, 0, stream>>>(detection_num, mask, boxes_sorted, max_keep, kept);
+
+    auto err = cudaGetLastError();
+    if (cudaSuccess != err) {
+        fprintf(stderr, "CUDA kernel failed : %s\n", cudaGetErrorString(err));
+        return -1;
+    }
+
+    return 0;
+}
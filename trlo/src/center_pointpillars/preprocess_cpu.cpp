@@ -0,0 +1,165 @@
+/****************************************************************************************
+ *
+ * Copyright (c) 2024, Shenyang Institute of Automation, Chinese Academy of Sciences
+ *
+ * Authors: Yanpeng Jia
+ * Contact: jiayanpeng@sia.cn
+ *
+ ****************************************************************************************/
+/*
+ * SPDX-FileCopyrightText: Copyright (c) 2023 NVIDIA CORPORATION & AFFILIATES. All rights reserved.
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+ 
+#include "center_pointpillars/preprocess_cpu.h"
+#include <math.h>
+
+static inline uint64_t hash(uint64_t k) {
+    k ^= k >> 16;
+    k *= 0x85ebca6b;
+    k ^= k >> 13;
+    k *= 0xc2b2ae35;
+    k ^= k >> 16;
+    return k;
+}
+
+PreProcessCpu::PreProcessCpu()
+{}
+
+PreProcessCpu::~PreProcessCpu()
+{}
+
+unsigned int PreProcessCpu::getOutput(half** h_voxel_features, unsigned int** h_voxel_indices, std::vector<int>& sparse_shape){
+    *h_voxel_features = voxel_features_.data();
+    *h_voxel_indices = voxel_indices_.data();
+
+    sparse_shape.clear();
+    sparse_shape.push_back(params_.getGridZSize() + 1);
+    sparse_shape.push_back(params_.getGridYSize());
+    sparse_shape.push_back(params_.getGridXSize());
+
+    return real_num_voxels_;
+}
+
+int PreProcessCpu::alloc_resource(){
+    hash_table_.resize(MAX_POINTS_NUM * 2 * 2);
+    point_voxel_offset_.resize(MAX_POINTS_NUM);
+
+    voxel_num_.resize(params_.max_voxels);
+    voxel_points_.resize(params_.max_voxels * params_.max_points_per_voxel);
+    voxel_features_.resize(params_.max_voxels * params_.feature_num);
+    voxel_indices_.resize(params_.max_voxels * 4);
+    return 0;
+}
+
+unsigned int PreProcessCpu::insertHashTable(unsigned int key, unsigned int hash_size)
+{
+    unsigned int slot = hash(key) % (hash_size / 2);
+    while (true) {
+        unsigned int pre_key = hash_table_[slot];
+        if (pre_key == UINT32_MAX) {
+            hash_table_[slot] = key;
+            hash_table_[slot + hash_size / 2] = real_num_voxels_++;
+            return hash_table_[slot + hash_size / 2];
+        } else if (pre_key == key) {
+            return hash_table_[slot + hash_size / 2];
+        }
+        slot = (slot + 1) % (hash_size / 2);
+    }
+}
+
+int PreProcessCpu::generateVoxels(const float *points, size_t points_size, cudaStream_t stream)
+{
+    if (points_size > MAX_POINTS_NUM) points_size = MAX_POINTS_NUM;
+
+    const int grid_x_size = params_.getGridXSize();
+    const int grid_y_size = params_.getGridYSize();
+    const int feature_num = params_.feature_num;
+    const int max_points_per_voxel = params_.max_points_per_voxel;
+    const unsigned int hash_size = points_size * 2 * 2;
+
+    std::fill(hash_table_.begin(), hash_table_.begin() + hash_size, UINT32_MAX);
+    std::fill(voxel_num_.begin(), voxel_num_.end(), 0);
+    real_num_voxels_ = 0;
+
+    // voxel offset of every point, UINT32_MAX if out of range
+    #pragma omp parallel for schedule(static)
+    for (int point_idx = 0; point_idx < (int)points_size; point_idx++) {
+        float px = points[feature_num * point_idx];
+        float py = points[feature_num * point_idx + 1];
+        float pz = points[feature_num * point_idx + 2];
+
+        if (px < params_.min_x_range || px >= params_.max_x_range || py < params_.min_y_range || py >= params_.max_y_range
+            || pz < params_.min_z_range || pz >= params_.max_z_range) {
+            point_voxel_offset_[point_idx] = UINT32_MAX;
+            continue;
+        }
+
+        unsigned int voxel_idx = floorf((px - params_.min_x_range) / params_.pillar_x_size);
+        unsigned int voxel_idy = floorf((py - params_.min_y_range) / params_.pillar_y_size);
+        unsigned int voxel_idz = floorf((pz - params_.min_z_range) / params_.pillar_z_size);
+        point_voxel_offset_[point_idx] = voxel_idz * grid_y_size * grid_x_size
+                                       + voxel_idy * grid_x_size
+                                       + voxel_idx;
+    }
+
+    // build hash table and scatter point ids to voxels
+    for (size_t point_idx = 0; point_idx < points_size; point_idx++) {
+        unsigned int voxel_offset = point_voxel_offset_[point_idx];
+        if (voxel_offset == UINT32_MAX) continue;
+
+        unsigned int num_before = real_num_voxels_;
+        unsigned int voxel_id = insertHashTable(voxel_offset, hash_size);
+        if (voxel_id >= params_.max_voxels) continue;
+
+        if (voxel_id == num_before) {
+            // now only deal with batch_size = 1
+            unsigned int *idx = voxel_indices_.data() + voxel_id * 4;
+            idx[0] = 0;
+            idx[1] = voxel_offset / (grid_y_size * grid_x_size);
+            idx[2] = (voxel_offset / grid_x_size) % grid_y_size;
+            idx[3] = voxel_offset % grid_x_size;
+        }
+
+        unsigned int current_num = voxel_num_[voxel_id]++;
+        if (current_num < (unsigned int)max_points_per_voxel) {
+            voxel_points_[voxel_id * max_points_per_voxel + current_num] = point_idx;
+        }
+    }
+    real_num_voxels_ = std::min(real_num_voxels_, params_.max_voxels);
+
+    // mean of the points in each voxel
+    #pragma omp parallel for schedule(static)
+    for (int voxel_id = 0; voxel_id < (int)real_num_voxels_; voxel_id++) {
+        int valid_points_num = std::min(voxel_num_[voxel_id], (unsigned int)max_points_per_voxel);
+        voxel_num_[voxel_id] = valid_points_num;
+        const unsigned int *point_ids = voxel_points_.data() + voxel_id * max_points_per_voxel;
+        for (int feature_idx = 0; feature_idx < feature_num; ++feature_idx) {
+            float sum = 0.0f;
+            for (int i = 0; i < valid_points_num; ++i) {
+                sum += points[point_ids[i] * feature_num + feature_idx];
+            }
+            voxel_features_[voxel_id * feature_num + feature_idx] = __float2half(sum / valid_points_num);
+        }
+    }
+
+    return 0;
+}
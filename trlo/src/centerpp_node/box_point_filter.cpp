@@ -0,0 +1,139 @@
+/****************************************************************************************
+ *
+ * Copyright (c) 2024, Shenyang Institute of Automation, Chinese Academy of Sciences
+ *
+ * Authors: Yanpeng Jia
+ * Contact: jiayanpeng@sia.cn
+ *
+ ****************************************************************************************/
+
+#include "centerpp_node/box_point_filter.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+BoxPointFilter::BoxPointFilter(float cell_size, float margin)
+    : cell_size_(cell_size), margin_(margin) {}
+
+void BoxPointFilter::setBoxes(const std::vector<Bndbox>& boxes) {
+    boxes_.clear();
+    cell_offsets_.clear();
+    cell_boxes_.clear();
+    size_x_ = size_y_ = 0;
+    if (boxes.empty()) return;
+
+    float max_x = -std::numeric_limits<float>::max();
+    float max_y = -std::numeric_limits<float>::max();
+    min_x_ = std::numeric_limits<float>::max();
+    min_y_ = std::numeric_limits<float>::max();
+
+    // footprint AABB of every box
+    std::vector<float> aabbs;
+    aabbs.reserve(boxes.size() * 4);
+    for (const auto& box : boxes) {
+        OrientedBox ob;
+        ob.x = box.x;
+        ob.y = box.y;
+        ob.z = box.z;
+        ob.cos_yaw = std::cos(-box.rt);
+        ob.sin_yaw = std::sin(-box.rt);
+        ob.half_w = box.w / 2 + margin_;
+        ob.half_l = box.l / 2 + margin_;
+        ob.half_h = box.h / 2 + margin_;
+        boxes_.push_back(ob);
+
+        float ex = std::fabs(ob.cos_yaw) * ob.half_w + std::fabs(ob.sin_yaw) * ob.half_l;
+        float ey = std::fabs(ob.sin_yaw) * ob.half_w + std::fabs(ob.cos_yaw) * ob.half_l;
+        aabbs.push_back(ob.x - ex);
+        aabbs.push_back(ob.y - ey);
+        aabbs.push_back(ob.x + ex);
+        aabbs.push_back(ob.y + ey);
+        min_x_ = std::min(min_x_, ob.x - ex);
+        min_y_ = std::min(min_y_, ob.y - ey);
+        max_x = std::max(max_x, ob.x + ex);
+        max_y = std::max(max_y, ob.y + ey);
+    }
+
+    size_x_ = static_cast<int>(std::floor((max_x - min_x_) / cell_size_)) + 1;
+    size_y_ = static_cast<int>(std::floor((max_y - min_y_) / cell_size_)) + 1;
+
+    // count, prefix sum, fill
+    cell_offsets_.assign(size_x_ * size_y_ + 1, 0);
+    for (int pass = 0; pass < 2; pass++) {
+        std::vector<int> cursor;
+        if (pass == 1) {
+            for (size_t c = 1; c < cell_offsets_.size(); c++) cell_offsets_[c] += cell_offsets_[c - 1];
+            cell_boxes_.resize(cell_offsets_.back());
+            cursor.assign(cell_offsets_.begin(), cell_offsets_.end() - 1);
+        }
+        for (size_t b = 0; b < boxes_.size(); b++) {
+            int x0 = static_cast<int>((aabbs[4 * b + 0] - min_x_) / cell_size_);
+            int y0 = static_cast<int>((aabbs[4 * b + 1] - min_y_) / cell_size_);
+            int x1 = std::min(static_cast<int>((aabbs[4 * b + 2] - min_x_) / cell_size_), size_x_ - 1);
+            int y1 = std::min(static_cast<int>((aabbs[4 * b + 3] - min_y_) / cell_size_), size_y_ - 1);
+            for (int cy = y0; cy <= y1; cy++) {
+                for (int cx = x0; cx <= x1; cx++) {
+                    int cell = cy * size_x_ + cx;
+                    if (pass == 0) {
+                        cell_offsets_[cell + 1]++;
+                    } else {
+                        cell_boxes_[cursor[cell]++] = b;
+                    }
+                }
+            }
+        }
+    }
+}
+
+bool BoxPointFilter::inside(float px, float py, float pz) const {
+    float gx = (px - min_x_) / cell_size_;
+    float gy = (py - min_y_) / cell_size_;
+    if (!(gx >= 0 && gy >= 0 && gx < size_x_ && gy < size_y_)) return false;
+
+    int cell = static_cast<int>(gy) * size_x_ + static_cast<int>(gx);
+    bool in = false;
+    for (int k = cell_offsets_[cell]; k < cell_offsets_[cell + 1]; k++) {
+        const OrientedBox& ob = boxes_[cell_boxes_[k]];
+        float dx = px - ob.x;
+        float dy = py - ob.y;
+        float dz = pz - ob.z;
+        // point in the box frame; branch free so the test vectorizes
+        float lx = ob.cos_yaw * dx + ob.sin_yaw * dy;
+        float ly = -ob.sin_yaw * dx + ob.cos_yaw * dy;
+        in |= (std::fabs(lx) <= ob.half_w) & (std::fabs(ly) <= ob.half_l) & (std::fabs(dz) <= ob.half_h);
+    }
+    return in;
+}
+
+void BoxPointFilter::filter(const pcl::PointCloud<pcl::PointXYZI>& cloud_in,
+                            pcl::PointCloud<pcl::PointXYZI>& static_out,
+                            pcl::PointCloud<pcl::PointXYZ>& dynamic_out) {
+    static_out.clear();
+    dynamic_out.clear();
+
+    const int cloud_size = cloud_in.size();
+    if (boxes_.empty()) {
+        static_out = cloud_in;
+        return;
+    }
+
+    labels_.resize(cloud_size);
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < cloud_size; i++) {
+        const auto& p = cloud_in.points[i];
+        labels_[i] = this->inside(p.x, p.y, p.z);
+    }
+
+    static_out.reserve(cloud_size);
+    for (int i = 0; i < cloud_size; i++) {
+        const auto& p = cloud_in.points[i];
+        if (labels_[i]) {
+            dynamic_out.push_back(pcl::PointXYZ(p.x, p.y, p.z));
+        } else {
+            static_out.push_back(p);
+        }
+    }
+    static_out.header = cloud_in.header;
+    dynamic_out.header = cloud_in.header;
+}
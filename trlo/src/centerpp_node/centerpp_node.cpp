@@ -18,7 +18,12 @@
 #include "pcl_ros/impl/transforms.hpp"
 
 #include <ros/ros.h>
+#ifdef TRLO_WITH_CENTERPOINT
 #include "center_pointpillars/centerpoint.h"
+#else
+#include "center_pointpillars/common.h"
+#include "center_pointpillars/detector.h"
+#endif
 
 #include <jsk_recognition_msgs/BoundingBox.h>
 #include <jsk_recognition_msgs/BoundingBoxArray.h>
@@ -35,8 +40,22 @@
 #include <nav_msgs/Odometry.h>
 
 #include "3d_mot/imm_ukf_jpda.h"
+#include "centerpp_node/pointcloud_packer.h"
+#include "centerpp_node/box_point_filter.h"
+#include "centerpp_node/bounded_queue.h"
+#include "centerpp_node/pose_buffer.h"
+#include "centerpp_node/detection_scheduler.h"
+#include "centerpp_node/detection_log.h"
+#include "trlo/cloud_filters.h"
+#include "trlo/metrics_diagnostics.h"
+
+#include <diagnostic_msgs/DiagnosticArray.h>
 
 #include <algorithm>
+#include <iomanip>
+#include <atomic>
+#include <mutex>
+#include <thread>
 
 #define GPU_CHECK(ans)                                                         \
     { GPUAssert((ans), __FILE__, __LINE__); }
@@ -52,9 +71,6 @@ inline void GPUAssert(cudaError_t code, const char *file, int line,
 
 std::vector<unsigned char> color;
 
-std::vector<double> avg_centerpoint_time;
-std::vector<double> avg_ukf_time;
-
 
 void GetDeviceInfo()
 {
@@ -88,72 +104,46 @@ void initDevice(int devNum) {
     GPU_CHECK(cudaSetDevice(dev));
 }
 
-void SaveToBin(const pcl::PointCloud<pcl::PointXYZI>& cloud, const std::string& path) {
-    // std::cout << "bin_path: " << path << std::endl;
-    //Create & write .bin file
-    std::ofstream out;
-    out.open(path, std::ios::out|std::ios::binary);
-    if(!out.good()) {
-        std::cout<<"Couldn't open "<<path<<std::endl;
-        return;
-    }
-    float zero = 0.0f;
-    
-    for (size_t i = 0; i < cloud.points.size (); ++i) {
-        out.write((char*)&cloud.points[i].x, 3*sizeof(float));
-        out.write((char*)&zero, sizeof(float));
-        out.write((char*)&zero, sizeof(float));
-    }
-    
-    out.close();
-}
-
-int loadData(const char *file, void **data, unsigned int *length)
-{
-    std::fstream dataFile(file, std::ifstream::in);
-
-    if (!dataFile.is_open()) {
-        std::cout << "Can't open files: "<< file<<std::endl;
-        return -1;
-    }
-
-    unsigned int len = 0;
-    dataFile.seekg (0, dataFile.end);
-    len = dataFile.tellg();
-    dataFile.seekg (0, dataFile.beg);
-
-    char *buffer = new char[len];
-    if (buffer==NULL) {
-        std::cout << "Can't malloc buffer."<<std::endl;
-        dataFile.close();
-        exit(EXIT_FAILURE);
-    }
-
-    dataFile.read(buffer, len);
-    dataFile.close();
+namespace cpp {
 
-    *data = (void*)buffer;
-    *length = len;
-    return 0;  
-}
+// Pipeline stages, in the order a frame visits them. Ingest runs in the
+// subscriber callback, every other stage owns one worker thread.
+enum PipelineStage {
+    STAGE_INGEST = 0,
+    STAGE_INFERENCE,
+    STAGE_TRACKING,
+    STAGE_FILTERING,
+    STAGE_PUBLISH,
+    NUM_STAGES
+};
 
-namespace cpp {
+static const char* const kStageNames[NUM_STAGES] = {"ingest", "inference", "tracking", "filtering", "publish"};
+
+// Everything a scan accumulates on its way through the pipeline.
+struct DetectionFrame {
+    std_msgs::Header header;
+    pcl::PointCloud<pcl::PointXYZI>::Ptr cloud;
+    pcl::PointCloud<pcl::PointXYZI>::Ptr static_cloud;
+    int buffer = -1;                    // index into the pinned staging pool
+    size_t points_num = 0;
+    bool detected = true;               // false: boxes propagated from the last detection
+    std::vector<Bndbox> filter_BBox;
+    std::vector<Bndbox> dynamic_BBox;
+    ros::WallTime received;
+    double centerpoint_ms = 0.0;
+    double ukf_ms = 0.0;
+    double stage_ms[NUM_STAGES] = {0.0};
+};
+typedef std::shared_ptr<DetectionFrame> DetectionFramePtr;
 
 class Center_PointPillars_ROS {
   public:
-    pcl::PointCloud<pcl::PointXYZ> targetPoints;
-    std::vector<std::vector<double>> targetVandYaw;
-    std::vector<int> trackManage;
-    std::vector<bool> isStaticVec;
-    std::vector<bool> isVisVec;
-    std::vector<pcl::PointCloud<pcl::PointXYZ>> visBBs;
-
     Center_PointPillars_ROS(ros::NodeHandle nh);
     ~Center_PointPillars_ROS();
 
     void Process();
-    void extractBBoxPointcloud(std::vector<Bndbox> filter_BBox, pcl::PointCloud<pcl::PointXYZI>::Ptr cloud_in, pcl::PointCloud<pcl::PointXYZI>::Ptr& cloud_out, pcl::PointCloud<pcl::PointXYZ>::Ptr& cloud_cluster);
-    void mot_3d(std_msgs::Header in_msg_header, std::vector<Bndbox> filter_BBox, std::vector<Bndbox>& dynamic_BBox);
+    void extractBBoxPointcloud(const std::vector<Bndbox>& filter_BBox, pcl::PointCloud<pcl::PointXYZI>::Ptr cloud_in, pcl::PointCloud<pcl::PointXYZI>::Ptr& cloud_out, pcl::PointCloud<pcl::PointXYZ>::Ptr& cloud_cluster);
+    void mot_3d(const std_msgs::Header& in_msg_header, const std::vector<Bndbox>& filter_BBox, std::vector<Bndbox>& dynamic_BBox, std::vector<Eigen::Vector2f>& box_velocity);
 
   private:
     ros::NodeHandle nh_;
@@ -169,6 +159,9 @@ class Center_PointPillars_ROS {
     ros::Publisher pub_arrows_;
     ros::Publisher pub_box_markers_;
     ros::Publisher pub_center_points_;
+    ros::Publisher pub_pipeline_stats_;
+    ros::Publisher pub_metrics_;
+    ros::Timer metrics_timer_;
     
     cudaEvent_t start_, stop_;
     cudaStream_t stream_ = NULL;
@@ -176,7 +169,30 @@ class Center_PointPillars_ROS {
     Params params;
 
     std::string Model_File_Dir_;
-    std::string saveBinFile_;
+    std::string detector_backend_;
+    std::string preprocess_backend_;
+    std::string postprocess_backend_;
+
+    // pinned host staging buffers (one per in-flight frame) and the device buffer
+    PointCloudPacker packer_;
+    std::vector<float*> h_points_pool_;
+    float* d_points_ = nullptr;
+
+    // ingest -> inference -> tracking -> filtering -> publish
+    int pipeline_queue_size_;
+    std::unique_ptr<BoundedQueue<int>> free_buffers_;
+    std::unique_ptr<BoundedQueue<DetectionFramePtr>> stage_queues_[NUM_STAGES];
+    std::vector<std::thread> stage_threads_;
+    double last_ukf_ms_ = 0.0;
+
+    // owned by the process-wide metrics registry
+    trlo::Histogram* stage_ms_[NUM_STAGES];
+    trlo::Histogram* end_to_end_ms_;
+    trlo::Histogram* centerpoint_ms_;
+    trlo::Histogram* ukf_ms_;
+    trlo::Counter* dropped_frames_;
+    double metrics_publish_freq_;
+    std::string metrics_file_;
 
     std::string odom_frame_;
     std::string child_frame_;
@@ -193,23 +209,44 @@ class Center_PointPillars_ROS {
 
     pcl::CropBox<pcl::PointXYZI> crop;
     pcl::VoxelGrid<pcl::PointXYZI> vf;
-    std::deque<nav_msgs::Odometry> odom_queue;
+    std::unique_ptr<PoseBuffer> pose_buffer_;
     visualization_msgs::MarkerArray center_points_array;
 
     bool verbose = true;
 
-    std::unique_ptr<CenterPoint> center_pointpillars_ptr_;
+    std::unique_ptr<Detector> detector_;
     nanoflann::KdTreeFLANN<pcl::PointXYZ>::Ptr objects_kdtree_;
+    std::unique_ptr<BoxPointFilter> box_filter_;
+    std::unique_ptr<MultiObjectTracker> tracker_;
+
+    // detection frame skipping: decided in the inference stage, boxes carried forward in tracking
+    std::unique_ptr<DetectionScheduler> scheduler_;
+    BoxPropagator propagator_;
+    std::atomic<double> track_std_;
+
+    // track store size after the last tracking step, read by the stats publisher
+    std::atomic<size_t> track_store_bytes_;
+    std::atomic<size_t> track_store_live_;
+    std::atomic<size_t> track_store_slots_;
 
     void PointCloud_Callback(const sensor_msgs::PointCloud2Ptr &msg);
+    void inferenceStage();
+    void trackingStage();
+    void filteringStage();
+    void publishStage();
+    void startPipeline();
+    void stopPipeline();
+    void releaseFrame(const DetectionFramePtr& frame);
+    void publishPipelineStats(double end_to_end_ms);
+    void metricsTimerCB(const ros::TimerEvent& e);
     void Odometry_Callback(const nav_msgs::OdometryPtr &odom);
     void publishCloud(std_msgs::Header header, const pcl::PointCloud<pcl::PointXYZI>::Ptr in_cloud_to_publish_ptr);
     void publishObjectBoundingBox(std_msgs::Header in_msg_header, std::vector<Bndbox> filter_BBox);
     void publishDynamicBoundingBox(std_msgs::Header in_msg_header, std::vector<Bndbox> dynamic_BBox);
     void publishClusterCloud(std_msgs::Header header, const pcl::PointCloud<pcl::PointXYZ>::Ptr cloud_in, std::vector<pcl::PointIndices> cluster_indices);
-    void publishVelArrows(pcl::PointCloud<pcl::PointXYZ> egoTFPoints, ros::Time input_time);
-    void publishTrackingCenter(pcl::PointCloud<pcl::PointXYZ> egoTFPoints, ros::Time input_time);
-    void publishBoundingBoxMarkers(ros::Time input_time);
+    void publishVelArrows(const std::vector<TrackedObject>& tracks, const pcl::PointCloud<pcl::PointXYZ>& egoTFPoints, ros::Time input_time);
+    void publishTrackingCenter(const std::vector<TrackedObject>& tracks, const pcl::PointCloud<pcl::PointXYZ>& egoTFPoints, ros::Time input_time);
+    void publishBoundingBoxMarkers(const std::vector<TrackedObject>& tracks, const Eigen::Matrix4f& ego_T, ros::Time input_time);
 
     void preprocessPoints(const pcl::PointCloud<pcl::PointXYZI>::Ptr &cloud_in, float th1, float th2);
     void removeClosedPointCloud(const pcl::PointCloud<pcl::PointXYZI> &cloud_in, pcl::PointCloud<pcl::PointXYZI> &cloud_out, float th1, float th2);
@@ -217,10 +254,13 @@ class Center_PointPillars_ROS {
 
 Center_PointPillars_ROS::Center_PointPillars_ROS(ros::NodeHandle nh) : nh_(nh) {
     ros::param::param<std::string>("Model_File_Dir", this->Model_File_Dir_, "/home/jyp/3D_LiDAR_SLAM/trlo_ws/src/trlo/model/center_pointpillars/");
-    ros::param::param<std::string>("SavaData_File", this->saveBinFile_, "/home/jyp/3D_LiDAR_SLAM/trlo_ws/src/trlo/data/data.bin");
     ros::param::param<std::string>("~center_pp/frame/odom_frame", this->odom_frame_, "robot/odom");
     ros::param::param<std::string>("~center_pp/frame/child_frame", this->child_frame_, "robot/base_link");
 
+    ros::param::param<std::string>("~center_pp/detector/backend", this->detector_backend_, "centerpoint");
+    ros::param::param<std::string>("~center_pp/backend/preprocess", this->preprocess_backend_, "cuda");
+    ros::param::param<std::string>("~center_pp/backend/postprocess", this->postprocess_backend_, "cuda");
+
     ros::param::param<double>("~center_pp/preprocessing/threshold/MINIMUM_RANGE", this->MINIMUM_RANGE, 0.5);
     ros::param::param<double>("~center_pp/preprocessing/threshold/MAXMUM_RANGE", this->MAXMUM_RANGE, 80);
 
@@ -232,10 +272,114 @@ Center_PointPillars_ROS::Center_PointPillars_ROS(ros::NodeHandle nh) : nh_(nh) {
     ros::param::param<bool>("~center_pp/preprocessing/voxelFilter/use", this->vf_use_, true);
     ros::param::param<double>("~center_pp/preprocessing/voxelFilter/res", this->vf_res_, 0.05);
 
-    checkCudaErrors(cudaEventCreate(&this->start_));
-    checkCudaErrors(cudaEventCreate(&this->stop_));
-    GPU_CHECK(cudaStreamCreate(&this->stream_));
-    this->center_pointpillars_ptr_.reset(new CenterPoint(this->Model_File_Dir_, this->verbose)); // 外部定义调用不了cuda函数
+    // Box Point Filter
+    double box_filter_cell_size, box_filter_margin;
+    ros::param::param<double>("~center_pp/boxFilter/cellSize", box_filter_cell_size, 0.5);
+    ros::param::param<double>("~center_pp/boxFilter/margin", box_filter_margin, 0.1);
+    this->box_filter_.reset(new BoxPointFilter(box_filter_cell_size, box_filter_margin));
+
+    // Detection Scheduler
+    int scheduler_detect_every;
+    double scheduler_max_track_std, scheduler_max_ego_translation, scheduler_max_ego_rotation;
+    ros::param::param<int>("~center_pp/scheduler/detectEvery", scheduler_detect_every, 1);
+    ros::param::param<double>("~center_pp/scheduler/maxTrackStd", scheduler_max_track_std, 0.5);
+    ros::param::param<double>("~center_pp/scheduler/maxEgoTranslation", scheduler_max_ego_translation, 2.0);
+    ros::param::param<double>("~center_pp/scheduler/maxEgoRotation", scheduler_max_ego_rotation, 0.1);
+    this->scheduler_.reset(new DetectionScheduler(scheduler_detect_every, scheduler_max_track_std,
+                                                  scheduler_max_ego_translation, scheduler_max_ego_rotation));
+    this->track_std_ = 0.0;
+    this->track_store_bytes_ = 0;
+    this->track_store_live_ = 0;
+    this->track_store_slots_ = 0;
+
+    // Tracker
+    TrackerConfig tracker_config;
+    ros::param::param<double>("~center_pp/tracker/gammaG", tracker_config.gammaG, 9.22);
+    ros::param::param<double>("~center_pp/tracker/pD", tracker_config.pD, 0.9);
+    ros::param::param<double>("~center_pp/tracker/pG", tracker_config.pG, 0.99);
+    ros::param::param<int>("~center_pp/tracker/lifeTimeThres", tracker_config.lifeTimeThres, 3);
+    ros::param::param<double>("~center_pp/tracker/staticDistThres", tracker_config.staticDistThres, 3.0);
+    ros::param::param<double>("~center_pp/tracker/gateCellSize", tracker_config.gateCellSize, 4.0);
+    ros::param::param<int>("~center_pp/tracker/jpdaMaxHypotheses", tracker_config.jpdaMaxHypotheses, 1024);
+    std::string association;
+    ros::param::param<std::string>("~center_pp/tracker/association", association, "jpda");
+    tracker_config.association = association == "gnn" ? ASSOC_GNN : ASSOC_JPDA;
+    this->tracker_.reset(new MultiObjectTracker(tracker_config));
+
+    // Ego Pose Buffer
+    int pose_buffer_capacity;
+    double pose_buffer_max_age;
+    ros::param::param<int>("~center_pp/poseBuffer/capacity", pose_buffer_capacity, 512);
+    ros::param::param<double>("~center_pp/poseBuffer/maxAge", pose_buffer_max_age, 2.0);
+    this->pose_buffer_.reset(new PoseBuffer(std::max(2, pose_buffer_capacity), pose_buffer_max_age));
+
+    // Pipeline
+    ros::param::param<int>("~center_pp/pipeline/queueSize", this->pipeline_queue_size_, 2);
+    this->pipeline_queue_size_ = std::max(1, this->pipeline_queue_size_);
+    for (int s = 0; s < NUM_STAGES; s++) {
+        if (s != STAGE_INGEST)
+            this->stage_queues_[s].reset(new BoundedQueue<DetectionFramePtr>(this->pipeline_queue_size_));
+    }
+
+    // Metrics
+    trlo::MetricsRegistry& registry = trlo::MetricsRegistry::global();
+    for (int s = 0; s < NUM_STAGES; s++) {
+        this->stage_ms_[s] = registry.histogram(std::string("centerpp/stage/") + kStageNames[s] + "_ms");
+    }
+    this->end_to_end_ms_ = registry.histogram("centerpp/end_to_end_ms");
+    this->centerpoint_ms_ = registry.histogram("centerpp/centerpoint_ms");
+    this->ukf_ms_ = registry.histogram("centerpp/ukf_ms");
+    this->dropped_frames_ = registry.counter("centerpp/dropped_frames");
+
+    ros::param::param<double>("~center_pp/metrics/publishFreq", this->metrics_publish_freq_, 1.0);
+    ros::param::param<std::string>("~center_pp/metrics/file", this->metrics_file_, "");
+
+    // Detector
+    if (this->detector_backend_ == "replay") {
+        std::string replay_file;
+        double replay_tolerance;
+        ros::param::param<std::string>("~center_pp/detector/replayFile", replay_file, "");
+        ros::param::param<double>("~center_pp/detector/replayTolerance", replay_tolerance, 0.005);
+        ReplayDetector* replay = new ReplayDetector(replay_tolerance);
+        if (!replay->load(replay_file)) {
+            ROS_ERROR("centerpp: cannot load detection log '%s', no boxes will be replayed", replay_file.c_str());
+        }
+        this->detector_.reset(replay);
+    } else {
+#ifdef TRLO_WITH_CENTERPOINT
+        CenterPoint* center_pointpillars = new CenterPoint(this->Model_File_Dir_, this->verbose, this->preprocess_backend_ == "cpu",
+                                                           this->postprocess_backend_ == "cpu" ? POSTPROCESS_CPU :
+                                                           this->postprocess_backend_ == "cuda_batched" ? POSTPROCESS_CUDA_BATCHED : POSTPROCESS_CUDA); // 外部定义调用不了cuda函数
+        center_pointpillars->prepare();
+        this->detector_.reset(center_pointpillars);
+#else
+        ROS_FATAL("centerpp: built without CenterPoint (TRLO_WITH_CENTERPOINT=OFF), set center_pp/detector/backend to replay");
+        exit(1);
+#endif
+    }
+
+    std::string record_file;
+    ros::param::param<std::string>("~center_pp/detector/recordFile", record_file, "");
+    if (!record_file.empty()) {
+        this->detector_.reset(new RecordingDetector(std::move(this->detector_), record_file));
+    }
+
+    // replay never touches the points, so it runs without any GPU resources
+    if (this->detector_->needsPoints()) {
+        checkCudaErrors(cudaEventCreate(&this->start_));
+        checkCudaErrors(cudaEventCreate(&this->stop_));
+        GPU_CHECK(cudaStreamCreate(&this->stream_));
+        checkCudaErrors(cudaMalloc((void **)&this->d_points_, MAX_POINTS_NUM * PointCloudPacker::kPointFeatures * sizeof(float)));
+    }
+    // one buffer per queued frame, plus the frame being packed and the one being inferred
+    this->free_buffers_.reset(new BoundedQueue<int>(this->pipeline_queue_size_ + 2));
+    for (int i = 0; i < this->pipeline_queue_size_ + 2; i++) {
+        float* buffer = nullptr;
+        if (this->detector_->needsPoints())
+            checkCudaErrors(cudaMallocHost((void **)&buffer, MAX_POINTS_NUM * PointCloudPacker::kPointFeatures * sizeof(float)));
+        this->h_points_pool_.push_back(buffer);
+        this->free_buffers_->push(i);
+    }
     this->objects_kdtree_.reset(new nanoflann::KdTreeFLANN<pcl::PointXYZ>());
     this->original_scan_.reset(new pcl::PointCloud<pcl::PointXYZI>());
     this->crop.setNegative(true);
@@ -243,22 +387,27 @@ Center_PointPillars_ROS::Center_PointPillars_ROS(ros::NodeHandle nh) : nh_(nh) {
     this->crop.setMax(Eigen::Vector4f(this->crop_size_, this->crop_size_, this->crop_size_, 1.0));
 
     this->vf.setLeafSize(this->vf_res_, this->vf_res_, this->vf_res_);
-    center_pointpillars_ptr_->prepare();
     setlocale(LC_ALL,"");
 }
 
 
 Center_PointPillars_ROS::~Center_PointPillars_ROS(){
+        this->stopPipeline();
+        this->detector_.reset();
+        if (this->stream_ == NULL)
+            return;
         checkCudaErrors(cudaEventDestroy(this->start_));
         checkCudaErrors(cudaEventDestroy(this->stop_));
         checkCudaErrors(cudaStreamDestroy(this->stream_));
+        for (float* buffer : this->h_points_pool_) {
+            checkCudaErrors(cudaFreeHost(buffer));
+        }
+        checkCudaErrors(cudaFree(this->d_points_));
 }
 
 
 void Center_PointPillars_ROS::Process() {
     std::cout << "Ready to receive point cloud topic!" << std::endl;
-    this->sub_pointcloud_ = nh_.subscribe("pointcloud", 1, &Center_PointPillars_ROS::PointCloud_Callback, this);
-    this->sub_odom_ = nh_.subscribe ("odom", 160, &Center_PointPillars_ROS::Odometry_Callback, this);
     this->pub_pointcloud_static_ = nh_.advertise<sensor_msgs::PointCloud2>("pointcloud_static", 10);
     this->pub_pointcloud_raw_ = nh_.advertise<sensor_msgs::PointCloud2>("pointcloud_raw", 10);
     this->pub_bbox_ = nh_.advertise<jsk_recognition_msgs::BoundingBoxArray>("box", 10, true);
@@ -269,144 +418,314 @@ void Center_PointPillars_ROS::Process() {
     this->pub_arrows_ = nh_.advertise<visualization_msgs::Marker>("object_vel_arrows", 10);
     this->pub_box_markers_ = nh_.advertise<visualization_msgs::Marker> ("box_markers", 10);
     this->pub_center_points_ = nh_.advertise<visualization_msgs::MarkerArray> ("center_markers", 10);
+    this->pub_pipeline_stats_ = nh_.advertise<diagnostic_msgs::DiagnosticArray>("pipeline_stats", 10);
+    this->pub_metrics_ = nh_.advertise<diagnostic_msgs::DiagnosticArray>("metrics", 1);
+    if (this->metrics_publish_freq_ > 0)
+        this->metrics_timer_ = nh_.createTimer(ros::Duration(1. / this->metrics_publish_freq_), &Center_PointPillars_ROS::metricsTimerCB, this);
+
+    // workers first, so the callback never pushes into a pipeline nobody drains
+    this->startPipeline();
+    this->sub_pointcloud_ = nh_.subscribe("pointcloud", this->pipeline_queue_size_, &Center_PointPillars_ROS::PointCloud_Callback, this);
+    this->sub_odom_ = nh_.subscribe ("odom", 160, &Center_PointPillars_ROS::Odometry_Callback, this);
     ros::spin();
+    this->stopPipeline();
 }
 
 
 
 void Center_PointPillars_ROS::PointCloud_Callback(const sensor_msgs::PointCloud2Ptr &msg) {
+    ros::WallTime t_start = ros::WallTime::now();
 
-    pcl::PointCloud<pcl::PointXYZI>::Ptr in_cloud_ptr(new pcl::PointCloud<pcl::PointXYZI>());
-    pcl::fromROSMsg(*msg, *in_cloud_ptr);
-
-    // std::cout << "process before size is : " << in_cloud_ptr->size() << std::endl;
-    // this->preprocessPoints(in_cloud_ptr, this->MINIMUM_RANGE, this->MAXMUM_RANGE);
-    // std::cout << "process after size is : " << in_cloud_ptr->size() << std::endl;
+    int buffer;
+    if (!this->free_buffers_->tryPop(buffer)) {
+        this->dropped_frames_->add();
+        ROS_WARN_THROTTLE(1.0, "centerpp: no free staging buffer, dropping scan");
+        return;
+    }
 
-    SaveToBin(*in_cloud_ptr, this->saveBinFile_);
-    // std::cout << "load file: "<< this->saveBinFile_ <<std::endl;
-    unsigned int length = 0;
-    void *pc_data = NULL;
-    loadData(this->saveBinFile_.c_str() , &pc_data, &length);
-    size_t points_num = length / (5 * sizeof(float)) ;
+    DetectionFramePtr frame = std::make_shared<DetectionFrame>();
+    frame->header = msg->header;
+    frame->received = t_start;
+    frame->buffer = buffer;
+    frame->cloud.reset(new pcl::PointCloud<pcl::PointXYZI>());
+    pcl::fromROSMsg(*msg, *frame->cloud);
+
+    if (this->h_points_pool_[buffer]) {
+        frame->points_num = this->packer_.pack(*msg, this->h_points_pool_[buffer], MAX_POINTS_NUM);
+        if (frame->points_num == 0 && msg->width * msg->height > 0) {
+            ROS_WARN_THROTTLE(5.0, "centerpp: no points packed from a %u point scan, it needs little-endian FLOAT32 x/y/z fields within point_step",
+                              msg->width * msg->height);
+        }
+    }
+    if (this->packer_.truncated() > 0) {
+        ROS_WARN("centerpp: scan exceeds MAX_POINTS_NUM, dropped %zu points", this->packer_.truncated());
+    }
 
-    float *d_points = nullptr;
-    checkCudaErrors(cudaMallocManaged((void **)&d_points, MAX_POINTS_NUM * 5 * sizeof(float)));
-    checkCudaErrors(cudaMemcpy(d_points, pc_data, length, cudaMemcpyHostToDevice));
-    checkCudaErrors(cudaDeviceSynchronize());
+    frame->stage_ms[STAGE_INGEST] = (ros::WallTime::now() - t_start).toSec() * 1000;
+    this->stage_ms_[STAGE_INGEST]->record(frame->stage_ms[STAGE_INGEST]);
 
-    cudaEventRecord(this->start_, this->stream_);
+    // keep the newest scans: when inference falls behind the oldest queued one is dropped
+    DetectionFramePtr dropped;
+    if (this->stage_queues_[STAGE_INFERENCE]->pushDropOldest(frame, &dropped)) {
+        this->releaseFrame(dropped);
+        this->dropped_frames_->add();
+    }
+}
 
-    double t1 = ros::Time::now().toSec();
-    center_pointpillars_ptr_->doinfer((void *)d_points, points_num, this->stream_);
-    double t2 = ros::Time::now().toSec();
-    avg_centerpoint_time.push_back((t2 - t1) * 1000);
 
-    float elapsedTime = 0.0f;
+void Center_PointPillars_ROS::inferenceStage() {
+    DetectionFramePtr frame;
+    while (this->stage_queues_[STAGE_INFERENCE]->pop(frame)) {
+        ros::WallTime t_start = ros::WallTime::now();
+
+        // ego motion is judged against the newest odometry, the scan's own pose is not out yet
+        Eigen::Matrix4f ego_pose;
+        if (!this->pose_buffer_->lookup(frame->header.stamp.toSec(), ego_pose))
+            ego_pose.setIdentity();
+        frame->detected = this->scheduler_->shouldDetect(this->track_std_.load(), ego_pose);
+
+        if (frame->detected) {
+            this->scheduler_->detected(ego_pose);
+
+            bool on_gpu = this->detector_->needsPoints();
+            float *points = this->h_points_pool_[frame->buffer];
+            if (on_gpu && this->detector_->deviceInput()) {
+                checkCudaErrors(cudaMemcpyAsync(this->d_points_, points, frame->points_num * PointCloudPacker::kPointFeatures * sizeof(float), cudaMemcpyHostToDevice, this->stream_));
+                points = this->d_points_;
+            }
+
+            if (on_gpu)
+                cudaEventRecord(this->start_, this->stream_);
+
+            std::vector<Bndbox> boxes;
+            double t1 = ros::Time::now().toSec();
+            this->detector_->detect(points, frame->points_num, frame->header.stamp.toSec(), this->stream_, boxes);
+            double t2 = ros::Time::now().toSec();
+            frame->centerpoint_ms = (t2 - t1) * 1000;
+
+            if (on_gpu) {
+                cudaEventRecord(this->stop_, this->stream_);
+                cudaEventSynchronize(this->stop_);
+            }
+
+            for (auto box : boxes) {
+                // car(id=0)/pedestrain(id=8)/cyclists(id=6)/truck(id=3)
+                // if ((box.id == 0 && box.score > 0.3) || (box.id == 6 && box.score > 0.5) || (box.id == 8 && box.score > 0.2)) { 
+                //     filter_BBox.push_back(box);
+                // }
+                if ((box.id == 0 && box.score > 0.5) || (box.id == 6 && box.score > 0.75)) {
+                    frame->filter_BBox.push_back(box);
+                }
+            }
+        } else {
+            this->scheduler_->skipped();
+        }
 
-    cudaEventRecord(this->stop_, this->stream_);
-    cudaEventSynchronize(this->stop_);
-    // cudaEventElapsedTime(&elapsedTime, this->start_, this->stop_);
+        // upload is complete (or skipped), the staging buffer can take the next scan
+        this->releaseFrame(frame);
 
-    checkCudaErrors(cudaFree(d_points));
+        frame->stage_ms[STAGE_INFERENCE] = (ros::WallTime::now() - t_start).toSec() * 1000;
+        this->stage_ms_[STAGE_INFERENCE]->record(frame->stage_ms[STAGE_INFERENCE]);
+        if (!this->stage_queues_[STAGE_TRACKING]->push(frame))
+            break;
+    }
+}
 
 
-    std::vector<Bndbox> filter_BBox, dynamic_BBox;
-    for (auto box : this->center_pointpillars_ptr_->nms_pred_) {
-        // car(id=0)/pedestrain(id=8)/cyclists(id=6)/truck(id=3)
-        // if ((box.id == 0 && box.score > 0.3) || (box.id == 6 && box.score > 0.5) || (box.id == 8 && box.score > 0.2)) { 
-        //     filter_BBox.push_back(box);
-        // }
-        // if (((box.id == 0 && box.score > 0.5) || (box.id == 6 && box.score > 0.75)) && abs(box.vy) > 0.001) {
-        //     dynamic_BBox.push_back(box);
-        // }
-        if ((box.id == 0 && box.score > 0.5) || (box.id == 6 && box.score > 0.75)) {
-            filter_BBox.push_back(box);
+void Center_PointPillars_ROS::trackingStage() {
+    DetectionFramePtr frame;
+    double last_stamp = 0.0;
+    while (this->stage_queues_[STAGE_TRACKING]->pop(frame)) {
+        ros::WallTime t_start = ros::WallTime::now();
+
+        double stamp = frame->header.stamp.toSec();
+        Eigen::Matrix4f ego_pose;
+        if (!this->pose_buffer_->lookup(stamp, ego_pose))
+            ego_pose.setIdentity();
+
+        if (frame->detected) {
+            std::vector<Eigen::Vector2f> box_velocity;
+            this->mot_3d(frame->header, frame->filter_BBox, frame->dynamic_BBox, box_velocity);
+            frame->ukf_ms = this->last_ukf_ms_;
+            this->propagator_.reset(stamp, ego_pose, frame->filter_BBox, box_velocity);
+        } else {
+            // no inference for this scan: move the last detections with their track velocity
+            this->propagator_.propagate(stamp, ego_pose, frame->filter_BBox, frame->dynamic_BBox);
         }
+
+        // tracker uncertainty expected at the next scan, read by the scheduler
+        double frame_dt = last_stamp > 0.0 ? stamp - last_stamp : 0.0;
+        last_stamp = stamp;
+        this->track_std_ = this->tracker_->maxPredictedPositionStd(stamp + frame_dt - this->propagator_.stamp());
+
+        frame->stage_ms[STAGE_TRACKING] = (ros::WallTime::now() - t_start).toSec() * 1000;
+        this->stage_ms_[STAGE_TRACKING]->record(frame->stage_ms[STAGE_TRACKING]);
+        if (!this->stage_queues_[STAGE_FILTERING]->push(frame))
+            break;
     }
+}
 
-    this->mot_3d(msg->header, filter_BBox, dynamic_BBox);
-    
-    // std::cout << "filter box size: " << filter_BBox.size() << std::endl;
-    // std::cout << "dynamic box size: " << dynamic_BBox.size() << std::endl;
 
-    if (filter_BBox.empty()) {
-        this->preprocessPoints(in_cloud_ptr, this->MINIMUM_RANGE, this->MAXMUM_RANGE);
-        this->publishCloud(msg->header, in_cloud_ptr);
-        return;
+void Center_PointPillars_ROS::filteringStage() {
+    DetectionFramePtr frame;
+    while (this->stage_queues_[STAGE_FILTERING]->pop(frame)) {
+        ros::WallTime t_start = ros::WallTime::now();
+
+        if (frame->filter_BBox.empty()) {
+            frame->static_cloud = frame->cloud;
+        } else {
+            frame->static_cloud.reset(new pcl::PointCloud<pcl::PointXYZI>());
+            pcl::PointCloud<pcl::PointXYZ>::Ptr cloud_cluster(new pcl::PointCloud<pcl::PointXYZ>());
+            this->extractBBoxPointcloud(frame->dynamic_BBox, frame->cloud, frame->static_cloud, cloud_cluster);
+        }
+        this->preprocessPoints(frame->static_cloud, this->MINIMUM_RANGE, this->MAXMUM_RANGE);
+
+        frame->stage_ms[STAGE_FILTERING] = (ros::WallTime::now() - t_start).toSec() * 1000;
+        this->stage_ms_[STAGE_FILTERING]->record(frame->stage_ms[STAGE_FILTERING]);
+        if (!this->stage_queues_[STAGE_PUBLISH]->push(frame))
+            break;
     }
+}
+
 
-    pcl::PointCloud<pcl::PointXYZI>::Ptr out_cloud_ptr(new pcl::PointCloud<pcl::PointXYZI>());
-    pcl::PointCloud<pcl::PointXYZ>::Ptr cloud_cluster(new pcl::PointCloud<pcl::PointXYZ>());
-    this->extractBBoxPointcloud(dynamic_BBox, in_cloud_ptr, out_cloud_ptr, cloud_cluster);
+void Center_PointPillars_ROS::publishStage() {
+    DetectionFramePtr frame;
+    while (this->stage_queues_[STAGE_PUBLISH]->pop(frame)) {
+        ros::WallTime t_start = ros::WallTime::now();
 
-    double avg_centerpoint_totaltime = std::accumulate(avg_centerpoint_time.begin(), avg_centerpoint_time.end(), 0.0) / avg_centerpoint_time.size();
-    double avg_ukf_totaltime = std::accumulate(avg_ukf_time.begin(), avg_ukf_time.end(), 0.0) / avg_ukf_time.size();
-    std::cout << "CenterPoint Time :: " << std::setfill(' ') << std::setw(6) << avg_centerpoint_time.back() << " ms    // Avg: " << std::setw(5) << avg_centerpoint_totaltime << std::endl;
-    std::cout << "UKF Time :: " << std::setfill(' ') << std::setw(6) << avg_ukf_time.back() << " ms    // Avg: " << std::setw(5) << avg_ukf_totaltime << std::endl;
+        if (frame->detected) {
+            this->centerpoint_ms_->record(frame->centerpoint_ms);
+            this->ukf_ms_->record(frame->ukf_ms);
+        }
 
+        this->publishCloud(frame->header, frame->static_cloud);
 
-    
-    this->preprocessPoints(out_cloud_ptr, this->MINIMUM_RANGE, this->MAXMUM_RANGE);
+        trlo::HistogramSnapshot centerpoint_time = this->centerpoint_ms_->snapshot();
+        if (!frame->filter_BBox.empty() && centerpoint_time.count > 0) {
+            trlo::HistogramSnapshot ukf_time = this->ukf_ms_->snapshot();
+            std::cout << "CenterPoint Time :: " << std::setfill(' ') << std::setw(6) << centerpoint_time.last << " ms    // Avg: " << std::setw(5) << centerpoint_time.mean() << std::endl;
+            std::cout << "UKF Time :: " << std::setfill(' ') << std::setw(6) << ukf_time.last << " ms    // Avg: " << std::setw(5) << ukf_time.mean() << std::endl;
 
-    this->publishCloud(msg->header, out_cloud_ptr);
-    this->publishObjectBoundingBox(msg->header, filter_BBox);
-    this->publishDynamicBoundingBox(msg->header, dynamic_BBox);
-    // this->publishClusterCloud(msg->header, cloud_cluster, cluster_indices);
+            this->publishObjectBoundingBox(frame->header, frame->filter_BBox);
+            this->publishDynamicBoundingBox(frame->header, frame->dynamic_BBox);
+            // this->publishClusterCloud(frame->header, cloud_cluster, cluster_indices);
+        }
 
+        frame->stage_ms[STAGE_PUBLISH] = (ros::WallTime::now() - t_start).toSec() * 1000;
+        this->stage_ms_[STAGE_PUBLISH]->record(frame->stage_ms[STAGE_PUBLISH]);
+        double end_to_end_ms = (ros::WallTime::now() - frame->received).toSec() * 1000;
+        this->end_to_end_ms_->record(end_to_end_ms);
+        this->publishPipelineStats(end_to_end_ms);
+    }
 }
 
 
-void Center_PointPillars_ROS::Odometry_Callback(const nav_msgs::OdometryPtr &odom) {
-    this->odom_queue.push_back(*odom);
+void Center_PointPillars_ROS::startPipeline() {
+    if (!this->stage_threads_.empty())
+        return;
+    this->stage_threads_.emplace_back(&Center_PointPillars_ROS::inferenceStage, this);
+    this->stage_threads_.emplace_back(&Center_PointPillars_ROS::trackingStage, this);
+    this->stage_threads_.emplace_back(&Center_PointPillars_ROS::filteringStage, this);
+    this->stage_threads_.emplace_back(&Center_PointPillars_ROS::publishStage, this);
 }
 
 
-
-void Center_PointPillars_ROS::extractBBoxPointcloud(std::vector<Bndbox> filter_BBox, pcl::PointCloud<pcl::PointXYZI>::Ptr cloud_in, pcl::PointCloud<pcl::PointXYZI>::Ptr& cloud_out, pcl::PointCloud<pcl::PointXYZ>::Ptr& cloud_cluster) {
-    // KDtree：O((logm)^2) + O(m^(1-1/3)+1) * n
-    // Violent methods：O(m*n)
-    if (filter_BBox.empty()) {
-        *cloud_out = *cloud_in;
-        return;
+void Center_PointPillars_ROS::stopPipeline() {
+    for (int s = STAGE_INFERENCE; s < NUM_STAGES; s++) {
+        this->stage_queues_[s]->stop();
+    }
+    for (auto& t : this->stage_threads_) {
+        if (t.joinable())
+            t.join();
     }
+    this->stage_threads_.clear();
+}
 
-    pcl::PointCloud<pcl::PointXYZ>::Ptr objects_cloud;
-    objects_cloud.reset(new pcl::PointCloud<pcl::PointXYZ>());
-    for (const auto box : filter_BBox) {
-        pcl::PointXYZ p;
-        p.x = box.x;
-        p.y = box.y;
-        p.z = box.z;
-        objects_cloud->points.push_back(p);
+
+void Center_PointPillars_ROS::releaseFrame(const DetectionFramePtr& frame) {
+    if (frame && frame->buffer >= 0) {
+        this->free_buffers_->push(frame->buffer);
+        frame->buffer = -1;
     }
-    this->objects_kdtree_->setInputCloud(objects_cloud);
-    
-    int cloudSize = cloud_in->size();
-    for (size_t i = 0; i < cloudSize; i++)
-    {
-        pcl::PointXYZ p;
-        p.x = cloud_in->points[i].x;
-        p.y = cloud_in->points[i].y;
-        p.z = cloud_in->points[i].z;
+}
 
-        std::vector<int> k_indices(1);
-        std::vector<float> k_sqr_distances(1);
-        this->objects_kdtree_->nearestKSearch(p, 1, k_indices, k_sqr_distances);
-        Bndbox nearest_object = filter_BBox[k_indices[0]];
 
-        if (k_sqr_distances[k_indices[0]] > 2.0) {
-            cloud_out->points.push_back(cloud_in->points[i]);
-            continue;
-        }
-        if ((p.x < nearest_object.x - nearest_object.l / 2 || p.x > nearest_object.x + nearest_object.l / 2) || 
-            (p.y < nearest_object.y - nearest_object.w / 2 || p.y > nearest_object.y + nearest_object.w / 2) ||
-            (p.z < nearest_object.z - nearest_object.h / 2 || p.z > nearest_object.z + nearest_object.h / 2)) {
-            cloud_out->points.push_back(cloud_in->points[i]);
-            continue;
-        }
-        cloud_cluster->points.push_back(p);
+void Center_PointPillars_ROS::publishPipelineStats(double end_to_end_ms) {
+    diagnostic_msgs::DiagnosticArray stats;
+    stats.header.stamp = ros::Time::now();
+
+    for (int s = 0; s < NUM_STAGES; s++) {
+        diagnostic_msgs::DiagnosticStatus status;
+        status.level = diagnostic_msgs::DiagnosticStatus::OK;
+        status.name = std::string("centerpp_node/pipeline/") + kStageNames[s];
+
+        diagnostic_msgs::KeyValue depth, latency;
+        depth.key = "queue_depth";
+        depth.value = std::to_string(this->stage_queues_[s] ? this->stage_queues_[s]->size() : 0);
+        latency.key = "latency_ms";
+        latency.value = std::to_string(this->stage_ms_[s]->last());
+        status.values.push_back(depth);
+        status.values.push_back(latency);
+        stats.status.push_back(status);
     }
+
+    diagnostic_msgs::DiagnosticStatus total;
+    total.level = diagnostic_msgs::DiagnosticStatus::OK;
+    total.name = "centerpp_node/pipeline";
+    diagnostic_msgs::KeyValue latency, dropped;
+    latency.key = "end_to_end_ms";
+    latency.value = std::to_string(end_to_end_ms);
+    dropped.key = "dropped_frames";
+    dropped.value = std::to_string(this->dropped_frames_->value());
+    total.values.push_back(latency);
+    total.values.push_back(dropped);
+    stats.status.push_back(total);
+
+    diagnostic_msgs::DiagnosticStatus store;
+    store.level = diagnostic_msgs::DiagnosticStatus::OK;
+    store.name = "centerpp_node/memory/track_store";
+    diagnostic_msgs::KeyValue bytes, live, slots;
+    bytes.key = "bytes";
+    bytes.value = std::to_string(this->track_store_bytes_.load());
+    live.key = "live_tracks";
+    live.value = std::to_string(this->track_store_live_.load());
+    slots.key = "slots";
+    slots.value = std::to_string(this->track_store_slots_.load());
+    store.values.push_back(bytes);
+    store.values.push_back(live);
+    store.values.push_back(slots);
+    stats.status.push_back(store);
+
+    this->pub_pipeline_stats_.publish(stats);
+}
+
+
+void Center_PointPillars_ROS::metricsTimerCB(const ros::TimerEvent& e) {
+    trlo::MetricsSnapshot snapshot = trlo::MetricsRegistry::global().snapshot();
+
+    diagnostic_msgs::DiagnosticArray stats;
+    stats.header.stamp = ros::Time::now();
+    trlo::metricsToDiagnostics(snapshot, "centerpp_node/metrics", stats);
+    this->pub_metrics_.publish(stats);
+
+    if (!this->metrics_file_.empty() && !trlo::appendMetricsSnapshot(this->metrics_file_, snapshot, stats.header.stamp.toSec()))
+        ROS_WARN_THROTTLE(60, "centerpp: could not append metrics to %s", this->metrics_file_.c_str());
+}
+
+
+void Center_PointPillars_ROS::Odometry_Callback(const nav_msgs::OdometryPtr &odom) {
+    const geometry_msgs::Pose& pose = odom->pose.pose;
+    this->pose_buffer_->insert(odom->header.stamp.toSec(),
+                               Eigen::Quaterniond(pose.orientation.w, pose.orientation.x, pose.orientation.y, pose.orientation.z),
+                               Eigen::Vector3d(pose.position.x, pose.position.y, pose.position.z));
+}
+
+
+
+void Center_PointPillars_ROS::extractBBoxPointcloud(const std::vector<Bndbox>& filter_BBox, pcl::PointCloud<pcl::PointXYZI>::Ptr cloud_in, pcl::PointCloud<pcl::PointXYZI>::Ptr& cloud_out, pcl::PointCloud<pcl::PointXYZ>::Ptr& cloud_cluster) {
+    // BEV grid over the box footprints + oriented box test: O(n) in the scan size
+    this->box_filter_->setBoxes(filter_BBox);
+    this->box_filter_->filter(*cloud_in, *cloud_out, *cloud_cluster);
     // std::cout << "cluster size is: " << cloud_cluster->size() << std::endl;
 }
 
@@ -574,19 +893,16 @@ void Center_PointPillars_ROS::publishClusterCloud(std_msgs::Header header, const
 }
 
 
-void Center_PointPillars_ROS::publishVelArrows(pcl::PointCloud<pcl::PointXYZ> egoTFPoints, ros::Time input_time) {
+void Center_PointPillars_ROS::publishVelArrows(const std::vector<TrackedObject>& tracks, const pcl::PointCloud<pcl::PointXYZ>& egoTFPoints, ros::Time input_time) {
     
-    int targetSize = this->targetPoints.size();
+    int targetSize = tracks.size();
     for(int i = 0; i < targetSize; i++){
         visualization_msgs::Marker arrowsG;
         arrowsG.lifetime = ros::Duration(0.1);
-        if(this->trackManage[i] == 0 ) {
+        if(tracks[i].isVisible == false ) {
         continue;
         }
-        if(this->isVisVec[i] == false ) {
-        continue;
-        }
-        if(this->isStaticVec[i] == true){
+        if(tracks[i].isStatic == true){
         continue;
         }
         arrowsG.header.frame_id = this->child_frame_;
@@ -599,14 +915,13 @@ void Center_PointPillars_ROS::publishVelArrows(pcl::PointCloud<pcl::PointXYZ> eg
         arrowsG.color.g = 1.0f;
         // arrowsG.color.r = 1.0f;
         arrowsG.color.a = 1.0;  
-        arrowsG.id = i;
+        arrowsG.id = tracks[i].id;
         geometry_msgs::Point p;
-        // assert(targetPoints[i].size()==4);
         p.x = egoTFPoints[i].x;
         p.y = egoTFPoints[i].y;
         p.z = -1.73/2;
-        double tv   = this->targetVandYaw[i][0];
-        double tyaw = this->targetVandYaw[i][1];
+        double tv   = tracks[i].v;
+        double tyaw = tracks[i].yaw;
 
         // Set the pose of the marker.  This is a full 6DOF pose relative to the frame/time specified in the header
         arrowsG.pose.position.x = p.x;
@@ -634,7 +949,7 @@ void Center_PointPillars_ROS::publishVelArrows(pcl::PointCloud<pcl::PointXYZ> eg
 }
 
 
-void Center_PointPillars_ROS::publishTrackingCenter(pcl::PointCloud<pcl::PointXYZ> egoTFPoints, ros::Time input_time) {
+void Center_PointPillars_ROS::publishTrackingCenter(const std::vector<TrackedObject>& tracks, const pcl::PointCloud<pcl::PointXYZ>& egoTFPoints, ros::Time input_time) {
 
     visualization_msgs::Marker pointsY, pointsG, pointsR, pointsB;
     pointsY.header.frame_id = pointsG.header.frame_id = pointsR.header.frame_id = pointsB.header.frame_id = this->child_frame_;
@@ -672,26 +987,23 @@ void Center_PointPillars_ROS::publishTrackingCenter(pcl::PointCloud<pcl::PointXY
     pointsB.color.b = 1.0;
     pointsB.color.a = 1.0;
 
-    int targetSize = this->targetPoints.size();
+    int targetSize = tracks.size();
     for(int i = 0; i < targetSize; i++){
-        if(this->trackManage[i] == 0) continue;
         geometry_msgs::Point p;
-        // p.x = this->targetPoints[i].x;
-        // p.y = this->targetPoints[i].y;
         p.x = egoTFPoints[i].x;
         p.y = egoTFPoints[i].y;
         p.z = -1.73/2;
 
-        if(this->isStaticVec[i] == true){
+        if(tracks[i].isStatic == true){
         pointsB.points.push_back(p);
         }
-        else if(this->trackManage[i] < 5 ){
+        else if(tracks[i].state == TRACK_TENTATIVE){
         pointsY.points.push_back(p);
         }
-        else if(this->trackManage[i] == 5){
+        else if(tracks[i].state == TRACK_CONFIRMED){
         pointsG.points.push_back(p);
         }
-        else if(this->trackManage[i] > 5){
+        else if(tracks[i].state == TRACK_COASTING){
         pointsR.points.push_back(p);
         }
     }
@@ -702,7 +1014,7 @@ void Center_PointPillars_ROS::publishTrackingCenter(pcl::PointCloud<pcl::PointXY
 }
 
 
-void Center_PointPillars_ROS::publishBoundingBoxMarkers(ros::Time input_time) {
+void Center_PointPillars_ROS::publishBoundingBoxMarkers(const std::vector<TrackedObject>& tracks, const Eigen::Matrix4f& ego_T, ros::Time input_time) {
 
     visualization_msgs::Marker line_list;
     line_list.header.frame_id = this->child_frame_;
@@ -721,41 +1033,26 @@ void Center_PointPillars_ROS::publishBoundingBoxMarkers(ros::Time input_time) {
     line_list.color.g = 1.0f;
     line_list.color.a = 1.0;
 
-    int id = 0;std::string ids;
-    int targetSize = this->visBBs.size();
-    for(int objectI = 0; objectI < targetSize; objectI ++){
-        for(int pointI = 0; pointI < 4; pointI++){
-            assert((pointI+1)%4 < this->visBBs[objectI].size());
-            assert((pointI+4) < this->visBBs[objectI].size());
-            assert((pointI+1)%4+4 < this->visBBs[objectI].size());
-            id ++; ids = to_string(id);
-            geometry_msgs::Point p;
-            p.x = this->visBBs[objectI][pointI].x;
-            p.y = this->visBBs[objectI][pointI].y;
-            p.z = this->visBBs[objectI][pointI].z;
-            line_list.points.push_back(p);
-            p.x = this->visBBs[objectI][(pointI+1)%4].x;
-            p.y = this->visBBs[objectI][(pointI+1)%4].y;
-            p.z = this->visBBs[objectI][(pointI+1)%4].z;
-            line_list.points.push_back(p);
-
-            p.x = this->visBBs[objectI][pointI].x;
-            p.y = this->visBBs[objectI][pointI].y;
-            p.z = this->visBBs[objectI][pointI].z;
-            line_list.points.push_back(p);
-            p.x = this->visBBs[objectI][pointI+4].x;
-            p.y = this->visBBs[objectI][pointI+4].y;
-            p.z = this->visBBs[objectI][pointI+4].z;
-            line_list.points.push_back(p);
-
-            p.x = this->visBBs[objectI][pointI+4].x;
-            p.y = this->visBBs[objectI][pointI+4].y;
-            p.z = this->visBBs[objectI][pointI+4].z;
-            line_list.points.push_back(p);
-            p.x = this->visBBs[objectI][(pointI+1)%4+4].x;
-            p.y = this->visBBs[objectI][(pointI+1)%4+4].y;
-            p.z = this->visBBs[objectI][(pointI+1)%4+4].z;
-            line_list.points.push_back(p);
+    // footprints are in the odom frame, ego_T brings them into the sensor frame
+    const float height[2] = {-1.73, 0};
+    for (const TrackedObject& track : tracks) {
+        if (!track.isVisible) continue;
+        Eigen::Vector3f corners[8];
+        for (int level = 0; level < 2; level++) {
+            for (int pointI = 0; pointI < 4; pointI++) {
+                corners[level*4 + pointI] = ego_T.block<3,3>(0,0) * Eigen::Vector3f(track.bbox.x[pointI], track.bbox.y[pointI], height[level])
+                                          + ego_T.block<3,1>(0,3);
+            }
+        }
+        const int edges[12][2] = {{0,1},{0,4},{4,5}, {1,2},{1,5},{5,6}, {2,3},{2,6},{6,7}, {3,0},{3,7},{7,4}};
+        for (int e = 0; e < 12; e++) {
+            for (int end = 0; end < 2; end++) {
+                geometry_msgs::Point p;
+                p.x = corners[edges[e][end]].x();
+                p.y = corners[edges[e][end]].y();
+                p.z = corners[edges[e][end]].z();
+                line_list.points.push_back(p);
+            }
         }
     }
     this->pub_box_markers_.publish(line_list);
@@ -794,151 +1091,61 @@ void Center_PointPillars_ROS::preprocessPoints(const pcl::PointCloud<pcl::PointX
 
 void Center_PointPillars_ROS::removeClosedPointCloud(const pcl::PointCloud<pcl::PointXYZI> &cloud_in, pcl::PointCloud<pcl::PointXYZI> &cloud_out, float th1, float th2)
 {
-  if (&cloud_in != &cloud_out)
-  {
-    cloud_out.header = cloud_in.header;
-    cloud_out.points.resize(cloud_in.points.size());
-  }
-
-  size_t j = 0;
-
-  for (size_t i = 0; i < cloud_in.points.size(); ++i)
-  {
-    float dis = cloud_in.points[i].x * cloud_in.points[i].x + cloud_in.points[i].y * cloud_in.points[i].y + cloud_in.points[i].z * cloud_in.points[i].z;
-    if (dis < th1 * th1)
-      continue;
-    if (dis > th2 * th2)
-      continue;
-    cloud_out.points[j++] = cloud_in.points[i];
-  }
-
-  if (j != cloud_in.points.size())
-  {
-    cloud_out.points.resize(j);
-  }
-
-  cloud_out.height = 1;
-  cloud_out.width = static_cast<uint32_t>(j);
-  cloud_out.is_dense = true;
+  trlo::removeClosedPointCloud(cloud_in, cloud_out, th1, th2);
 }
 
 
-void Center_PointPillars_ROS::mot_3d(std_msgs::Header in_msg_header, std::vector<Bndbox> filter_BBox, std::vector<Bndbox>& dynamic_BBox)
+void Center_PointPillars_ROS::mot_3d(const std_msgs::Header& in_msg_header, const std::vector<Bndbox>& filter_BBox, std::vector<Bndbox>& dynamic_BBox, std::vector<Eigen::Vector2f>& box_velocity)
 {
     double timestamp = in_msg_header.stamp.toSec();
     ros::Time input_time = in_msg_header.stamp;
 
     int box_num = filter_BBox.size();
-    // convert local to global-------------------------
-    std::vector<pcl::PointCloud<pcl::PointXYZ>> bBoxes;
-    pcl::PointCloud<pcl::PointXYZ> oneBbox;
-
-    for(int i = 0; i < box_num; i++)
-    {
-        pcl::PointXYZ o;
-        o.x = filter_BBox[i].x - filter_BBox[i].l / 2;
-        o.y = filter_BBox[i].y - filter_BBox[i].w / 2;
-        o.z = filter_BBox[i].z - filter_BBox[i].h / 2;
-        oneBbox.push_back(o);
-        o.x = filter_BBox[i].x + filter_BBox[i].l / 2;
-        o.y = filter_BBox[i].y - filter_BBox[i].w / 2;
-        o.z = filter_BBox[i].z - filter_BBox[i].h / 2; 
-        oneBbox.push_back(o);
-        o.x = filter_BBox[i].x + filter_BBox[i].l / 2;
-        o.y = filter_BBox[i].y + filter_BBox[i].w / 2;
-        o.z = filter_BBox[i].z - filter_BBox[i].h / 2;   
-        oneBbox.push_back(o);
-        o.x = filter_BBox[i].x - filter_BBox[i].l / 2;
-        o.y = filter_BBox[i].y + filter_BBox[i].w / 2;
-        o.z = filter_BBox[i].z - filter_BBox[i].h / 2;  
-        oneBbox.push_back(o);
-        o.x = filter_BBox[i].x - filter_BBox[i].l / 2;
-        o.y = filter_BBox[i].y - filter_BBox[i].w / 2;
-        o.z = filter_BBox[i].z + filter_BBox[i].h / 2;  
-        oneBbox.push_back(o);
-        o.x = filter_BBox[i].x + filter_BBox[i].l / 2;
-        o.y = filter_BBox[i].y - filter_BBox[i].w / 2;
-        o.z = filter_BBox[i].z + filter_BBox[i].h / 2;  
-        oneBbox.push_back(o);
-        o.x = filter_BBox[i].x + filter_BBox[i].l / 2;
-        o.y = filter_BBox[i].y + filter_BBox[i].w / 2;
-        o.z = filter_BBox[i].z + filter_BBox[i].h / 2;  
-        oneBbox.push_back(o);
-        o.x = filter_BBox[i].x - filter_BBox[i].l / 2;
-        o.y = filter_BBox[i].y + filter_BBox[i].w / 2;
-        o.z = filter_BBox[i].z + filter_BBox[i].h / 2;
-
-        bBoxes.push_back(oneBbox);
-        oneBbox.clear();
-    }
-
-    
-
+    box_velocity.assign(box_num, Eigen::Vector2f::Zero());
+    // ego pose interpolated at the scan stamp, identity until odometry arrives
     Eigen::Matrix4f last_T;
-    
-    if (this->odom_queue.empty())
+    if (!this->pose_buffer_->lookup(timestamp, last_T))
     {
         last_T.setIdentity();
     }
-    else
-    {
-        Eigen::Quaternionf last_q(this->odom_queue.front().pose.pose.orientation.w, this->odom_queue.front().pose.pose.orientation.x, this->odom_queue.front().pose.pose.orientation.y, this->odom_queue.front().pose.pose.orientation.z);
-        last_T.block<3,3>(0,0) = last_q.toRotationMatrix();
-        Eigen::Vector3f last_t(this->odom_queue.front().pose.pose.position.x, this->odom_queue.front().pose.pose.position.y, this->odom_queue.front().pose.pose.position.z);
-        last_T.block<3,1>(0,3) = last_t;
-    }
-    // getOriginPoints(last_T.block<3,3>(0,0));
 
-    pcl::PointCloud<pcl::PointXYZ> newBox;
-    for(int i = 0; i < box_num; i++ ){
-        bBoxes[i].header.frame_id = this->odom_frame_;
-        
-        pcl::transformPointCloud(bBoxes[i], newBox, last_T);
-        bBoxes[i] = newBox;
-        bBoxes[i].header.frame_id = this->odom_frame_;
+    // convert local to global-------------------------
+    // boxes are tracked axis aligned in the sensor frame, the detector yaw is not used
+    std::vector<OrientedBox> bBoxes(box_num);
+    for(int i = 0; i < box_num; i++)
+    {
+        OrientedBox box;
+        box.x = filter_BBox[i].x;
+        box.y = filter_BBox[i].y;
+        box.z = filter_BBox[i].z;
+        box.l = filter_BBox[i].l;
+        box.w = filter_BBox[i].w;
+        box.h = filter_BBox[i].h;
+        box.yaw = 0;
+        bBoxes[i] = box.transformed(last_T);
     }
     //end converting----------------------------------------
-    this->targetPoints.clear();
-    this->targetVandYaw.clear();
-    this->trackManage.clear();
-    this->isStaticVec.clear();
-    this->isVisVec.clear();
-    this->visBBs.clear();
     double t1 = ros::Time::now().toSec();
-    immUkfJpdaf(bBoxes, timestamp, this->targetPoints, this->targetVandYaw, this->trackManage, this->isStaticVec, this->isVisVec, this->visBBs);
+    const std::vector<TrackedObject>& tracks = this->tracker_->step(bBoxes, timestamp, last_T);
     double t2 = ros::Time::now().toSec();
-    avg_ukf_time.push_back((t2 - t1) * 1000);
+    this->last_ukf_ms_ = (t2 - t1) * 1000;
+    this->track_store_bytes_ = this->tracker_->trackStoreBytes();
+    this->track_store_live_ = this->tracker_->liveTracks();
+    this->track_store_slots_ = this->tracker_->trackSlots();
     // ROS_INFO("UKF cost time:%f ms", (t2 - t1) * 1000);
 
-    assert(targetPoints.size() == trackManage.size());
-    assert(targetPoints.size()== targetVandYaw.size());
-
     //start converting to ego tf-------------------------
-    if (this->odom_queue.empty())
-    {
-        last_T.setIdentity();
-    }
-    else
-    {
-        Eigen::Quaternionf last_q(this->odom_queue.front().pose.pose.orientation.w, this->odom_queue.front().pose.pose.orientation.x, this->odom_queue.front().pose.pose.orientation.y, this->odom_queue.front().pose.pose.orientation.z);
-        last_T.block<3,3>(0,0) = last_q.toRotationMatrix().inverse();
-        Eigen::Vector3f last_t(this->odom_queue.front().pose.pose.position.x, this->odom_queue.front().pose.pose.position.y, this->odom_queue.front().pose.pose.position.z);
-        last_t = -last_T.block<3,3>(0,0) * last_t;
-        last_T.block<3,1>(0,3) = last_t;
-    }
+    Eigen::Matrix3f last_R = last_T.block<3,3>(0,0).transpose();
+    last_T.block<3,1>(0,3) = -last_R * last_T.block<3,1>(0,3);
+    last_T.block<3,3>(0,0) = last_R;
 
     // converting from global to ego tf for visualization
-    // processing targetPoints
+    // processing track centers
     pcl::PointCloud<pcl::PointXYZ> egoTFPoints;
-    this->targetPoints.header.frame_id = this->child_frame_;
-    pcl::transformPointCloud(targetPoints, egoTFPoints, last_T);
-
-    //processing visBBs
-    pcl::PointCloud<pcl::PointXYZ> visEgoBB;
-    for(int i = 0; i < visBBs.size(); i++){
-        this->visBBs[i].header.frame_id = this->child_frame_;
-        pcl::transformPointCloud(this->visBBs[i], visEgoBB, last_T);
-        this->visBBs[i] = visEgoBB;
+    egoTFPoints.header.frame_id = this->child_frame_;
+    for (const TrackedObject& track : tracks) {
+        Eigen::Vector3f p = last_R * Eigen::Vector3f(track.x, track.y, -1.73/2) + last_T.block<3,1>(0,3);
+        egoTFPoints.push_back(pcl::PointXYZ(p.x(), p.y(), p.z()));
     }
     //end converting to ego tf---------------------------
 
@@ -953,16 +1160,14 @@ void Center_PointPillars_ROS::mot_3d(std_msgs::Header in_msg_header, std::vector
     }
     this->objects_kdtree_->setInputCloud(objects_cloud);
 
-    int targetSize = targetPoints.size();
+    // nothing to match live tracks against without detections
+    int targetSize = filter_BBox.empty() ? 0 : tracks.size();
     for (int i = 0; i < targetSize; i++)
     {
-        if(this->trackManage[i] == 0 ) {
+        if(tracks[i].isVisible == false ) {
         continue;
         }
-        if(this->isVisVec[i] == false ) {
-        continue;
-        }
-        if(this->isStaticVec[i] == true){
+        if(tracks[i].isStatic == true){
         continue;
         }
         pcl::PointXYZ p;
@@ -975,14 +1180,16 @@ void Center_PointPillars_ROS::mot_3d(std_msgs::Header in_msg_header, std::vector
         this->objects_kdtree_->nearestKSearch(p, 1, k_indices, k_sqr_distances);
         Bndbox nearest_object = filter_BBox[k_indices[0]];
         dynamic_BBox.push_back(nearest_object);
-    }
 
-    if (!this->odom_queue.empty())
-        this->odom_queue.pop_front();
+        // odom-frame velocity of the track, used to propagate the box on skipped frames
+        double v = tracks[i].v;
+        double yaw = tracks[i].yaw;
+        box_velocity[k_indices[0]] = Eigen::Vector2f(v * cos(yaw), v * sin(yaw));
+    }
 
-    // this->publishVelArrows(egoTFPoints, input_time);
-    // this->publishTrackingCenter(egoTFPoints, input_time);
-    // this->publishBoundingBoxMarkers(input_time);
+    // this->publishVelArrows(tracks, egoTFPoints, input_time);
+    // this->publishTrackingCenter(tracks, egoTFPoints, input_time);
+    // this->publishBoundingBoxMarkers(tracks, last_T, input_time);
 }
 
 
@@ -1006,7 +1213,10 @@ int main(int argc, char **argv) {
     }
 
     // GetDeviceInfo();
-    initDevice(0);
+    std::string detector_backend;
+    ros::param::param<std::string>("~center_pp/detector/backend", detector_backend, "centerpoint");
+    if (detector_backend != "replay")
+        initDevice(0);
 
     cpp::Center_PointPillars_ROS center_pintPillars_ros(nh);
     center_pintPillars_ros.Process();
@@ -0,0 +1,136 @@
+/****************************************************************************************
+ *
+ * Copyright (c) 2024, Shenyang Institute of Automation, Chinese Academy of Sciences
+ *
+ * Authors: Yanpeng Jia
+ * Contact: jiayanpeng@sia.cn
+ *
+ ****************************************************************************************/
+
+#include "centerpp_node/detection_log.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <numeric>
+
+static const char kLogMagic[8] = {'T', 'R', 'L', 'O', 'D', 'E', 'T', '1'};
+
+// on-disk box record, independent of Bndbox's in-memory layout
+struct LoggedBox {
+    float val[9];   // x, y, z, w, l, h, vx, vy, rt
+    int32_t id;
+    float score;
+};
+
+DetectionLogWriter::~DetectionLogWriter() {
+    this->close();
+}
+
+bool DetectionLogWriter::open(const std::string& path) {
+    this->close();
+    this->out_.open(path, std::ios::binary | std::ios::trunc);
+    if (!this->out_.is_open()) return false;
+    this->out_.write(kLogMagic, sizeof(kLogMagic));
+    return this->out_.good();
+}
+
+void DetectionLogWriter::write(double stamp, const std::vector<Bndbox>& boxes) {
+    if (!this->out_.is_open()) return;
+
+    uint32_t count = boxes.size();
+    this->out_.write(reinterpret_cast<const char*>(&stamp), sizeof(stamp));
+    this->out_.write(reinterpret_cast<const char*>(&count), sizeof(count));
+    for (const auto& box : boxes) {
+        LoggedBox rec = {{box.x, box.y, box.z, box.w, box.l, box.h, box.vx, box.vy, box.rt}, box.id, box.score};
+        this->out_.write(reinterpret_cast<const char*>(&rec), sizeof(rec));
+    }
+}
+
+void DetectionLogWriter::close() {
+    if (this->out_.is_open()) {
+        this->out_.flush();
+        this->out_.close();
+    }
+}
+
+ReplayDetector::ReplayDetector(double tolerance) : tolerance_(tolerance) {}
+
+bool ReplayDetector::load(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    char magic[sizeof(kLogMagic)];
+    if (!in.read(magic, sizeof(magic)) || std::memcmp(magic, kLogMagic, sizeof(kLogMagic)) != 0) {
+        std::cerr << "ReplayDetector: " << path << " is not a detection log" << std::endl;
+        return false;
+    }
+
+    struct Record { double stamp; size_t begin, end; };
+    std::vector<Record> records;
+    std::vector<Bndbox> boxes;
+    double stamp;
+    uint32_t count;
+    while (in.read(reinterpret_cast<char*>(&stamp), sizeof(stamp)) &&
+           in.read(reinterpret_cast<char*>(&count), sizeof(count))) {
+        size_t begin = boxes.size();
+        LoggedBox rec;
+        for (uint32_t i = 0; i < count && in.read(reinterpret_cast<char*>(&rec), sizeof(rec)); i++) {
+            boxes.push_back(Bndbox(rec.val[0], rec.val[1], rec.val[2], rec.val[3], rec.val[4], rec.val[5],
+                                   rec.val[6], rec.val[7], rec.val[8], rec.id, rec.score));
+        }
+        if (boxes.size() - begin != count) break;   // truncated tail of a crashed recording
+        records.push_back({stamp, begin, boxes.size()});
+    }
+
+    // live recordings are in stamp order already, but do not rely on it
+    std::stable_sort(records.begin(), records.end(), [](const Record& a, const Record& b) { return a.stamp < b.stamp; });
+
+    this->stamps_.clear();
+    this->offsets_.assign(1, 0);
+    this->boxes_.clear();
+    this->boxes_.reserve(boxes.size());
+    for (const auto& r : records) {
+        this->stamps_.push_back(r.stamp);
+        this->boxes_.insert(this->boxes_.end(), boxes.begin() + r.begin, boxes.begin() + r.end);
+        this->offsets_.push_back(this->boxes_.size());
+    }
+    this->misses_ = 0;
+    return true;
+}
+
+int ReplayDetector::detect(const void* points, unsigned int points_num, double stamp,
+                           cudaStream_t stream, std::vector<Bndbox>& boxes) {
+    boxes.clear();
+    if (this->stamps_.empty()) {
+        this->misses_++;
+        return 0;
+    }
+
+    auto it = std::lower_bound(this->stamps_.begin(), this->stamps_.end(), stamp);
+    size_t idx = it - this->stamps_.begin();
+    if (idx == this->stamps_.size() ||
+        (idx > 0 && stamp - this->stamps_[idx - 1] < this->stamps_[idx] - stamp)) {
+        idx--;
+    }
+    if (std::fabs(this->stamps_[idx] - stamp) > this->tolerance_) {
+        this->misses_++;
+        return 0;
+    }
+
+    boxes.assign(this->boxes_.begin() + this->offsets_[idx], this->boxes_.begin() + this->offsets_[idx + 1]);
+    return 0;
+}
+
+RecordingDetector::RecordingDetector(std::unique_ptr<Detector> inner, const std::string& path)
+    : inner_(std::move(inner)) {
+    if (!this->writer_.open(path)) {
+        std::cerr << "RecordingDetector: cannot open " << path << ", detections are not recorded" << std::endl;
+    }
+}
+
+int RecordingDetector::detect(const void* points, unsigned int points_num, double stamp,
+                              cudaStream_t stream, std::vector<Bndbox>& boxes) {
+    int ret = this->inner_->detect(points, points_num, stamp, stream, boxes);
+    this->writer_.write(stamp, boxes);
+    return ret;
+}
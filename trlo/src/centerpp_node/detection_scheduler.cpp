@@ -0,0 +1,84 @@
+/****************************************************************************************
+ *
+ * Copyright (c) 2024, Shenyang Institute of Automation, Chinese Academy of Sciences
+ *
+ * Authors: Yanpeng Jia
+ * Contact: jiayanpeng@sia.cn
+ *
+ ****************************************************************************************/
+
+#include "centerpp_node/detection_scheduler.h"
+
+#include <algorithm>
+#include <cmath>
+
+static float poseYaw(const Eigen::Matrix4f& T) {
+    return std::atan2(T(1, 0), T(0, 0));
+}
+
+DetectionScheduler::DetectionScheduler(int detect_every, double max_track_std,
+                                       double max_ego_translation, double max_ego_rotation)
+    : detect_every_(std::max(1, detect_every)), max_track_std_(max_track_std),
+      max_ego_translation_(max_ego_translation), max_ego_rotation_(max_ego_rotation) {}
+
+bool DetectionScheduler::shouldDetect(double track_std, const Eigen::Matrix4f& ego_pose) const {
+    if (!this->has_detection_ || this->detect_every_ <= 1) return true;
+    if (this->frames_skipped_ + 1 >= this->detect_every_) return true;
+    if (track_std > this->max_track_std_) return true;
+
+    Eigen::Matrix4f delta = this->last_pose_.inverse() * ego_pose;
+    if (delta.block<3,1>(0,3).norm() > this->max_ego_translation_) return true;
+    Eigen::AngleAxisf rotation(Eigen::Matrix3f(delta.block<3,3>(0,0)));
+    if (std::fabs(rotation.angle()) > this->max_ego_rotation_) return true;
+    return false;
+}
+
+void DetectionScheduler::detected(const Eigen::Matrix4f& ego_pose) {
+    this->has_detection_ = true;
+    this->frames_skipped_ = 0;
+    this->last_pose_ = ego_pose;
+}
+
+void BoxPropagator::reset(double stamp, const Eigen::Matrix4f& ego_pose,
+                          const std::vector<Bndbox>& boxes, const std::vector<Eigen::Vector2f>& velocity) {
+    this->valid_ = true;
+    this->stamp_ = stamp;
+    this->boxes_.clear();
+    this->velocity_.assign(boxes.size(), Eigen::Vector2f::Zero());
+
+    // rt is measured clockwise (BoxPointFilter uses yaw = -rt)
+    float yaw = poseYaw(ego_pose);
+    for (size_t i = 0; i < boxes.size(); i++) {
+        Bndbox box = boxes[i];
+        Eigen::Vector4f p = ego_pose * Eigen::Vector4f(box.x, box.y, box.z, 1.0f);
+        box.x = p.x();
+        box.y = p.y();
+        box.z = p.z();
+        box.rt -= yaw;
+        this->boxes_.push_back(box);
+        if (i < velocity.size()) this->velocity_[i] = velocity[i];
+    }
+}
+
+bool BoxPropagator::propagate(double stamp, const Eigen::Matrix4f& ego_pose,
+                              std::vector<Bndbox>& boxes, std::vector<Bndbox>& dynamic) const {
+    boxes.clear();
+    dynamic.clear();
+    if (!this->valid_) return false;
+
+    float dt = static_cast<float>(stamp - this->stamp_);
+    Eigen::Matrix4f world_to_ego = ego_pose.inverse();
+    float yaw = poseYaw(ego_pose);
+    for (size_t i = 0; i < this->boxes_.size(); i++) {
+        Bndbox box = this->boxes_[i];
+        const Eigen::Vector2f& v = this->velocity_[i];
+        Eigen::Vector4f p = world_to_ego * Eigen::Vector4f(box.x + v.x() * dt, box.y + v.y() * dt, box.z, 1.0f);
+        box.x = p.x();
+        box.y = p.y();
+        box.z = p.z();
+        box.rt += yaw;
+        boxes.push_back(box);
+        if (!v.isZero()) dynamic.push_back(box);
+    }
+    return true;
+}
@@ -0,0 +1,65 @@
+/****************************************************************************************
+ *
+ * Copyright (c) 2024, Shenyang Institute of Automation, Chinese Academy of Sciences
+ *
+ * Authors: Yanpeng Jia
+ * Contact: jiayanpeng@sia.cn
+ *
+ ****************************************************************************************/
+
+#include "centerpp_node/pointcloud_packer.h"
+
+#include <cmath>
+#include <cstring>
+
+bool PointCloudPacker::findFields(const sensor_msgs::PointCloud2& msg) {
+    // floats are copied as they are, so they have to be in host (little-endian) order
+    if (msg.is_bigendian) return false;
+    int found = 0;
+    for (const auto& field : msg.fields) {
+        if (field.datatype != sensor_msgs::PointField::FLOAT32) continue;
+        // a field reaching past the point would read into the next one or past the data
+        if ((size_t)field.offset + sizeof(float) > msg.point_step) continue;
+        if (field.name == "x") { x_offset_ = field.offset; found |= 1; }
+        else if (field.name == "y") { y_offset_ = field.offset; found |= 2; }
+        else if (field.name == "z") { z_offset_ = field.offset; found |= 4; }
+    }
+    return found == 7;
+}
+
+size_t PointCloudPacker::pack(const sensor_msgs::PointCloud2& msg, float* dst, size_t max_points) {
+    truncated_ = 0;
+    if (!findFields(msg)) return 0;
+
+    if (msg.width == 0 || msg.height == 0) return 0;
+    const size_t required = (size_t)msg.row_step * (msg.height - 1) + (size_t)msg.point_step * msg.width;
+    if (msg.data.size() < required) return 0;
+
+    size_t n = 0;
+    for (uint32_t row = 0; row < msg.height; row++) {
+        const uint8_t* row_data = msg.data.data() + (size_t)row * msg.row_step;
+        for (uint32_t col = 0; col < msg.width; col++) {
+            const uint8_t* p = row_data + (size_t)col * msg.point_step;
+
+            float x, y, z;
+            std::memcpy(&x, p + x_offset_, sizeof(float));
+            std::memcpy(&y, p + y_offset_, sizeof(float));
+            std::memcpy(&z, p + z_offset_, sizeof(float));
+            if (!std::isfinite(x) || !std::isfinite(y) || !std::isfinite(z)) continue;
+
+            if (n == max_points) {
+                truncated_++;
+                continue;
+            }
+
+            float* out = dst + n * kPointFeatures;
+            out[0] = x;
+            out[1] = y;
+            out[2] = z;
+            out[3] = 0.0f;
+            out[4] = 0.0f;
+            n++;
+        }
+    }
+    return n;
+}
@@ -0,0 +1,89 @@
+/****************************************************************************************
+ *
+ * Copyright (c) 2024, Shenyang Institute of Automation, Chinese Academy of Sciences
+ *
+ * Authors: Yanpeng Jia
+ * Contact: jiayanpeng@sia.cn
+ *
+ ****************************************************************************************/
+
+#include "centerpp_node/pose_buffer.h"
+
+#include <algorithm>
+
+PoseBuffer::PoseBuffer(size_t capacity, double max_age)
+    : ring_(std::max<size_t>(capacity, 2)), max_age_(max_age) {}
+
+void PoseBuffer::insert(double stamp, const Eigen::Quaterniond& q, const Eigen::Vector3d& t) {
+    std::lock_guard<std::mutex> lock(this->mtx_);
+    if (this->size_ > 0 && stamp <= this->at(this->size_ - 1).stamp) return;
+
+    // full: overwrite the oldest slot
+    if (this->size_ == this->ring_.size()) {
+        this->head_ = (this->head_ + 1) % this->ring_.size();
+        this->size_--;
+    }
+    StampedPose& slot = this->ring_[(this->head_ + this->size_) % this->ring_.size()];
+    slot.stamp = stamp;
+    slot.q = q.normalized();
+    slot.t = t;
+    this->size_++;
+
+    // keep at least two entries so a scan slightly older than max_age still interpolates
+    while (this->size_ > 2 && this->at(0).stamp < stamp - this->max_age_) {
+        this->head_ = (this->head_ + 1) % this->ring_.size();
+        this->size_--;
+    }
+}
+
+bool PoseBuffer::lookup(double stamp, Eigen::Quaterniond& q, Eigen::Vector3d& t) const {
+    std::lock_guard<std::mutex> lock(this->mtx_);
+    if (this->size_ == 0) return false;
+
+    if (stamp <= this->at(0).stamp) {
+        q = this->at(0).q;
+        t = this->at(0).t;
+        return true;
+    }
+    if (stamp >= this->at(this->size_ - 1).stamp) {
+        q = this->at(this->size_ - 1).q;
+        t = this->at(this->size_ - 1).t;
+        return true;
+    }
+
+    // first entry with entry.stamp > stamp; at(0) <= stamp < at(size_-1) so 1 <= hi < size_
+    size_t lo = 0, hi = this->size_ - 1;
+    while (hi - lo > 1) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (this->at(mid).stamp <= stamp) lo = mid;
+        else hi = mid;
+    }
+
+    const StampedPose& a = this->at(lo);
+    const StampedPose& b = this->at(hi);
+    double s = (stamp - a.stamp) / (b.stamp - a.stamp);
+    q = a.q.slerp(s, b.q);
+    t = (1.0 - s) * a.t + s * b.t;
+    return true;
+}
+
+bool PoseBuffer::lookup(double stamp, Eigen::Matrix4f& T) const {
+    Eigen::Quaterniond q;
+    Eigen::Vector3d t;
+    if (!this->lookup(stamp, q, t)) return false;
+    T.setIdentity();
+    T.block<3,3>(0,0) = q.toRotationMatrix().cast<float>();
+    T.block<3,1>(0,3) = t.cast<float>();
+    return true;
+}
+
+size_t PoseBuffer::size() const {
+    std::lock_guard<std::mutex> lock(this->mtx_);
+    return this->size_;
+}
+
+void PoseBuffer::clear() {
+    std::lock_guard<std::mutex> lock(this->mtx_);
+    this->head_ = 0;
+    this->size_ = 0;
+}
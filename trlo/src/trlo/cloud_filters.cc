@@ -0,0 +1,40 @@
+/****************************************************************************************
+ *
+ * Copyright (c) 2024, Shenyang Institute of Automation, Chinese Academy of Sciences
+ *
+ * Authors: Yanpeng Jia
+ * Contact: jiayanpeng@sia.cn
+ *
+ ****************************************************************************************/
+
+#include "trlo/cloud_filters.h"
+
+void trlo::removeClosedPointCloud(const pcl::PointCloud<pcl::PointXYZI> &cloud_in, pcl::PointCloud<pcl::PointXYZI> &cloud_out, float th1, float th2)
+{
+  if (&cloud_in != &cloud_out)
+  {
+    cloud_out.header = cloud_in.header;
+    cloud_out.points.resize(cloud_in.points.size());
+  }
+
+  size_t j = 0;
+
+  for (size_t i = 0; i < cloud_in.points.size(); ++i)
+  {
+    float dis = cloud_in.points[i].x * cloud_in.points[i].x + cloud_in.points[i].y * cloud_in.points[i].y + cloud_in.points[i].z * cloud_in.points[i].z;
+    if (dis < th1 * th1)
+      continue;
+    if (dis > th2 * th2)
+      continue;
+    cloud_out.points[j++] = cloud_in.points[i];
+  }
+
+  if (j != cloud_in.points.size())
+  {
+    cloud_out.points.resize(j);
+  }
+
+  cloud_out.height = 1;
+  cloud_out.width = static_cast<uint32_t>(j);
+  cloud_out.is_dense = true;
+}
@@ -0,0 +1,257 @@
+/****************************************************************************************
+ *
+ * Copyright (c) 2024, Shenyang Institute of Automation, Chinese Academy of Sciences
+ *
+ * Authors: Yanpeng Jia
+ * Contact: jiayanpeng@sia.cn
+ *
+ ****************************************************************************************/
+
+/**
+ * Accuracy and latency regression harness on a KITTI odometry sequence.
+ *
+ * Feeds velodyne/%06d.bin of ~sequence to the odometry one scan at a time through
+ * OdomNode::processScan, no bag and no subscribers, then writes ATE, RPE, per-stage
+ * latency percentiles and peak RSS to ~output. With ~baseline set the metrics are
+ * compared against it and the node exits with 2 on a regression. Ground truth is
+ * poses.txt in the camera frame, moved to the velodyne frame with calib.txt.
+ *
+ * With ~simulate the scans are ray-cast by LidarSim along streetTrajectory
+ * instead, the ground truth is then exact and no dataset is needed.
+ *
+ * With ~metrics set, the final snapshot of the metrics registry (latency
+ * histograms of the odometry) is appended to that file as a JSON line.
+ **/
+
+#include "trlo/odom.h"
+#include "trlo/lidar_sim.h"
+#include "trlo/trajectory_eval.h"
+
+static double peakRssMB() {
+  std::ifstream status("/proc/self/status");
+  std::string line;
+  while (std::getline(status, line)) {
+    if (line.compare(0, 6, "VmHWM:") == 0) {
+      return std::atof(line.c_str() + 6) / 1024.;
+    }
+  }
+  return 0;
+}
+
+static bool loadScan(const std::string& path, pcl::PointCloud<PointType>& cloud) {
+  std::ifstream in(path, std::ios::binary | std::ios::ate);
+  if (!in.is_open()) {
+    return false;
+  }
+  size_t bytes = in.tellg();
+  in.seekg(0);
+  std::vector<float> buf(bytes / sizeof(float));
+  in.read(reinterpret_cast<char*>(buf.data()), buf.size() * sizeof(float));
+
+  size_t n = buf.size() / 4;
+  cloud.points.resize(n);
+  for (size_t i = 0; i < n; i++) {
+    PointType& p = cloud.points[i];
+    p.x = buf[i * 4];
+    p.y = buf[i * 4 + 1];
+    p.z = buf[i * 4 + 2];
+    p.intensity = buf[i * 4 + 3];
+  }
+  cloud.width = n;
+  cloud.height = 1;
+  cloud.is_dense = true;
+  return true;
+}
+
+int main(int argc, char** argv) {
+
+  ros::init(argc, argv, "trlo_kitti_eval");
+  ros::NodeHandle nh("~");
+
+  std::string sequence, poses_path, calib_path, times_path, output, baseline, trajectory_path, metrics_path;
+  int max_frames, rpe_delta;
+  double scan_period, tol_accuracy, tol_latency, tol_memory;
+  bool simulate;
+  trlo::LidarSimConfig sim;
+  int sim_frames, sim_seed;
+  double sim_speed;
+
+  ros::param::param<std::string>("~sequence", sequence, "");
+  ros::param::param<std::string>("~poses", poses_path, sequence + "/poses.txt");
+  ros::param::param<std::string>("~calib", calib_path, sequence + "/calib.txt");
+  ros::param::param<std::string>("~times", times_path, sequence + "/times.txt");
+  ros::param::param<std::string>("~output", output, "trlo_eval.txt");
+  ros::param::param<std::string>("~baseline", baseline, "");
+  ros::param::param<std::string>("~trajectory", trajectory_path, "");
+  ros::param::param<std::string>("~metrics", metrics_path, "");
+  ros::param::param<int>("~max_frames", max_frames, -1);
+  ros::param::param<int>("~rpe_delta", rpe_delta, 10);
+  ros::param::param<double>("~scan_period", scan_period, 0.1);
+  ros::param::param<double>("~tolerance/accuracy", tol_accuracy, 0.05);
+  ros::param::param<double>("~tolerance/latency", tol_latency, 0.10);
+  ros::param::param<double>("~tolerance/memory", tol_memory, 0.10);
+
+  ros::param::param<bool>("~simulate", simulate, false);
+  ros::param::param<int>("~sim/frames", sim_frames, 300);
+  ros::param::param<double>("~sim/speed", sim_speed, 10.0);
+  ros::param::param<int>("~sim/beams", sim.beams, sim.beams);
+  ros::param::param<double>("~sim/azimuth_res", sim.azimuth_res, sim.azimuth_res);
+  ros::param::param<double>("~sim/range_noise", sim.range_noise, sim.range_noise);
+  ros::param::param<double>("~sim/dropout", sim.dropout, sim.dropout);
+  ros::param::param<int>("~sim/seed", sim_seed, 1);
+  sim.seed = sim_seed;
+
+  // Ground truth in the velodyne frame, indexed by frame
+  trlo::PoseList gt_all;
+  std::vector<double> stamps;
+  std::unique_ptr<trlo::LidarSim> simulator;
+
+  if (simulate) {
+    gt_all = trlo::streetTrajectory(sim_frames, 1. / scan_period, sim_speed);
+    double length = sim_speed * sim_frames * scan_period;
+    simulator.reset(new trlo::LidarSim(trlo::LidarScene::street(length, sim.seed), sim));
+  } else {
+    if (sequence.empty()) {
+      ROS_ERROR("~sequence is not set");
+      return 1;
+    }
+
+    if (!trlo::loadKittiPoses(poses_path, gt_all)) {
+      ROS_ERROR("Could not read ground truth %s", poses_path.c_str());
+      return 1;
+    }
+
+    // Without a calibration the poses are taken as velodyne poses
+    Eigen::Matrix4d Tr = Eigen::Matrix4d::Identity();
+    if (!trlo::loadKittiCalib(calib_path, Tr)) {
+      ROS_WARN("No Tr in %s, using ground truth as is", calib_path.c_str());
+    }
+    Eigen::Matrix4d Tr_inv = Tr.inverse();
+    for (auto& T : gt_all) {
+      T = Tr_inv * T * Tr;
+    }
+
+    std::ifstream times(times_path);
+    double t;
+    while (times >> t) {
+      stamps.push_back(t);
+    }
+  }
+
+  size_t frames = gt_all.size();
+  if (max_frames > 0) {
+    frames = std::min(frames, (size_t) max_frames);
+  }
+
+  trlo::OdomNode node(nh);
+
+  trlo::PoseList gt, est;
+  std::vector<std::vector<double>> stage(7);
+  pcl::PointCloud<PointType> cloud;
+
+  for (size_t i = 0; i < frames && ros::ok(); i++) {
+    if (simulator) {
+      simulator->scan(gt_all[i], i, cloud);
+    } else {
+      char name[32];
+      snprintf(name, sizeof(name), "/velodyne/%06zu.bin", i);
+      if (!loadScan(sequence + name, cloud)) {
+        ROS_WARN("Missing scan %s, stopping at frame %zu", name, i);
+        break;
+      }
+    }
+
+    sensor_msgs::PointCloud2::Ptr msg (new sensor_msgs::PointCloud2);
+    pcl::toROSMsg(cloud, *msg);
+    msg->header.frame_id = "velodyne";
+    msg->header.stamp = ros::Time(1. + (i < stamps.size() ? stamps[i] : i * scan_period));
+
+    if (!node.processScan(msg)) {
+      continue;
+    }
+
+    gt.push_back(gt_all[i]);
+    est.push_back(node.getPose().cast<double>());
+
+    const trlo::OdomNode::StageTimes& s = node.getStageTimes();
+    const double times_s[7] = {s.preprocess, s.sources, s.s2s, s.submap, s.s2m, s.keyframes, s.total};
+    for (int k = 0; k < 7; k++) {
+      stage[k].push_back(1e3 * times_s[k]);
+    }
+  }
+
+  if (gt.empty()) {
+    ROS_ERROR("The odometry produced no pose");
+    return 1;
+  }
+
+  // Both trajectories start at the first estimated frame
+  Eigen::Matrix4d gt_origin = gt.front().inverse();
+  Eigen::Matrix4d est_origin = est.front().inverse();
+  for (size_t i = 0; i < gt.size(); i++) {
+    gt[i] = gt_origin * gt[i];
+    est[i] = est_origin * est[i];
+  }
+
+  if (!trajectory_path.empty() && !trlo::saveKittiPoses(trajectory_path, est)) {
+    ROS_WARN("Could not write %s", trajectory_path.c_str());
+  }
+
+  if (!metrics_path.empty() &&
+      !trlo::appendMetricsSnapshot(metrics_path, trlo::MetricsRegistry::global().snapshot(), ros::WallTime::now().toSec())) {
+    ROS_WARN("Could not append metrics to %s", metrics_path.c_str());
+  }
+
+  double rpe_trans, rpe_rot;
+  trlo::relativePoseError(gt, est, rpe_delta, rpe_trans, rpe_rot);
+
+  trlo::MetricList metrics;
+  metrics.push_back(std::make_pair("frames", (double) gt.size()));
+  metrics.push_back(std::make_pair("ate_rmse_m", trlo::absoluteTrajectoryError(gt, est)));
+  metrics.push_back(std::make_pair("rpe_trans_rmse_m", rpe_trans));
+  metrics.push_back(std::make_pair("rpe_rot_rmse_deg", rpe_rot));
+
+  const char* stage_names[7] = {"preprocess", "sources", "s2s", "submap", "s2m", "keyframes", "total"};
+  const char* pct_names[4] = {"p50", "p90", "p99", "max"};
+  const double pct[4] = {0.5, 0.9, 0.99, 1.0};
+  for (int k = 0; k < 7; k++) {
+    for (int j = 0; j < 4; j++) {
+      metrics.push_back(std::make_pair(std::string("latency_") + stage_names[k] + "_" + pct_names[j] + "_ms",
+                                       trlo::percentile(stage[k], pct[j])));
+    }
+  }
+  metrics.push_back(std::make_pair("peak_rss_mb", peakRssMB()));
+
+  for (const auto& m : metrics) {
+    std::cout << boost::format("%-28s %12.4f") % m.first % m.second << std::endl;
+  }
+  if (!trlo::writeMetrics(output, metrics)) {
+    ROS_ERROR("Could not write %s", output.c_str());
+    return 1;
+  }
+
+  if (baseline.empty()) {
+    return 0;
+  }
+
+  trlo::MetricList reference;
+  if (!trlo::readMetrics(baseline, reference)) {
+    ROS_ERROR("Could not read baseline %s", baseline.c_str());
+    return 1;
+  }
+
+  bool regression = false;
+  std::cout << std::endl << boost::format("%-28s %12s %12s %12s") % "metric" % "baseline" % "current" % "limit" << std::endl;
+  for (const auto& c : trlo::compareMetrics(reference, metrics, tol_accuracy, tol_latency, tol_memory)) {
+    std::cout << boost::format("%-28s %12.4f %12.4f %12.4f %s") % c.name % c.baseline % c.current % c.limit
+                 % (c.pass ? "" : "FAIL") << std::endl;
+    regression |= !c.pass;
+  }
+
+  if (regression) {
+    ROS_ERROR("Regression against %s", baseline.c_str());
+    return 2;
+  }
+  return 0;
+
+}
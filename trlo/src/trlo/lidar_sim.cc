@@ -0,0 +1,333 @@
+/****************************************************************************************
+ *
+ * Copyright (c) 2024, Shenyang Institute of Automation, Chinese Academy of Sciences
+ *
+ * Authors: Yanpeng Jia
+ * Contact: jiayanpeng@sia.cn
+ *
+ ****************************************************************************************/
+
+#include "trlo/lidar_sim.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <random>
+
+#include <Eigen/Geometry>
+
+// azimuth sectors the primitives are binned into for every scan
+static const int kSectors = 720;
+
+static inline uint64_t splitmix64(uint64_t x) {
+  x += 0x9E3779B97F4A7C15ULL;
+  x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+  return x ^ (x >> 31);
+}
+
+// (0, 1), advances the state
+static inline double hashUniform(uint64_t& state) {
+  state = splitmix64(state);
+  return ((state >> 11) + 0.5) * (1.0 / 9007199254740992.0);
+}
+
+
+/**
+ * Ray Intersections
+ *
+ * o is the ray origin and d its unit direction in the world frame. On a hit t is
+ * the distance to the entry point and cos_inc the cosine of the incidence angle.
+ **/
+
+static bool intersectPlane(const Eigen::Vector3d& o, const Eigen::Vector3d& d, const trlo::SimPlane& plane,
+                           double& t, double& cos_inc) {
+  double denom = plane.normal.dot(d);
+  if (std::abs(denom) < 1e-12) {
+    return false;
+  }
+  t = (plane.d - plane.normal.dot(o)) / denom;
+  cos_inc = std::abs(denom);
+  return t > 0;
+}
+
+static bool intersectBox(const Eigen::Vector3d& o, const Eigen::Vector3d& d, const trlo::SimBox& box,
+                         double& t, double& cos_inc) {
+  // ray in the box frame
+  double c = std::cos(box.yaw), s = std::sin(box.yaw);
+  Eigen::Vector3d q = o - box.center;
+  Eigen::Vector3d p( c * q.x() + s * q.y(), -s * q.x() + c * q.y(), q.z());
+  Eigen::Vector3d v( c * d.x() + s * d.y(), -s * d.x() + c * d.y(), d.z());
+
+  double t_near = -std::numeric_limits<double>::infinity();
+  double t_far = std::numeric_limits<double>::infinity();
+  int axis = 0;
+  for (int i = 0; i < 3; i++) {
+    if (std::abs(v[i]) < 1e-12) {
+      if (std::abs(p[i]) > box.half[i]) {
+        return false;
+      }
+      continue;
+    }
+    double t1 = (-box.half[i] - p[i]) / v[i];
+    double t2 = ( box.half[i] - p[i]) / v[i];
+    if (t1 > t2) {
+      std::swap(t1, t2);
+    }
+    if (t1 > t_near) {
+      t_near = t1;
+      axis = i;
+    }
+    t_far = std::min(t_far, t2);
+    if (t_near > t_far) {
+      return false;
+    }
+  }
+
+  // a sensor inside a box sees nothing of it
+  if (t_near <= 0) {
+    return false;
+  }
+  t = t_near;
+  cos_inc = std::abs(v[axis]);
+  return true;
+}
+
+static bool intersectPole(const Eigen::Vector3d& o, const Eigen::Vector3d& d, const trlo::SimPole& pole,
+                          double& t, double& cos_inc) {
+  double qx = o.x() - pole.x, qy = o.y() - pole.y;
+  double a = d.x() * d.x() + d.y() * d.y();
+  if (a < 1e-12) {
+    return false;
+  }
+  double b = qx * d.x() + qy * d.y();
+  double c = qx * qx + qy * qy - pole.radius * pole.radius;
+  double disc = b * b - a * c;
+  if (disc < 0) {
+    return false;
+  }
+  t = (-b - std::sqrt(disc)) / a;
+  double z = o.z() + t * d.z();
+  if (t <= 0 || z < 0 || z > pole.height) {
+    return false;
+  }
+  cos_inc = std::abs((qx + t * d.x()) * d.x() + (qy + t * d.y()) * d.y()) / pole.radius;
+  return true;
+}
+
+// adds idx to the sectors that rays from o can hit the vertical cylinder (cx, cy, r) through
+static void binPrimitive(std::vector<std::vector<int>>& sectors, int idx, const Eigen::Vector3d& o,
+                         double cx, double cy, double r, double max_range) {
+  double dx = cx - o.x(), dy = cy - o.y();
+  double dist = std::sqrt(dx * dx + dy * dy);
+  if (dist - r > max_range) {
+    return;
+  }
+  if (dist <= r + 1e-6) {
+    for (auto& s : sectors) {
+      s.push_back(idx);
+    }
+    return;
+  }
+
+  double center = std::atan2(dy, dx);
+  double half = std::asin(r / dist);
+  int s0 = (int) std::floor((center - half + M_PI) / (2 * M_PI) * kSectors) - 1;
+  int s1 = (int) std::floor((center + half + M_PI) / (2 * M_PI) * kSectors) + 1;
+  for (int s = s0; s <= s1; s++) {
+    sectors[((s % kSectors) + kSectors) % kSectors].push_back(idx);
+  }
+}
+
+
+/**
+ * Procedural Scene
+ **/
+
+trlo::LidarScene trlo::LidarScene::street(double length, unsigned seed) {
+  // draws straight from mt19937, the same scene with every standard library
+  std::mt19937 rng(seed);
+  auto uniform = [&rng](double lo, double hi) { return lo + (hi - lo) * ((rng() + 0.5) / 4294967296.0); };
+
+  LidarScene scene;
+  scene.planes.push_back({Eigen::Vector3d::UnitZ(), 0., 0.3f});
+
+  const double begin = -40., end = length + 40.;
+  for (int side = -1; side <= 1; side += 2) {
+    // building blocks
+    for (double x = begin; x < end; ) {
+      SimBox b;
+      b.half = Eigen::Vector3d(0.5 * uniform(8, 25), 0.5 * uniform(8, 16), 0.5 * uniform(6, 20));
+      b.center = Eigen::Vector3d(x + b.half.x(), side * (uniform(10, 13) + b.half.y()), b.half.z());
+      b.yaw = uniform(-0.05, 0.05);
+      b.reflectivity = uniform(0.2, 0.6);
+      scene.boxes.push_back(b);
+      x += 2 * b.half.x() + uniform(2, 8);
+    }
+
+    // parked cars
+    for (double x = begin + uniform(0, 20); x < end; x += uniform(6, 30)) {
+      SimBox b;
+      b.half = Eigen::Vector3d(2.25, 0.9, 0.75);
+      b.center = Eigen::Vector3d(x, side * uniform(4.5, 5.5), b.half.z());
+      b.yaw = uniform(-0.1, 0.1);
+      b.reflectivity = uniform(0.1, 0.9);
+      scene.boxes.push_back(b);
+    }
+
+    // poles
+    for (double x = begin + uniform(0, 10); x < end; x += uniform(10, 20)) {
+      SimPole p;
+      p.x = x;
+      p.y = side * uniform(6.5, 7.5);
+      p.radius = uniform(0.1, 0.25);
+      p.height = uniform(4, 9);
+      p.reflectivity = 0.5f;
+      scene.poles.push_back(p);
+    }
+  }
+
+  return scene;
+}
+
+trlo::PoseList trlo::streetTrajectory(int frames, double rate, double speed, double sensor_height) {
+  const double amplitude = 1.5, period = 15.;
+
+  PoseList poses;
+  for (int i = 0; i < frames; i++) {
+    double t = i / rate;
+    double w = 2 * M_PI / period;
+    Eigen::Matrix4d T = Eigen::Matrix4d::Identity();
+    T.block<3,3>(0,0) = Eigen::AngleAxisd(std::atan2(amplitude * w * std::cos(w * t), speed),
+                                          Eigen::Vector3d::UnitZ()).toRotationMatrix();
+    T.block<3,1>(0,3) = Eigen::Vector3d(speed * t, amplitude * std::sin(w * t), sensor_height);
+    poses.push_back(T);
+  }
+  return poses;
+}
+
+
+/**
+ * Ray Caster
+ **/
+
+trlo::LidarSim::LidarSim(const LidarScene& scene, const LidarSimConfig& config) : scene_(scene), config_(config) {
+  this->columns_ = std::max(1, (int) std::lround(360. / this->config_.azimuth_res));
+  this->elevations_.resize(std::max(1, this->config_.beams));
+  for (size_t i = 0; i < this->elevations_.size(); i++) {
+    double f = this->elevations_.size() > 1 ? double(i) / (this->elevations_.size() - 1) : 0.5;
+    this->elevations_[i] = (this->config_.fov_down + f * (this->config_.fov_up - this->config_.fov_down)) * M_PI / 180.;
+  }
+}
+
+void trlo::LidarSim::scan(const Eigen::Matrix4d& pose, int frame, pcl::PointCloud<pcl::PointXYZI>& cloud) const {
+  const Eigen::Matrix3d R = pose.block<3,3>(0,0);
+  const Eigen::Vector3d o = pose.block<3,1>(0,3);
+  const int rings = this->elevations_.size();
+  const int columns = this->columns_;
+
+  // primitives a ray can hit, by the world azimuth of the ray
+  std::vector<std::vector<int>> box_sectors(kSectors), pole_sectors(kSectors);
+  for (size_t i = 0; i < this->scene_.boxes.size(); i++) {
+    const SimBox& b = this->scene_.boxes[i];
+    binPrimitive(box_sectors, i, o, b.center.x(), b.center.y(), b.half.head<2>().norm(), this->config_.max_range);
+  }
+  for (size_t i = 0; i < this->scene_.poles.size(); i++) {
+    const SimPole& p = this->scene_.poles[i];
+    binPrimitive(pole_sectors, i, o, p.x, p.y, p.radius, this->config_.max_range);
+  }
+
+  const pcl::PointXYZI nan_point = [] {
+    pcl::PointXYZI p;
+    p.x = p.y = p.z = std::numeric_limits<float>::quiet_NaN();
+    p.intensity = 0;
+    return p;
+  }();
+  cloud.points.assign((size_t) rings * columns, nan_point);
+  const uint64_t frame_key = splitmix64(this->config_.seed * 0x9E3779B97F4A7C15ULL + (uint64_t) frame);
+
+  #pragma omp parallel for schedule(dynamic)
+  for (int ring = 0; ring < rings; ring++) {
+    const double ce = std::cos(this->elevations_[ring]), se = std::sin(this->elevations_[ring]);
+
+    for (int col = 0; col < columns; col++) {
+      uint64_t state = splitmix64(frame_key ^ ((uint64_t) ring * columns + col));
+      if (this->config_.dropout > 0 && hashUniform(state) < this->config_.dropout) {
+        continue;
+      }
+
+      double az = -M_PI + col * 2 * M_PI / columns;
+      Eigen::Vector3d local(ce * std::cos(az), ce * std::sin(az), se);
+      Eigen::Vector3d d = R * local;
+
+      double best = std::numeric_limits<double>::infinity(), best_cos = 0;
+      float best_refl = 0;
+      double t, cos_inc;
+      auto keep = [&](float refl) {
+        if (t < best) {
+          best = t;
+          best_cos = cos_inc;
+          best_refl = refl;
+        }
+      };
+
+      for (const auto& plane : this->scene_.planes) {
+        if (intersectPlane(o, d, plane, t, cos_inc)) {
+          keep(plane.reflectivity);
+        }
+      }
+
+      // straight up or down, every sector is a candidate
+      bool vertical = d.x() * d.x() + d.y() * d.y() < 1e-12;
+      int sector = vertical ? 0 : std::min(kSectors - 1, (int) ((std::atan2(d.y(), d.x()) + M_PI) / (2 * M_PI) * kSectors));
+      for (int s = vertical ? 0 : sector; s <= (vertical ? kSectors - 1 : sector); s++) {
+        for (int i : box_sectors[s]) {
+          if (intersectBox(o, d, this->scene_.boxes[i], t, cos_inc)) {
+            keep(this->scene_.boxes[i].reflectivity);
+          }
+        }
+        for (int i : pole_sectors[s]) {
+          if (intersectPole(o, d, this->scene_.poles[i], t, cos_inc)) {
+            keep(this->scene_.poles[i].reflectivity);
+          }
+        }
+      }
+
+      // anything nearer than the minimum range blocks the beam
+      if (best < this->config_.min_range || best > this->config_.max_range) {
+        continue;
+      }
+
+      double range = best;
+      if (this->config_.range_noise > 0) {
+        double u1 = hashUniform(state), u2 = hashUniform(state);
+        range += this->config_.range_noise * std::sqrt(-2. * std::log(u1)) * std::cos(2 * M_PI * u2);
+      }
+
+      pcl::PointXYZI& p = cloud.points[(size_t) ring * columns + col];
+      p.x = range * local.x();
+      p.y = range * local.y();
+      p.z = range * local.z();
+      p.intensity = best_refl * (0.2 + 0.8 * best_cos);
+    }
+  }
+
+  if (this->config_.organized) {
+    cloud.width = columns;
+    cloud.height = rings;
+    cloud.is_dense = false;
+    return;
+  }
+
+  size_t n = 0;
+  for (size_t i = 0; i < cloud.points.size(); i++) {
+    if (std::isfinite(cloud.points[i].x)) {
+      cloud.points[n++] = cloud.points[i];
+    }
+  }
+  cloud.points.resize(n);
+  cloud.width = n;
+  cloud.height = 1;
+  cloud.is_dense = true;
+}
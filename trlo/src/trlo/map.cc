@@ -8,6 +8,7 @@
  ****************************************************************************************/
 
 #include "trlo/map.h"
+#include "trlo/pcd_writer.h"
 
 std::atomic<bool> trlo::MapNode::abort_(false);
 
@@ -16,7 +17,7 @@ std::atomic<bool> trlo::MapNode::abort_(false);
  * Constructor
  **/
 
-trlo::MapNode::MapNode(ros::NodeHandle node_handle) : nh(node_handle) {
+trlo::MapNode::MapNode(ros::NodeHandle node_handle) : nh(node_handle), save_in_progress(false) {
 
   this->getParams();
 
@@ -28,6 +29,19 @@ trlo::MapNode::MapNode(ros::NodeHandle node_handle) : nh(node_handle) {
   
   this->keyframe_sub = this->nh.subscribe("keyframes", 1, &trlo::MapNode::keyframeCB, this);
   this->map_pub = this->nh.advertise<sensor_msgs::PointCloud2>("map", 1);
+  this->save_status_pub = this->nh.advertise<trlo::save_status>("save_status", 10);
+  this->memory_pub = this->nh.advertise<diagnostic_msgs::DiagnosticArray>("memory", 1);
+  this->metrics_pub = this->nh.advertise<diagnostic_msgs::DiagnosticArray>("metrics", 1);
+
+  trlo::MetricsRegistry& registry = trlo::MetricsRegistry::global();
+  this->keyframe_ms = registry.histogram("map/keyframe_ms");
+  this->save_ms = registry.histogram("map/save_ms");
+  this->keyframes_received = registry.counter("map/keyframes");
+  this->map_points = registry.gauge("map/points");
+
+  if (this->metrics_publish_freq_ > 0) {
+    this->metrics_timer = this->nh.createTimer(ros::Duration(1. / this->metrics_publish_freq_), &trlo::MapNode::metricsTimerCB, this);
+  }
 
   this->save_pcd_srv = this->nh.advertiseService("save_pcd", &trlo::MapNode::savePcd, this);
 
@@ -44,15 +58,21 @@ trlo::MapNode::MapNode(ros::NodeHandle node_handle) : nh(node_handle) {
  **/
 
 trlo::MapNode::~MapNode() {
-  pcl::PointCloud<PointType>::Ptr m =
-    pcl::PointCloud<PointType>::Ptr (boost::make_shared<pcl::PointCloud<PointType>>(*this->trlo_map));
 
-  std::string p = "/home/jyp/";
+  // let a running save job finish writing its file, or stop at its next chunk after a SIGTERM
+  if (this->save_thread.joinable()) {
+    this->save_thread.join();
+  }
 
-  std::cout << std::setprecision(2) << "Saving map to " << p + "/trlo_map.pcd" << "... "; std::cout.flush();
+  // a SIGTERM asks for a quick exit, a save started now would be cut short at once;
+  // the map saved last time stays in place
+  if (this->shutdown_save_path_.empty() || abort_) {
+    return;
+  }
+
+  // no more keyframes arrive at this point, so the map can be streamed out directly
+  this->saveJob(this->trlo_map, this->shutdown_save_path_ + "/trlo_map.pcd", 0.);
 
-  // save map
-  int ret = pcl::io::savePCDFileBinary(p + "/trlo_map.pcd", *m);
 }
 
 
@@ -66,6 +86,11 @@ void trlo::MapNode::getParams() {
   ros::param::param<bool>("~trlo/mapNode/publishFullMap", this->publish_full_map_, true);
   ros::param::param<double>("~trlo/mapNode/publishFreq", this->publish_freq_, 1.0);
   ros::param::param<double>("~trlo/mapNode/leafSize", this->leaf_size_, 0.5);
+  ros::param::param<std::string>("~trlo/mapNode/shutdownSavePath", this->shutdown_save_path_, "");
+  ros::param::param<int>("~trlo/mapNode/saveChunkSize", this->save_chunk_size_, 65536);
+  ros::param::param<double>("~trlo/mapNode/memoryWarnMB", this->memory_warn_mb_, 4096.);
+  ros::param::param<double>("~trlo/mapNode/metrics/publishFreq", this->metrics_publish_freq_, 1.0);
+  ros::param::param<std::string>("~trlo/mapNode/metrics/file", this->metrics_file_, "");
 
   // Get Node NS and Remove Leading Character
   std::string ns = ros::this_node::getNamespace();
@@ -126,12 +151,34 @@ void trlo::MapNode::publishTimerCB(const ros::TimerEvent& e) {
 }
 
 
+/**
+ * Metrics Timer Callback
+ **/
+
+void trlo::MapNode::metricsTimerCB(const ros::TimerEvent& e) {
+
+  trlo::MetricsSnapshot snapshot = trlo::MetricsRegistry::global().snapshot();
+
+  diagnostic_msgs::DiagnosticArray stats;
+  stats.header.stamp = ros::Time::now();
+  trlo::metricsToDiagnostics(snapshot, "trlo_map/metrics", stats);
+  this->metrics_pub.publish(stats);
+
+  if (!this->metrics_file_.empty() && !trlo::appendMetricsSnapshot(this->metrics_file_, snapshot, stats.header.stamp.toSec())) {
+    ROS_WARN_THROTTLE(60, "Could not append metrics to %s", this->metrics_file_.c_str());
+  }
+
+}
+
+
 /**
  * Node Callback
  **/
 
 void trlo::MapNode::keyframeCB(const sensor_msgs::PointCloud2ConstPtr& keyframe) {
 
+  ros::WallTime then = ros::WallTime::now();
+
   // convert scan to pcl format
   pcl::PointCloud<PointType>::Ptr keyframe_pcl = pcl::PointCloud<PointType>::Ptr (new pcl::PointCloud<PointType>);
   pcl::fromROSMsg(*keyframe, *keyframe_pcl);
@@ -141,9 +188,21 @@ void trlo::MapNode::keyframeCB(const sensor_msgs::PointCloud2ConstPtr& keyframe)
   this->voxelgrid.setInputCloud(keyframe_pcl);
   this->voxelgrid.filter(*keyframe_pcl);
 
-  // save keyframe to map
+  // save keyframe to map; a running save job still holds the old map, so copy before appending
   this->map_stamp = keyframe->header.stamp;
+  {
+    std::lock_guard<std::mutex> lock(this->mtx_save);
+    if (this->trlo_map.use_count() > 1) {
+      // the save job still holds the old map and clears this entry when it lets go
+      this->memory.set(MEM_SAVE_SNAPSHOT, trlo::heapBytes(*this->trlo_map));
+      this->trlo_map = pcl::PointCloud<PointType>::Ptr (boost::make_shared<pcl::PointCloud<PointType>>(*this->trlo_map));
+    }
+  }
   *this->trlo_map += *keyframe_pcl;
+  this->memory.set(MEM_MAP, trlo::heapBytes(*this->trlo_map));
+  this->publishMemory();
+  this->keyframes_received->add();
+  this->map_points->set(this->trlo_map->size());
 
   if (!this->publish_full_map_) {
     if (keyframe_pcl->points.size() == keyframe_pcl->width * keyframe_pcl->height) {
@@ -155,35 +214,172 @@ void trlo::MapNode::keyframeCB(const sensor_msgs::PointCloud2ConstPtr& keyframe)
     }
   }
 
+  this->keyframe_ms->record((ros::WallTime::now() - then).toSec() * 1e3);
+
 }
 
+
+/**
+ * Save Map Service
+ **/
+
 bool trlo::MapNode::savePcd(trlo::save_pcd::Request& req,
                            trlo::save_pcd::Response& res) {
 
-  pcl::PointCloud<PointType>::Ptr m =
-    pcl::PointCloud<PointType>::Ptr (boost::make_shared<pcl::PointCloud<PointType>>(*this->trlo_map));
+  // the job runs in the background; progress is reported on save_status
+  res.success = this->startSaveJob(req.save_path + "/trlo_map.pcd", req.leaf_size);
+
+  return res.success;
+
+}
+
 
-  float leaf_size = req.leaf_size;
-  std::string p = req.save_path;
+/**
+ * Start Background Save Job
+ **/
 
-  std::cout << std::setprecision(2) << "Saving map to " << p + "/trlo_map.pcd" << "... "; std::cout.flush();
+bool trlo::MapNode::startSaveJob(const std::string& path, float leaf_size) {
 
-  // voxelize map
-  pcl::VoxelGrid<PointType> vg;
-  vg.setLeafSize(leaf_size, leaf_size, leaf_size);
-  vg.setInputCloud(m);
-  vg.filter(*m);
+  bool expected = false;
+  if (!this->save_in_progress.compare_exchange_strong(expected, true)) {
+    ROS_WARN("Map save already in progress, ignoring request for %s", path.c_str());
+    return false;
+  }
+
+  if (this->save_thread.joinable()) {
+    this->save_thread.join();
+  }
+
+  // snapshot shares the points with the live map until the next keyframe arrives
+  pcl::PointCloud<PointType>::ConstPtr snapshot;
+  {
+    std::lock_guard<std::mutex> lock(this->mtx_save);
+    snapshot = this->trlo_map;
+  }
+
+  this->save_thread = std::thread(&trlo::MapNode::saveJob, this, snapshot, path, leaf_size);
+
+  return true;
+
+}
 
-  // save map
-  int ret = pcl::io::savePCDFileBinary(p + "/trlo_map.pcd", *m);
-  res.success = ret == 0;
 
-  if (res.success) {
-    std::cout << "done" << std::endl;
+/**
+ * Save Job
+ **/
+
+void trlo::MapNode::saveJob(pcl::PointCloud<PointType>::ConstPtr map, std::string path, float leaf_size) {
+
+  std::cout << "Saving map to " << path << "... " << std::endl;
+  ros::WallTime then = ros::WallTime::now();
+
+  trlo::PcdWriter writer(leaf_size);
+  bool success = writer.open(path);
+
+  const size_t total = map->points.size();
+  const size_t chunk = std::max(this->save_chunk_size_, 1);
+
+  // a SIGTERM stops the write between chunks, the partial file is dropped and the
+  // previous map at path is kept
+  size_t i = 0;
+  for (; success && !abort_ && i < total; i += chunk) {
+    size_t n = std::min(chunk, total - i);
+    success = writer.write(&map->points[i], n);
+    this->publishSaveStatus(path, writer.size(), float(i + n) / total, false, success);
+  }
+  bool aborted = success && i < total;
+
+  if (success && !aborted) {
+    success = writer.close();
   } else {
-    std::cout << "failed" << std::endl;
+    writer.discard();
+    success = false;
   }
+  this->publishSaveStatus(path, writer.size(), 1., true, success);
 
-  return res.success;
+  if (success) {
+    std::cout << "Saved " << writer.size() << " points to " << path << std::endl;
+  } else if (aborted) {
+    std::cout << "Save aborted after " << writer.size() << " points, " << path << " left unchanged" << std::endl;
+  } else {
+    std::cout << "Failed to save map to " << path << std::endl;
+  }
+
+  this->save_ms->record((ros::WallTime::now() - then).toSec() * 1e3);
+
+  // free the snapshot before reporting it freed, once a keyframe has replaced the live
+  // map this is the last reference; under the lock so a keyframe cannot copy the map
+  // and set the entry in between
+  {
+    std::lock_guard<std::mutex> lock(this->mtx_save);
+    map.reset();
+    this->memory.set(MEM_SAVE_SNAPSHOT, 0);
+  }
+  this->save_in_progress = false;
+
+}
+
+
+/**
+ * Publish Save Status
+ **/
+
+void trlo::MapNode::publishSaveStatus(const std::string& path, size_t points_written, float progress, bool done, bool success) {
+
+  trlo::save_status status;
+  status.save_path = path;
+  status.points_written = points_written;
+  status.progress = progress;
+  status.done = done;
+  status.success = success;
+
+  this->save_status_pub.publish(status);
+
+}
+
+
+/**
+ * Publish Memory Diagnostics
+ **/
+
+void trlo::MapNode::publishMemory() {
+
+  diagnostic_msgs::DiagnosticArray stats;
+  stats.header.stamp = ros::Time::now();
+
+  for (int i = 0; i < this->memory.size(); i++) {
+    diagnostic_msgs::DiagnosticStatus status;
+    status.level = diagnostic_msgs::DiagnosticStatus::OK;
+    status.name = "trlo_map/memory/" + this->memory.name(i);
+
+    diagnostic_msgs::KeyValue bytes, peak;
+    bytes.key = "bytes";
+    bytes.value = std::to_string(this->memory.bytes(i));
+    peak.key = "peak_bytes";
+    peak.value = std::to_string(this->memory.peak(i));
+    status.values.push_back(bytes);
+    status.values.push_back(peak);
+    stats.status.push_back(status);
+  }
+
+  size_t total_bytes = this->memory.total();
+  diagnostic_msgs::DiagnosticStatus total;
+  total.name = "trlo_map/memory";
+  if (this->memory_warn_mb_ > 0 && total_bytes > this->memory_warn_mb_ * 1e6) {
+    total.level = diagnostic_msgs::DiagnosticStatus::WARN;
+    total.message = "accounted memory above " + std::to_string((int) this->memory_warn_mb_) + " MB";
+  } else {
+    total.level = diagnostic_msgs::DiagnosticStatus::OK;
+  }
+  diagnostic_msgs::KeyValue accounted, points;
+  accounted.key = "accounted_bytes";
+  accounted.value = std::to_string(total_bytes);
+  points.key = "map_points";
+  points.value = std::to_string(this->trlo_map->size());
+  total.values.push_back(accounted);
+  total.values.push_back(points);
+  stats.status.push_back(total);
+
+  this->memory_pub.publish(stats);
 
 }
@@ -0,0 +1,54 @@
+/****************************************************************************************
+ *
+ * Copyright (c) 2024, Shenyang Institute of Automation, Chinese Academy of Sciences
+ *
+ * Authors: Yanpeng Jia
+ * Contact: jiayanpeng@sia.cn
+ *
+ ****************************************************************************************/
+
+#include "trlo/memory_ledger.h"
+
+trlo::MemoryLedger::MemoryLedger(std::initializer_list<const char*> names) : size_(0) {
+  for (const char* name : names) {
+    if (this->size_ == kMaxEntries) {
+      break;
+    }
+    this->names_[this->size_++] = name;
+  }
+  for (int i = 0; i < kMaxEntries; i++) {
+    this->bytes_[i].store(0, std::memory_order_relaxed);
+    this->peak_[i].store(0, std::memory_order_relaxed);
+  }
+}
+
+void trlo::MemoryLedger::grow(int entry, size_t bytes) {
+  size_t now = this->bytes_[entry].fetch_add(bytes, std::memory_order_relaxed) + bytes;
+  this->updatePeak(entry, now);
+}
+
+void trlo::MemoryLedger::shrink(int entry, size_t bytes) {
+  // never wraps below zero if an owner over-reports an erase
+  size_t now = this->bytes_[entry].load(std::memory_order_relaxed);
+  while (!this->bytes_[entry].compare_exchange_weak(now, now > bytes ? now - bytes : 0, std::memory_order_relaxed)) {
+  }
+}
+
+void trlo::MemoryLedger::set(int entry, size_t bytes) {
+  this->bytes_[entry].store(bytes, std::memory_order_relaxed);
+  this->updatePeak(entry, bytes);
+}
+
+size_t trlo::MemoryLedger::total() const {
+  size_t sum = 0;
+  for (int i = 0; i < this->size_; i++) {
+    sum += this->bytes(i);
+  }
+  return sum;
+}
+
+void trlo::MemoryLedger::updatePeak(int entry, size_t bytes) {
+  size_t peak = this->peak_[entry].load(std::memory_order_relaxed);
+  while (bytes > peak && !this->peak_[entry].compare_exchange_weak(peak, bytes, std::memory_order_relaxed)) {
+  }
+}
@@ -0,0 +1,284 @@
+/****************************************************************************************
+ *
+ * Copyright (c) 2024, Shenyang Institute of Automation, Chinese Academy of Sciences
+ *
+ * Authors: Yanpeng Jia
+ * Contact: jiayanpeng@sia.cn
+ *
+ ****************************************************************************************/
+
+#include "trlo/metrics.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+
+namespace {
+
+// Shard of the calling thread, handed out round robin on its first record
+int threadShard() {
+  static std::atomic<int> next(0);
+  thread_local int shard = next.fetch_add(1, std::memory_order_relaxed) % trlo::kMetricShards;
+  return shard;
+}
+
+void atomicAdd(std::atomic<double>& a, double v) {
+  double now = a.load(std::memory_order_relaxed);
+  while (!a.compare_exchange_weak(now, now + v, std::memory_order_relaxed)) {
+  }
+}
+
+void atomicMax(std::atomic<double>& a, double v) {
+  double now = a.load(std::memory_order_relaxed);
+  while (v > now && !a.compare_exchange_weak(now, v, std::memory_order_relaxed)) {
+  }
+}
+
+void writeJsonString(std::ostream& out, const std::string& s) {
+  out << '"';
+  for (char c : s) {
+    if (c == '"' || c == '\\') {
+      out << '\\';
+    }
+    out << c;
+  }
+  out << '"';
+}
+
+}
+
+std::vector<double> trlo::latencyBucketsMs() {
+  return {0.05, 0.1, 0.2, 0.5, 1, 2, 5, 10, 20, 50, 100, 200, 500, 1000, 2000, 5000};
+}
+
+
+/**
+ * Counter
+ **/
+
+trlo::Counter::Counter(const std::string& name) : name_(name), shards_(kMetricShards) {
+  for (int s = 0; s < kMetricShards; s++) {
+    this->shards_[s].value.store(0, std::memory_order_relaxed);
+  }
+}
+
+void trlo::Counter::add(uint64_t n) {
+  this->shards_[threadShard()].value.fetch_add(n, std::memory_order_relaxed);
+}
+
+uint64_t trlo::Counter::value() const {
+  uint64_t sum = 0;
+  for (int s = 0; s < kMetricShards; s++) {
+    sum += this->shards_[s].value.load(std::memory_order_relaxed);
+  }
+  return sum;
+}
+
+
+/**
+ * Gauge
+ **/
+
+trlo::Gauge::Gauge(const std::string& name) : name_(name), value_(0) {}
+
+
+/**
+ * Histogram
+ **/
+
+trlo::Histogram::Histogram(const std::string& name, const std::vector<double>& bounds)
+  : name_(name), bounds_(bounds), shards_(kMetricShards) {
+
+  std::sort(this->bounds_.begin(), this->bounds_.end());
+  const size_t per_line = kCacheLine / sizeof(std::atomic<uint64_t>);
+  this->row_ = (this->bounds_.size() + 1 + per_line - 1) / per_line * per_line;
+  this->buckets_.reset(new CacheAlignedArray<std::atomic<uint64_t>>(kMetricShards * this->row_));
+
+  CacheAlignedArray<std::atomic<uint64_t>>& buckets = *this->buckets_;
+  for (size_t i = 0; i < kMetricShards * this->row_; i++) {
+    buckets[i].store(0, std::memory_order_relaxed);
+  }
+  for (int s = 0; s < kMetricShards; s++) {
+    this->shards_[s].count.store(0, std::memory_order_relaxed);
+    this->shards_[s].sum.store(0, std::memory_order_relaxed);
+    this->shards_[s].max.store(0, std::memory_order_relaxed);
+    this->shards_[s].last.store(0, std::memory_order_relaxed);
+    this->shards_[s].last_stamp.store(0, std::memory_order_relaxed);
+  }
+}
+
+void trlo::Histogram::record(double value) {
+  int s = threadShard();
+  // bucket i holds bounds[i-1] < value <= bounds[i], the last one everything above
+  size_t b = std::lower_bound(this->bounds_.begin(), this->bounds_.end(), value) - this->bounds_.begin();
+
+  (*this->buckets_)[s * this->row_ + b].fetch_add(1, std::memory_order_relaxed);
+  Shard& shard = this->shards_[s];
+  shard.count.fetch_add(1, std::memory_order_relaxed);
+  atomicAdd(shard.sum, value);
+  atomicMax(shard.max, value);
+  shard.last.store(value, std::memory_order_relaxed);
+  shard.last_stamp.store(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                           std::chrono::steady_clock::now().time_since_epoch()).count(), std::memory_order_relaxed);
+}
+
+double trlo::Histogram::last() const {
+  // a reader may pair a stamp with the value of the next record, either is recent
+  int64_t newest = 0;
+  double value = 0;
+  for (int s = 0; s < kMetricShards; s++) {
+    int64_t stamp = this->shards_[s].last_stamp.load(std::memory_order_relaxed);
+    if (stamp > newest) {
+      newest = stamp;
+      value = this->shards_[s].last.load(std::memory_order_relaxed);
+    }
+  }
+  return value;
+}
+
+trlo::HistogramSnapshot trlo::Histogram::snapshot() const {
+  HistogramSnapshot snap;
+  snap.name = this->name_;
+  snap.bounds = this->bounds_;
+  snap.buckets.assign(this->bounds_.size() + 1, 0);
+  snap.last = this->last();
+
+  for (int s = 0; s < kMetricShards; s++) {
+    for (size_t b = 0; b < snap.buckets.size(); b++) {
+      snap.buckets[b] += (*this->buckets_)[s * this->row_ + b].load(std::memory_order_relaxed);
+    }
+    snap.count += this->shards_[s].count.load(std::memory_order_relaxed);
+    snap.sum += this->shards_[s].sum.load(std::memory_order_relaxed);
+    snap.max = std::max(snap.max, this->shards_[s].max.load(std::memory_order_relaxed));
+  }
+  return snap;
+}
+
+double trlo::HistogramSnapshot::quantile(double q) const {
+  // shards are read one after the other, so count may run ahead of the buckets
+  uint64_t total = 0;
+  for (uint64_t n : this->buckets) {
+    total += n;
+  }
+  if (total == 0) {
+    return 0;
+  }
+
+  double rank = std::max(1., std::ceil(std::min(1., std::max(0., q)) * total));
+  uint64_t seen = 0;
+  for (size_t b = 0; b < this->buckets.size(); b++) {
+    if (this->buckets[b] == 0 || seen + this->buckets[b] < rank) {
+      seen += this->buckets[b];
+      continue;
+    }
+    double lower = b == 0 ? 0 : this->bounds[b - 1];
+    double upper = b < this->bounds.size() ? this->bounds[b] : this->max;
+    double value = lower + (upper - lower) * (rank - seen) / this->buckets[b];
+    return std::min(value, this->max);
+  }
+  return this->max;
+}
+
+
+/**
+ * Registry
+ **/
+
+trlo::MetricsRegistry& trlo::MetricsRegistry::global() {
+  static MetricsRegistry registry;
+  return registry;
+}
+
+trlo::Counter* trlo::MetricsRegistry::counter(const std::string& name) {
+  std::lock_guard<std::mutex> lock(this->mtx_);
+  for (const auto& c : this->counters_) {
+    if (c->name() == name) {
+      return c.get();
+    }
+  }
+  this->counters_.emplace_back(new Counter(name));
+  return this->counters_.back().get();
+}
+
+trlo::Gauge* trlo::MetricsRegistry::gauge(const std::string& name) {
+  std::lock_guard<std::mutex> lock(this->mtx_);
+  for (const auto& g : this->gauges_) {
+    if (g->name() == name) {
+      return g.get();
+    }
+  }
+  this->gauges_.emplace_back(new Gauge(name));
+  return this->gauges_.back().get();
+}
+
+trlo::Histogram* trlo::MetricsRegistry::histogram(const std::string& name, const std::vector<double>& bounds) {
+  std::lock_guard<std::mutex> lock(this->mtx_);
+  for (const auto& h : this->histograms_) {
+    if (h->name() == name) {
+      return h.get();
+    }
+  }
+  this->histograms_.emplace_back(new Histogram(name, bounds));
+  return this->histograms_.back().get();
+}
+
+trlo::MetricsSnapshot trlo::MetricsRegistry::snapshot() const {
+  std::lock_guard<std::mutex> lock(this->mtx_);
+  MetricsSnapshot snap;
+  for (const auto& c : this->counters_) {
+    snap.counters.push_back(std::make_pair(c->name(), c->value()));
+  }
+  for (const auto& g : this->gauges_) {
+    snap.gauges.push_back(std::make_pair(g->name(), g->value()));
+  }
+  for (const auto& h : this->histograms_) {
+    snap.histograms.push_back(h->snapshot());
+  }
+  return snap;
+}
+
+
+/**
+ * Export
+ **/
+
+bool trlo::appendMetricsSnapshot(const std::string& path, const MetricsSnapshot& snapshot, double stamp) {
+  std::ofstream out(path, std::ios::app);
+  if (!out.is_open()) {
+    return false;
+  }
+  out << std::setprecision(9);
+
+  out << "{\"stamp\":" << std::fixed << stamp << std::defaultfloat << ",\"counters\":{";
+  for (size_t i = 0; i < snapshot.counters.size(); i++) {
+    out << (i ? "," : "");
+    writeJsonString(out, snapshot.counters[i].first);
+    out << ":" << snapshot.counters[i].second;
+  }
+  out << "},\"gauges\":{";
+  for (size_t i = 0; i < snapshot.gauges.size(); i++) {
+    out << (i ? "," : "");
+    writeJsonString(out, snapshot.gauges[i].first);
+    out << ":" << snapshot.gauges[i].second;
+  }
+  out << "},\"histograms\":{";
+  for (size_t i = 0; i < snapshot.histograms.size(); i++) {
+    const HistogramSnapshot& h = snapshot.histograms[i];
+    out << (i ? "," : "");
+    writeJsonString(out, h.name);
+    out << ":{\"count\":" << h.count << ",\"sum\":" << h.sum << ",\"max\":" << h.max << ",\"bounds\":[";
+    for (size_t b = 0; b < h.bounds.size(); b++) {
+      out << (b ? "," : "") << h.bounds[b];
+    }
+    out << "],\"buckets\":[";
+    for (size_t b = 0; b < h.buckets.size(); b++) {
+      out << (b ? "," : "") << h.buckets[b];
+    }
+    out << "]}";
+  }
+  out << "}}" << std::endl;
+
+  return out.good();
+}
@@ -9,6 +9,7 @@
 
 #include "trlo/odom.h"
 #include "ceresFactor.hpp"
+#include "trlo/cloud_filters.h"
 
 std::atomic<bool> trlo::OdomNode::abort_(false);
 
@@ -123,6 +124,21 @@ trlo::OdomNode::OdomNode(ros::NodeHandle node_handle) : nh(node_handle) {
   this->kf_pub = this->nh.advertise<nav_msgs::Odometry>("kfs", 1, true);
   this->keyframe_pub = this->nh.advertise<sensor_msgs::PointCloud2>("keyframe", 1, true);
   this->robot_pub = this->nh.advertise<visualization_msgs::Marker>("robot", 10);
+  this->memory_pub = this->nh.advertise<diagnostic_msgs::DiagnosticArray>("memory", 1);
+  this->metrics_pub = this->nh.advertise<diagnostic_msgs::DiagnosticArray>("metrics", 1);
+
+  trlo::MetricsRegistry& registry = trlo::MetricsRegistry::global();
+  this->comp_ms = registry.histogram("odom/comp_ms");
+  this->submap_build_ms = registry.histogram("odom/submap_build_ms");
+  this->ground_optimize_ms = registry.histogram("odom/ground_optimize_ms");
+  const char* stage_names[7] = {"preprocess", "sources", "s2s", "submap", "s2m", "keyframes", "total"};
+  for (int k = 0; k < 7; k++) {
+    this->stage_ms[k] = registry.histogram(std::string("odom/stage/") + stage_names[k] + "_ms");
+  }
+
+  if (this->metrics_publish_freq_ > 0) {
+    this->metrics_timer = this->nh.createTimer(ros::Duration(1. / this->metrics_publish_freq_), &trlo::OdomNode::metricsTimerCB, this);
+  }
 
   this->save_traj_srv = this->nh.advertiseService("save_traj", &trlo::OdomNode::saveTrajectory, this);
 
@@ -244,6 +260,13 @@ void trlo::OdomNode::getParams() {
   // BBox
   ros::param::param<int>("~trlo/odomNode/box/bufferSize", this->box_buffer_size_, 3);
 
+  // Memory diagnostics, warn above this total of the accounted containers (0 disables)
+  ros::param::param<double>("~trlo/odomNode/memoryWarnMB", this->memory_warn_mb_, 2048.);
+
+  // Metrics snapshots on ~metrics, and appended to file when it is set
+  ros::param::param<double>("~trlo/odomNode/metrics/publishFreq", this->metrics_publish_freq_, 1.0);
+  ros::param::param<std::string>("~trlo/odomNode/metrics/file", this->metrics_file_, "");
+
   // Ground Contrain
   ros::param::param<bool>("~/trlo/ground", this->ground_use_, true);
   ros::param::param<double>("~trlo/odomNode/ground/threshold", this->ground_threshold_, 0.2);
@@ -277,6 +300,8 @@ void trlo::OdomNode::InitParam() {
   this->stop_metrics_thread = false;
   this->stop_debug_thread = false;
 
+  this->stage_times = StageTimes();
+
   this->trlo_initialized = false;
   this->imu_calibrated = false;
 
@@ -437,6 +462,24 @@ void trlo::OdomNode::abortTimerCB(const ros::TimerEvent& e) {
 }
 
 
+/**
+ * Metrics Timer Callback
+ **/
+
+void trlo::OdomNode::metricsTimerCB(const ros::TimerEvent& e) {
+  trlo::MetricsSnapshot snapshot = trlo::MetricsRegistry::global().snapshot();
+
+  diagnostic_msgs::DiagnosticArray stats;
+  stats.header.stamp = ros::Time::now();
+  trlo::metricsToDiagnostics(snapshot, "trlo_odom/metrics", stats);
+  this->metrics_pub.publish(stats);
+
+  if (!this->metrics_file_.empty() && !trlo::appendMetricsSnapshot(this->metrics_file_, snapshot, stats.header.stamp.toSec())) {
+    ROS_WARN_THROTTLE(60, "Could not append metrics to %s", this->metrics_file_.c_str());
+  }
+}
+
+
 /**
  * Publish to ROS
  **/
@@ -650,32 +693,7 @@ void trlo::OdomNode::preprocessPoints() {
 double MINIMUM_RANGE = 0.5, MAXMUM_RANGE = 80;
 void trlo::OdomNode::removeClosedPointCloud(const pcl::PointCloud<pcl::PointXYZI> &cloud_in, pcl::PointCloud<pcl::PointXYZI> &cloud_out, float th1, float th2)
 {
-  if (&cloud_in != &cloud_out)
-  {
-    cloud_out.header = cloud_in.header;
-    cloud_out.points.resize(cloud_in.points.size());
-  }
-
-  size_t j = 0;
-
-  for (size_t i = 0; i < cloud_in.points.size(); ++i)
-  {
-    float dis = cloud_in.points[i].x * cloud_in.points[i].x + cloud_in.points[i].y * cloud_in.points[i].y + cloud_in.points[i].z * cloud_in.points[i].z;
-    if (dis < th1 * th1)
-      continue;
-    if (dis > th2 * th2)
-      continue;
-    cloud_out.points[j++] = cloud_in.points[i];
-  }
-
-  if (j != cloud_in.points.size())
-  {
-    cloud_out.points.resize(j);
-  }
-
-  cloud_out.height = 1;
-  cloud_out.width = static_cast<uint32_t>(j);
-  cloud_out.is_dense = true;
+  trlo::removeClosedPointCloud(cloud_in, cloud_out, th1, th2);
 }
 
 
@@ -709,11 +727,14 @@ void trlo::OdomNode::initializeInputTarget() {
   this->keyframes.push_back(std::make_pair(std::make_pair(this->pose, this->rotq), first_keyframe));
   *this->keyframes_cloud += *first_keyframe;
   *this->keyframe_cloud = *first_keyframe;
+  this->memory.grow(MEM_KEYFRAMES, sizeof(this->keyframes.back()) + trlo::heapBytes(*first_keyframe));
+  this->memory.set(MEM_KEYFRAMES_CLOUD, trlo::heapBytes(*this->keyframes_cloud));
 
   // compute kdtree and keyframe normals (use gicp_s2s input source as temporary storage because it will be overwritten by setInputSources())
   this->gicp_s2s.setInputSource(this->keyframe_cloud);
   this->gicp_s2s.calculateSourceCovariances();
   this->keyframe_normals.push_back(this->gicp_s2s.getSourceCovariances());
+  this->memory.grow(MEM_KEYFRAME_NORMALS, sizeof(this->keyframe_normals.back()) + trlo::heapBytes(this->keyframe_normals.back()));
 
   this->publish_keyframe_thread = std::thread( &trlo::OdomNode::publishKeyframe, this );
   this->publish_keyframe_thread.detach();
@@ -845,6 +866,7 @@ void trlo::OdomNode::initializeTRLO() {
 void trlo::OdomNode::icpCB(const sensor_msgs::PointCloud2ConstPtr& pc) {
 
   double then = ros::Time::now().toSec();
+  this->lapStage();
   this->scan_stamp = pc->header.stamp;
   this->curr_frame_stamp = pc->header.stamp.toSec();
 
@@ -864,6 +886,7 @@ void trlo::OdomNode::icpCB(const sensor_msgs::PointCloud2ConstPtr& pc) {
 
   // Preprocess points
   this->preprocessPoints();
+  this->stage_times.preprocess = this->lapStage();
 
   // Compute Metrics
   this->metrics_thread = std::thread( &trlo::OdomNode::computeMetrics, this );
@@ -886,21 +909,33 @@ void trlo::OdomNode::icpCB(const sensor_msgs::PointCloud2ConstPtr& pc) {
 
   // Set new frame as input source for both gicp objects
   this->setInputSources();
+  this->stage_times.sources = this->lapStage();
 
   // Get the next pose via IMU + S2S + S2M
   this->getNextPose();
 
   // Update current keyframe poses and map
   this->updateKeyframes();
+  this->stage_times.keyframes = this->lapStage();
+  this->stage_times.total = this->stage_times.preprocess + this->stage_times.sources + this->stage_times.s2s +
+                            this->stage_times.submap + this->stage_times.s2m + this->stage_times.keyframes;
+
+  const double stage_s[7] = {this->stage_times.preprocess, this->stage_times.sources, this->stage_times.s2s,
+                             this->stage_times.submap, this->stage_times.s2m, this->stage_times.keyframes, this->stage_times.total};
+  for (int k = 0; k < 7; k++) {
+    this->stage_ms[k]->record(1e3 * stage_s[k]);
+  }
 
   // Update trajectory
   this->trajectory.push_back( std::make_pair(this->pose, this->rotq) );
+  this->memory.grow(MEM_TRAJECTORY, sizeof(this->trajectory.back()));
+  this->updateKdtreeMemory();
 
   // Update next time stamp
   this->prev_frame_stamp = this->curr_frame_stamp;
 
   // Update some statistics
-  this->comp_times.push_back(ros::Time::now().toSec() - then);
+  this->comp_ms->record(1e3 * (ros::Time::now().toSec() - then));
 
   // Publish stuff to ROS
   this->publish_thread = std::thread( &trlo::OdomNode::publishToROS, this );
@@ -913,6 +948,34 @@ void trlo::OdomNode::icpCB(const sensor_msgs::PointCloud2ConstPtr& pc) {
 }
 
 
+/**
+ * Offline Replay
+ **/
+
+bool trlo::OdomNode::processScan(const sensor_msgs::PointCloud2ConstPtr& pc) {
+  size_t poses = this->trajectory.size();
+  this->icpCB(pc);
+  return this->trajectory.size() > poses;
+}
+
+Eigen::Matrix4f trlo::OdomNode::getPose() const {
+  Eigen::Matrix4f T = Eigen::Matrix4f::Identity();
+  if (!this->trajectory.empty()) {
+    T.block<3,3>(0,0) = this->trajectory.back().second.toRotationMatrix();
+    T.block<3,1>(0,3) = this->trajectory.back().first;
+  }
+  return T;
+}
+
+// Seconds since the previous call
+double trlo::OdomNode::lapStage() {
+  std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+  double dt = std::chrono::duration<double>(now - this->stage_clock).count();
+  this->stage_clock = now;
+  return dt;
+}
+
+
 /**
  * IMU Callback
  **/
@@ -994,6 +1057,7 @@ void trlo::OdomNode::imuCB(const sensor_msgs::Imu::ConstPtr& imu) {
     // Store into circular buffer
     this->mtx_imu.lock();
     this->imu_buffer.push_front(this->imu_meas);
+    this->memory.set(MEM_IMU_BUFFER, this->imu_buffer.size() * sizeof(ImuMeas));
     this->mtx_imu.unlock();
   }
 
@@ -1043,6 +1107,7 @@ void trlo::OdomNode::getNextPose() {
 
   // Swap source and target (which also swaps KdTrees internally) for next S2S
   this->gicp_s2s.swapSourceAndTarget();
+  this->stage_times.s2s = this->lapStage();
 
   //
   // FRAME-TO-SUBMAP
@@ -1059,6 +1124,7 @@ void trlo::OdomNode::getNextPose() {
     // Set target cloud's normals as submap normals
     this->gicp.setTargetCovariances( this->submap_normals );
   }
+  this->stage_times.submap = this->lapStage();
 
   // Align with current submap with global S2S transformation as initial guess
   this->gicp.align(*aligned, this->T_s2s);
@@ -1183,7 +1249,7 @@ void trlo::OdomNode::getNextPose() {
     options.gradient_check_relative_precision = 1e-4;
     ceres::Solver::Summary summary;
     ceres::Solve(options, &problem, &summary);
-    this->ground_optimize_times.push_back(ros::Time::now().toSec() - tg);
+    this->ground_optimize_ms->record(1e3 * (ros::Time::now().toSec() - tg));
 
     this->T(2,3) = static_cast<float>(this->para_tz[0]);
     Eigen::Vector3f raw_rpy = q_tem.toRotationMatrix().eulerAngles(2, 1, 0);
@@ -1207,6 +1273,7 @@ void trlo::OdomNode::getNextPose() {
   // Update next global pose
   // Both source and target clouds are in the global frame now, so tranformation is global
   this->propagateS2M();
+  this->stage_times.s2m = this->lapStage();
 
   // Set next target cloud as current source cloud
   *this->target_cloud = *this->source_cloud;
@@ -1526,14 +1593,17 @@ void trlo::OdomNode::updateKeyframes() {
 
     // update keyframe vector
     this->keyframes.push_back(std::make_pair(std::make_pair(this->pose, this->rotq), this->current_scan_t));
+    this->memory.grow(MEM_KEYFRAMES, sizeof(this->keyframes.back()) + trlo::heapBytes(*this->current_scan_t));
 
     // compute kdtree and keyframe normals (use gicp_s2s input source as temporary storage because it will be overwritten by setInputSources())
     *this->keyframes_cloud += *this->current_scan_t;
     *this->keyframe_cloud = *this->current_scan_t;
+    this->memory.set(MEM_KEYFRAMES_CLOUD, trlo::heapBytes(*this->keyframes_cloud));
 
     this->gicp_s2s.setInputSource(this->keyframe_cloud);
     this->gicp_s2s.calculateSourceCovariances();
     this->keyframe_normals.push_back(this->gicp_s2s.getSourceCovariances());
+    this->memory.grow(MEM_KEYFRAME_NORMALS, sizeof(this->keyframe_normals.back()) + trlo::heapBytes(this->keyframe_normals.back()));
 
     this->publish_keyframe_thread = std::thread( &trlo::OdomNode::publishKeyframe, this );
     this->publish_keyframe_thread.detach();
@@ -1694,9 +1764,10 @@ void trlo::OdomNode::getSubmapKeyframes() {
 
     this->submap_cloud = submap_cloud_;
     this->submap_kf_idx_prev = this->submap_kf_idx_curr;
+    this->memory.set(MEM_SUBMAP, trlo::heapBytes(*this->submap_cloud) + trlo::heapBytes(this->submap_normals));
   }
 
-  this->submap_build_times.push_back(ros::Time::now().toSec() - submap_build_time);
+  this->submap_build_ms->record(1e3 * (ros::Time::now().toSec() - submap_build_time));
 
 }
 
@@ -1753,9 +1824,9 @@ void trlo::OdomNode::debug() {
   }
 
   // Average computation time
-  double avg_comp_time = std::accumulate(this->comp_times.begin(), this->comp_times.end(), 0.0) / this->comp_times.size();
-  double avg_submap_build_time = std::accumulate(this->submap_build_times.begin(), this->submap_build_times.end(), 0.0) / this->submap_build_times.size();
-  double avg_ground_optimize_time = std::accumulate(this->ground_optimize_times.begin(), this->ground_optimize_times.end(), 0.0) / this->ground_optimize_times.size();
+  trlo::HistogramSnapshot comp_time = this->comp_ms->snapshot();
+  trlo::HistogramSnapshot submap_build_time = this->submap_build_ms->snapshot();
+  trlo::HistogramSnapshot ground_optimize_time = this->ground_optimize_ms->snapshot();
 
   // RAM Usage
   double vm_usage = 0.0;
@@ -1812,16 +1883,86 @@ void trlo::OdomNode::debug() {
   std::cout << "Distance to Origin :: " << sqrt(pow(this->pose[0]-this->origin[0],2) + pow(this->pose[1]-this->origin[1],2) + pow(this->pose[2]-this->origin[2],2)) << " meters" << std::endl;
 
   std::cout << std::endl << std::right << std::setprecision(2) << std::fixed;
-  std::cout << "Computation Time :: " << std::setfill(' ') << std::setw(6) << this->comp_times.back()*1000. << " ms    // Avg: " << std::setw(5) << avg_comp_time*1000. << std::endl;
+  std::cout << "Computation Time :: " << std::setfill(' ') << std::setw(6) << comp_time.last << " ms    // Avg: " << std::setw(5) << comp_time.mean() << std::endl;
   std::cout << "Cores Utilized   :: " << std::setfill(' ') << std::setw(6) << (cpu_percent/100.) * this->numProcessors << " cores // Avg: " << std::setw(5) << (avg_cpu_usage/100.) * this->numProcessors << std::endl;
   std::cout << "CPU Load         :: " << std::setfill(' ') << std::setw(6) << cpu_percent << " %     // Avg: " << std::setw(5) << avg_cpu_usage << std::endl;
   std::cout << "RAM Allocation   :: " << std::setfill(' ') << std::setw(6) << resident_set/1000. << " MB    // VSZ: " << vm_usage/1000. << " MB" << std::endl;
 
-  std::cout << "Submap build Time :: " << std::setfill(' ') << std::setw(6) << this->submap_build_times.back()*1000. << " ms    // Avg: " << std::setw(5) << avg_submap_build_time*1000. << std::endl;
-  std::cout << "Ground optimize Time :: " << std::setfill(' ') << std::setw(6) << this->ground_optimize_times.back()*1000. << " ms    // Avg: " << std::setw(5) << avg_ground_optimize_time*1000. << std::endl;
+  std::cout << "Submap build Time :: " << std::setfill(' ') << std::setw(6) << submap_build_time.last << " ms    // Avg: " << std::setw(5) << submap_build_time.mean() << std::endl;
+  std::cout << "Ground optimize Time :: " << std::setfill(' ') << std::setw(6) << ground_optimize_time.last << " ms    // Avg: " << std::setw(5) << ground_optimize_time.mean() << std::endl;
 
   std::cout << "concave size is: " << this->keyframe_concave.size() << std::endl;
   std::cout << "this->submap_kf_idx_hash size is: " << this->submap_kf_idx_hash.size() << std::endl;
+
+  std::cout << std::endl << "Memory           :: " << std::setw(6) << this->memory.total() / 1e6 << " MB accounted" << std::endl;
+  for (int i = 0; i < this->memory.size(); i++) {
+    std::cout << "  " << std::left << std::setw(16) << this->memory.name(i) << std::right << " :: "
+              << std::setw(6) << this->memory.bytes(i) / 1e6 << " MB    // Peak: " << std::setw(6) << this->memory.peak(i) / 1e6 << " MB" << std::endl;
+  }
+
+  this->publishMemory(resident_set * 1024.);
+}
+
+
+/**
+ * Memory Accounting
+ **/
+
+// The kd-trees are rebuilt every scan, so they are measured rather than counted on insert
+void trlo::OdomNode::updateKdtreeMemory() {
+  std::vector<nanoflann::KdTreeFLANN<PointType>*> trees = {
+    this->gicp_s2s.source_kdtree_.get(), this->gicp_s2s.target_kdtree_.get(),
+    this->gicp.source_kdtree_.get(), this->gicp.target_kdtree_.get()};
+
+  size_t bytes = 0;
+  for (size_t i = 0; i < trees.size(); i++) {
+    // S2M shares the source tree of S2S
+    if (trees[i] == nullptr || std::find(trees.begin(), trees.begin() + i, trees[i]) != trees.begin() + i) {
+      continue;
+    }
+    bytes += trees[i]->usedMemory();
+  }
+  this->memory.set(MEM_KDTREES, bytes);
+}
+
+void trlo::OdomNode::publishMemory(double rss_bytes) {
+  diagnostic_msgs::DiagnosticArray stats;
+  stats.header.stamp = ros::Time::now();
+
+  for (int i = 0; i < this->memory.size(); i++) {
+    diagnostic_msgs::DiagnosticStatus status;
+    status.level = diagnostic_msgs::DiagnosticStatus::OK;
+    status.name = "trlo_odom/memory/" + this->memory.name(i);
+
+    diagnostic_msgs::KeyValue bytes, peak;
+    bytes.key = "bytes";
+    bytes.value = std::to_string(this->memory.bytes(i));
+    peak.key = "peak_bytes";
+    peak.value = std::to_string(this->memory.peak(i));
+    status.values.push_back(bytes);
+    status.values.push_back(peak);
+    stats.status.push_back(status);
+  }
+
+  size_t total_bytes = this->memory.total();
+  diagnostic_msgs::DiagnosticStatus total;
+  total.name = "trlo_odom/memory";
+  if (this->memory_warn_mb_ > 0 && total_bytes > this->memory_warn_mb_ * 1e6) {
+    total.level = diagnostic_msgs::DiagnosticStatus::WARN;
+    total.message = "accounted memory above " + std::to_string((int) this->memory_warn_mb_) + " MB";
+  } else {
+    total.level = diagnostic_msgs::DiagnosticStatus::OK;
+  }
+  diagnostic_msgs::KeyValue accounted, rss;
+  accounted.key = "accounted_bytes";
+  accounted.value = std::to_string(total_bytes);
+  rss.key = "rss_bytes";
+  rss.value = std::to_string((size_t) rss_bytes);
+  total.values.push_back(accounted);
+  total.values.push_back(rss);
+  stats.status.push_back(total);
+
+  this->memory_pub.publish(stats);
 }
 
 
@@ -0,0 +1,188 @@
+/****************************************************************************************
+ *
+ * Copyright (c) 2024, Shenyang Institute of Automation, Chinese Academy of Sciences
+ *
+ * Authors: Yanpeng Jia
+ * Contact: jiayanpeng@sia.cn
+ *
+ ****************************************************************************************/
+
+#include "trlo/pcd_writer.h"
+
+#include <cstdio>
+
+// fixed width of the patched WIDTH/POINTS fields
+static const int kCountWidth = 10;
+
+// voxel indices with a magnitude at or above this are not deduplicated
+static const double kMaxVoxelIndex = 2147483647.;
+
+
+/**
+ * Constructor
+ **/
+
+trlo::PcdWriter::PcdWriter(float leaf_size) : leaf_size(leaf_size), num_points(0) {}
+
+
+/**
+ * Destructor
+ **/
+
+trlo::PcdWriter::~PcdWriter() {
+  this->discard();
+}
+
+
+/**
+ * Open File and Write Header
+ **/
+
+bool trlo::PcdWriter::open(const std::string& path) {
+
+  this->discard();
+  this->path = path;
+  this->tmp_path = path + ".tmp";
+
+  this->out.open(this->tmp_path, std::ios::out | std::ios::binary | std::ios::trunc);
+  if (!this->out.is_open()) {
+    return false;
+  }
+
+  this->num_points = 0;
+  this->voxels.clear();
+
+  this->out << "# .PCD v0.7 - Point Cloud Data file format\n"
+            << "VERSION 0.7\n"
+            << "FIELDS x y z intensity\n"
+            << "SIZE 4 4 4 4\n"
+            << "TYPE F F F F\n"
+            << "COUNT 1 1 1 1\n"
+            << "WIDTH ";
+  this->width_pos = this->out.tellp();
+  this->out << std::string(kCountWidth, '0') << "\n"
+            << "HEIGHT 1\n"
+            << "VIEWPOINT 0 0 0 1 0 0 0\n"
+            << "POINTS ";
+  this->points_pos = this->out.tellp();
+  this->out << std::string(kCountWidth, '0') << "\n"
+            << "DATA binary\n";
+
+  return this->out.good();
+
+}
+
+
+/**
+ * Append Chunk
+ **/
+
+bool trlo::PcdWriter::write(const PointType* points, size_t num_points) {
+
+  if (!this->out.is_open()) {
+    return false;
+  }
+
+  this->buffer.clear();
+  this->buffer.reserve(num_points * 4);
+
+  for (size_t i = 0; i < num_points; i++) {
+    const PointType& p = points[i];
+
+    if (!std::isfinite(p.x) || !std::isfinite(p.y) || !std::isfinite(p.z)) {
+      continue;
+    }
+
+    if (this->leaf_size > 0.) {
+      double vx = std::floor(double(p.x) / this->leaf_size);
+      double vy = std::floor(double(p.y) / this->leaf_size);
+      double vz = std::floor(double(p.z) / this->leaf_size);
+
+      // a point whose voxel index does not fit an int32 is written as is rather
+      // than folded onto the key of some other voxel
+      if (std::fabs(vx) < kMaxVoxelIndex && std::fabs(vy) < kMaxVoxelIndex && std::fabs(vz) < kMaxVoxelIndex) {
+        VoxelKey key = {int32_t(vx), int32_t(vy), int32_t(vz)};
+        if (!this->voxels.insert(key).second) {
+          continue;
+        }
+      }
+    }
+
+    this->buffer.push_back(p.x);
+    this->buffer.push_back(p.y);
+    this->buffer.push_back(p.z);
+    this->buffer.push_back(p.intensity);
+  }
+
+  this->out.write(reinterpret_cast<const char*>(this->buffer.data()), this->buffer.size() * sizeof(float));
+  this->num_points += this->buffer.size() / 4;
+
+  return this->out.good();
+
+}
+
+
+/**
+ * Patch Header and Close File
+ **/
+
+bool trlo::PcdWriter::close() {
+
+  if (!this->out.is_open()) {
+    return false;
+  }
+
+  bool ok = this->out.good();
+  ok = this->writeCount(this->width_pos) && ok;
+  ok = this->writeCount(this->points_pos) && ok;
+
+  this->out.close();
+  this->voxels.clear();
+  std::vector<float>().swap(this->buffer);
+
+  ok = ok && !this->out.fail();
+  if (ok) {
+    ok = std::rename(this->tmp_path.c_str(), this->path.c_str()) == 0;
+  }
+  if (!ok) {
+    std::remove(this->tmp_path.c_str());
+  }
+
+  return ok;
+
+}
+
+
+/**
+ * Discard Partial File
+ **/
+
+void trlo::PcdWriter::discard() {
+
+  if (!this->out.is_open()) {
+    return;
+  }
+
+  this->out.close();
+  this->voxels.clear();
+  std::vector<float>().swap(this->buffer);
+  std::remove(this->tmp_path.c_str());
+
+}
+
+
+/**
+ * Write Point Count at Header Position
+ **/
+
+bool trlo::PcdWriter::writeCount(std::streampos pos) {
+
+  std::streampos end = this->out.tellp();
+
+  this->out.seekp(pos);
+  this->out << std::setw(kCountWidth) << std::setfill('0') << this->num_points;
+  this->out.seekp(end);
+
+  return this->out.good();
+
+}
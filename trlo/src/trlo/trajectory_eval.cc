@@ -0,0 +1,229 @@
+/****************************************************************************************
+ *
+ * Copyright (c) 2024, Shenyang Institute of Automation, Chinese Academy of Sciences
+ *
+ * Authors: Yanpeng Jia
+ * Contact: jiayanpeng@sia.cn
+ *
+ ****************************************************************************************/
+
+#include "trlo/trajectory_eval.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <sstream>
+
+#include <Eigen/Geometry>
+
+
+/**
+ * KITTI Files
+ **/
+
+bool trlo::loadKittiPoses(const std::string& path, PoseList& poses) {
+  std::ifstream in(path);
+  if (!in.is_open()) {
+    return false;
+  }
+
+  poses.clear();
+  std::string line;
+  while (std::getline(in, line)) {
+    if (line.find_first_not_of(" \t\r") == std::string::npos) {
+      continue;
+    }
+    std::istringstream ss(line);
+    Eigen::Matrix4d T = Eigen::Matrix4d::Identity();
+    for (int i = 0; i < 12; i++) {
+      if (!(ss >> T(i / 4, i % 4))) {
+        return false;
+      }
+    }
+    poses.push_back(T);
+  }
+  return true;
+}
+
+bool trlo::saveKittiPoses(const std::string& path, const PoseList& poses) {
+  std::ofstream out(path);
+  if (!out.is_open()) {
+    return false;
+  }
+
+  out << std::setprecision(9);
+  for (const auto& T : poses) {
+    for (int i = 0; i < 12; i++) {
+      out << T(i / 4, i % 4) << (i < 11 ? " " : "\n");
+    }
+  }
+  return out.good();
+}
+
+bool trlo::loadKittiCalib(const std::string& path, Eigen::Matrix4d& Tr) {
+  std::ifstream in(path);
+  std::string line;
+  while (std::getline(in, line)) {
+    if (line.compare(0, 3, "Tr:") != 0) {
+      continue;
+    }
+    std::istringstream ss(line.substr(3));
+    Tr.setIdentity();
+    for (int i = 0; i < 12; i++) {
+      if (!(ss >> Tr(i / 4, i % 4))) {
+        return false;
+      }
+    }
+    return true;
+  }
+  return false;
+}
+
+
+/**
+ * Accuracy
+ **/
+
+double trlo::absoluteTrajectoryError(const PoseList& gt, const PoseList& est) {
+  size_t n = std::min(gt.size(), est.size());
+  if (n == 0) {
+    return std::numeric_limits<double>::quiet_NaN();
+  }
+
+  Eigen::Matrix<double, 3, Eigen::Dynamic> src(3, n), dst(3, n);
+  for (size_t i = 0; i < n; i++) {
+    src.col(i) = est[i].block<3,1>(0,3);
+    dst.col(i) = gt[i].block<3,1>(0,3);
+  }
+  // a single pose leaves the rotation undetermined, only the translation is fitted
+  Eigen::Matrix4d A = Eigen::Matrix4d::Identity();
+  if (n > 2) {
+    A = Eigen::umeyama(src, dst, false);
+  } else {
+    A.block<3,1>(0,3) = dst.col(0) - src.col(0);
+  }
+
+  double sum = 0;
+  for (size_t i = 0; i < n; i++) {
+    Eigen::Vector3d p = A.block<3,3>(0,0) * src.col(i) + A.block<3,1>(0,3);
+    sum += (p - dst.col(i)).squaredNorm();
+  }
+  return std::sqrt(sum / n);
+}
+
+void trlo::relativePoseError(const PoseList& gt, const PoseList& est, int delta, double& trans_rmse, double& rot_rmse_deg) {
+  size_t n = std::min(gt.size(), est.size());
+  double trans_sum = 0, rot_sum = 0;
+  size_t count = 0;
+
+  for (size_t i = 0; delta > 0 && i + delta < n; i++) {
+    Eigen::Matrix4d gt_rel = gt[i].inverse() * gt[i + delta];
+    Eigen::Matrix4d est_rel = est[i].inverse() * est[i + delta];
+    Eigen::Matrix4d E = gt_rel.inverse() * est_rel;
+
+    double c = std::max(-1., std::min(1., 0.5 * (E.block<3,3>(0,0).trace() - 1.)));
+    double angle = std::acos(c) * 180. / M_PI;
+    trans_sum += E.block<3,1>(0,3).squaredNorm();
+    rot_sum += angle * angle;
+    count++;
+  }
+
+  trans_rmse = count ? std::sqrt(trans_sum / count) : std::numeric_limits<double>::quiet_NaN();
+  rot_rmse_deg = count ? std::sqrt(rot_sum / count) : std::numeric_limits<double>::quiet_NaN();
+}
+
+double trlo::percentile(std::vector<double> values, double p) {
+  if (values.empty()) {
+    return std::numeric_limits<double>::quiet_NaN();
+  }
+  double rank = std::ceil(p * values.size());
+  size_t k = rank < 1 ? 0 : std::min(values.size() - 1, (size_t) rank - 1);
+  std::nth_element(values.begin(), values.begin() + k, values.end());
+  return values[k];
+}
+
+
+/**
+ * Regression Metrics
+ **/
+
+bool trlo::writeMetrics(const std::string& path, const MetricList& metrics) {
+  std::ofstream out(path);
+  if (!out.is_open()) {
+    return false;
+  }
+
+  out << std::setprecision(9);
+  for (const auto& m : metrics) {
+    out << m.first << " " << m.second << "\n";
+  }
+  return out.good();
+}
+
+bool trlo::readMetrics(const std::string& path, MetricList& metrics) {
+  std::ifstream in(path);
+  if (!in.is_open()) {
+    return false;
+  }
+
+  metrics.clear();
+  std::string line;
+  while (std::getline(in, line)) {
+    if (line.empty() || line[0] == '#') {
+      continue;
+    }
+    std::istringstream ss(line);
+    std::string name;
+    std::string value;
+    if (!(ss >> name >> value)) {
+      continue;
+    }
+    // strtod also reads the nan and inf that a broken run writes
+    metrics.push_back(std::make_pair(name, std::strtod(value.c_str(), nullptr)));
+  }
+  return true;
+}
+
+std::vector<trlo::MetricCheck> trlo::compareMetrics(const MetricList& baseline, const MetricList& current,
+                                                    double tol_accuracy, double tol_latency, double tol_memory) {
+  std::vector<MetricCheck> checks;
+  for (const auto& b : baseline) {
+    MetricCheck c;
+    c.name = b.first;
+    c.baseline = b.second;
+    c.current = std::numeric_limits<double>::quiet_NaN();
+    for (const auto& m : current) {
+      if (m.first == b.first) {
+        c.current = m.second;
+        break;
+      }
+    }
+
+    double tol = -1;
+    if (c.name.compare(0, 4, "ate_") == 0 || c.name.compare(0, 4, "rpe_") == 0) {
+      tol = tol_accuracy;
+    } else if (c.name.compare(0, 8, "latency_") == 0) {
+      tol = tol_latency;
+    } else if (c.name.compare(0, 9, "peak_rss_") == 0) {
+      tol = tol_memory;
+    }
+
+    if (c.name == "frames") {
+      c.limit = c.baseline;
+      c.pass = c.current == c.baseline;
+    } else if (tol >= 0) {
+      c.limit = c.baseline * (1. + tol);
+      // nan never passes, a metric missing from the current run neither
+      c.pass = c.current <= c.limit;
+    } else {
+      // informational
+      c.limit = std::numeric_limits<double>::quiet_NaN();
+      c.pass = true;
+    }
+    checks.push_back(c);
+  }
+  return checks;
+}
@@ -0,0 +1,450 @@
+/****************************************************************************************
+ *
+ * Copyright (c) 2024, Shenyang Institute of Automation, Chinese Academy of Sciences
+ *
+ * Authors: Yanpeng Jia
+ * Contact: jiayanpeng@sia.cn
+ *
+ ****************************************************************************************/
+
+/**
+ * Microbenchmarks of the odometry kernels, no ROS needed.
+ *
+ *   trlo_bench [--data data.bin] [--dims 5] [--filter substring] [--min_time 0.5] [--json out.json]
+ *
+ * Covers preprocessing (removeClosedPointCloud, voxel filter), the nanoflann kd-tree
+ * (build, kNN) and NanoGICP (covariances, linearize, align) at S2S and S2M sizes,
+ * on the scan in data/data.bin (float x, y, z, intensity, ... per point) and on
+ * ray-cast scans of a synthetic street. The sim_* cases align simulated scans of
+ * 16 to 128 beams, their error against the exact ground truth goes to stderr.
+ * Every case runs until min_time seconds have passed. --json writes the results
+ * in the Google Benchmark JSON layout, so its compare tools work on them.
+ **/
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+#include <pcl/common/transforms.h>
+#include <pcl/filters/voxel_grid.h>
+
+#include <nano_gicp/nano_gicp.hpp>
+#include <nano_gicp/nanoflann.hpp>
+
+#include "trlo/cloud_filters.h"
+#include "trlo/lidar_sim.h"
+
+#ifndef TRLO_DATA_DIR
+#define TRLO_DATA_DIR "data"
+#endif
+
+typedef pcl::PointXYZI PointType;
+typedef pcl::PointCloud<PointType> Cloud;
+
+// exposes the per iteration step of the solver, it is protected in NanoGICP
+class BenchGICP : public nano_gicp::NanoGICP<PointType, PointType> {
+public:
+  using nano_gicp::NanoGICP<PointType, PointType>::linearize;
+};
+
+struct BenchResult {
+  std::string name;
+  long iterations;
+  double real_us;
+  double cpu_us;
+  double items_per_second;
+};
+
+static volatile double sink;
+
+static double cpuSeconds() {
+  timespec ts;
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+  return ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
+
+/**
+ * Runs fn in growing batches until a batch takes min_time, after one warm up
+ * call. items is the work of one call (points), for the throughput column.
+ **/
+
+static BenchResult runCase(const std::string& name, double min_time, long items, const std::function<void()>& fn) {
+  fn();
+  long n = 1;
+  double real = 0, cpu = 0;
+  while (true) {
+    double c0 = cpuSeconds();
+    auto t0 = std::chrono::steady_clock::now();
+    for (long i = 0; i < n; i++) {
+      fn();
+    }
+    real = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    cpu = cpuSeconds() - c0;
+    if (real >= min_time || n >= (1L << 30)) {
+      break;
+    }
+    // aim a bit past min_time, at most 10x per step
+    double grow = real > 0 ? 1.4 * min_time / real : 10.;
+    n = std::max(n + 1, (long) (n * std::min(grow, 10.)));
+  }
+
+  BenchResult r;
+  r.name = name;
+  r.iterations = n;
+  r.real_us = 1e6 * real / n;
+  r.cpu_us = 1e6 * cpu / n;
+  r.items_per_second = real > 0 ? items * n / real : 0;
+  return r;
+}
+
+static Cloud::Ptr loadBin(const std::string& path, int dims) {
+  Cloud::Ptr cloud(new Cloud);
+  std::ifstream in(path, std::ios::binary | std::ios::ate);
+  if (!in.is_open() || dims < 4) {
+    return cloud;
+  }
+  size_t bytes = in.tellg();
+  in.seekg(0);
+  std::vector<float> buf(bytes / sizeof(float));
+  in.read(reinterpret_cast<char*>(buf.data()), buf.size() * sizeof(float));
+
+  size_t n = buf.size() / dims;
+  cloud->points.resize(n);
+  for (size_t i = 0; i < n; i++) {
+    PointType& p = cloud->points[i];
+    p.x = buf[i * dims];
+    p.y = buf[i * dims + 1];
+    p.z = buf[i * dims + 2];
+    p.intensity = buf[i * dims + 3];
+  }
+  cloud->width = n;
+  cloud->height = 1;
+  cloud->is_dense = true;
+  return cloud;
+}
+
+// Ray-cast scan of the street at a frame of the drive, see lidar_sim.h
+static Cloud::Ptr simScan(const trlo::LidarScene& scene, const trlo::PoseList& poses, int beams, int frame) {
+  trlo::LidarSimConfig config;
+  config.beams = beams;
+  Cloud::Ptr cloud(new Cloud);
+  trlo::LidarSim(scene, config).scan(poses[frame], frame, *cloud);
+  return cloud;
+}
+
+static Cloud::Ptr voxelize(const Cloud::ConstPtr& cloud, float res) {
+  Cloud::Ptr out(new Cloud);
+  pcl::VoxelGrid<PointType> vf;
+  vf.setLeafSize(res, res, res);
+  vf.setInputCloud(cloud);
+  vf.filter(*out);
+  return out;
+}
+
+static Eigen::Matrix4f motion(float x, float yaw_deg) {
+  Eigen::Affine3f T = Eigen::Affine3f::Identity();
+  T.translation() << x, 0.1f * x, 0.f;
+  T.rotate(Eigen::AngleAxisf(yaw_deg * M_PI / 180., Eigen::Vector3f::UnitZ()));
+  return T.matrix();
+}
+
+// defaults of cfg/params.yaml
+static void configureGICP(BenchGICP& gicp, int k, double max_corr) {
+  gicp.setCorrespondenceRandomness(k);
+  gicp.setMaxCorrespondenceDistance(max_corr);
+  gicp.setMaximumIterations(32);
+  gicp.setTransformationEpsilon(0.01);
+  gicp.setEuclideanFitnessEpsilon(0.01);
+  gicp.setRANSACIterations(5);
+  gicp.setRANSACOutlierRejectionThreshold(1.0);
+}
+
+static std::string jsonEscape(const std::string& s) {
+  std::string out;
+  for (char c : s) {
+    if (c == '"' || c == '\\') {
+      out += '\\';
+    }
+    out += c;
+  }
+  return out;
+}
+
+static bool writeJson(const std::string& path, const std::vector<BenchResult>& results,
+                      const std::vector<std::pair<std::string, long>>& inputs) {
+  FILE* f = path == "-" ? stdout : fopen(path.c_str(), "w");
+  if (!f) {
+    return false;
+  }
+
+  char date[64];
+  time_t now = time(nullptr);
+  strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S%z", localtime(&now));
+  char host[256] = {0};
+  gethostname(host, sizeof(host) - 1);
+
+  fprintf(f, "{\n  \"context\": {\n");
+  fprintf(f, "    \"date\": \"%s\",\n", date);
+  fprintf(f, "    \"host_name\": \"%s\",\n", jsonEscape(host).c_str());
+  fprintf(f, "    \"executable\": \"trlo_bench\",\n");
+  fprintf(f, "    \"num_cpus\": %u,\n", std::thread::hardware_concurrency());
+#ifdef NDEBUG
+  fprintf(f, "    \"library_build_type\": \"release\",\n");
+#else
+  fprintf(f, "    \"library_build_type\": \"debug\",\n");
+#endif
+  fprintf(f, "    \"inputs\": {");
+  for (size_t i = 0; i < inputs.size(); i++) {
+    fprintf(f, "%s\"%s\": %ld", i ? ", " : "", jsonEscape(inputs[i].first).c_str(), inputs[i].second);
+  }
+  fprintf(f, "}\n  },\n  \"benchmarks\": [\n");
+  for (size_t i = 0; i < results.size(); i++) {
+    const BenchResult& r = results[i];
+    fprintf(f, "    {\n");
+    fprintf(f, "      \"name\": \"%s\",\n", jsonEscape(r.name).c_str());
+    fprintf(f, "      \"run_name\": \"%s\",\n", jsonEscape(r.name).c_str());
+    fprintf(f, "      \"run_type\": \"iteration\",\n");
+    fprintf(f, "      \"iterations\": %ld,\n", r.iterations);
+    fprintf(f, "      \"real_time\": %.6g,\n", r.real_us);
+    fprintf(f, "      \"cpu_time\": %.6g,\n", r.cpu_us);
+    fprintf(f, "      \"time_unit\": \"us\",\n");
+    fprintf(f, "      \"items_per_second\": %.6g\n", r.items_per_second);
+    fprintf(f, "    }%s\n", i + 1 < results.size() ? "," : "");
+  }
+  fprintf(f, "  ]\n}\n");
+  if (f != stdout) {
+    fclose(f);
+  }
+  return true;
+}
+
+int main(int argc, char** argv) {
+  std::string data_path = std::string(TRLO_DATA_DIR) + "/data.bin";
+  std::string json_path;
+  std::string filter;
+  double min_time = 0.5;
+  int dims = 5;
+
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    bool has_value = i + 1 < argc;
+    if (arg == "--data" && has_value) {
+      data_path = argv[++i];
+    } else if (arg == "--dims" && has_value) {
+      dims = atoi(argv[++i]);
+    } else if (arg == "--json" && has_value) {
+      json_path = argv[++i];
+    } else if (arg == "--filter" && has_value) {
+      filter = argv[++i];
+    } else if (arg == "--min_time" && has_value) {
+      min_time = atof(argv[++i]);
+    } else {
+      fprintf(stderr, "usage: %s [--data data.bin] [--dims 5] [--filter substring] [--min_time 0.5] [--json out.json|-]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  // inputs
+  const trlo::PoseList sim_poses = trlo::streetTrajectory(12, 10., 10.);
+  const trlo::LidarScene sim_scene = trlo::LidarScene::street(20., 1);
+  Cloud::Ptr scan = loadBin(data_path, dims);
+  if (scan->empty()) {
+    fprintf(stderr, "could not read %s, using a simulated scan\n", data_path.c_str());
+    scan = simScan(sim_scene, sim_poses, 64, 0);
+  }
+  Cloud::Ptr scan_clean(new Cloud);
+  trlo::removeClosedPointCloud(*scan, *scan_clean, 0.5, 80);
+
+  // S2S: the scan against itself seen from 0.5 m further, voxelized like the scan filter
+  Cloud::Ptr moved(new Cloud);
+  pcl::transformPointCloud(*scan_clean, *moved, motion(0.5f, 1.f));
+  Cloud::Ptr s2s_source = voxelize(moved, 0.25);
+  Cloud::Ptr s2s_target = voxelize(scan_clean, 0.25);
+
+  // S2M: the scan seen from 10 keyframes along a path, voxelized like the submap filter
+  Cloud::Ptr submap_raw(new Cloud);
+  for (int k = 0; k < 10; k++) {
+    Cloud frame;
+    pcl::transformPointCloud(*scan_clean, frame, motion(2.f * k, 0.5f * k));
+    *submap_raw += frame;
+  }
+  Cloud::Ptr submap = voxelize(submap_raw, 0.5);
+
+  Cloud::Ptr synthetic = simScan(sim_scene, sim_poses, 128, 0);
+
+  // Simulated pairs at controlled densities: frame 11 against frame 10 (S2S) and
+  // against the keyframes 0 to 9 seen from frame 10 (S2M), truth is poses[10]^-1 poses[11]
+  const std::vector<int> sim_beams = {16, 32, 64, 128};
+  const Eigen::Matrix4d sim_truth = sim_poses[10].inverse() * sim_poses[11];
+  std::vector<Cloud::Ptr> sim_source, sim_target, sim_submap;
+  for (int beams : sim_beams) {
+    sim_source.push_back(voxelize(simScan(sim_scene, sim_poses, beams, 11), 0.25));
+    sim_target.push_back(voxelize(simScan(sim_scene, sim_poses, beams, 10), 0.25));
+    Cloud::Ptr keyframes(new Cloud);
+    for (int k = 0; k < 10; k++) {
+      Cloud frame;
+      pcl::transformPointCloud(*simScan(sim_scene, sim_poses, beams, k), frame,
+                               Eigen::Matrix4f((sim_poses[10].inverse() * sim_poses[k]).cast<float>()));
+      *keyframes += frame;
+    }
+    sim_submap.push_back(voxelize(keyframes, 0.5));
+  }
+
+  std::vector<std::pair<std::string, long>> inputs = {
+    {"scan", (long) scan->size()}, {"s2s_source", (long) s2s_source->size()},
+    {"s2s_target", (long) s2s_target->size()}, {"submap_raw", (long) submap_raw->size()},
+    {"submap", (long) submap->size()}, {"synthetic", (long) synthetic->size()}};
+  for (size_t i = 0; i < sim_beams.size(); i++) {
+    const std::string b = std::to_string(sim_beams[i]);
+    inputs.push_back({"sim" + b + "_source", (long) sim_source[i]->size()});
+    inputs.push_back({"sim" + b + "_submap", (long) sim_submap[i]->size()});
+  }
+  for (const auto& in : inputs) {
+    fprintf(stderr, "%-12s %8ld points\n", in.first.c_str(), in.second);
+  }
+
+  // the table goes to stderr when the JSON takes stdout
+  FILE* table = json_path == "-" ? stderr : stdout;
+  std::vector<BenchResult> results;
+  auto bench = [&](const std::string& name, long items, const std::function<void()>& fn) {
+    if (!filter.empty() && name.find(filter) == std::string::npos) {
+      return;
+    }
+    results.push_back(runCase(name, min_time, items, fn));
+    const BenchResult& r = results.back();
+    fprintf(table, "%-44s %12.1f us %12.1f us cpu %10ld it %12.3g items/s\n",
+            r.name.c_str(), r.real_us, r.cpu_us, r.iterations, r.items_per_second);
+    fflush(table);
+  };
+
+  // preprocessing
+  Cloud scratch;
+  bench("preprocess/removeClosedPointCloud/scan", scan->size(), [&]() {
+    trlo::removeClosedPointCloud(*scan, scratch, 0.5, 80);
+    sink = scratch.size();
+  });
+  bench("preprocess/voxel_0.25/scan", scan_clean->size(), [&]() {
+    sink = voxelize(scan_clean, 0.25)->size();
+  });
+  bench("preprocess/voxel_0.5/submap_raw", submap_raw->size(), [&]() {
+    sink = voxelize(submap_raw, 0.5)->size();
+  });
+  bench("preprocess/voxel_0.25/synthetic", synthetic->size(), [&]() {
+    sink = voxelize(synthetic, 0.25)->size();
+  });
+
+  // kd-tree
+  const std::vector<std::pair<std::string, Cloud::Ptr>> tree_inputs = {
+    {"s2s_target", s2s_target}, {"submap", submap}, {"synthetic", synthetic}};
+  for (const auto& in : tree_inputs) {
+    bench("kdtree/build/" + in.first, in.second->size(), [&]() {
+      nanoflann::KdTreeFLANN<PointType> tree;
+      tree.setInputCloud(in.second);
+      sink = tree.getInputCloud()->size();
+    });
+  }
+  const std::vector<std::pair<int, Cloud::Ptr>> knn_inputs = {{10, s2s_target}, {20, submap}};
+  for (const auto& in : knn_inputs) {
+    nanoflann::KdTreeFLANN<PointType> tree;
+    tree.setInputCloud(in.second);
+    const std::string target = in.second == submap ? "submap" : "s2s_target";
+    bench("kdtree/knn" + std::to_string(in.first) + "/" + target, s2s_source->size(), [&]() {
+      std::vector<int> k_indices;
+      std::vector<float> k_sq_dists;
+      double sum = 0;
+      for (const auto& p : s2s_source->points) {
+        tree.nearestKSearch(p, in.first, k_indices, k_sq_dists);
+        sum += k_sq_dists.back();
+      }
+      sink = sum;
+    });
+  }
+
+  // NanoGICP, covariances are computed once outside the align and linearize cases
+  // as the odometry node does with the keyframe normals
+  BenchGICP s2s;
+  configureGICP(s2s, 10, 1.0);
+  s2s.setInputSource(s2s_source);
+  s2s.setInputTarget(s2s_target);
+  BenchGICP s2m;
+  configureGICP(s2m, 20, 0.5);
+  s2m.setInputSource(s2s_source);
+  s2m.setInputTarget(submap);
+
+  bench("gicp/calculate_covariances/s2s_source_k10", s2s_source->size(), [&]() {
+    sink = s2s.calculateSourceCovariances();
+  });
+  bench("gicp/calculate_covariances/submap_k20", submap->size(), [&]() {
+    sink = s2m.calculateTargetCovariances();
+  });
+  s2s.calculateSourceCovariances();
+  s2s.calculateTargetCovariances();
+  s2m.calculateSourceCovariances();
+  s2m.calculateTargetCovariances();
+
+  const Eigen::Isometry3d guess(motion(-0.45f, -0.9f).cast<double>());
+  bench("gicp/linearize/s2s", s2s_source->size(), [&]() {
+    Eigen::Matrix<double, 6, 6> H;
+    Eigen::Matrix<double, 6, 1> b;
+    sink = s2s.linearize(guess, &H, &b);
+  });
+  bench("gicp/linearize/s2m", s2s_source->size(), [&]() {
+    Eigen::Matrix<double, 6, 6> H;
+    Eigen::Matrix<double, 6, 1> b;
+    sink = s2m.linearize(Eigen::Isometry3d::Identity(), &H, &b);
+  });
+
+  Cloud aligned;
+  bench("gicp/align/s2s", s2s_source->size(), [&]() {
+    s2s.align(aligned);
+    sink = s2s.getFinalTransformation()(0, 3);
+  });
+  bench("gicp/align/s2m", s2s_source->size(), [&]() {
+    s2m.align(aligned);
+    sink = s2m.getFinalTransformation()(0, 3);
+  });
+
+  // simulated scans, S2S and S2M per beam count
+  for (size_t i = 0; i < sim_beams.size(); i++) {
+    const std::string b = std::to_string(sim_beams[i]);
+    const std::vector<std::pair<std::string, Cloud::Ptr>> targets = {{"s2s", sim_target[i]}, {"s2m", sim_submap[i]}};
+    for (const auto& target : targets) {
+      const std::string name = "gicp/align/sim_" + target.first + "_b" + b;
+      if (!filter.empty() && name.find(filter) == std::string::npos) {
+        continue;
+      }
+      BenchGICP gicp;
+      configureGICP(gicp, target.first == "s2s" ? 10 : 20, target.first == "s2s" ? 1.0 : 0.5);
+      gicp.setInputSource(sim_source[i]);
+      gicp.setInputTarget(target.second);
+      gicp.calculateSourceCovariances();
+      gicp.calculateTargetCovariances();
+      bench(name, sim_source[i]->size(), [&]() {
+        gicp.align(aligned);
+        sink = gicp.getFinalTransformation()(0, 3);
+      });
+
+      Eigen::Matrix4d E = sim_truth.inverse() * gicp.getFinalTransformation().cast<double>();
+      double angle = std::acos(std::max(-1., std::min(1., 0.5 * (E.block<3,3>(0,0).trace() - 1.)))) * 180. / M_PI;
+      fprintf(stderr, "%-44s error %.4f m %.4f deg\n", name.c_str(), E.block<3,1>(0,3).norm(), angle);
+    }
+  }
+
+  if (!json_path.empty() && !writeJson(json_path, results, inputs)) {
+    fprintf(stderr, "could not write %s\n", json_path.c_str());
+    return 1;
+  }
+  return 0;
+}
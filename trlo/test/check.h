@@ -0,0 +1,45 @@
+/****************************************************************************************
+ *
+ * Copyright (c) 2024, Shenyang Institute of Automation, Chinese Academy of Sciences
+ *
+ * Authors: Yanpeng Jia
+ * Contact: jiayanpeng@sia.cn
+ *
+ ****************************************************************************************/
+
+// CHECK and the case table shared by the host-only checks in test/.
+//
+//   static bool checkSomething() { CHECK(a == b); return true; }
+//   CheckCase cases[] = {{"something", checkSomething()}, ...};
+//   return runCases(cases) ? 1 : 0;
+
+#ifndef TRLO_TEST_CHECK_H_
+#define TRLO_TEST_CHECK_H_
+
+#include <cstddef>
+#include <cstdio>
+
+// Reports the failed condition and returns false from the enclosing check
+#define CHECK(cond)                                                          \
+  if (!(cond)) {                                                             \
+    fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+    return false;                                                            \
+  }
+
+struct CheckCase {
+    const char* name;
+    bool ok;
+};
+
+// Prints one line per case and returns the number of failed ones
+template <size_t N>
+static int runCases(const CheckCase (&cases)[N]) {
+    int failures = 0;
+    for (const CheckCase& c : cases) {
+        printf("%-14s %s\n", c.name, c.ok ? "ok" : "FAILED");
+        failures += !c.ok;
+    }
+    return failures;
+}
+
+#endif
@@ -0,0 +1,289 @@
+/****************************************************************************************
+ *
+ * Copyright (c) 2024, Shenyang Institute of Automation, Chinese Academy of Sciences
+ *
+ * Authors: Yanpeng Jia
+ * Contact: jiayanpeng@sia.cn
+ *
+ ****************************************************************************************/
+
+// Checks DetectionScheduler and BoxPropagator, no GPU or ROS master needed.
+//
+//   detection_scheduler_check [LOG]
+//
+// The detections of a SyntheticScenario are written to a detection log (LOG, by
+// default detection_scheduler_check.log in the working directory) and served back
+// by a ReplayDetector. Every frame then goes through the scheduler, the replay, the
+// tracker and the propagator the way centerpp_node runs them. Exits 1 if any case
+// fails.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "3d_mot/imm_ukf_jpda.h"
+#include "3d_mot/scenario.h"
+#include "centerpp_node/detection_log.h"
+#include "centerpp_node/detection_scheduler.h"
+#include "check.h"
+
+static const int FRAMES = 200;
+static const float NEVER = 1e9;  // threshold that never forces a detection
+
+static Eigen::Matrix4f pose(float x, float y, float yaw) {
+    Eigen::Matrix4f T = Eigen::Matrix4f::Identity();
+    T.block<3,3>(0,0) = Eigen::AngleAxisf(yaw, Eigen::Vector3f::UnitZ()).toRotationMatrix();
+    T(0,3) = x;
+    T(1,3) = y;
+    return T;
+}
+
+// Stamps and ego poses of the logged frames, with the ground truth kept to judge the
+// propagated boxes
+struct Recording {
+    std::vector<double> stamps;
+    std::vector<Eigen::Matrix4f> poses;
+    std::vector<std::vector<ScenarioObject>> objects;
+};
+
+static Recording record(const std::string& path) {
+    ScenarioConfig config;
+    config.objects = 20;
+    SyntheticScenario scenario(config);
+    DetectionLogWriter writer;
+    writer.open(path);
+
+    Recording rec;
+    for (int f = 0; f < FRAMES; f++) {
+        scenario.next();
+        Eigen::Matrix4f world_to_ego = scenario.egoPose().inverse();
+        std::vector<Bndbox> boxes;
+        for (const OrientedBox& d : scenario.detections()) {
+            OrientedBox b = d.transformed(world_to_ego);
+            // a car above the score centerpp_node filters on, rt is clockwise
+            boxes.push_back(Bndbox(b.x, b.y, b.z, b.w, b.l, b.h, 0, 0, -b.yaw, 0, 0.9f));
+        }
+        writer.write(scenario.timestamp(), boxes);
+        rec.stamps.push_back(scenario.timestamp());
+        rec.poses.push_back(scenario.egoPose());
+        rec.objects.push_back(scenario.objects());
+    }
+    writer.close();
+    return rec;
+}
+
+struct PipelineResult {
+    std::vector<char> detected;
+    size_t misses = 0;
+    double propagated_err = 0;   // mean distance of propagated moving boxes to the nearest object
+    double held_err = 0;         // the same boxes left where they were detected
+    int propagated = 0;
+};
+
+// mot_3d of centerpp_node: track the boxes in the odom frame, then give each box the
+// velocity of the nearest visible moving track
+static void track(MultiObjectTracker& tracker, const std::vector<Bndbox>& boxes, double stamp,
+                  const Eigen::Matrix4f& ego_pose, std::vector<Eigen::Vector2f>& velocity) {
+    std::vector<OrientedBox> odom_boxes(boxes.size());
+    for (size_t i = 0; i < boxes.size(); i++) {
+        OrientedBox box;
+        box.x = boxes[i].x;
+        box.y = boxes[i].y;
+        box.z = boxes[i].z;
+        box.l = boxes[i].l;
+        box.w = boxes[i].w;
+        box.h = boxes[i].h;
+        box.yaw = 0;
+        odom_boxes[i] = box.transformed(ego_pose);
+    }
+    const std::vector<TrackedObject>& tracks = tracker.step(odom_boxes, stamp, ego_pose);
+
+    velocity.assign(boxes.size(), Eigen::Vector2f::Zero());
+    if (boxes.empty()) return;
+    for (const TrackedObject& t : tracks) {
+        if (!t.isVisible || t.isStatic) continue;
+        size_t nearest = 0;
+        float best = NEVER;
+        for (size_t i = 0; i < odom_boxes.size(); i++) {
+            float d = std::hypot(odom_boxes[i].x - t.x, odom_boxes[i].y - t.y);
+            if (d < best) {
+                best = d;
+                nearest = i;
+            }
+        }
+        velocity[nearest] = Eigen::Vector2f(t.v * std::cos(t.yaw), t.v * std::sin(t.yaw));
+    }
+}
+
+static double nearestObject(const std::vector<ScenarioObject>& objects, const Eigen::Matrix4f& ego_pose, const Bndbox& box) {
+    Eigen::Vector4f p = ego_pose * Eigen::Vector4f(box.x, box.y, box.z, 1.0f);
+    double best = NEVER;
+    for (const ScenarioObject& o : objects) best = std::min(best, std::hypot(o.x - p.x(), o.y - p.y()));
+    return best;
+}
+
+static PipelineResult runPipeline(const Recording& rec, ReplayDetector& replay, DetectionScheduler& scheduler) {
+    MultiObjectTracker tracker;
+    BoxPropagator propagator;
+    PipelineResult r;
+    size_t misses0 = replay.misses();
+    double track_std = 0.0;
+    double last_stamp = 0.0;
+    std::vector<Bndbox> boxes, dynamic, held, held_dynamic;
+    std::vector<Eigen::Vector2f> velocity;
+    BoxPropagator holder;
+
+    for (size_t f = 0; f < rec.stamps.size(); f++) {
+        double stamp = rec.stamps[f];
+        const Eigen::Matrix4f& ego_pose = rec.poses[f];
+        bool detect = scheduler.shouldDetect(track_std, ego_pose);
+        r.detected.push_back(detect);
+
+        if (detect) {
+            scheduler.detected(ego_pose);
+            replay.detect(nullptr, 0, stamp, nullptr, boxes);
+            track(tracker, boxes, stamp, ego_pose, velocity);
+            propagator.reset(stamp, ego_pose, boxes, velocity);
+            holder.reset(stamp, ego_pose, boxes, std::vector<Eigen::Vector2f>());
+        } else {
+            scheduler.skipped();
+            propagator.propagate(stamp, ego_pose, boxes, dynamic);
+            holder.propagate(stamp, ego_pose, held, held_dynamic);
+            for (size_t i = 0; i < boxes.size(); i++) {
+                if (boxes[i].x == held[i].x && boxes[i].y == held[i].y) continue;
+                r.propagated_err += nearestObject(rec.objects[f], ego_pose, boxes[i]);
+                r.held_err += nearestObject(rec.objects[f], ego_pose, held[i]);
+                r.propagated++;
+            }
+        }
+
+        double frame_dt = last_stamp > 0.0 ? stamp - last_stamp : 0.0;
+        last_stamp = stamp;
+        track_std = tracker.maxPredictedPositionStd(stamp + frame_dt - propagator.stamp());
+    }
+    if (r.propagated) {
+        r.propagated_err /= r.propagated;
+        r.held_err /= r.propagated;
+    }
+    r.misses = replay.misses() - misses0;
+    return r;
+}
+
+static bool checkThresholds() {
+    DetectionScheduler scheduler(5, 0.5, 2.0, 0.1);
+    Eigen::Matrix4f origin = pose(10, 5, 0.3f);
+    CHECK(scheduler.shouldDetect(0.0, origin));   // nothing detected yet
+    scheduler.detected(origin);
+    CHECK(!scheduler.shouldDetect(0.0, origin));
+    CHECK(!scheduler.shouldDetect(0.4, origin * pose(1.9f, 0, 0.09f)));
+    CHECK(scheduler.shouldDetect(0.6, origin));
+    // ego motion is measured from the last detected pose, not in the odom frame
+    CHECK(scheduler.shouldDetect(0.0, origin * pose(2.1f, 0, 0)));
+    CHECK(scheduler.shouldDetect(0.0, origin * pose(0, -2.1f, 0)));
+    CHECK(!scheduler.shouldDetect(0.0, pose(11.5f, 5.5f, 0.3f)));
+    CHECK(scheduler.shouldDetect(0.0, origin * pose(0, 0, -0.11f)));
+
+    for (int i = 0; i < 3; i++) scheduler.skipped();
+    CHECK(!scheduler.shouldDetect(0.0, origin));
+    scheduler.skipped();
+    CHECK(scheduler.framesSkipped() == 4);
+    CHECK(scheduler.shouldDetect(0.0, origin));   // the 5th frame
+    scheduler.detected(origin);
+    CHECK(scheduler.framesSkipped() == 0);
+
+    DetectionScheduler every_frame(1, 0.0, 0.0, 0.0);
+    every_frame.detected(origin);
+    CHECK(every_frame.shouldDetect(0.0, origin));
+    return true;
+}
+
+static bool checkPropagatorStatic() {
+    // a static box stays put in the odom frame while the ego drives and turns
+    Bndbox box(5, 1, -1, 2, 4, 1.5f, 0, 0, 0.2f, 0, 0.9f);
+    Eigen::Matrix4f first = pose(3, -2, 0.4f);
+    Eigen::Matrix4f second = pose(6, -1, 0.7f);
+    BoxPropagator propagator;
+    std::vector<Bndbox> boxes, dynamic;
+    CHECK(!propagator.propagate(0.1, second, boxes, dynamic));
+    propagator.reset(0.0, first, {box}, {});
+    CHECK(propagator.propagate(0.5, second, boxes, dynamic));
+    CHECK(boxes.size() == 1 && dynamic.empty());
+
+    Eigen::Vector4f world = first * Eigen::Vector4f(box.x, box.y, box.z, 1);
+    Eigen::Vector4f seen = second * Eigen::Vector4f(boxes[0].x, boxes[0].y, boxes[0].z, 1);
+    CHECK((world - seen).norm() < 1e-4);
+    // clockwise rt, the ego turned 0.3 rad left so the box turns right
+    CHECK(std::fabs(boxes[0].rt - (box.rt + 0.3f)) < 1e-5);
+    CHECK(boxes[0].w == box.w && boxes[0].l == box.l && boxes[0].id == box.id);
+
+    // a moving one goes with its odom velocity and is listed as dynamic
+    propagator.reset(0.0, first, {box}, {Eigen::Vector2f(2, -1)});
+    CHECK(propagator.propagate(0.5, first, boxes, dynamic));
+    CHECK(dynamic.size() == 1);
+    Eigen::Vector4f moved = first * Eigen::Vector4f(boxes[0].x, boxes[0].y, boxes[0].z, 1);
+    CHECK((moved - world - Eigen::Vector4f(1, -0.5f, 0, 0)).norm() < 1e-4);
+    return true;
+}
+
+static bool checkEveryFrame(const Recording& rec, ReplayDetector& replay) {
+    DetectionScheduler scheduler(1);
+    PipelineResult r = runPipeline(rec, replay, scheduler);
+    CHECK(std::count(r.detected.begin(), r.detected.end(), 1) == FRAMES);
+    CHECK(r.misses == 0);
+    return true;
+}
+
+static bool checkDetectEvery(const Recording& rec, ReplayDetector& replay) {
+    DetectionScheduler scheduler(4, NEVER, NEVER, NEVER);
+    PipelineResult r = runPipeline(rec, replay, scheduler);
+    for (int f = 0; f < FRAMES; f++) CHECK(r.detected[f] == (f % 4 == 0));
+    CHECK(r.misses == 0);
+    return true;
+}
+
+// Default thresholds: the scene turns and tracks lose certainty, so some frames are
+// forced early, and none goes more than detect_every frames without inference
+static bool checkSchedule(const Recording& rec, ReplayDetector& replay) {
+    const int detect_every = 3;
+    DetectionScheduler scheduler(detect_every, 0.5, 2.0, 0.1);
+    PipelineResult r = runPipeline(rec, replay, scheduler);
+
+    int detected = std::count(r.detected.begin(), r.detected.end(), 1);
+    int gap = 0, longest = 0;
+    for (char d : r.detected) {
+        gap = d ? 0 : gap + 1;
+        longest = std::max(longest, gap);
+    }
+    printf("  %d of %d frames detected, longest skip %d, propagated box error %.3f m, held %.3f m over %d boxes\n",
+           detected, FRAMES, longest, r.propagated_err, r.held_err, r.propagated);
+    CHECK(r.misses == 0);
+    CHECK(longest <= detect_every - 1);
+    CHECK(detected > FRAMES / detect_every && detected < FRAMES);
+    // moving the boxes with their track velocity has to beat leaving them in place
+    CHECK(r.propagated > 0);
+    CHECK(r.propagated_err < r.held_err);
+    return true;
+}
+
+int main(int argc, char** argv) {
+    std::string path = argc > 1 ? argv[1] : "detection_scheduler_check.log";
+    Recording rec = record(path);
+    ReplayDetector replay;
+    if (!replay.load(path) || replay.records() != (size_t)FRAMES) {
+        fprintf(stderr, "cannot replay %s\n", path.c_str());
+        return 1;
+    }
+
+    CheckCase cases[] = {
+        {"thresholds", checkThresholds()},
+        {"propagator", checkPropagatorStatic()},
+        {"every_frame", checkEveryFrame(rec, replay)},
+        {"detect_every", checkDetectEvery(rec, replay)},
+        {"schedule", checkSchedule(rec, replay)},
+    };
+    int failures = runCases(cases);
+    std::remove(path.c_str());
+    return failures ? 1 : 0;
+}
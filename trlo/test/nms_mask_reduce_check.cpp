@@ -0,0 +1,145 @@
+/****************************************************************************************
+ *
+ * Copyright (c) 2024, Shenyang Institute of Automation, Chinese Academy of Sciences
+ *
+ * Authors: Yanpeng Jia
+ * Contact: jiayanpeng@sia.cn
+ *
+ ****************************************************************************************/
+
+// Checks nms_mask_reduce_cpu against a plain greedy NMS over the same bitmask, on the
+// host only. Built with NMS_DEVICE_CHECK (nms_mask_reduce_device_check) it also checks
+// it against the device reduction of the batched postprocess (nms_reduce_batched_launch)
+// and needs a GPU. Exits 1 on a mismatch.
+//
+// The masks are random with the layout nms_batched_cuda writes: NMS_MAX_COL_BLOCKS
+// words per row, only bits above the diagonal set in the diagonal word, and the words
+// left of it never written, filled with ones here since neither walk should read them.
+// Box i of a task carries i in its first channel, so the kept boxes of the device
+// give back the kept indices.
+
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "center_pointpillars/postprocess_cpu.h"
+
+static const int ROUNDS = 20;
+
+// Indices a greedy NMS keeps, one box at a time
+static std::vector<int> greedy(const uint64_t* mask, unsigned int boxes_num, unsigned int max_keep){
+    std::vector<int> keep;
+    std::vector<bool> suppressed(boxes_num, false);
+    for(unsigned int i = 0; i < boxes_num && keep.size() < max_keep; i++){
+        if(suppressed[i]) continue;
+        keep.push_back(i);
+        for(unsigned int b = i + 1; b < boxes_num; b++){
+            if(mask[i*NMS_MAX_COL_BLOCKS + b/NMS_THREADS_PER_BLOCK] & (1ULL << (b%NMS_THREADS_PER_BLOCK))) suppressed[b] = true;
+        }
+    }
+    return keep;
+}
+
+// One task mask with suppression probability density
+static void fillMask(uint64_t* mask, double density, std::mt19937_64& rng){
+    std::bernoulli_distribution bit(density);
+    for(unsigned int i = 0; i < MAX_DET_NUM; i++){
+        const unsigned int nblock = i/NMS_THREADS_PER_BLOCK;
+        for(int b = 0; b < NMS_MAX_COL_BLOCKS; b++){
+            uint64_t word = 0;
+            for(int j = 0; j < NMS_THREADS_PER_BLOCK; j++){
+                if(bit(rng)) word |= 1ULL << j;
+            }
+            if((unsigned int)b < nblock) word = ~0ULL;
+            else if((unsigned int)b == nblock) word &= ~0ULL << (i%NMS_THREADS_PER_BLOCK) << 1;
+            mask[i*NMS_MAX_COL_BLOCKS + b] = word;
+        }
+    }
+}
+
+int main(){
+    const size_t task_mask_size = (size_t)MAX_DET_NUM*NMS_MAX_COL_BLOCKS;
+    const unsigned int max_keeps[2] = {Params().nms_post_max_size, MAX_DET_NUM};
+
+#ifdef NMS_DEVICE_CHECK
+    unsigned int* detection_num;
+    uint64_t* mask;
+    float* boxes;
+    float* kept;
+    checkCudaErrors(cudaMallocManaged((void **)&detection_num, NUM_TASKS*sizeof(unsigned int)));
+    checkCudaErrors(cudaMallocManaged((void **)&mask, NUM_TASKS*task_mask_size*sizeof(uint64_t)));
+    checkCudaErrors(cudaMallocManaged((void **)&boxes, NUM_TASKS*MAX_DET_NUM*DET_CHANNEL*sizeof(float)));
+    checkCudaErrors(cudaMallocManaged((void **)&kept, NUM_TASKS*(1 + MAX_DET_NUM*DET_CHANNEL)*sizeof(float)));
+    for(unsigned int t = 0; t < NUM_TASKS; t++){
+        for(unsigned int i = 0; i < MAX_DET_NUM; i++){
+            for(unsigned int c = 0; c < DET_CHANNEL; c++) boxes[(t*MAX_DET_NUM + i)*DET_CHANNEL + c] = c == 0 ? i : t;
+        }
+    }
+#else
+    std::vector<unsigned int> detection_num(NUM_TASKS);
+    std::vector<uint64_t> masks(NUM_TASKS*task_mask_size);
+    uint64_t* mask = masks.data();
+#endif
+
+    std::mt19937_64 rng(20240607);
+    // empty, single, block edges, full and past the slot size (clamped to MAX_DET_NUM)
+    const unsigned int edge_nums[NUM_TASKS] = {0, 1, 64, 65, MAX_DET_NUM, MAX_DET_NUM + 200};
+    const double densities[4] = {0.001, 0.01, 0.1, 0.6};
+
+    int failures = 0;
+    int cases = 0;
+    for(int round = 0; round < ROUNDS; round++){
+        for(unsigned int t = 0; t < NUM_TASKS; t++){
+            detection_num[t] = round == 0 ? edge_nums[t] : rng()%(MAX_DET_NUM + 1);
+            fillMask(mask + t*task_mask_size, densities[(round + t)%4], rng);
+        }
+
+        for(unsigned int max_keep : max_keeps){
+#ifdef NMS_DEVICE_CHECK
+            checkCudaErrors(cudaDeviceSynchronize());
+            if(nms_reduce_batched_launch(NUM_TASKS, detection_num, mask, boxes, max_keep, kept) != 0) return 1;
+            checkCudaErrors(cudaDeviceSynchronize());
+#endif
+
+            for(unsigned int t = 0; t < NUM_TASKS; t++){
+                const uint64_t* task_mask = mask + t*task_mask_size;
+                const unsigned int boxes_num = std::min(detection_num[t], MAX_DET_NUM);
+                std::vector<int> keep;
+                nms_mask_reduce_cpu(task_mask, boxes_num, NMS_MAX_COL_BLOCKS, max_keep, keep);
+
+                cases++;
+                bool same_greedy = keep == greedy(task_mask, boxes_num, max_keep);
+#ifdef NMS_DEVICE_CHECK
+                std::vector<int> device_keep;
+                const float* task_kept = kept + t*(1 + max_keep*DET_CHANNEL);
+                for(unsigned int k = 0; k < (unsigned int)task_kept[0] && k < max_keep; k++){
+                    device_keep.push_back(task_kept[1 + k*DET_CHANNEL]);
+                }
+                bool same_device = keep == device_keep;
+                if(!same_greedy || !same_device){
+                    if(failures++ < 10){
+                        fprintf(stderr, "round %d task %u, %u boxes, max_keep %u: cpu keeps %zu, %s greedy, device keeps %zu\n",
+                                round, t, boxes_num, max_keep, keep.size(), same_greedy ? "same as" : "differs from", device_keep.size());
+                    }
+                }
+#else
+                if(!same_greedy && failures++ < 10){
+                    fprintf(stderr, "round %d task %u, %u boxes, max_keep %u: cpu keeps %zu, differs from greedy\n",
+                            round, t, boxes_num, max_keep, keep.size());
+                }
+#endif
+            }
+        }
+    }
+
+#ifdef NMS_DEVICE_CHECK
+    checkCudaErrors(cudaFree(detection_num));
+    checkCudaErrors(cudaFree(mask));
+    checkCudaErrors(cudaFree(boxes));
+    checkCudaErrors(cudaFree(kept));
+#endif
+
+    printf("%d masks, %d mismatches\n", cases, failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,176 @@
+/****************************************************************************************
+ *
+ * Copyright (c) 2024, Shenyang Institute of Automation, Chinese Academy of Sciences
+ *
+ * Authors: Yanpeng Jia
+ * Contact: jiayanpeng@sia.cn
+ *
+ ****************************************************************************************/
+
+// Checks PointCloudPacker on hand-built PointCloud2 messages, no GPU or ROS master
+// needed: non-finite points, the max_points cap, x/y/z at other offsets than the
+// usual xyzi layout, padded rows, and the messages it has to reject, big-endian ones
+// included. Exits 1 if
+// any case fails.
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "centerpp_node/pointcloud_packer.h"
+#include "check.h"
+
+static sensor_msgs::PointField field(const std::string& name, uint32_t offset,
+                                     uint8_t datatype = sensor_msgs::PointField::FLOAT32) {
+    sensor_msgs::PointField f;
+    f.name = name;
+    f.offset = offset;
+    f.datatype = datatype;
+    f.count = 1;
+    return f;
+}
+
+// An empty width x height cloud of point_step byte points, rows padded by row_pad bytes
+static sensor_msgs::PointCloud2 cloud(uint32_t width, uint32_t height, uint32_t point_step, uint32_t row_pad = 0) {
+    sensor_msgs::PointCloud2 msg;
+    msg.width = width;
+    msg.height = height;
+    msg.point_step = point_step;
+    msg.row_step = width * point_step + row_pad;
+    msg.data.assign((size_t)msg.row_step * height, 0xab);
+    return msg;
+}
+
+static void setFloat(sensor_msgs::PointCloud2& msg, uint32_t row, uint32_t col, uint32_t offset, float v) {
+    std::memcpy(msg.data.data() + (size_t)row * msg.row_step + (size_t)col * msg.point_step + offset, &v, sizeof(float));
+}
+
+// x y z intensity, the layout of most drivers
+static sensor_msgs::PointCloud2 xyzi(uint32_t n) {
+    sensor_msgs::PointCloud2 msg = cloud(n, 1, 16);
+    msg.fields = {field("x", 0), field("y", 4), field("z", 8), field("intensity", 12)};
+    for (uint32_t i = 0; i < n; i++) {
+        setFloat(msg, 0, i, 0, i);
+        setFloat(msg, 0, i, 4, 10.0f + i);
+        setFloat(msg, 0, i, 8, -1.0f - i);
+        setFloat(msg, 0, i, 12, 100.0f);
+    }
+    return msg;
+}
+
+static bool checkXyzi() {
+    sensor_msgs::PointCloud2 msg = xyzi(4);
+    std::vector<float> dst(4 * PointCloudPacker::kPointFeatures, -1.0f);
+    PointCloudPacker packer;
+    CHECK(packer.pack(msg, dst.data(), 4) == 4);
+    CHECK(packer.truncated() == 0);
+    for (int i = 0; i < 4; i++) {
+        const float* p = dst.data() + i * PointCloudPacker::kPointFeatures;
+        CHECK(p[0] == i && p[1] == 10.0f + i && p[2] == -1.0f - i);
+        CHECK(p[3] == 0.0f && p[4] == 0.0f);
+    }
+    return true;
+}
+
+static bool checkNonFinite() {
+    sensor_msgs::PointCloud2 msg = xyzi(6);
+    setFloat(msg, 0, 1, 0, std::numeric_limits<float>::quiet_NaN());
+    setFloat(msg, 0, 3, 4, std::numeric_limits<float>::infinity());
+    setFloat(msg, 0, 4, 8, -std::numeric_limits<float>::infinity());
+    // a nan intensity is not read and does not drop the point
+    setFloat(msg, 0, 5, 12, std::numeric_limits<float>::quiet_NaN());
+
+    std::vector<float> dst(6 * PointCloudPacker::kPointFeatures);
+    PointCloudPacker packer;
+    CHECK(packer.pack(msg, dst.data(), 6) == 3);
+    CHECK(packer.truncated() == 0);
+    CHECK(dst[0] == 0.0f && dst[5] == 2.0f && dst[10] == 5.0f);
+    return true;
+}
+
+static bool checkMaxPoints() {
+    sensor_msgs::PointCloud2 msg = xyzi(10);
+    setFloat(msg, 0, 7, 0, std::numeric_limits<float>::quiet_NaN());
+    // one spare slot past the cap, it must stay untouched
+    std::vector<float> dst(5 * PointCloudPacker::kPointFeatures, -1.0f);
+    PointCloudPacker packer;
+    CHECK(packer.pack(msg, dst.data(), 4) == 4);
+    // the non-finite point is skipped, not counted as truncated
+    CHECK(packer.truncated() == 5);
+    CHECK(dst[3 * PointCloudPacker::kPointFeatures] == 3.0f);
+    for (unsigned int k = 0; k < PointCloudPacker::kPointFeatures; k++) CHECK(dst[4 * PointCloudPacker::kPointFeatures + k] == -1.0f);
+
+    CHECK(packer.pack(msg, dst.data(), 0) == 0);
+    CHECK(packer.truncated() == 9);
+    CHECK(packer.pack(xyzi(3), dst.data(), 4) == 3);
+    CHECK(packer.truncated() == 0);
+    return true;
+}
+
+// Organized 3 x 2 cloud with z, x, y at other offsets, a double time field and padded rows
+static bool checkOtherLayout() {
+    sensor_msgs::PointCloud2 msg = cloud(3, 2, 32, 8);
+    msg.fields = {field("t", 0, sensor_msgs::PointField::FLOAT64), field("z", 8), field("intensity", 12), field("x", 20), field("y", 28)};
+    for (uint32_t row = 0; row < 2; row++) {
+        for (uint32_t col = 0; col < 3; col++) {
+            setFloat(msg, row, col, 20, row * 3 + col);
+            setFloat(msg, row, col, 28, 0.5f);
+            setFloat(msg, row, col, 8, 2.0f);
+        }
+    }
+    std::vector<float> dst(6 * PointCloudPacker::kPointFeatures);
+    PointCloudPacker packer;
+    CHECK(packer.pack(msg, dst.data(), 6) == 6);
+    for (int i = 0; i < 6; i++) {
+        const float* p = dst.data() + i * PointCloudPacker::kPointFeatures;
+        CHECK(p[0] == i && p[1] == 0.5f && p[2] == 2.0f && p[3] == 0.0f && p[4] == 0.0f);
+    }
+    return true;
+}
+
+static bool checkRejected() {
+    std::vector<float> dst(4 * PointCloudPacker::kPointFeatures);
+    PointCloudPacker packer;
+
+    sensor_msgs::PointCloud2 no_z = xyzi(4);
+    no_z.fields = {field("x", 0), field("y", 4), field("intensity", 12)};
+    CHECK(packer.pack(no_z, dst.data(), 4) == 0);
+
+    sensor_msgs::PointCloud2 double_x = xyzi(4);
+    double_x.fields[0].datatype = sensor_msgs::PointField::FLOAT64;
+    CHECK(packer.pack(double_x, dst.data(), 4) == 0);
+
+    // z would be read from the first bytes of the next point
+    sensor_msgs::PointCloud2 past_point = xyzi(4);
+    past_point.fields[2].offset = 14;
+    CHECK(packer.pack(past_point, dst.data(), 4) == 0);
+    past_point.fields[2].offset = 1000;
+    CHECK(packer.pack(past_point, dst.data(), 4) == 0);
+
+    // the packer reads floats in host order, which is little-endian on every target
+    sensor_msgs::PointCloud2 big_endian = xyzi(4);
+    big_endian.is_bigendian = true;
+    CHECK(packer.pack(big_endian, dst.data(), 4) == 0);
+
+    sensor_msgs::PointCloud2 short_data = xyzi(4);
+    short_data.data.resize(short_data.data.size() - 1);
+    CHECK(packer.pack(short_data, dst.data(), 4) == 0);
+
+    sensor_msgs::PointCloud2 empty = xyzi(0);
+    CHECK(packer.pack(empty, dst.data(), 4) == 0);
+    return true;
+}
+
+int main() {
+    CheckCase cases[] = {
+        {"xyzi", checkXyzi()},
+        {"non_finite", checkNonFinite()},
+        {"max_points", checkMaxPoints()},
+        {"other_layout", checkOtherLayout()},
+        {"rejected", checkRejected()},
+    };
+    return runCases(cases) ? 1 : 0;
+}
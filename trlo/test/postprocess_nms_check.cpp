@@ -0,0 +1,249 @@
+/****************************************************************************************
+ *
+ * Copyright (c) 2024, Shenyang Institute of Automation, Chinese Academy of Sciences
+ *
+ * Authors: Yanpeng Jia
+ * Contact: jiayanpeng@sia.cn
+ *
+ ****************************************************************************************/
+
+// Checks the rotated BEV NMS of PostProcessCpu on the host, no GPU needed.
+//
+// rotatedBoxIoU is compared with the IoU of the two rectangles clipped against each
+// other in double precision. doPostNMSCpu, which only compares boxes in neighbouring
+// cells of a 2 * max_radius grid, has to keep the same indices as a brute-force greedy
+// NMS that compares every box with every kept one through the same rotatedBoxIoU,
+// and no more than nms_post_max_size. Boxes are random with varied sizes, elongated
+// ones included, in clusters or lanes so that many of them overlap. Exits 1 if any case fails.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "center_pointpillars/postprocess_cpu.h"
+#include "check.h"
+
+static const int ROUNDS = 200;
+static const float IOU_TOL = 2e-3;
+
+struct Vec2 {
+    double x, y;
+};
+
+// Corners of a BEV box {x, y, z, dx, dy, dz, heading}, counter-clockwise
+static std::vector<Vec2> corners(const float* box) {
+    const double c = std::cos(box[6]), s = std::sin(box[6]);
+    const double hx = box[3] / 2.0, hy = box[4] / 2.0;
+    const double local[4][2] = {{-hx, -hy}, {hx, -hy}, {hx, hy}, {-hx, hy}};
+    std::vector<Vec2> poly;
+    for (const auto& p : local) poly.push_back({box[0] + p[0] * c - p[1] * s, box[1] + p[0] * s + p[1] * c});
+    return poly;
+}
+
+static double area(const std::vector<Vec2>& poly) {
+    double a = 0;
+    for (size_t i = 0; i < poly.size(); i++) {
+        const Vec2& p = poly[i];
+        const Vec2& q = poly[(i + 1) % poly.size()];
+        a += p.x * q.y - q.x * p.y;
+    }
+    return std::fabs(a) / 2;
+}
+
+// Sutherland-Hodgman, clip is convex and counter-clockwise
+static std::vector<Vec2> clipPolygon(std::vector<Vec2> poly, const std::vector<Vec2>& clip) {
+    for (size_t e = 0; e < clip.size() && !poly.empty(); e++) {
+        const Vec2 a = clip[e], b = clip[(e + 1) % clip.size()];
+        auto side = [&](const Vec2& p) { return (b.x - a.x) * (p.y - a.y) - (b.y - a.y) * (p.x - a.x); };
+        std::vector<Vec2> out;
+        for (size_t i = 0; i < poly.size(); i++) {
+            const Vec2 p = poly[i], q = poly[(i + 1) % poly.size()];
+            const double sp = side(p), sq = side(q);
+            if (sp >= 0) out.push_back(p);
+            if ((sp >= 0) != (sq >= 0)) {
+                const double t = sp / (sp - sq);
+                out.push_back({p.x + t * (q.x - p.x), p.y + t * (q.y - p.y)});
+            }
+        }
+        poly = out;
+    }
+    return poly;
+}
+
+static double referenceIoU(const float* a, const float* b) {
+    const double overlap = area(clipPolygon(corners(a), corners(b)));
+    return overlap / (a[3] * a[4] + b[3] * b[4] - overlap);
+}
+
+// Same permutation as permute_box in postprocess_cpu.cpp
+static void nmsBox(const float11& det, float* box) {
+    box[0] = det.val[0];
+    box[1] = det.val[1];
+    box[2] = det.val[2];
+    box[3] = det.val[4];
+    box[4] = det.val[3];
+    box[5] = det.val[5];
+    box[6] = -det.val[8] - 3.141592653 * 0.5;
+}
+
+// Every box against every kept one, in score order
+static std::vector<int> bruteForceNMS(const std::vector<float11>& detections, float threshold, unsigned int max_keep) {
+    std::vector<float> boxes(detections.size() * 7);
+    for (size_t i = 0; i < detections.size(); i++) nmsBox(detections[i], &boxes[i * 7]);
+
+    std::vector<int> keep;
+    for (int i = 0; i < (int)detections.size() && keep.size() < max_keep; i++) {
+        bool suppressed = false;
+        for (int j : keep) {
+            if (rotatedBoxIoU(&boxes[j * 7], &boxes[i * 7]) >= threshold) {
+                suppressed = true;
+                break;
+            }
+        }
+        if (!suppressed) keep.push_back(i);
+    }
+    return keep;
+}
+
+// A car, pedestrian, bus or trailer sized box, the elongated ones up to 20 x 0.5 m
+static void randomSize(std::mt19937& rng, float& length, float& width) {
+    std::uniform_real_distribution<float> u(0, 1);
+    switch (rng() % 4) {
+    case 0: length = 3.5f + 1.5f * u(rng); width = 1.6f + 0.4f * u(rng); break;
+    case 1: length = 0.4f + 0.6f * u(rng); width = 0.4f + 0.6f * u(rng); break;
+    case 2: length = 8.0f + 6.0f * u(rng); width = 2.5f + 0.5f * u(rng); break;
+    default: length = 10.0f + 10.0f * u(rng); width = 0.5f + 0.5f * u(rng); break;
+    }
+}
+
+// n detections in clusters over [-60, 60]^2, sorted by score as doPostDecodeCpu leaves them.
+// In lanes every box is a trailer with the heading of its cluster on the cluster's long
+// axis, so boxes reach an IoU of 0.2 with centers more than max_radius apart.
+static std::vector<float11> randomDetections(std::mt19937& rng, int n, int clusters, bool lanes) {
+    std::uniform_real_distribution<float> u(0, 1);
+    std::vector<float> cx(clusters), cy(clusters), spread(clusters), heading(clusters);
+    for (int c = 0; c < clusters; c++) {
+        cx[c] = -60 + 120 * u(rng);
+        cy[c] = -60 + 120 * u(rng);
+        spread[c] = 0.5f + 15.0f * u(rng);
+        heading[c] = -3.14159265f + 6.2831853f * u(rng);
+    }
+
+    std::vector<float11> detections(n);
+    for (float11& det : detections) {
+        const int c = rng() % clusters;
+        float length, width;
+        randomSize(rng, length, width);
+        if (lanes) {
+            // trailers close to the longest box, which sets the grid cell
+            length = 19.0f + u(rng);
+            width = 0.5f + 0.5f * u(rng);
+            // the long side of the NMS box lies along (cos, -sin) of the decoded rotation
+            const float along = spread[c] * (2 * u(rng) - 1), across = 0.2f * (2 * u(rng) - 1);
+            det.val[0] = cx[c] + along * std::cos(heading[c]) + across * std::sin(heading[c]);
+            det.val[1] = cy[c] - along * std::sin(heading[c]) + across * std::cos(heading[c]);
+        } else {
+            det.val[0] = cx[c] + spread[c] * (2 * u(rng) - 1);
+            det.val[1] = cy[c] + spread[c] * (2 * u(rng) - 1);
+        }
+        det.val[2] = -1 + u(rng);
+        det.val[3] = length;
+        det.val[4] = width;
+        det.val[5] = 1.5f;
+        det.val[6] = 0;
+        det.val[7] = 0;
+        det.val[8] = lanes ? heading[c] : -3.14159265f + 6.2831853f * u(rng);
+        det.val[9] = 0;
+        det.val[10] = u(rng);
+    }
+    std::sort(detections.begin(), detections.end(), [](const float11& a, const float11& b) { return a.val[10] > b.val[10]; });
+    return detections;
+}
+
+static bool checkIoU() {
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<float> u(0, 1);
+    double worst = 0;
+    int overlapping = 0;
+    for (int k = 0; k < 20000; k++) {
+        float a[7], b[7];
+        for (float* box : {a, b}) {
+            randomSize(rng, box[3], box[4]);
+            box[2] = 0;
+            box[5] = 1.5f;
+            box[6] = -3.14159265f + 6.2831853f * u(rng);
+        }
+        // a few meters apart, enough for elongated boxes to reach past each other's circle
+        a[0] = 0;
+        a[1] = 0;
+        b[0] = 12 * (2 * u(rng) - 1);
+        b[1] = 12 * (2 * u(rng) - 1);
+
+        const double ref = referenceIoU(a, b);
+        const float iou = rotatedBoxIoU(a, b);
+        CHECK(iou >= 0.0f && iou <= 1.0f + 1e-5f);
+        CHECK(std::fabs(iou - rotatedBoxIoU(b, a)) <= IOU_TOL);
+        worst = std::max(worst, std::fabs(iou - ref));
+        overlapping += ref > 0;
+    }
+    printf("  %d of 20000 pairs overlap, largest IoU difference to the clipped polygons %.3g\n", overlapping, worst);
+    CHECK(overlapping > 1000);
+    CHECK(worst <= IOU_TOL);
+
+    // a 20 m trailer crossing a car 9 m from its center, far outside the car's circle
+    const float trailer[7] = {0, 0, 0, 20, 0.8f, 1.5f, 0};
+    const float car[7] = {9, 0, 0, 4, 1.8f, 1.5f, 1.2f};
+    CHECK(rotatedBoxIoU(trailer, car) > 0.0f);
+    CHECK(std::fabs(rotatedBoxIoU(trailer, car) - referenceIoU(trailer, car)) <= IOU_TOL);
+    // circumscribed circles 0.1 m apart
+    const float far_car[7] = {0.5f * std::sqrt(400 + 0.64f) + 0.5f * std::sqrt(16 + 3.24f) + 0.1f, 0, 0, 4, 1.8f, 1.5f, 0};
+    CHECK(rotatedBoxIoU(trailer, far_car) == 0.0f);
+    return true;
+}
+
+static bool checkNMS() {
+    std::mt19937 rng(20240607);
+    PostProcessCpu post;
+    Params params;
+    int capped = 0;
+    size_t kept = 0, total = 0;
+    for (int round = 0; round < ROUNDS; round++) {
+        // from a handful of detections to more than nms_post_max_size survivors
+        const int n = round < 5 ? round : 1 + rng() % 1000;
+        const int clusters = 1 + rng() % 40;
+        const bool lanes = round % 2 == 1;
+        std::vector<float11> detections = randomDetections(rng, n, clusters, lanes);
+
+        std::vector<int> keep;
+        CHECK(post.doPostNMSCpu(detections, keep) == (int)keep.size());
+        std::vector<int> expected = bruteForceNMS(detections, params.nms_iou_threshold, params.nms_post_max_size);
+        if (keep != expected) {
+            fprintf(stderr, "round %d, %d boxes in %d %s: grid NMS keeps %zu, brute force %zu\n",
+                    round, n, clusters, lanes ? "lanes" : "clusters", keep.size(), expected.size());
+            return false;
+        }
+
+        CHECK(keep.size() <= params.nms_post_max_size);
+        const std::vector<int> uncapped = bruteForceNMS(detections, params.nms_iou_threshold, detections.size());
+        if (uncapped.size() > params.nms_post_max_size) {
+            CHECK(keep.size() == params.nms_post_max_size);
+            CHECK(std::equal(keep.begin(), keep.end(), uncapped.begin()));
+            capped++;
+        }
+        kept += keep.size();
+        total += detections.size();
+    }
+    printf("  %zu of %zu boxes kept over %d rounds, %d capped at %u\n", kept, total, ROUNDS, capped, params.nms_post_max_size);
+    CHECK(capped > 0 && capped < ROUNDS);
+    return true;
+}
+
+int main() {
+    CheckCase cases[] = {
+        {"iou", checkIoU()},
+        {"nms", checkNMS()},
+    };
+    return runCases(cases) ? 1 : 0;
+}
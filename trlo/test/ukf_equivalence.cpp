@@ -0,0 +1,230 @@
+/****************************************************************************************
+ *
+ * Copyright (c) 2024, Shenyang Institute of Automation, Chinese Academy of Sciences
+ *
+ * Authors: Yanpeng Jia
+ * Contact: jiayanpeng@sia.cn
+ *
+ ****************************************************************************************/
+
+// Checks the fixed-size IMM-UKF against outputs recorded from the dynamic-size
+// (MatrixXd) filter it replaced, no ROS needed.
+//
+//   ukf_equivalence REFERENCE            compare, exit 1 on a mismatch
+//   ukf_equivalence --record REFERENCE   write REFERENCE from the filter built in
+//
+// Every object of a SyntheticScenario is followed by a lone filter fed with the
+// detection closest to it: predict, lidar update of the three models, mode
+// probabilities from their likelihoods, merge. Frames where the object is missed
+// are skipped, the next update predicts over the gap. The merged state, the trace of
+// the merged covariance and the mode probabilities are compared after every update.
+// The source only uses members both filters have, so the reference can be
+// re-recorded by building it against the ukf.h/ukf.cpp of the dynamic-size filter.
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "3d_mot/ukf.h"
+#include "3d_mot/scenario.h"
+
+static const int FRAMES = 100;
+static const double MATCH_DIST = 1.0;  // m, detection to ground truth
+static const double REL_TOL = 1e-7;  // fixed-size products round differently, about 1e-8 at worst
+// an ungated lone filter can diverge on a turning object, it is then restarted at
+// the next detection instead of running into inf
+static const double MAX_TRACE_P = 1e3;
+
+struct Sample
+{
+    int frame;
+    int id;
+    double v[9];  // x y v yaw yawd trace(P) pCV pCTRV pRM
+};
+
+static void wrapYaw(double& yaw){
+    while (yaw> M_PI) yaw -= 2.*M_PI;
+    while (yaw<-M_PI) yaw += 2.*M_PI;
+}
+
+// x += K (z - zPred), P -= K S K^T, written against the members so it works for
+// fixed and dynamic sizes alike
+template <typename X, typename P, typename K, typename S, typename Z>
+static void lidarUpdate(X& x, P& p, const K& k, const S& s, const Z& zPred, const Eigen::Vector2d& z){
+    Eigen::Vector2d diff = z - zPred;
+    x = x + k*diff;
+    wrapYaw(x(3));
+    p = p - k*s*k.transpose();
+}
+
+static void step(UKF& ukf, double dt, const Eigen::Vector2d& z){
+    ukf.ProcessIMMUKF(dt);
+    lidarUpdate(ukf.x_cv_,   ukf.P_cv_,   ukf.K_cv_,   ukf.lS_cv_,   ukf.zPredCVl_,   z);
+    lidarUpdate(ukf.x_ctrv_, ukf.P_ctrv_, ukf.K_ctrv_, ukf.lS_ctrv_, ukf.zPredCTRVl_, z);
+    lidarUpdate(ukf.x_rm_,   ukf.P_rm_,   ukf.K_rm_,   ukf.lS_rm_,   ukf.zPredRMl_,   z);
+
+    Eigen::VectorXd meas(2);
+    meas << z(0), z(1);
+    std::vector<double> lambda(3);
+    for(int m = 0; m < 3; m++) lambda[m] = ukf.CalculateGauss(meas, 0, m);
+    ukf.PostProcessIMMUKF(lambda);
+}
+
+struct Follower
+{
+    std::unique_ptr<UKF> ukf;
+    double stamp;
+};
+
+static std::vector<Sample> run(){
+    ScenarioConfig config;
+    config.objects = 8;
+    SyntheticScenario scenario(config);
+    std::map<int, Follower> filters;
+    std::vector<Sample> samples;
+
+    for(int f = 0; f < FRAMES; f++){
+        scenario.next();
+        const std::vector<ScenarioObject>& objects = scenario.objects();
+        const std::vector<OrientedBox>& detections = scenario.detections();
+
+        // filters of objects that left the area
+        for(std::map<int, Follower>::iterator it = filters.begin(); it != filters.end();){
+            bool alive = false;
+            for(size_t i = 0; i < objects.size(); i++) alive = alive || objects[i].id == it->first;
+            if(alive) ++it;
+            else it = filters.erase(it);
+        }
+
+        for(size_t i = 0; i < objects.size(); i++){
+            const ScenarioObject& o = objects[i];
+            int best = -1;
+            double bestDist = MATCH_DIST;
+            for(size_t d = 0; d < detections.size(); d++){
+                double dist = std::hypot(detections[d].x - o.x, detections[d].y - o.y);
+                if(dist < bestDist){
+                    bestDist = dist;
+                    best = d;
+                }
+            }
+            if(best < 0) continue;
+            Eigen::Vector2d z(detections[best].x, detections[best].y);
+
+            Follower& follower = filters[o.id];
+            if(!follower.ukf){
+                follower.ukf.reset(new UKF());
+                follower.ukf->Initialize(z, scenario.timestamp());
+                follower.stamp = scenario.timestamp();
+                continue;
+            }
+            std::unique_ptr<UKF>& ukf = follower.ukf;
+            step(*ukf, scenario.timestamp() - follower.stamp, z);
+            follower.stamp = scenario.timestamp();
+            if(!(ukf->P_merge_.trace() < MAX_TRACE_P)){
+                filters.erase(o.id);
+                continue;
+            }
+
+            Sample s;
+            s.frame = f;
+            s.id = o.id;
+            for(int k = 0; k < 5; k++) s.v[k] = ukf->x_merge_(k);
+            s.v[5] = ukf->P_merge_.trace();
+            s.v[6] = ukf->modeProbCV_;
+            s.v[7] = ukf->modeProbCTRV_;
+            s.v[8] = ukf->modeProbRM_;
+            samples.push_back(s);
+        }
+    }
+    return samples;
+}
+
+static bool readReference(const char* path, std::vector<Sample>& samples){
+    FILE* in = fopen(path, "r");
+    if(!in) return false;
+    char line[1024];
+    while(fgets(line, sizeof(line), in)){
+        if(line[0] == '#' || line[0] == '\n') continue;
+        Sample s;
+        if(sscanf(line, "%d %d %lf %lf %lf %lf %lf %lf %lf %lf %lf", &s.frame, &s.id,
+                  &s.v[0], &s.v[1], &s.v[2], &s.v[3], &s.v[4], &s.v[5], &s.v[6], &s.v[7], &s.v[8]) != 11){
+            fclose(in);
+            return false;
+        }
+        samples.push_back(s);
+    }
+    fclose(in);
+    return true;
+}
+
+int main(int argc, char** argv){
+    bool record = argc > 2 && strcmp(argv[1], "--record") == 0;
+    if(argc < 2 || (argc > 2 && !record)){
+        fprintf(stderr, "usage: %s [--record] REFERENCE\n", argv[0]);
+        return 1;
+    }
+    const char* path = argv[argc - 1];
+    std::vector<Sample> samples = run();
+
+    if(record){
+        FILE* out = fopen(path, "w");
+        if(!out){
+            fprintf(stderr, "cannot write %s\n", path);
+            return 1;
+        }
+        fprintf(out, "# frame id x y v yaw yawd trace(P) pCV pCTRV pRM, %d frames of SyntheticScenario, 8 objects\n", FRAMES);
+        for(size_t i = 0; i < samples.size(); i++){
+            const Sample& s = samples[i];
+            fprintf(out, "%d %d", s.frame, s.id);
+            for(int k = 0; k < 9; k++) fprintf(out, " %.17g", s.v[k]);
+            fprintf(out, "\n");
+        }
+        fclose(out);
+        printf("recorded %zu samples to %s\n", samples.size(), path);
+        return 0;
+    }
+
+    std::vector<Sample> reference;
+    if(!readReference(path, reference)){
+        fprintf(stderr, "cannot read %s\n", path);
+        return 1;
+    }
+    if(reference.size() != samples.size()){
+        fprintf(stderr, "%zu samples, the reference has %zu\n", samples.size(), reference.size());
+        return 1;
+    }
+
+    static const char* names[9] = {"x", "y", "v", "yaw", "yawd", "trace(P)", "pCV", "pCTRV", "pRM"};
+    double worst = 0;
+    int failures = 0;
+    for(size_t i = 0; i < samples.size(); i++){
+        const Sample& s = samples[i];
+        const Sample& r = reference[i];
+        if(s.frame != r.frame || s.id != r.id){
+            fprintf(stderr, "sample %zu is frame %d id %d, the reference has frame %d id %d\n",
+                    i, s.frame, s.id, r.frame, r.id);
+            return 1;
+        }
+        for(int k = 0; k < 9; k++){
+            double err = std::fabs(s.v[k] - r.v[k])/std::max(1.0, std::fabs(r.v[k]));
+            if(!(err <= REL_TOL)){
+                if(failures++ < 10){
+                    fprintf(stderr, "frame %d id %d %s: %.17g, reference %.17g\n",
+                            s.frame, s.id, names[k], s.v[k], r.v[k]);
+                }
+            }
+            else worst = std::max(worst, err);
+        }
+    }
+    printf("%zu samples, largest relative difference %.3g\n", samples.size(), worst);
+    if(failures){
+        fprintf(stderr, "%d values differ by more than %g\n", failures, REL_TOL);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,236 @@
+/****************************************************************************************
+ *
+ * Copyright (c) 2024, Shenyang Institute of Automation, Chinese Academy of Sciences
+ *
+ * Authors: Yanpeng Jia
+ * Contact: jiayanpeng@sia.cn
+ *
+ ****************************************************************************************/
+
+// Checks the CPU voxelization backend against a reference voxelization.
+//
+//   voxelization_check [--data POINTS] REFERENCE    compare, exit 1 on a mismatch
+//   voxelization_record [--data POINTS] REFERENCE   write REFERENCE with PreProcessCuda
+//
+// voxelization_check runs on the host only, no GPU needed. voxelization_record is the
+// same source built with VOXELIZATION_RECORD and needs one. POINTS is data/data.bin by
+// default, feature_num floats per point, or a .txt file with one point per line.
+//
+// Voxel ids of the CUDA path come from atomics, so voxels are matched by their
+// {z, y, x} index: the voxel count, every index, the points kept per voxel and their
+// sum have to be equal. Features are compared for voxels below max_points_per_voxel
+// only, in fuller ones the two backends may keep different points, and only up to
+// half precision since the sums run in a different order.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifdef VOXELIZATION_RECORD
+#include "center_pointpillars/preprocess.h"
+#else
+#include "center_pointpillars/preprocess_cpu.h"
+#endif
+
+static const float FEATURE_TOL = 2e-3;  // relative, a little above one half ulp
+
+struct Voxel
+{
+    unsigned int z, y, x;
+    unsigned int points;
+    float features[5];
+
+    bool operator<(const Voxel& other) const {
+        if(z != other.z) return z < other.z;
+        if(y != other.y) return y < other.y;
+        return x < other.x;
+    }
+};
+
+// The voxels of the last generateVoxels, sorted by index. The outputs of the CUDA
+// backend are managed, so host accessible once the stream is synchronized.
+static std::vector<Voxel> collect(PreProcess& pre, unsigned int feature_num){
+    half* features;
+    unsigned int* indices;
+    std::vector<int> sparse_shape;
+    unsigned int num = pre.getOutput(&features, &indices, sparse_shape);
+    const unsigned int* voxel_num = pre.getVoxelNum();
+
+    std::vector<Voxel> voxels(num);
+    for(unsigned int i = 0; i < num; i++){
+        Voxel& v = voxels[i];
+        v.z = indices[i*4 + 1];
+        v.y = indices[i*4 + 2];
+        v.x = indices[i*4 + 3];
+        v.points = voxel_num[i];
+        for(unsigned int f = 0; f < 5; f++) v.features[f] = f < feature_num ? __half2float(features[i*feature_num + f]) : 0;
+    }
+    std::sort(voxels.begin(), voxels.end());
+    return voxels;
+}
+
+#ifdef VOXELIZATION_RECORD
+static bool writeReference(const char* path, const std::vector<Voxel>& voxels, const std::string& data_path, size_t points){
+    FILE* out = fopen(path, "w");
+    if(!out) return false;
+    fprintf(out, "# z y x points features, PreProcessCuda on %s, %zu input points\n", data_path.c_str(), points);
+    for(size_t i = 0; i < voxels.size(); i++){
+        const Voxel& v = voxels[i];
+        fprintf(out, "%u %u %u %u", v.z, v.y, v.x, v.points);
+        for(int f = 0; f < 5; f++) fprintf(out, " %.9g", v.features[f]);
+        fprintf(out, "\n");
+    }
+    fclose(out);
+    return true;
+}
+#endif
+
+#ifndef VOXELIZATION_RECORD
+static bool readReference(const char* path, std::vector<Voxel>& voxels){
+    FILE* in = fopen(path, "r");
+    if(!in) return false;
+    char line[1024];
+    while(fgets(line, sizeof(line), in)){
+        if(line[0] == '#' || line[0] == '\n') continue;
+        Voxel v;
+        if(sscanf(line, "%u %u %u %u %f %f %f %f %f", &v.z, &v.y, &v.x, &v.points,
+                  &v.features[0], &v.features[1], &v.features[2], &v.features[3], &v.features[4]) != 9){
+            fclose(in);
+            return false;
+        }
+        voxels.push_back(v);
+    }
+    fclose(in);
+    return true;
+}
+#endif
+
+static bool loadPoints(const std::string& path, unsigned int feature_num, std::vector<float>& points){
+    if(path.size() > 4 && path.compare(path.size() - 4, 4, ".txt") == 0){
+        std::ifstream in(path);
+        if(!in.is_open()) return false;
+        std::string line;
+        while(std::getline(in, line)){
+            if(line.empty() || line[0] == '#') continue;
+            std::istringstream fields(line);
+            float f;
+            for(unsigned int k = 0; k < feature_num; k++){
+                if(!(fields >> f)) return false;
+                points.push_back(f);
+            }
+        }
+        return true;
+    }
+
+    std::ifstream in(path, std::ios::binary | std::ios::ate);
+    if(!in.is_open()) return false;
+    size_t bytes = in.tellg();
+    in.seekg(0);
+    points.resize(bytes/sizeof(float)/feature_num*feature_num);
+    in.read(reinterpret_cast<char*>(points.data()), points.size()*sizeof(float));
+    return in.good() || in.eof();
+}
+
+int main(int argc, char** argv){
+    std::string data_path = std::string(TRLO_DATA_DIR) + "/data.bin";
+    const char* reference_path = nullptr;
+    for(int i = 1; i < argc; i++){
+        if(strcmp(argv[i], "--data") == 0 && i + 1 < argc) data_path = argv[++i];
+        else if(!reference_path && argv[i][0] != '-') reference_path = argv[i];
+        else{
+            reference_path = nullptr;
+            break;
+        }
+    }
+    if(!reference_path){
+        fprintf(stderr, "usage: %s [--data POINTS] REFERENCE\n", argv[0]);
+        return 1;
+    }
+
+    Params params;
+    std::vector<float> host_points;
+    if(!loadPoints(data_path, params.feature_num, host_points)){
+        fprintf(stderr, "cannot read %s\n", data_path.c_str());
+        return 1;
+    }
+    size_t points_size = std::min<size_t>(host_points.size()/params.feature_num, MAX_POINTS_NUM);
+
+#ifdef VOXELIZATION_RECORD
+    // managed, so the same buffer feeds the kernels and the host loops
+    float* points = nullptr;
+    checkCudaErrors(cudaMallocManaged((void **)&points, points_size*params.feature_num*sizeof(float)));
+    std::copy(host_points.begin(), host_points.begin() + points_size*params.feature_num, points);
+    cudaStream_t stream;
+    checkCudaErrors(cudaStreamCreate(&stream));
+
+    std::unique_ptr<PreProcess> pre(new PreProcessCuda());
+    pre->alloc_resource();
+    pre->generateVoxels(points, points_size, stream);
+    checkCudaErrors(cudaStreamSynchronize(stream));
+    std::vector<Voxel> voxels = collect(*pre, params.feature_num);
+
+    pre.reset();
+    checkCudaErrors(cudaStreamDestroy(stream));
+    checkCudaErrors(cudaFree(points));
+
+    if(!writeReference(reference_path, voxels, data_path, points_size)){
+        fprintf(stderr, "cannot write %s\n", reference_path);
+        return 1;
+    }
+    printf("recorded %zu voxels to %s\n", voxels.size(), reference_path);
+    return 0;
+#else
+    // the CPU backend ignores the stream
+    PreProcessCpu pre;
+    pre.alloc_resource();
+    pre.generateVoxels(host_points.data(), points_size, 0);
+    std::vector<Voxel> voxels = collect(pre, params.feature_num);
+
+    std::vector<Voxel> reference;
+    if(!readReference(reference_path, reference)){
+        fprintf(stderr, "cannot read %s\n", reference_path);
+        return 1;
+    }
+
+    size_t points_kept = 0, reference_points = 0;
+    for(size_t i = 0; i < voxels.size(); i++) points_kept += voxels[i].points;
+    for(size_t i = 0; i < reference.size(); i++) reference_points += reference[i].points;
+    printf("%zu voxels and %zu points kept, the reference has %zu and %zu\n",
+           voxels.size(), points_kept, reference.size(), reference_points);
+    if(voxels.size() != reference.size() || points_kept != reference_points){
+        fprintf(stderr, "voxel or point count differs\n");
+        return 1;
+    }
+
+    int failures = 0;
+    float worst = 0;
+    for(size_t i = 0; i < voxels.size(); i++){
+        const Voxel& v = voxels[i];
+        const Voxel& r = reference[i];
+        bool same = v.z == r.z && v.y == r.y && v.x == r.x && v.points == r.points;
+        if(same && r.points < (unsigned int)params.max_points_per_voxel){
+            for(int f = 0; f < 5; f++){
+                float err = std::fabs(v.features[f] - r.features[f])/std::max(1.0f, std::fabs(r.features[f]));
+                if(!(err <= FEATURE_TOL)) same = false;
+                else worst = std::max(worst, err);
+            }
+        }
+        if(!same && failures++ < 10){
+            fprintf(stderr, "voxel %u %u %u with %u points, the reference has %u %u %u with %u\n",
+                    v.z, v.y, v.x, v.points, r.z, r.y, r.x, r.points);
+        }
+    }
+    printf("largest relative feature difference %.3g\n", worst);
+    if(failures){
+        fprintf(stderr, "%d voxels differ\n", failures);
+        return 1;
+    }
+    return 0;
+#endif
+}